@@ -23,6 +23,8 @@
 //   Actual benchmarks:
 //      fillseq       -- write N values in sequential key order in async mode
 //      fillrandom    -- write N values in random key order in async mode
+//      fillrandomconcurrent -- fillrandom split over --threads threads, see
+//                      --allow_concurrent_memtable_write
 //      overwrite     -- overwrite N values in random key order in async mode
 //      fillsync      -- write N/100 values in random key order in sync mode
 //      fill100K      -- write N/1000 100K values in random order in async mode
@@ -31,6 +33,7 @@
 //      readseq       -- read N times sequentially
 //      readreverse   -- read N times in reverse order
 //      readrandom    -- read N times in random order
+//      multireadrandom -- read N times in random order, 100 keys per MultiGet
 //      readmissing   -- read N missing keys in random order
 //      readhot       -- read N times in random order from 1% section of DB
 //      seekrandom    -- N random seeks
@@ -86,6 +89,17 @@ static int FLAGS_write_buffer_size = 0;
 // (initialized to default value by "main")
 static int FLAGS_max_file_size = 0;
 
+// Number of key ranges a compaction is split into
+// (initialized to default value by "main")
+static int FLAGS_max_subcompactions = 0;
+
+// Number of compactions run at the same time
+// (initialized to default value by "main")
+static int FLAGS_max_background_compactions = 0;
+
+// Let concurrent writers insert into the memtable at the same time
+static bool FLAGS_allow_concurrent_memtable_write = false;
+
 // Approximate size of user data packed per block (before compression.
 // (initialized to default value by "main")
 static int FLAGS_block_size = 0;
@@ -471,6 +485,11 @@ class Benchmark {
       } else if (name == Slice("fillrandom")) {
         fresh_db = true;
         method = &Benchmark::WriteRandom;
+      } else if (name == Slice("fillrandomconcurrent")) {
+        fresh_db = true;
+        num_ /= num_threads;
+        if (num_ < 1) num_ = 1;
+        method = &Benchmark::WriteRandom;
       } else if (name == Slice("overwrite")) {
         fresh_db = false;
         method = &Benchmark::WriteRandom;
@@ -490,6 +509,9 @@ class Benchmark {
         method = &Benchmark::ReadReverse;
       } else if (name == Slice("readrandom")) {
         method = &Benchmark::ReadRandom;
+      } else if (name == Slice("multireadrandom")) {
+        entries_per_batch_ = 100;
+        method = &Benchmark::MultiReadRandom;
       } else if (name == Slice("readmissing")) {
         method = &Benchmark::ReadMissing;
       } else if (name == Slice("seekrandom")) {
@@ -693,6 +715,10 @@ class Benchmark {
     options.block_cache = cache_;
     options.write_buffer_size = FLAGS_write_buffer_size;
     options.max_file_size = FLAGS_max_file_size;
+    options.max_subcompactions = FLAGS_max_subcompactions;
+    options.max_background_compactions = FLAGS_max_background_compactions;
+    options.allow_concurrent_memtable_write =
+        FLAGS_allow_concurrent_memtable_write;
     options.block_size = FLAGS_block_size;
     options.max_open_files = FLAGS_open_files;
     options.filter_policy = filter_policy_;
@@ -790,6 +816,32 @@ class Benchmark {
     thread->stats.AddMessage(msg);
   }
 
+  void MultiReadRandom(ThreadState* thread) {
+    ReadOptions options;
+    std::vector<std::string> keys(entries_per_batch_);
+    std::vector<Slice> key_slices(entries_per_batch_);
+    std::vector<std::string> values;
+    int found = 0;
+    for (int i = 0; i < reads_; i += entries_per_batch_) {
+      for (int j = 0; j < entries_per_batch_; j++) {
+        char key[100];
+        const int k = thread->rand.Next() % FLAGS_num;
+        std::snprintf(key, sizeof(key), "%016d", k);
+        keys[j] = key;
+        key_slices[j] = keys[j];
+      }
+      for (auto& s : db_->MultiGet(options, key_slices, &values)) {
+        if (s.ok()) {
+          found++;
+        }
+        thread->stats.FinishedSingleOp();
+      }
+    }
+    char msg[100];
+    std::snprintf(msg, sizeof(msg), "(%d of %d found)", found, num_);
+    thread->stats.AddMessage(msg);
+  }
+
   void ReadMissing(ThreadState* thread) {
     ReadOptions options;
     std::string value;
@@ -926,6 +978,9 @@ class Benchmark {
 int main(int argc, char** argv) {
   FLAGS_write_buffer_size = leveldb::Options().write_buffer_size;
   FLAGS_max_file_size = leveldb::Options().max_file_size;
+  FLAGS_max_subcompactions = leveldb::Options().max_subcompactions;
+  FLAGS_max_background_compactions =
+      leveldb::Options().max_background_compactions;
   FLAGS_block_size = leveldb::Options().block_size;
   FLAGS_open_files = leveldb::Options().max_open_files;
   std::string default_db_path;
@@ -947,6 +1002,10 @@ int main(int argc, char** argv) {
     } else if (sscanf(argv[i], "--reuse_logs=%d%c", &n, &junk) == 1 &&
                (n == 0 || n == 1)) {
       FLAGS_reuse_logs = n;
+    } else if (sscanf(argv[i], "--allow_concurrent_memtable_write=%d%c", &n,
+                      &junk) == 1 &&
+               (n == 0 || n == 1)) {
+      FLAGS_allow_concurrent_memtable_write = n;
     } else if (sscanf(argv[i], "--num=%d%c", &n, &junk) == 1) {
       FLAGS_num = n;
     } else if (sscanf(argv[i], "--reads=%d%c", &n, &junk) == 1) {
@@ -959,6 +1018,11 @@ int main(int argc, char** argv) {
       FLAGS_write_buffer_size = n;
     } else if (sscanf(argv[i], "--max_file_size=%d%c", &n, &junk) == 1) {
       FLAGS_max_file_size = n;
+    } else if (sscanf(argv[i], "--max_subcompactions=%d%c", &n, &junk) == 1) {
+      FLAGS_max_subcompactions = n;
+    } else if (sscanf(argv[i], "--max_background_compactions=%d%c", &n,
+                      &junk) == 1) {
+      FLAGS_max_background_compactions = n;
     } else if (sscanf(argv[i], "--block_size=%d%c", &n, &junk) == 1) {
       FLAGS_block_size = n;
     } else if (sscanf(argv[i], "--cache_size=%d%c", &n, &junk) == 1) {
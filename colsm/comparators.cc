@@ -5,6 +5,7 @@
 #include "colsm/comparators.h"
 
 #include "leveldb/slice.h"
+#include "util/coding.h"
 
 using namespace std;
 using namespace leveldb;
@@ -14,14 +15,15 @@ class IntComparator : public Comparator {
  public:
   const char* Name() const override { return "IntComparator"; }
 
+  // Compiles to two compares and a subtraction without branches
   int Compare(const Slice& a, const Slice& b) const override {
-    auto auint = *((uint32_t*)a.data());
-    auto buint = *((uint32_t*)b.data());
-    auto msb = ((auint & 0x80000000) ^ (buint & 0x80000000)) >> 31;
-    return (int)(((msb - 1) & (auint & 0x7FFFFFFF) - (buint & 0x7FFFFFFF)) |
-                 ((-msb) & buint));
+    uint32_t auint = DecodeFixed32(a.data());
+    uint32_t buint = DecodeFixed32(b.data());
+    return (auint > buint) - (auint < buint);
   }
 
+  KeyType key_type() const override { return kIntKey; }
+
   void FindShortestSeparator(std::string* start,
                              const Slice& limit) const override {}
 
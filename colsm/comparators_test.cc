@@ -7,6 +7,8 @@
 #include <gtest/gtest.h>
 #include <leveldb/slice.h>
 
+#include "db/dbformat.h"
+
 TEST(Comparators, IntComparator) {
   auto comparator = colsm::intComparator();
 
@@ -55,6 +57,57 @@ TEST(Comparators, IntComparator) {
   b = 0xFFFF2343;
   a = 0xF7F3;
   ASSERT_TRUE(comparator->Compare(akey, bkey) < 0);
+
+  a = 0x80000000;
+  b = 0;
+  ASSERT_TRUE(comparator->Compare(akey, bkey) > 0);
+
+  a = 0;
+  b = 0x80000000;
+  ASSERT_TRUE(comparator->Compare(akey, bkey) < 0);
+}
+
+TEST(Comparators, KeyType) {
+  ASSERT_EQ(leveldb::Comparator::kIntKey, colsm::intComparator()->key_type());
+  ASSERT_EQ(leveldb::Comparator::kAnyKey,
+            leveldb::BytewiseComparator()->key_type());
+
+  auto comparator = colsm::intComparator();
+  leveldb::InternalKeyComparator int_icmp(comparator.get());
+  leveldb::InternalKeyComparator bytes_icmp(leveldb::BytewiseComparator());
+  ASSERT_EQ(leveldb::Comparator::kIntInternalKey, int_icmp.key_type());
+  ASSERT_EQ(leveldb::Comparator::kAnyKey, bytes_icmp.key_type());
+}
+
+TEST(Comparators, IntInternalKey) {
+  auto comparator = colsm::intComparator();
+  leveldb::InternalKeyComparator icmp(comparator.get());
+  // The inline order must agree with the user comparator and sequence order
+  const uint32_t keys[] = {0, 1, 255, 256, 0x7FFFFFFF, 0x80000000, 0xFFFFFFFF};
+  const uint64_t seqs[] = {0, 1, 100, leveldb::kMaxSequenceNumber};
+  std::vector<std::string> encoded;
+  for (auto key : keys) {
+    for (auto seq : seqs) {
+      std::string user_key((const char*)&key, 4);
+      leveldb::InternalKey ikey(user_key, seq, leveldb::kTypeValue);
+      encoded.push_back(ikey.Encode().ToString());
+    }
+  }
+  for (auto& a : encoded) {
+    for (auto& b : encoded) {
+      auto expect = icmp.user_comparator()->Compare(
+          leveldb::ExtractUserKey(a), leveldb::ExtractUserKey(b));
+      if (expect == 0) {
+        auto aseq = leveldb::DecodeFixed64(a.data() + 4);
+        auto bseq = leveldb::DecodeFixed64(b.data() + 4);
+        expect = (aseq < bseq) - (aseq > bseq);
+      }
+      ASSERT_EQ(expect > 0, leveldb::CompareIntInternalKey(a, b) > 0);
+      ASSERT_EQ(expect < 0, leveldb::CompareIntInternalKey(a, b) < 0);
+      ASSERT_EQ(expect > 0, icmp.Compare(a, b) > 0);
+      ASSERT_EQ(expect < 0, icmp.Compare(a, b) < 0);
+    }
+  }
 }
 
 // LevelDB test did not use gtest_main
@@ -0,0 +1,233 @@
+//
+// Created by harper on 7/23/21.
+//
+
+#include "calibrate.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <memory>
+#include <sstream>
+
+#include "leveldb/comparator.h"
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+
+#include "table/block.h"
+#include "table/block_builder.h"
+#include "table/format.h"
+#include "util/random.h"
+
+#include "colsm/vblock/vert_block.h"
+#include "colsm/vblock/vert_block_builder.h"
+
+namespace colsm {
+
+using namespace leveldb;
+using namespace std;
+
+namespace {
+
+const int kKeySize = 12;
+const int kValueSize = 16;
+
+inline uint64_t NowNanos() {
+  return chrono::duration_cast<chrono::nanoseconds>(
+             chrono::steady_clock::now().time_since_epoch())
+      .count();
+}
+
+// Least squares fit of y = slope * x + intercept
+void FitLine(const vector<double>& x, const vector<double>& y, double* slope,
+             double* intercept) {
+  double n = x.size();
+  double sx = 0, sy = 0, sxx = 0, sxy = 0;
+  for (size_t i = 0; i < x.size(); ++i) {
+    sx += x[i];
+    sy += y[i];
+    sxx += x[i] * x[i];
+    sxy += x[i] * y[i];
+  }
+  double denom = n * sxx - sx * sx;
+  *slope = denom == 0 ? 0 : (n * sxy - sx * sy) / denom;
+  *intercept = (sy - *slope * sx) / n;
+}
+
+// Keys of a block, horizontal blocks are ordered by the bytes of the key
+vector<uint32_t> BlockKeys(int num_entry, bool vertical) {
+  vector<uint32_t> keys;
+  for (int i = 0; i < num_entry; ++i) {
+    keys.push_back(i);
+  }
+  if (!vertical) {
+    sort(keys.begin(), keys.end(), [](uint32_t a, uint32_t b) {
+      return memcmp(&a, &b, 4) < 0;
+    });
+  }
+  return keys;
+}
+
+// Build a block of the given keys, the contents are owned by the block
+BlockCore* BuildBlock(const vector<uint32_t>& keys, bool vertical) {
+  Options options;
+  options.comparator = BytewiseComparator();
+  unique_ptr<BlockBuilder> builder(
+      vertical ? new VertBlockBuilder(&options, LENGTH)
+               : new BlockBuilder(&options));
+  char key_buffer[kKeySize];
+  char value_buffer[kValueSize];
+  memset(key_buffer, 0, kKeySize);
+  memset(value_buffer, 0, kValueSize);
+  for (auto key : keys) {
+    memcpy(key_buffer, &key, 4);
+    memcpy(value_buffer, &key, 4);
+    builder->Add(Slice(key_buffer, kKeySize), Slice(value_buffer, kValueSize));
+  }
+  auto result = builder->Finish();
+  char* copied = new char[result.size()];
+  memcpy(copied, result.data(), result.size());
+  BlockContents contents{Slice(copied, result.size()), true, true};
+  if (vertical) {
+    return new VertBlockCore(contents);
+  }
+  return new BasicBlockCore(contents);
+}
+
+}  // namespace
+
+void FitUpdateCost(const vector<double>& block_sizes,
+                   const vector<double>& build_times, double* mu, double* xi) {
+  vector<double> inverse_sizes, entry_times;
+  for (size_t i = 0; i < block_sizes.size(); ++i) {
+    inverse_sizes.push_back(1 / block_sizes[i]);
+    entry_times.push_back(build_times[i] / block_sizes[i]);
+  }
+  FitLine(inverse_sizes, entry_times, xi, mu);
+}
+
+Calibrator::Calibrator()
+    : block_sizes_({512, 2048, 8192, 32768}),
+      num_lookup_(2000),
+      num_scan_(200) {}
+
+void Calibrator::Run(Parameter* param) {
+  Random rnd(301);
+  for (bool vertical : {true, false}) {
+    vector<double> log_sizes, lookup_times;
+    vector<double> sizes, build_times;
+    double scan_time = 0;
+    double seek_time = 0;
+    for (auto block_size : block_sizes_) {
+      auto keys = BlockKeys(block_size, vertical);
+
+      // Build enough entries for a stable time on the small blocks
+      int num_build = std::max(1, block_sizes_.back() / block_size);
+      auto start = NowNanos();
+      for (int i = 0; i < num_build; ++i) {
+        delete BuildBlock(keys, vertical);
+      }
+      sizes.push_back(block_size);
+      build_times.push_back((double)(NowNanos() - start) / num_build);
+
+      unique_ptr<BlockCore> block(BuildBlock(keys, vertical));
+      const Comparator* comparator = vertical ? nullptr : BytewiseComparator();
+      char target[kKeySize];
+      memset(target, 0, kKeySize);
+
+      start = NowNanos();
+      for (int i = 0; i < num_lookup_; ++i) {
+        uint32_t key = rnd.Uniform(block_size);
+        memcpy(target, &key, 4);
+        unique_ptr<Iterator> ite(block->NewIterator(comparator));
+        ite->Seek(Slice(target, kKeySize));
+      }
+      seek_time = (double)(NowNanos() - start) / num_lookup_;
+      log_sizes.push_back(std::log(block_size));
+      lookup_times.push_back(seek_time);
+
+      if (block_size != block_sizes_.back()) {
+        continue;
+      }
+      // Read a range after the seek in the largest block
+      start = NowNanos();
+      for (int i = 0; i < num_scan_; ++i) {
+        uint32_t key = rnd.Uniform(block_size);
+        memcpy(target, &key, 4);
+        unique_ptr<Iterator> ite(block->NewIterator(comparator));
+        ite->Seek(Slice(target, kKeySize));
+        for (int j = 0; j < kScanLength && ite->Valid(); ++j) {
+          ite->key();
+          ite->value();
+          ite->Next();
+        }
+      }
+      scan_time = (double)(NowNanos() - start) / num_scan_;
+    }
+
+    double epsilon, eta, mu, xi;
+    FitLine(log_sizes, lookup_times, &epsilon, &eta);
+    FitUpdateCost(sizes, build_times, &mu, &xi);
+    double range = std::max(0.0, scan_time - seek_time);
+    if (vertical) {
+      param->v_epsilon = epsilon;
+      param->v_eta = eta;
+      param->rv = range;
+      param->v_mu = mu;
+      param->v_xi = xi;
+    } else {
+      param->h_epsilon = epsilon;
+      param->h_eta = eta;
+      param->rh = range;
+      param->h_mu = mu;
+      param->h_xi = xi;
+    }
+  }
+}
+
+namespace {
+const struct {
+  const char* name;
+  double Parameter::*field;
+} kHardwareFields[] = {
+    {"v_epsilon", &Parameter::v_epsilon}, {"v_eta", &Parameter::v_eta},
+    {"h_epsilon", &Parameter::h_epsilon}, {"h_eta", &Parameter::h_eta},
+    {"rv", &Parameter::rv},               {"rh", &Parameter::rh},
+    {"v_mu", &Parameter::v_mu},           {"v_xi", &Parameter::v_xi},
+    {"h_mu", &Parameter::h_mu},           {"h_xi", &Parameter::h_xi}};
+const size_t kNumHardwareField =
+    sizeof(kHardwareFields) / sizeof(kHardwareFields[0]);
+}  // namespace
+
+std::string EncodeHardwareParameter(const Parameter& param) {
+  ostringstream out;
+  out.precision(17);
+  for (auto& field : kHardwareFields) {
+    out << field.name << ' ' << param.*field.field << '\n';
+  }
+  return out.str();
+}
+
+bool DecodeHardwareParameter(const std::string& input, Parameter* param) {
+  Parameter decoded = *param;
+  uint32_t found = 0;
+  istringstream in(input);
+  std::string name;
+  double value;
+  while (in >> name >> value) {
+    for (size_t i = 0; i < kNumHardwareField; ++i) {
+      if (name == kHardwareFields[i].name) {
+        decoded.*kHardwareFields[i].field = value;
+        found |= 1u << i;
+      }
+    }
+  }
+  if (found != (1u << kNumHardwareField) - 1) {
+    return false;
+  }
+  *param = decoded;
+  return true;
+}
+
+}  // namespace colsm
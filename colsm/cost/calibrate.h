@@ -0,0 +1,56 @@
+//
+// Created by harper on 7/23/21.
+//
+//
+// Calibrate the hardware-dependent constants of the cost model with short
+// probes on horizontal (BasicBlockCore) and vertical (VertBlockCore) blocks
+// of a few sizes. All constants are in nanoseconds.
+//
+//    p(b) = epsilon * ln(b) + eta   time of a Seek in a block of b entries
+//    r    = rv / rh                 time to read kScanLength entries
+//                                   after a Seek
+//    u(b) = mu + xi / b             time to add an entry to a block of
+//                                   b entries, including Finish
+//
+
+#ifndef COLSM_COST_CALIBRATE_H
+#define COLSM_COST_CALIBRATE_H
+
+#include <string>
+#include <vector>
+
+#include "cost_model.h"
+
+namespace colsm {
+
+class Calibrator {
+ public:
+  static const int kScanLength = 100;
+
+  Calibrator();
+
+  // Fill the hardware constants of param with the measured ones
+  void Run(Parameter* param);
+
+ private:
+  std::vector<int> block_sizes_;
+  int num_lookup_;
+  int num_scan_;
+};
+
+// Fit u(b) = mu + xi / b to the times of building blocks of the given
+// sizes, by regressing the time per entry on 1 / b
+void FitUpdateCost(const std::vector<double>& block_sizes,
+                   const std::vector<double>& build_times, double* mu,
+                   double* xi);
+
+// Text form of the hardware constants, one "name value" per line
+std::string EncodeHardwareParameter(const Parameter&);
+
+// Read the constants written by EncodeHardwareParameter, false if any is
+// missing
+bool DecodeHardwareParameter(const std::string&, Parameter*);
+
+}  // namespace colsm
+
+#endif  // COLSM_COST_CALIBRATE_H
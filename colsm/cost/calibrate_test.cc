@@ -0,0 +1,123 @@
+//
+// Created by harper on 7/23/21.
+//
+
+#include "calibrate.h"
+
+#include <cmath>
+#include <gtest/gtest.h>
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+
+#include "db/filename.h"
+
+using namespace colsm;
+
+TEST(Calibrator, Run) {
+  auto param = DefaultParameter(7);
+  Calibrator().Run(&param);
+  for (double value : {param.v_epsilon, param.v_eta, param.h_epsilon,
+                       param.h_eta, param.rv, param.rh, param.v_mu, param.v_xi,
+                       param.h_mu, param.h_xi}) {
+    EXPECT_TRUE(std::isfinite(value));
+  }
+  // Searching, scanning and building take time on both layouts
+  EXPECT_GT(param.v_epsilon * std::log(32768) + param.v_eta, 0);
+  EXPECT_GT(param.h_epsilon * std::log(32768) + param.h_eta, 0);
+  EXPECT_GT(param.rv, 0);
+  EXPECT_GT(param.rh, 0);
+  EXPECT_GT(param.v_mu, 0);
+  EXPECT_GT(param.h_mu, 0);
+  // Level structure is untouched
+  EXPECT_EQ(7, param.l);
+  EXPECT_EQ(15000, param.b[0]);
+}
+
+TEST(Calibrator, FitUpdateCost) {
+  // Block build times of u(b) = mu + xi / b per entry
+  const double mu = 400, xi = -5e6;
+  std::vector<double> sizes, build_times;
+  for (double b : {15000.0, 30000.0, 60000.0, 150000.0}) {
+    sizes.push_back(b);
+    build_times.push_back(b * (mu + xi / b));
+  }
+  double fit_mu, fit_xi;
+  FitUpdateCost(sizes, build_times, &fit_mu, &fit_xi);
+  EXPECT_NEAR(mu, fit_mu, 1e-6 * std::abs(mu));
+  EXPECT_NEAR(xi, fit_xi, 1e-6 * std::abs(xi));
+
+  // Noise on the time per entry does not move the fit far
+  build_times.clear();
+  double noise = 0.01;
+  for (double b : sizes) {
+    build_times.push_back(b * (mu + xi / b) * (1 + noise));
+    noise = -noise;
+  }
+  FitUpdateCost(sizes, build_times, &fit_mu, &fit_xi);
+  EXPECT_NEAR(mu, fit_mu, 0.05 * std::abs(mu));
+  EXPECT_NEAR(xi, fit_xi, 0.05 * std::abs(xi));
+}
+
+TEST(Calibrator, EncodeDecode) {
+  auto param = DefaultParameter(7);
+  param.v_epsilon = 1.5;
+  param.h_xi = -2.25e6;
+  param.rv = 1.0 / 3;
+  auto encoded = EncodeHardwareParameter(param);
+
+  auto decoded = DefaultParameter(3);
+  ASSERT_TRUE(DecodeHardwareParameter(encoded, &decoded));
+  EXPECT_EQ(3, decoded.l);
+  EXPECT_EQ(1.5, decoded.v_epsilon);
+  EXPECT_EQ(-2.25e6, decoded.h_xi);
+  EXPECT_EQ(1.0 / 3, decoded.rv);
+  EXPECT_EQ(param.h_epsilon, decoded.h_epsilon);
+
+  // Missing constants leave the parameter unchanged
+  auto partial = DefaultParameter(3);
+  ASSERT_FALSE(DecodeHardwareParameter("v_epsilon 1.5\n", &partial));
+  EXPECT_NE(1.5, partial.v_epsilon);
+}
+
+TEST(Calibrator, PersistWithDB) {
+  leveldb::Env* env = leveldb::Env::Default();
+  std::string dbname;
+  ASSERT_TRUE(env->GetTestDirectory(&dbname).ok());
+  dbname += "/calibrate_test";
+  leveldb::Options options;
+  leveldb::DestroyDB(dbname, options);
+  options.create_if_missing = true;
+
+  // Without the option no constants are measured
+  leveldb::DB* db;
+  ASSERT_TRUE(leveldb::DB::Open(options, dbname, &db).ok());
+  delete db;
+  auto fname = leveldb::ColsmParameterFileName(dbname);
+  ASSERT_FALSE(env->FileExists(fname));
+
+  options.calibrate_layout_model = true;
+  ASSERT_TRUE(leveldb::DB::Open(options, dbname, &db).ok());
+  delete db;
+  ASSERT_TRUE(env->FileExists(fname));
+  std::string contents;
+  ASSERT_TRUE(leveldb::ReadFileToString(env, fname, &contents).ok());
+  auto param = DefaultParameter(7);
+  ASSERT_TRUE(DecodeHardwareParameter(contents, &param));
+
+  // Later opens keep the calibrated constants
+  ASSERT_TRUE(leveldb::DB::Open(options, dbname, &db).ok());
+  delete db;
+  std::string reopened;
+  ASSERT_TRUE(leveldb::ReadFileToString(env, fname, &reopened).ok());
+  EXPECT_EQ(contents, reopened);
+
+  ASSERT_TRUE(leveldb::DestroyDB(dbname, options).ok());
+  ASSERT_FALSE(env->FileExists(fname));
+}
+
+// LevelDB test did not use gtest_main
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -4,7 +4,11 @@
 
 #include "cost_model.h"
 
-#include <fstream>
+#include <cmath>
+#include <cstdio>
+#include <sstream>
+
+#include "solver.h"
 
 namespace colsm {
 
@@ -12,34 +16,284 @@ using namespace std;
 
 static int LEVEL_DEFAULT = 7;
 
-CostModel::CostModel() {
-  if (!ReadModel()) {
-    for (auto i = 0; i <= LEVEL_DEFAULT; ++i) {
-      level_vertical_.push_back(false);
+// The layout only changes when the new one is cheaper by this fraction,
+// so that a workload near the break-even point does not flip levels back
+// and forth
+static const double kFlipMargin = 0.05;
+
+Parameter DefaultParameter(int num_level) {
+  Parameter param;
+  param.l = num_level;
+  param.m = num_level + 1;
+  for (auto i = 0; i < num_level; ++i) {
+    param.t.push_back(10);
+    param.fpr.push_back(0.01);
+    param.b.push_back(i == 0 ? 15000 : param.b.back() * 10);
+    // The size limits of leveldb levels, 10MB at level 0 and 1
+    param.level_bytes.push_back(i <= 1 ? 10485760.0
+                                       : param.level_bytes.back() * 10);
+  }
+  // Measured for run_solver
+  param.h_epsilon = 179.46;
+  param.h_eta = -1740.2;
+  param.rh = 10;
+  // Estimates, not measured. Vertical sections are searched with SIMD on the
+  // packed keys, taken as 0.6 of the row search, one point of the 0.2 to 3
+  // range run_solver sweeps. A scan decodes each column separately, taken
+  // as twice the row scan, where run_solver has them equal.
+  param.v_epsilon = 0.6 * param.h_epsilon;
+  param.v_eta = 0.6 * param.h_eta;
+  param.rv = 20;
+
+  // Measured for run_solver
+  param.v_mu = 409.41;
+  param.v_xi = -7.99e6;
+  param.h_mu = 429.87;
+  param.h_xi = -5.01e6;
+
+  // Estimate, not measured. Columns of a vertical section are encoded
+  // separately, taken as saving a fifth of the row size.
+  param.v_space = 0.8;
+  param.h_space = 1;
+  param.space_budget = 0;
+  return param;
+}
+
+double LevelCost(const Parameter& param, const Workload& workload, int level,
+                 bool vertical) {
+  double epsilon = vertical ? param.v_epsilon : param.h_epsilon;
+  double eta = vertical ? param.v_eta : param.h_eta;
+  double probe = param.fpr[level] * (epsilon * std::log(param.b[level]) + eta);
+
+  auto p = param.t[level] * probe;
+  auto r = param.t[level] * (probe + (vertical ? param.rv : param.rh));
+  auto u = (vertical ? param.v_mu : param.h_mu) +
+           (vertical ? param.v_xi : param.h_xi) / param.b[level];
+  return workload.alpha * p + workload.beta * r + workload.gamma * u;
+}
+
+bool DecodeLayout(const std::string& contents, std::vector<bool>* layout) {
+  std::istringstream input(contents);
+  int num_level;
+  if (!(input >> num_level) || num_level < 0) {
+    return false;
+  }
+  std::vector<bool> result;
+  for (int i = 0; i < num_level; ++i) {
+    int vertical;
+    if (!(input >> vertical) || (vertical != 0 && vertical != 1)) {
+      return false;
     }
+    result.push_back(vertical == 1);
+  }
+  layout->swap(result);
+  return true;
+}
+
+CostModel::CostModel()
+    : num_evaluation_(0), num_get_(0), num_scan_(0), num_update_(0) {
+  // Every level starts horizontal until a layout is solved
+  level_vertical_.assign(LEVEL_DEFAULT + 1, false);
+  for (auto& lookup : level_lookup_) {
+    lookup.store(0);
+  }
+  param_ = DefaultParameter(level_vertical_.size());
+  for (auto vertical : level_vertical_) {
+    decisions_.push_back({vertical, {0, 0, 0}, 0, 0, 0});
+  }
+}
+
+bool CostModel::ShouldVertical(int level) {
+  std::lock_guard<std::mutex> guard(lock_);
+  return level_vertical_[level];
+}
+
+void CostModel::SetSpaceBudget(double budget) {
+  std::lock_guard<std::mutex> guard(lock_);
+  param_.space_budget = budget;
+}
+
+void CostModel::SetLevelBytes(const std::vector<int64_t>& bytes) {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (size_t level = 0; level < bytes.size() && level < (size_t)param_.l;
+       ++level) {
+    // An empty level keeps the size it is expected to grow to
+    if (bytes[level] == 0) {
+      continue;
+    }
+    // Vertical tables of the level count at their row size
+    param_.level_bytes[level] =
+        bytes[level] /
+        (level_vertical_[level] ? param_.v_space : param_.h_space);
+  }
+}
+
+void CostModel::SetLayout(const std::vector<bool>& layout) {
+  std::lock_guard<std::mutex> guard(lock_);
+  for (size_t level = 0; level < layout.size() && level < decisions_.size();
+       ++level) {
+    level_vertical_[level] = layout[level];
+    decisions_[level].vertical = layout[level];
+  }
+}
+
+bool CostModel::SolveLayout(const Workload& workload) {
+  std::lock_guard<std::mutex> guard(lock_);
+  if (workload.alpha + workload.beta + workload.gamma == 0) {
+    return false;
   }
+  return Decide(std::vector<Workload>(param_.l, workload), false);
 }
 
-bool CostModel::ReadModel() {
-  level_vertical_.clear();
-  ifstream modelFile("colsm_model");
-  if (modelFile.good()) {
-    uint32_t num_level;
-    modelFile >> num_level;
-    bool level_assign;
-    for (int i = 0; i < num_level; ++i) {
-      modelFile >> level_assign;
-      level_vertical_.push_back(level_assign);
+Parameter CostModel::GetParameter() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  return param_;
+}
+
+void CostModel::SetHardwareParameter(const Parameter& param) {
+  std::lock_guard<std::mutex> guard(lock_);
+  param_.v_epsilon = param.v_epsilon;
+  param_.v_eta = param.v_eta;
+  param_.h_epsilon = param.h_epsilon;
+  param_.h_eta = param.h_eta;
+  param_.rv = param.rv;
+  param_.rh = param.rh;
+  param_.v_mu = param.v_mu;
+  param_.v_xi = param.v_xi;
+  param_.h_mu = param.h_mu;
+  param_.h_xi = param.h_xi;
+}
+
+void CostModel::RecordLookup(uint32_t levels_read) {
+  num_get_.fetch_add(1, std::memory_order_relaxed);
+  while (levels_read != 0) {
+    auto level = __builtin_ctz(levels_read);
+    if (level < kMaxLevel) {
+      level_lookup_[level].fetch_add(1, std::memory_order_relaxed);
     }
-    modelFile.close();
-    return true;
+    levels_read &= levels_read - 1;
   }
-  return false;
 }
 
-std::unique_ptr<CostModel> CostModel::INSTANCE =
-    std::unique_ptr<CostModel>(new CostModel());
+void CostModel::RecordScan() {
+  num_scan_.fetch_add(1, std::memory_order_relaxed);
+}
+
+void CostModel::RecordUpdate(uint64_t count) {
+  num_update_.fetch_add(count, std::memory_order_relaxed);
+}
 
-bool CostModel::ShouldVertical(int level) { return level_vertical_[level]; }
+bool CostModel::MaybeReevaluate(uint64_t interval) {
+  if (interval == 0 ||
+      num_get_.load(std::memory_order_relaxed) +
+              num_scan_.load(std::memory_order_relaxed) +
+              num_update_.load(std::memory_order_relaxed) <
+          interval) {
+    return false;
+  }
+  return Reevaluate();
+}
+
+bool CostModel::Reevaluate() {
+  std::lock_guard<std::mutex> guard(lock_);
+  double num_get = num_get_.exchange(0);
+  double num_scan = num_scan_.exchange(0);
+  double num_update = num_update_.exchange(0);
+  double total = num_get + num_scan + num_update;
+  std::vector<double> level_lookup;
+  for (auto& lookup : level_lookup_) {
+    level_lookup.push_back(lookup.exchange(0));
+  }
+  if (total == 0) {
+    return false;
+  }
+  num_evaluation_++;
+
+  std::vector<Workload> workloads;
+  for (auto level = 0; level < param_.l; ++level) {
+    Workload workload;
+    workload.alpha = level < kMaxLevel ? level_lookup[level] / total : 0;
+    workload.beta = num_scan / total;
+    workload.gamma = num_update / total;
+    workloads.push_back(workload);
+  }
+  return Decide(workloads, true);
+}
+
+bool CostModel::Decide(const std::vector<Workload>& workloads, bool margin) {
+  for (auto level = 0; level < param_.l; ++level) {
+    auto& decision = decisions_[level];
+    decision.workload = workloads[level];
+    decision.vertical_cost = LevelCost(param_, decision.workload, level, true);
+    decision.horizontal_cost =
+        LevelCost(param_, decision.workload, level, false);
+  }
+
+  LayoutSolver solver;
+  double best = solver.Solve(param_, workloads);
+  double current = LayoutSolver::Cost(param_, workloads, level_vertical_);
+  bool over_budget =
+      param_.space_budget > 0 &&
+      LayoutSolver::Space(param_, level_vertical_) > param_.space_budget;
+  if (!over_budget && margin &&
+      best >= current - kFlipMargin * std::abs(current)) {
+    return false;
+  }
+
+  bool flipped = false;
+  for (auto level = 0; level < param_.l; ++level) {
+    auto& decision = decisions_[level];
+    if (param_.level_results[level] == decision.vertical) {
+      continue;
+    }
+    decision.vertical = param_.level_results[level];
+    decision.num_flip++;
+    level_vertical_[level] = decision.vertical;
+    if (!flipped) {
+      last_flip_.clear();
+    }
+    flipped = true;
+
+    char buf[200];
+    std::snprintf(buf, sizeof(buf),
+                  "evaluation %u: level %d to %s, cost %.2f / %.2f with "
+                  "lookup %.3f scan %.3f update %.3f\n",
+                  num_evaluation_, level,
+                  decision.vertical ? "vertical" : "horizontal",
+                  decision.vertical_cost, decision.horizontal_cost,
+                  decision.workload.alpha, decision.workload.beta,
+                  decision.workload.gamma);
+    last_flip_.append(buf);
+  }
+  return flipped;
+}
+
+std::string CostModel::DebugString() const {
+  std::lock_guard<std::mutex> guard(lock_);
+  std::string result;
+  char buf[200];
+  std::snprintf(buf, sizeof(buf),
+                "Level Layout     Lookup  Scan    Update  Vertical   "
+                "Horizontal Flips\n"
+                "--------------------------------------------------------"
+                "------------\n");
+  result.append(buf);
+  for (size_t level = 0; level < decisions_.size(); ++level) {
+    auto& decision = decisions_[level];
+    std::snprintf(buf, sizeof(buf),
+                  "%5zu %-10s %7.3f %7.3f %7.3f %10.2f %10.2f %5u\n", level,
+                  decision.vertical ? "vertical" : "horizontal",
+                  decision.workload.alpha, decision.workload.beta,
+                  decision.workload.gamma, decision.vertical_cost,
+                  decision.horizontal_cost, decision.num_flip);
+    result.append(buf);
+  }
+  std::snprintf(buf, sizeof(buf), "Evaluations: %u\n", num_evaluation_);
+  result.append(buf);
+  if (!last_flip_.empty()) {
+    result.append("Last flips:\n").append(last_flip_);
+  }
+  return result;
+}
 
-}  // namespace colsm
\ No newline at end of file
+}  // namespace colsm
@@ -4,7 +4,11 @@
 
 #ifndef COLSM_COST_MODEL_H
 #define COLSM_COST_MODEL_H
+#include <atomic>
+#include <cstdint>
 #include <memory>
+#include <mutex>
+#include <string>
 #include <vector>
 
 namespace colsm {
@@ -13,7 +17,7 @@ struct Parameter {
   int l;  // Total number of levels
   int m;  // Number of levels start using leveling
 
-  std::vector<int> b;       // Number of entries in a storage block;
+  std::vector<int64_t> b;   // Number of entries in a storage block;
   std::vector<int> t;       // Compaction ratio
   std::vector<double> fpr;  // False positive rate
 
@@ -31,6 +35,14 @@ struct Parameter {
   double h_mu;  // Update for Horizontal
   double h_xi;
 
+  // Bytes of the tables at each level if they were all horizontal
+  std::vector<double> level_bytes;
+
+  // Size of a level in each layout, relative to level_bytes
+  double v_space;
+  double h_space;
+  double space_budget;  // In bytes, no limit if 0
+
   std::vector<bool> level_results;
 };
 
@@ -40,20 +52,113 @@ struct Workload {
   double gamma;  // Percentage of update
 };
 
+/**
+ * Parameters of num_level levels. The horizontal search and all update
+ * constants are the ones measured for run_solver, the vertical search,
+ * range read and space constants are estimates. All are defaults until
+ * calibrated on the host.
+ */
+Parameter DefaultParameter(int num_level);
+
+/**
+ * Cost of the given level under the workload, its term in the objective
+ * alpha * P + beta * R + gamma * U
+ */
+double LevelCost(const Parameter&, const Workload&, int level, bool vertical);
+
+/**
+ * Read the layout of a colsm_model file, as written by earlier run_solver:
+ * the number of levels, then 1 for each vertical level and 0 for each
+ * horizontal one. False if it is malformed.
+ */
+bool DecodeLayout(const std::string& contents, std::vector<bool>* layout);
+
 class CostModel {
+ public:
+  static const int kMaxLevel = 16;
+
+  // The layout of a level and the workload it was last decided with
+  struct LevelDecision {
+    bool vertical;
+    Workload workload;
+    double vertical_cost;
+    double horizontal_cost;
+    uint32_t num_flip;
+  };
+
  protected:
-  CostModel();
+  Parameter param_;
 
+  mutable std::mutex lock_;
   std::vector<bool> level_vertical_;
-
-  bool ReadModel();
+  std::vector<LevelDecision> decisions_;
+  std::string last_flip_;
+  uint32_t num_evaluation_;
+
+  // Operations since the last evaluation. Scans and updates touch every
+  // level, lookups only count on the levels they read a table from.
+  std::atomic<uint64_t> num_get_;
+  std::atomic<uint64_t> num_scan_;
+  std::atomic<uint64_t> num_update_;
+  std::atomic<uint64_t> level_lookup_[kMaxLevel];
+
+  // Take the cheapest layout for the workload of each level, if it is
+  // cheaper by kFlipMargin than the current one or the current one does
+  // not fit the space budget. REQUIRES: lock_ is held
+  bool Decide(const std::vector<Workload>& workloads, bool margin);
 
  public:
-  virtual ~CostModel() = default;
+  CostModel();
 
-  static std::unique_ptr<CostModel> INSTANCE;
+  virtual ~CostModel() = default;
 
   bool ShouldVertical(int level);
+
+  /**
+   * Count a point lookup
+   * @param levels_read bit i is set if a table at level i was read
+   */
+  void RecordLookup(uint32_t levels_read);
+
+  void RecordScan();
+
+  void RecordUpdate(uint64_t count);
+
+  // Limit the space of all levels, see Parameter::space_budget
+  void SetSpaceBudget(double budget);
+
+  // Take the bytes stored at each level, in the layout each level has now.
+  // Empty levels keep their expected size.
+  void SetLevelBytes(const std::vector<int64_t>& bytes);
+
+  // Take the layout of the first levels, the others keep theirs
+  void SetLayout(const std::vector<bool>& layout);
+
+  /**
+   * Decide the layout of every level for the workload expected on all of
+   * them, such as when no operation has been counted yet. A workload of
+   * all 0 keeps the current layout.
+   * @return true if a level changed layout
+   */
+  bool SolveLayout(const Workload& workload);
+
+  Parameter GetParameter() const;
+
+  // Take the hardware constants of param, such as the calibrated ones
+  void SetHardwareParameter(const Parameter& param);
+
+  /**
+   * Re-decide the layout of each level with the operations counted since
+   * the last evaluation, if there are at least interval of them. The new
+   * layout is taken if it is cheaper by a margin.
+   * @return true if a level changed layout
+   */
+  bool MaybeReevaluate(uint64_t interval);
+
+  bool Reevaluate();
+
+  // Layout, workload and costs of each level, followed by the last flip
+  std::string DebugString() const;
 };
 
 }  // namespace colsm
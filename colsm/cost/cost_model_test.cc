@@ -0,0 +1,134 @@
+//
+// Created by harper on 7/20/21.
+//
+
+#include "cost_model.h"
+
+#include <gtest/gtest.h>
+
+#include "solver.h"
+
+using namespace colsm;
+
+TEST(CostModel, LevelCost) {
+  auto param = DefaultParameter(7);
+  Workload lookup{1, 0, 0};
+  Workload scan{0, 1, 0};
+  for (int level = 1; level < 7; ++level) {
+    EXPECT_LT(LevelCost(param, lookup, level, true),
+              LevelCost(param, lookup, level, false))
+        << level;
+    EXPECT_GT(LevelCost(param, scan, level, true),
+              LevelCost(param, scan, level, false))
+        << level;
+  }
+}
+
+TEST(CostModel, Reevaluate) {
+  CostModel model;
+  for (int level = 0; level < 8; ++level) {
+    ASSERT_FALSE(model.ShouldVertical(level));
+  }
+
+  // Lookups reading tables at level 0 to 3
+  for (int i = 0; i < 1000; ++i) {
+    model.RecordLookup(0xF);
+  }
+  EXPECT_FALSE(model.MaybeReevaluate(0));
+  EXPECT_FALSE(model.MaybeReevaluate(2000));
+  EXPECT_TRUE(model.MaybeReevaluate(1000));
+  for (int level = 1; level < 4; ++level) {
+    EXPECT_TRUE(model.ShouldVertical(level)) << level;
+  }
+  // No operation reached the lower levels
+  for (int level = 4; level < 8; ++level) {
+    EXPECT_FALSE(model.ShouldVertical(level)) << level;
+  }
+  // Counters are cleared after the evaluation
+  EXPECT_FALSE(model.MaybeReevaluate(1));
+
+  // The same workload keeps the layout
+  for (int i = 0; i < 1000; ++i) {
+    model.RecordLookup(0xF);
+  }
+  EXPECT_FALSE(model.Reevaluate());
+
+  // Scan heavy workload flips them back
+  for (int i = 0; i < 100; ++i) {
+    model.RecordLookup(0xF);
+  }
+  for (int i = 0; i < 900; ++i) {
+    model.RecordScan();
+  }
+  EXPECT_TRUE(model.Reevaluate());
+  for (int level = 0; level < 4; ++level) {
+    EXPECT_FALSE(model.ShouldVertical(level)) << level;
+  }
+  auto debug = model.DebugString();
+  EXPECT_NE(std::string::npos, debug.find("Evaluations: 3"));
+  EXPECT_NE(std::string::npos, debug.find("to horizontal"));
+}
+
+TEST(CostModel, SolveLayout) {
+  CostModel model;
+  EXPECT_FALSE(model.SolveLayout({0, 0, 0}));
+  EXPECT_TRUE(model.SolveLayout({1, 0, 0}));
+  for (int level = 1; level < 8; ++level) {
+    EXPECT_TRUE(model.ShouldVertical(level)) << level;
+  }
+  EXPECT_TRUE(model.SolveLayout({0, 1, 0}));
+  for (int level = 0; level < 7; ++level) {
+    EXPECT_FALSE(model.ShouldVertical(level)) << level;
+  }
+}
+
+TEST(CostModel, SpaceBudgetInBytes) {
+  CostModel model;
+  // 1MB at level 0 and 1, 100MB at level 2
+  model.SetLevelBytes({1 << 20, 1 << 20, 100 << 20});
+  auto param = model.GetParameter();
+  EXPECT_EQ(100 << 20, param.level_bytes[2]);
+
+  // Scans favor rows, but they do not fit once 10MB must be saved
+  auto layout = [&model]() {
+    std::vector<bool> result;
+    for (int level = 0; level < 8; ++level) {
+      result.push_back(model.ShouldVertical(level));
+    }
+    return result;
+  };
+  model.SolveLayout({0, 1, 0});
+  const double budget =
+      LayoutSolver::Space(model.GetParameter(), layout()) - (10 << 20);
+  model.SetSpaceBudget(budget);
+  EXPECT_TRUE(model.SolveLayout({0, 1, 0}));
+  EXPECT_LE(LayoutSolver::Space(model.GetParameter(), layout()), budget);
+
+  // Vertical bytes are taken at their row size
+  model.SetSpaceBudget(0);
+  EXPECT_TRUE(model.SolveLayout({1, 0, 0}));
+  ASSERT_TRUE(model.ShouldVertical(2));
+  model.SetLevelBytes({0, 0, 80 << 20});
+  EXPECT_EQ(100 << 20, model.GetParameter().level_bytes[2]);
+}
+
+TEST(CostModel, DecodeLayout) {
+  std::vector<bool> layout;
+  ASSERT_TRUE(DecodeLayout("3\n0\n1\n1\n", &layout));
+  EXPECT_EQ(std::vector<bool>({false, true, true}), layout);
+  EXPECT_FALSE(DecodeLayout("3\n0\n1\n", &layout));
+  EXPECT_FALSE(DecodeLayout("2\n0\n2\n", &layout));
+  EXPECT_EQ(3, layout.size());
+
+  CostModel model;
+  model.SetLayout(layout);
+  EXPECT_FALSE(model.ShouldVertical(0));
+  EXPECT_TRUE(model.ShouldVertical(2));
+  EXPECT_FALSE(model.ShouldVertical(3));
+}
+
+// LevelDB test did not use gtest_main
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -10,34 +10,14 @@ using namespace std;
 using namespace colsm;
 
 int main() {
-  CPlexSolver solver;
+  LayoutSolver solver;
   // Get input parameters
-  Parameter param;
+  Parameter param = DefaultParameter(7);
   Workload workload;
 
-  param.l = 7;
-  for (auto i = 0; i < 7; ++i) {
-    param.t.push_back(10);
-    param.fpr.push_back(0.01);
-    if (param.b.empty()) {
-      param.b.push_back(15000);
-    } else {
-      param.b.push_back(param.b.back() * 10);
-    }
-  }
-  param.m = 8;
-
-  param.h_epsilon = 179.46;
-  param.h_eta = -1740.2;
-
   param.rv = 10;
   param.rh = 10;
 
-  param.v_mu = 409.41;
-  param.v_xi = -7.99e6;
-  param.h_mu = 429.87;
-  param.h_xi = -5.01e6;
-
   workload.alpha = 0.5;
   workload.beta = 0;
   workload.gamma = 0.5;
@@ -56,11 +36,9 @@ int main() {
   }
   log_file.close();
 
-  // Write model to output file
-  ofstream model_file("colsm_model");
-  model_file << param.l << '\n';
+  // Print the layout of the last factor, DBs solve their own at open
   for (auto i = 0; i < param.l; ++i) {
-    model_file << param.level_results[i] << '\n';
+    cout << "level " << i << ": "
+         << (param.level_results[i] ? "vertical" : "horizontal") << '\n';
   }
-  model_file.close();
-}
\ No newline at end of file
+}
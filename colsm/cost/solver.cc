@@ -3,82 +3,83 @@
 //
 
 #include "solver.h"
-#include <math.h>
 
-#include <ilcplex/ilocplex.h>
+#include <cassert>
+#include <limits>
 
 namespace colsm {
 
-    using namespace std;
-
-    void CPlexSolver::Solve(Parameter &parameter, Workload &workload) {
-        SolveLevelDB(parameter, workload);
+using namespace std;
+
+double LayoutSolver::Solve(Parameter& param, const Workload& workload) {
+  return Solve(param, vector<Workload>(param.l, workload));
+}
+
+double LayoutSolver::Solve(Parameter& param,
+                           const vector<Workload>& workloads) {
+  param.level_results.assign(param.l, false);
+
+  double result = 0;
+  for (int i = 0; i < param.l; ++i) {
+    auto vertical = LevelCost(param, workloads[i], i, true);
+    auto horizontal = LevelCost(param, workloads[i], i, false);
+    param.level_results[i] = vertical < horizontal;
+    result += std::min(vertical, horizontal);
+  }
+  if (param.space_budget <= 0 ||
+      Space(param, param.level_results) <= param.space_budget) {
+    return result;
+  }
+
+  // Pick the cheapest layout within the budget, or the smallest if none is
+  assert(param.l <= kMaxEnumerateLevel);
+  vector<bool> layout(param.l);
+  vector<bool> smallest;
+  double best = numeric_limits<double>::max();
+  double min_space = numeric_limits<double>::max();
+  bool feasible = false;
+  for (uint32_t mask = 0; mask < (1u << param.l); ++mask) {
+    for (int i = 0; i < param.l; ++i) {
+      layout[i] = (mask >> i) & 1;
     }
-
-    void CPlexSolver::SolveLevelDB(Parameter &param, Workload &workload) {
-        IloEnv env;
-        IloModel model(env);
-
-        IloNumVarArray var(env);
-
-        // Define variables
-        for (auto i = 0; i < param.l; ++i) {
-            var.add(IloNumVar(env, 0, 1, ILOINT));
-        }
-
-        // sum 0.1 p(B_i)
-        //
-
-        // P = \sum T p P
-        // R = P + R
-        // U = \sum D/B
-        // result = alpha P + beta R + gamma U
-        auto p = param.t[0] * param.fpr[0] * (
-                (var[0] * param.v_epsilon + (1 - var[0]) * param.h_epsilon) * std::log(param.b[0])
-                + var[0] * param.v_eta + (1 - var[0]) * param.h_eta);
-        auto r = param.t[0] * (param.fpr[0] * (
-                (var[0] * param.v_epsilon + (1 - var[0]) * param.h_epsilon) * std::log(param.b[0])
-                + var[0] * param.v_eta + (1 - var[0]) * param.h_eta)
-                               + var[0] * param.rv + (1 - var[0]) * param.rh);
-        auto u = (var[0] * param.v_mu + (1 - var[0]) * param.h_mu) +
-                 (var[0] * param.v_xi + (1 - var[0]) * param.h_xi) / param.b[0];
-
-        for (int i = 1; i < param.l; ++i) {
-            p = p + param.t[i] * param.fpr[i] * (
-                    (var[i] * param.v_epsilon + (1 - var[i]) * param.h_epsilon) * std::log(param.b[i])
-                    + var[i] * param.v_eta + (1 - var[i]) * param.h_eta);
-            r = r + param.t[i] * (param.fpr[i] * (
-                    (var[i] * param.v_epsilon + (1 - var[i]) * param.h_epsilon) * std::log(param.b[i])
-                    + var[i] * param.v_eta + (1 - var[i]) * param.h_eta)
-                                  + var[i] * param.rv + (1 - var[i]) * param.rh);
-            u = u + (var[i] * param.v_mu + (1 - var[i]) * param.h_mu) +
-                    (var[i] * param.v_xi + (1 - var[i]) * param.h_xi) / param.b[i];
-        }
-
-        auto result = workload.alpha * p + workload.beta * r + workload.gamma * u;
-
-        model.add(IloMinimize(env, result));
-
-        IloCplex cplex(model);
-
-        cplex.solve();
-
-//        env.out() << "Solution status = " << cplex.getStatus() << endl;
-//        env.out() << "Solution value  = " << cplex.getObjValue() << endl;
-
-        IloNumArray vals(env);
-        cplex.getValues(vals, var);
-//        env.out() << "Values        = " << vals << endl;
-
-        auto intArray = vals.toIntArray();
-        param.level_results.clear();
-        for (int i = 0; i < param.l; ++i) {
-            param.level_results.push_back(intArray[i] != 0);
-        }
-
-        env.end();
-
-        return;
+    auto space = Space(param, layout);
+    if (space <= param.space_budget) {
+      auto cost = Cost(param, workloads, layout);
+      if (cost < best) {
+        best = cost;
+        param.level_results = layout;
+        feasible = true;
+      }
+    } else if (!feasible && space < min_space) {
+      min_space = space;
+      smallest = layout;
     }
-
-}  // namespace colsm
\ No newline at end of file
+  }
+  if (!feasible) {
+    param.level_results = smallest;
+    best = Cost(param, workloads, smallest);
+  }
+  return best;
+}
+
+double LayoutSolver::Cost(const Parameter& param,
+                          const vector<Workload>& workloads,
+                          const vector<bool>& vertical) {
+  double result = 0;
+  for (int i = 0; i < param.l; ++i) {
+    result += LevelCost(param, workloads[i], i, vertical[i]);
+  }
+  return result;
+}
+
+double LayoutSolver::Space(const Parameter& param,
+                           const vector<bool>& vertical) {
+  double result = 0;
+  for (int i = 0; i < param.l; ++i) {
+    result +=
+        param.level_bytes[i] * (vertical[i] ? param.v_space : param.h_space);
+  }
+  return result;
+}
+
+}  // namespace colsm
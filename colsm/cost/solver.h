@@ -10,12 +10,32 @@
 #include "cost_model.h"
 
 namespace colsm {
-class CPlexSolver {
- protected:
-  void SolveLevelDB(Parameter&, Workload&);
 
+/**
+ * Choose the layout of each level minimizing alpha * P + beta * R +
+ * gamma * U. Each level only appears in its own term, so without a space
+ * budget every level takes its cheaper layout. With a budget the levels
+ * are enumerated, the number of levels is small.
+ */
+class LayoutSolver {
  public:
-  void Solve(Parameter&, Workload&);
+  static const int kMaxEnumerateLevel = 20;
+
+  /**
+   * Solve with the same workload on every level
+   * @return the objective, the layout goes to param.level_results
+   */
+  double Solve(Parameter&, const Workload&);
+
+  // Solve with a workload for each level
+  double Solve(Parameter&, const std::vector<Workload>&);
+
+  // Objective of the given layout
+  static double Cost(const Parameter&, const std::vector<Workload>&,
+                     const std::vector<bool>& vertical);
+
+  // Bytes used by the given layout
+  static double Space(const Parameter&, const std::vector<bool>& vertical);
 };
 
 }  // namespace colsm
@@ -0,0 +1,81 @@
+//
+// Created by harper on 7/21/21.
+//
+
+#include "solver.h"
+
+#include <gtest/gtest.h>
+
+using namespace colsm;
+
+TEST(LayoutSolver, Separable) {
+  auto param = DefaultParameter(7);
+  LayoutSolver solver;
+
+  Workload lookup{1, 0, 0};
+  auto cost = solver.Solve(param, lookup);
+  ASSERT_EQ(7, param.level_results.size());
+  std::vector<Workload> workloads(7, lookup);
+  EXPECT_DOUBLE_EQ(cost,
+                   LayoutSolver::Cost(param, workloads, param.level_results));
+  for (int level = 0; level < 7; ++level) {
+    EXPECT_EQ(LevelCost(param, lookup, level, true) <
+                  LevelCost(param, lookup, level, false),
+              param.level_results[level])
+        << level;
+  }
+
+  // Compare with all layouts
+  std::vector<bool> layout(7);
+  for (uint32_t mask = 0; mask < 128; ++mask) {
+    for (int level = 0; level < 7; ++level) {
+      layout[level] = (mask >> level) & 1;
+    }
+    EXPECT_LE(cost, LayoutSolver::Cost(param, workloads, layout)) << mask;
+  }
+
+  Workload scan{0, 1, 0};
+  solver.Solve(param, scan);
+  for (int level = 1; level < 7; ++level) {
+    EXPECT_FALSE(param.level_results[level]) << level;
+  }
+}
+
+TEST(LayoutSolver, SpaceBudget) {
+  auto param = DefaultParameter(4);
+  LayoutSolver solver;
+  Workload scan{0, 1, 0};
+  std::vector<Workload> workloads(4, scan);
+
+  // Horizontal is cheaper for scans but does not fit
+  solver.Solve(param, scan);
+  auto horizontal = LayoutSolver::Space(param, param.level_results);
+  param.space_budget = horizontal - 1;
+  auto cost = solver.Solve(param, scan);
+  EXPECT_LE(LayoutSolver::Space(param, param.level_results),
+            param.space_budget);
+  // The largest level is vertical, which saves the most space
+  EXPECT_TRUE(param.level_results[3]);
+  std::vector<bool> layout(4);
+  for (uint32_t mask = 0; mask < 16; ++mask) {
+    for (int level = 0; level < 4; ++level) {
+      layout[level] = (mask >> level) & 1;
+    }
+    if (LayoutSolver::Space(param, layout) <= param.space_budget) {
+      EXPECT_LE(cost, LayoutSolver::Cost(param, workloads, layout)) << mask;
+    }
+  }
+
+  // Too small a budget takes the smallest layout
+  param.space_budget = 1;
+  solver.Solve(param, scan);
+  for (int level = 0; level < 4; ++level) {
+    EXPECT_TRUE(param.level_results[level]) << level;
+  }
+}
+
+// LevelDB test did not use gtest_main
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
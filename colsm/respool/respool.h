@@ -5,10 +5,16 @@
 #ifndef COLSM_RESPOOL_H
 #define COLSM_RESPOOL_H
 
+#include <algorithm>
+#include <atomic>
+#include <cassert>
 #include <forward_list>
 #include <functional>
 #include <memory>
 #include <mutex>
+#include <thread>
+#include <unordered_map>
+#include <vector>
 
 namespace colsm {
 
@@ -139,6 +145,324 @@ class lockfree_pool {
     return std::shared_ptr<R>((R*)res, [this](R* ptr) { this->add(ptr); });
   }
 };
+
+namespace detail {
+// Index of the calling thread, given in the order threads first use a pool
+inline uint32_t pool_thread_index() {
+  static std::atomic<uint32_t> counter{0};
+  thread_local uint32_t index = counter.fetch_add(1, std::memory_order_relaxed);
+  return index;
+}
+
+// Ids are never reused, so a thread cache never mistakes a slot for one of
+// a later pool
+inline uint64_t next_pool_id() {
+  static std::atomic<uint64_t> counter{1};
+  return counter.fetch_add(1, std::memory_order_relaxed);
+}
+
+// A pool that takes back the resources cached by exiting threads
+class cached_pool {
+ public:
+  virtual ~cached_pool() = default;
+
+  virtual void release_cached(uint32_t slot) = 0;
+};
+
+// Pools alive by id. Both are never destroyed, threads may exit after the
+// static objects are gone.
+inline std::mutex& live_pools_lock() {
+  static std::mutex* lock = new std::mutex();
+  return *lock;
+}
+
+inline std::unordered_map<uint64_t, cached_pool*>& live_pools() {
+  static auto* pools = new std::unordered_map<uint64_t, cached_pool*>();
+  return *pools;
+}
+
+// Give a slot cached by an exiting thread back to its pool, if the pool is
+// still alive
+inline void release_cached(uint64_t pool, uint32_t slot) {
+  std::lock_guard<std::mutex> guard(live_pools_lock());
+  auto found = live_pools().find(pool);
+  if (found != live_pools().end()) {
+    found->second->release_cached(slot);
+  }
+}
+}  // namespace detail
+
+/**
+ * Work-stealing pool. Each thread caches the last resource it released and
+ * gets it back without any atomic operation. Other free resources are kept
+ * in lock-free lists, one for each shard. A thread uses its home shard and
+ * steals from the others when that is empty. Slots are padded to a cache
+ * line, so threads working on different resources share no line.
+ *
+ * The pool grows when no resource is free. A resource cached by a thread is
+ * only used by that thread, so the pool may hold one more resource than
+ * the concurrent users for each live thread. A thread gives its cached
+ * resources back when it exits. At kMaxSize, get() waits for a release.
+ *
+ * Each shard is a Treiber stack of slot indices, the head is tagged with a
+ * counter against ABA. Slots live until the pool is destroyed.
+ *
+ * @tparam R
+ */
+template <typename R>
+class steal_pool : public detail::cached_pool {
+ public:
+  static const uint32_t kChunkSize = 64;
+  static const uint32_t kMaxChunk = 1024;
+  static const uint32_t kMaxSize = kChunkSize * kMaxChunk;
+
+ private:
+  static const uint32_t kEmpty = UINT32_MAX;
+  // Pools a thread caches a resource for at the same time
+  static const uint32_t kCacheWays = 4;
+
+  struct alignas(64) Slot {
+    R* resource = nullptr;
+    std::atomic<uint32_t> next{kEmpty};
+  };
+
+  // Tag in the high 32 bits, slot index in the low ones
+  struct alignas(64) Shard {
+    std::atomic<uint64_t> head{kEmpty};
+  };
+
+  struct CacheEntry {
+    uint64_t pool = 0;
+    uint32_t slot = kEmpty;
+  };
+
+  struct ThreadCache {
+    CacheEntry entries[kCacheWays];
+
+    ~ThreadCache() {
+      for (auto& entry : entries) {
+        if (entry.slot != kEmpty) {
+          detail::release_cached(entry.pool, entry.slot);
+        }
+      }
+    }
+  };
+
+  const uint64_t id_;
+  std::function<R*()> creator_;
+  std::atomic<Slot*> chunks_[kMaxChunk];
+  std::unique_ptr<Shard[]> shards_;
+  uint32_t shard_mask_;
+  std::atomic<uint32_t> created_;
+
+  CacheEntry& cache_entry() const {
+    thread_local ThreadCache cache;
+    return cache.entries[id_ % kCacheWays];
+  }
+
+  uint32_t home_shard() const {
+    return detail::pool_thread_index() & shard_mask_;
+  }
+
+  Slot& slot(uint32_t index) const {
+    return chunks_[index / kChunkSize].load(std::memory_order_acquire)
+        [index % kChunkSize];
+  }
+
+  void push(uint32_t shard, uint32_t index) {
+    auto& head = shards_[shard].head;
+    uint64_t old_head = head.load(std::memory_order_relaxed);
+    uint64_t new_head;
+    do {
+      slot(index).next.store((uint32_t)old_head, std::memory_order_relaxed);
+      new_head = ((old_head >> 32) + 1) << 32 | index;
+    } while (!head.compare_exchange_weak(old_head, new_head,
+                                         std::memory_order_release,
+                                         std::memory_order_relaxed));
+  }
+
+  uint32_t pop(uint32_t shard) {
+    auto& head = shards_[shard].head;
+    uint64_t old_head = head.load(std::memory_order_acquire);
+    uint64_t new_head;
+    do {
+      uint32_t index = (uint32_t)old_head;
+      if (index == kEmpty) {
+        return kEmpty;
+      }
+      uint32_t next = slot(index).next.load(std::memory_order_relaxed);
+      new_head = ((old_head >> 32) + 1) << 32 | next;
+    } while (!head.compare_exchange_weak(old_head, new_head,
+                                         std::memory_order_acquire,
+                                         std::memory_order_acquire));
+    return (uint32_t)old_head;
+  }
+
+  // Create the resource of a new slot, kEmpty at kMaxSize
+  uint32_t grow() {
+    uint32_t index = created_.load(std::memory_order_relaxed);
+    do {
+      if (index >= kMaxSize) {
+        return kEmpty;
+      }
+    } while (!created_.compare_exchange_weak(index, index + 1,
+                                             std::memory_order_relaxed));
+    auto& chunk = chunks_[index / kChunkSize];
+    Slot* slots = chunk.load(std::memory_order_acquire);
+    if (slots == nullptr) {
+      Slot* fresh = new Slot[kChunkSize];
+      if (chunk.compare_exchange_strong(slots, fresh,
+                                        std::memory_order_acq_rel)) {
+        slots = fresh;
+      } else {
+        delete[] fresh;
+      }
+    }
+    slots[index % kChunkSize].resource = creator_();
+    return index;
+  }
+
+  void release(uint32_t index) {
+    // An entry holding the resource of another pool is left alone
+    auto& entry = cache_entry();
+    if (entry.slot == kEmpty) {
+      entry.pool = id_;
+      entry.slot = index;
+      return;
+    }
+    push(home_shard(), index);
+  }
+
+ public:
+  /**
+   * Hold a resource of the pool and release it when destroyed. Getting and
+   * releasing a resource allocates nothing.
+   */
+  class handle {
+   private:
+    steal_pool* pool_;
+    uint32_t slot_;
+    R* resource_;
+
+   public:
+    handle() : pool_(nullptr), slot_(kEmpty), resource_(nullptr) {}
+
+    handle(steal_pool* pool, uint32_t slot)
+        : pool_(pool), slot_(slot), resource_(pool->slot(slot).resource) {}
+
+    handle(handle&& other) noexcept
+        : pool_(other.pool_), slot_(other.slot_), resource_(other.resource_) {
+      other.pool_ = nullptr;
+      other.resource_ = nullptr;
+    }
+
+    handle& operator=(handle&& other) noexcept {
+      if (this != &other) {
+        reset();
+        pool_ = other.pool_;
+        slot_ = other.slot_;
+        resource_ = other.resource_;
+        other.pool_ = nullptr;
+        other.resource_ = nullptr;
+      }
+      return *this;
+    }
+
+    handle(const handle&) = delete;
+
+    handle& operator=(const handle&) = delete;
+
+    ~handle() { reset(); }
+
+    R* get() const { return resource_; }
+
+    R* operator->() const { return resource_; }
+
+    R& operator*() const { return *resource_; }
+
+    explicit operator bool() const { return pool_ != nullptr; }
+
+    // Return the resource to the pool
+    void reset() {
+      if (pool_ != nullptr) {
+        pool_->release(slot_);
+        pool_ = nullptr;
+        resource_ = nullptr;
+      }
+    }
+  };
+
+  /**
+   * @param size number of resources created up front
+   * @param creator
+   * @param num_shard number of free lists, rounded up to a power of 2. 0 for
+   * one for each hardware thread
+   */
+  steal_pool(uint32_t size, std::function<R*()> creator, uint32_t num_shard = 0)
+      : id_(detail::next_pool_id()), creator_(creator), created_(0) {
+    assert(size <= kMaxSize);
+    for (auto& chunk : chunks_) {
+      chunk.store(nullptr, std::memory_order_relaxed);
+    }
+    if (num_shard == 0) {
+      num_shard = std::max(1u, std::thread::hardware_concurrency());
+    }
+    uint32_t shards = 1;
+    while (shards < num_shard) {
+      shards <<= 1;
+    }
+    shard_mask_ = shards - 1;
+    shards_.reset(new Shard[shards]);
+    for (uint32_t i = 0; i < size; ++i) {
+      push(i & shard_mask_, grow());
+    }
+    std::lock_guard<std::mutex> guard(detail::live_pools_lock());
+    detail::live_pools()[id_] = this;
+  }
+
+  // All handles should have been released
+  virtual ~steal_pool() {
+    {
+      std::lock_guard<std::mutex> guard(detail::live_pools_lock());
+      detail::live_pools().erase(id_);
+    }
+    for (uint32_t i = 0; i < created_.load(); ++i) {
+      delete slot(i).resource;
+    }
+    for (auto& chunk : chunks_) {
+      delete[] chunk.load();
+    }
+  }
+
+  handle get() {
+    auto& entry = cache_entry();
+    if (entry.pool == id_ && entry.slot != kEmpty) {
+      uint32_t index = entry.slot;
+      entry.slot = kEmpty;
+      return handle(this, index);
+    }
+    uint32_t home = home_shard();
+    while (true) {
+      uint32_t index = pop(home);
+      for (uint32_t i = 1; index == kEmpty && i <= shard_mask_; ++i) {
+        index = pop((home + i) & shard_mask_);
+      }
+      if (index == kEmpty) {
+        index = grow();
+      }
+      if (index != kEmpty) {
+        return handle(this, index);
+      }
+      std::this_thread::yield();
+    }
+  }
+
+  void release_cached(uint32_t slot) override { push(home_shard(), slot); }
+
+  // Number of resources created
+  uint32_t size() const { return created_.load(std::memory_order_relaxed); }
+};
+
 }  // namespace colsm
 
 #endif  // COLSM_RESPOOL_H
@@ -9,6 +9,9 @@ class PoolItem {
 
 };
 
+// Enough resources for every thread of the threaded runs
+const uint32_t kPoolSize = 64;
+
 void create(benchmark::State & state) {
    for(auto _ :state) {
        auto item = new PoolItem();
@@ -32,8 +35,10 @@ void simple(benchmark::State& state) {
     }
 }
 
+// The pools below are shared by the threads of a run
+
 void lock(benchmark::State& state) {
-    colsm::lock_pool<PoolItem> pool(10, [](){return new PoolItem();});
+    static colsm::lock_pool<PoolItem> pool(kPoolSize, [](){return new PoolItem();});
     for(auto _:state) {
         auto item = pool.get();
         benchmark::DoNotOptimize(item);
@@ -41,15 +46,24 @@ void lock(benchmark::State& state) {
 }
 
 void lockfree(benchmark::State& state) {
-    colsm::lockfree_pool<PoolItem> pool(10, [](){return new PoolItem();});
+    static colsm::lockfree_pool<PoolItem> pool(kPoolSize, [](){return new PoolItem();});
     for(auto _:state) {
         auto item = pool.get();
         benchmark::DoNotOptimize(item);
     }
 }
 
-BENCHMARK(create);
+void steal(benchmark::State& state) {
+    static colsm::steal_pool<PoolItem> pool(kPoolSize, [](){return new PoolItem();});
+    for(auto _:state) {
+        auto item = pool.get();
+        benchmark::DoNotOptimize(item.get());
+    }
+}
+
+BENCHMARK(create)->ThreadRange(1, 64);
 BENCHMARK(stack);
 BENCHMARK(simple);
-BENCHMARK(lock);
-BENCHMARK(lockfree);
\ No newline at end of file
+BENCHMARK(lock)->ThreadRange(1, 64);
+BENCHMARK(lockfree)->ThreadRange(1, 64);
+BENCHMARK(steal)->ThreadRange(1, 64);
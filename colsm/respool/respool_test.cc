@@ -5,6 +5,7 @@
 #include "respool.h"
 
 #include <gtest/gtest.h>
+#include <thread>
 
 class LockPoolObj {
  public:
@@ -40,6 +41,19 @@ public:
 
     virtual ~LockFreePoolObj() {}
 };
+class StealPoolObj {
+ public:
+  int value_;
+  std::atomic<int> users_{0};
+  StealPoolObj() {
+    // Created by several threads when the pool grows
+    static std::atomic<int> counter{0};
+    value_ = ++counter;
+  }
+
+  virtual ~StealPoolObj() {}
+};
+
 TEST(LockPool, Get) {
     colsm::lock_pool<LockPoolObj> pool(10, []() { return new LockPoolObj(); });
 
@@ -118,6 +132,149 @@ TEST(LockFreePool, Get) {
     EXPECT_EQ(val8->value_,7);
 }
 
+TEST(StealPool, Get) {
+  // A single shard behaves as a stack
+  colsm::steal_pool<StealPoolObj> pool(
+      10, []() { return new StealPoolObj(); }, 1);
+
+  auto val1 = pool.get();
+  auto val2 = pool.get();
+  auto val3 = pool.get();
+
+  EXPECT_EQ(val1->value_, 10);
+  EXPECT_EQ(val2->value_, 9);
+  EXPECT_EQ(val3->value_, 8);
+
+  {
+    auto val4 = pool.get();
+    EXPECT_EQ(val4->value_, 7);
+  }
+
+  auto val5 = pool.get();
+  EXPECT_EQ(val5->value_, 7);
+
+  auto moved = std::move(val5);
+  EXPECT_FALSE(val5);
+  EXPECT_EQ(moved->value_, 7);
+  moved.reset();
+  EXPECT_FALSE(moved);
+  EXPECT_EQ(pool.get()->value_, 7);
+}
+
+TEST(StealPool, Grow) {
+  colsm::steal_pool<StealPoolObj> pool(
+      2, []() { return new StealPoolObj(); });
+  EXPECT_EQ(2, pool.size());
+
+  std::vector<colsm::steal_pool<StealPoolObj>::handle> handles;
+  for (int i = 0; i < 4; ++i) {
+    handles.push_back(pool.get());
+  }
+  EXPECT_EQ(4, pool.size());
+  for (int i = 0; i < 4; ++i) {
+    for (int j = 0; j < i; ++j) {
+      EXPECT_NE(handles[i].get(), handles[j].get());
+    }
+  }
+
+  // Released ones are reused, the first from the thread cache
+  auto last = handles.back().get();
+  handles.pop_back();
+  EXPECT_EQ(last, pool.get().get());
+  handles.clear();
+  for (int i = 0; i < 4; ++i) {
+    handles.push_back(pool.get());
+  }
+  EXPECT_EQ(4, pool.size());
+}
+
+TEST(StealPool, ManyPools) {
+  // More pools than a thread caches at a time, in turns
+  std::vector<std::unique_ptr<colsm::steal_pool<StealPoolObj>>> pools;
+  std::vector<std::vector<StealPoolObj*>> objects(10);
+  for (int i = 0; i < 10; ++i) {
+    pools.emplace_back(new colsm::steal_pool<StealPoolObj>(
+        1, [&objects, i]() {
+          auto obj = new StealPoolObj();
+          objects[i].push_back(obj);
+          return obj;
+        }));
+  }
+  for (int round = 0; round < 100; ++round) {
+    for (int i = 0; i < 10; ++i) {
+      auto item = pools[i]->get();
+      ASSERT_EQ(objects[i][0], item.get());
+    }
+  }
+  for (auto& pool : pools) {
+    EXPECT_EQ(1, pool->size());
+  }
+}
+
+TEST(StealPool, Threads) {
+  colsm::steal_pool<StealPoolObj> pool(
+      2, []() { return new StealPoolObj(); }, 4);
+  std::atomic<int> conflicts{0};
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 8; ++t) {
+    threads.emplace_back([&]() {
+      for (int i = 0; i < 20000; ++i) {
+        auto item = pool.get();
+        if (item->users_.fetch_add(1) != 0) {
+          conflicts++;
+        }
+        item->users_.fetch_sub(1);
+        if (i % 7 == 0) {
+          // Hold two at a time, so that some go to the shared lists
+          auto other = pool.get();
+          EXPECT_NE(item.get(), other.get());
+        }
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  EXPECT_EQ(0, conflicts.load());
+  // At most two held and one cached by each thread
+  EXPECT_GE(24, pool.size());
+}
+
+TEST(StealPool, ShortLivedThreads) {
+  colsm::steal_pool<StealPoolObj> pool(
+      1, []() { return new StealPoolObj(); });
+  // Each thread caches the resource it used until it exits
+  for (int batch = 0; batch < 125; ++batch) {
+    std::vector<std::thread> threads;
+    for (int t = 0; t < 8; ++t) {
+      threads.emplace_back([&pool]() { pool.get(); });
+    }
+    for (auto& thread : threads) {
+      thread.join();
+    }
+  }
+  EXPECT_GE(8, pool.size());
+
+  // A thread outliving the pool keeps nothing for it
+  std::mutex lock;
+  std::unique_lock<std::mutex> hold(lock);
+  std::unique_ptr<colsm::steal_pool<StealPoolObj>> gone(
+      new colsm::steal_pool<StealPoolObj>(
+          1, []() { return new StealPoolObj(); }));
+  std::atomic<bool> used{false};
+  std::thread late([&]() {
+    gone->get();
+    used = true;
+    std::lock_guard<std::mutex> wait(lock);
+  });
+  while (!used) {
+    std::this_thread::yield();
+  }
+  gone.reset();
+  hold.unlock();
+  late.join();
+}
+
 // LevelDB test did not use gtest_main
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
@@ -0,0 +1,35 @@
+//
+// Created by harper on 7/23/21.
+//
+// Calibrate the cost model on this host and print the constants. With a DB
+// path, they are also written to its COLSM_PARAMETER file, which the DB
+// loads when opened.
+//
+
+#include <iostream>
+#include <leveldb/env.h>
+#include <leveldb/status.h>
+
+#include "db/filename.h"
+
+#include "colsm/cost/calibrate.h"
+
+using namespace std;
+using namespace leveldb;
+
+int main(int argc, char** argv) {
+  colsm::Parameter param = colsm::DefaultParameter(7);
+  colsm::Calibrator().Run(&param);
+  auto encoded = colsm::EncodeHardwareParameter(param);
+  cout << encoded;
+
+  if (argc > 1) {
+    Env* env = Env::Default();
+    Status s = WriteStringToFile(env, encoded, ColsmParameterFileName(argv[1]));
+    if (!s.ok()) {
+      cerr << s.ToString() << endl;
+      return 1;
+    }
+  }
+  return 0;
+}
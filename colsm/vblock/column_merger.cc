@@ -0,0 +1,198 @@
+//
+// Created by harper on 8/2/21.
+//
+
+#include "column_merger.h"
+
+#include <algorithm>
+
+#include "util/coding.h"
+
+namespace colsm {
+
+ColumnReader::ColumnReader(const ReadOptions& options,
+                           std::vector<Table*> tables)
+    : options_(options),
+      tables_(std::move(tables)),
+      table_index_(0),
+      run_(0),
+      position_(0) {}
+
+void ColumnReader::SeekToFirst() {
+  table_index_ = 0;
+  index_iter_.reset();
+  block_.Release();
+  columns_.clear();
+  position_ = 0;
+  NextRun();
+}
+
+void ColumnReader::NextRun() {
+  columns_.clear();
+  position_ = 0;
+  while (status_.ok()) {
+    if (block_.block != nullptr && ++run_ < block_.block->NumRun()) {
+      status_ = block_.block->ReadColumns(run_, &columns_);
+      if (columns_.size() > 0) {
+        return;
+      }
+      continue;
+    }
+    block_.Release();
+    if (index_iter_ != nullptr) {
+      index_iter_->Next();
+    } else if (table_index_ < tables_.size()) {
+      index_iter_.reset(tables_[table_index_]->NewIndexIterator());
+      index_iter_->SeekToFirst();
+    } else {
+      return;
+    }
+    if (!index_iter_->Valid()) {
+      status_ = index_iter_->status();
+      index_iter_.reset();
+      table_index_++;
+      continue;
+    }
+    status_ = tables_[table_index_]->ReadDataBlock(
+        options_, index_iter_->value(), &block_);
+    if (status_.ok() && block_.block->NumRun() > 0) {
+      run_ = 0;
+      status_ = block_.block->ReadColumns(run_, &columns_);
+      if (columns_.size() > 0) {
+        return;
+      }
+    }
+  }
+  columns_.clear();
+}
+
+namespace {
+
+// The readers are kept in a loser tree, see table/merger.cc. Node 0 holds
+// the current reader, nodes [1, n) the loser of the match at the node, and
+// the leaf of reader i is node n + i.
+class ColumnMergingIterator : public Iterator {
+ public:
+  explicit ColumnMergingIterator(std::vector<ColumnReader*> readers)
+      : n_(readers.size()), tree_(std::max<size_t>(readers.size(), 1)) {
+    for (auto reader : readers) {
+      readers_.emplace_back(reader);
+    }
+  }
+
+  bool Valid() const override { return current_ != nullptr; }
+
+  void SeekToFirst() override {
+    for (auto& reader : readers_) {
+      reader->SeekToFirst();
+    }
+    std::vector<int> winners(2 * n_);
+    for (int i = 0; i < n_; i++) {
+      winners[n_ + i] = i;
+    }
+    for (int node = n_ - 1; node > 0; node--) {
+      int left = winners[2 * node];
+      int right = winners[2 * node + 1];
+      bool left_wins = Beats(left, right);
+      winners[node] = left_wins ? left : right;
+      tree_[node] = left_wins ? right : left;
+    }
+    tree_[0] = n_ > 0 ? winners[1] : 0;
+    SetCurrent();
+  }
+
+  void SeekToLast() override {
+    status_ = Status::NotSupported("SeekToLast Not Supported");
+    current_ = nullptr;
+  }
+
+  void Seek(const Slice& target) override {
+    status_ = Status::NotSupported("Seek Not Supported");
+    current_ = nullptr;
+  }
+
+  void Next() override {
+    assert(Valid());
+    current_->Next();
+    int winner = tree_[0];
+    for (int node = (winner + n_) / 2; node > 0; node /= 2) {
+      if (Beats(tree_[node], winner)) {
+        std::swap(tree_[node], winner);
+      }
+    }
+    tree_[0] = winner;
+    SetCurrent();
+  }
+
+  void Prev() override {
+    status_ = Status::NotSupported("Prev Not Supported");
+    current_ = nullptr;
+  }
+
+  Slice key() const override {
+    assert(Valid());
+    return Slice(key_, sizeof(key_));
+  }
+
+  Slice value() const override {
+    assert(Valid());
+    return current_->value();
+  }
+
+  Status status() const override {
+    if (!status_.ok()) {
+      return status_;
+    }
+    for (auto& reader : readers_) {
+      if (!reader->status().ok()) {
+        return reader->status();
+      }
+    }
+    return Status::OK();
+  }
+
+ private:
+  // Keys ascending, then sequences descending. Exhausted readers lose.
+  bool Beats(int a, int b) const {
+    const ColumnReader* ra = readers_[a].get();
+    const ColumnReader* rb = readers_[b].get();
+    if (!ra->Valid()) {
+      return false;
+    }
+    if (!rb->Valid()) {
+      return true;
+    }
+    if (ra->key() != rb->key()) {
+      return ra->key() < rb->key();
+    }
+    if (ra->seq() != rb->seq()) {
+      return ra->seq() > rb->seq();
+    }
+    return a < b;
+  }
+
+  void SetCurrent() {
+    current_ = nullptr;
+    if (n_ == 0 || !readers_[tree_[0]]->Valid()) {
+      return;
+    }
+    current_ = readers_[tree_[0]].get();
+    EncodeFixed32(key_, current_->key());
+    EncodeFixed64(key_ + 4, (current_->seq() << 8) | current_->type());
+  }
+
+  int n_;
+  std::vector<std::unique_ptr<ColumnReader>> readers_;
+  std::vector<int> tree_;
+  ColumnReader* current_ = nullptr;
+  char key_[12];
+  Status status_;
+};
+
+}  // namespace
+
+Iterator* NewColumnMergingIterator(std::vector<ColumnReader*> readers) {
+  return new ColumnMergingIterator(std::move(readers));
+}
+
+}  // namespace colsm
@@ -0,0 +1,83 @@
+//
+// Created by harper on 8/2/21.
+//
+//
+// Merge the inputs of a compaction column by column. Tables are read one
+// run of a data block at a time with Block::ReadColumns, a section of a
+// vertical block or a whole row block, and the runs are merged in a loser
+// tree on the decoded int keys and sequences. No iterator is stacked on
+// each table and block, and no internal key is parsed.
+//
+
+#ifndef COLSM_COLUMN_MERGER_H
+#define COLSM_COLUMN_MERGER_H
+
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "leveldb/iterator.h"
+#include "leveldb/options.h"
+#include "leveldb/table.h"
+
+#include "table/block.h"
+
+namespace colsm {
+
+using namespace leveldb;
+
+// Entries of non-overlapping tables with int keys in key order, e.g. the
+// input files of a level
+class ColumnReader {
+ public:
+  // The tables should stay live while the reader is used
+  ColumnReader(const ReadOptions& options, std::vector<Table*> tables);
+
+  ColumnReader(const ColumnReader&) = delete;
+
+  ColumnReader& operator=(const ColumnReader&) = delete;
+
+  void SeekToFirst();
+
+  bool Valid() const { return position_ < columns_.size(); }
+
+  void Next() {
+    if (++position_ == columns_.size()) {
+      NextRun();
+    }
+  }
+
+  uint32_t key() const { return columns_.keys[position_]; }
+
+  uint64_t seq() const { return columns_.seqs[position_]; }
+
+  uint8_t type() const { return columns_.types[position_]; }
+
+  Slice value() const { return columns_.values[position_]; }
+
+  Status status() const { return status_; }
+
+ private:
+  // Read the next non-empty run, moving to the next block and table
+  void NextRun();
+
+  const ReadOptions options_;
+  std::vector<Table*> tables_;
+  size_t table_index_;
+  std::unique_ptr<Iterator> index_iter_;
+  Table::BlockRef block_;
+  uint32_t run_;
+
+  BlockColumns columns_;
+  size_t position_;
+  Status status_;
+};
+
+// Return a forward-only iterator on the union of the readers, in the order
+// of the internal keys. Takes ownership of the readers. Seek, SeekToLast
+// and Prev are not supported.
+Iterator* NewColumnMergingIterator(std::vector<ColumnReader*> readers);
+
+}  // namespace colsm
+
+#endif  // COLSM_COLUMN_MERGER_H
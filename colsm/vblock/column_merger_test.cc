@@ -0,0 +1,208 @@
+//
+// Created by harper on 8/2/21.
+//
+
+#include "column_merger.h"
+
+#include <gtest/gtest.h>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "leveldb/db.h"
+#include "leveldb/env.h"
+#include "leveldb/table_builder.h"
+
+#include "colsm/comparators.h"
+#include "db/dbformat.h"
+#include "table/merger.h"
+#include "util/coding.h"
+
+using namespace std;
+using namespace leveldb;
+using namespace colsm;
+
+namespace {
+
+class StringSink : public WritableFile {
+ public:
+  const string& contents() const { return contents_; }
+
+  Status Close() override { return Status::OK(); }
+  Status Flush() override { return Status::OK(); }
+  Status Sync() override { return Status::OK(); }
+
+  Status Append(const Slice& data) override {
+    contents_.append(data.data(), data.size());
+    return Status::OK();
+  }
+
+ private:
+  string contents_;
+};
+
+class StringSource : public RandomAccessFile {
+ public:
+  explicit StringSource(const string& contents) : contents_(contents) {}
+
+  Status Read(uint64_t offset, size_t n, Slice* result,
+              char* scratch) const override {
+    n = std::min<size_t>(n, contents_.size() - offset);
+    memcpy(scratch, contents_.data() + offset, n);
+    *result = Slice(scratch, n);
+    return Status::OK();
+  }
+
+ private:
+  string contents_;
+};
+
+struct Entry {
+  uint32_t key;
+  SequenceNumber seq;
+  ValueType type;
+  string value;
+};
+
+class TableHolder {
+ public:
+  TableHolder(const Options& options, bool vertical,
+              const vector<Entry>& entries) {
+    StringSink sink;
+    TableBuilder builder(options, vertical, &sink);
+    char key[12];
+    for (auto& entry : entries) {
+      EncodeFixed32(key, entry.key);
+      EncodeFixed64(key + 4, (entry.seq << 8) | entry.type);
+      builder.Add(Slice(key, 12), entry.value);
+    }
+    EXPECT_TRUE(builder.Finish().ok());
+    source_.reset(new StringSource(sink.contents()));
+    Table* table;
+    EXPECT_TRUE(
+        Table::Open(options, source_.get(), sink.contents().size(), &table)
+            .ok());
+    table_.reset(table);
+  }
+
+  Table* table() { return table_.get(); }
+
+ private:
+  unique_ptr<StringSource> source_;
+  unique_ptr<Table> table_;
+};
+
+vector<Entry> MakeEntries(uint32_t begin, uint32_t end, uint32_t step,
+                          SequenceNumber seq, const string& prefix) {
+  vector<Entry> entries;
+  for (uint32_t key = begin; key < end; key += step) {
+    auto type = key % 7 == 0 ? kTypeDeletion : kTypeValue;
+    entries.push_back({key, seq++, type,
+                       type == kTypeValue ? prefix + to_string(key % 50) : ""});
+  }
+  return entries;
+}
+
+}  // namespace
+
+TEST(ColumnMerger, SameAsMergingIterator) {
+  auto comparator = intComparator();
+  InternalKeyComparator icmp(comparator.get());
+  Options options;
+  options.comparator = &icmp;
+  options.block_size = 1024;
+  options.section_limit = 64;
+
+  // A vertical table with compressed values, a row table, and a level of
+  // two mixed tables
+  TableHolder vertical(options, true, MakeEntries(0, 3000, 3, 1000, "vert"));
+  Options row_options = options;
+  row_options.vert_value_compression = false;
+  TableHolder row(row_options, false, MakeEntries(0, 3000, 2, 5000, "row"));
+  Options mixed_options = options;
+  mixed_options.vert_block_choice = true;
+  TableHolder low(mixed_options, true,
+                  MakeEntries(0, 1500, 1, 10000, string(600, 'x')));
+  TableHolder high(mixed_options, true,
+                   MakeEntries(1500, 3000, 1, 20000, "mixed"));
+
+  unique_ptr<Iterator> merged(NewColumnMergingIterator(
+      {new ColumnReader(ReadOptions(), {vertical.table()}),
+       new ColumnReader(ReadOptions(), {row.table()}),
+       new ColumnReader(ReadOptions(), {low.table(), high.table()})}));
+  Iterator* children[] = {vertical.table()->NewIterator(ReadOptions()),
+                          row.table()->NewIterator(ReadOptions()),
+                          low.table()->NewIterator(ReadOptions()),
+                          high.table()->NewIterator(ReadOptions())};
+  unique_ptr<Iterator> expected(NewMergingIterator(&icmp, children, 4));
+
+  int count = 0;
+  merged->SeekToFirst();
+  for (expected->SeekToFirst(); expected->Valid(); expected->Next()) {
+    ASSERT_TRUE(merged->Valid());
+    ASSERT_EQ(expected->key().ToString(), merged->key().ToString());
+    ASSERT_EQ(expected->value().ToString(), merged->value().ToString());
+    merged->Next();
+    count++;
+  }
+  EXPECT_FALSE(merged->Valid());
+  EXPECT_TRUE(merged->status().ok());
+  EXPECT_EQ(1000 + 1500 + 3000, count);
+
+  merged->Seek(Slice("abcd"));
+  EXPECT_FALSE(merged->status().ok());
+}
+
+TEST(ColumnMerger, Compaction) {
+  Env* env = Env::Default();
+  string dbname;
+  ASSERT_TRUE(env->GetTestDirectory(&dbname).ok());
+  dbname += "/column_merger_test";
+  auto comparator = intComparator();
+  Options options;
+  options.comparator = comparator.get();
+  DestroyDB(dbname, options);
+  options.create_if_missing = true;
+  options.vert_column_compaction = true;
+  options.write_buffer_size = 64 * 1024;
+
+  DB* db;
+  ASSERT_TRUE(DB::Open(options, dbname, &db).ok());
+  auto key_of = [](uint32_t key) {
+    string result;
+    PutFixed32(&result, key);
+    return result;
+  };
+  // Overwrite and delete keys across several memtables
+  for (uint32_t round = 0; round < 4; ++round) {
+    for (uint32_t key = 0; key < 5000; ++key) {
+      if (key % 11 == round) {
+        ASSERT_TRUE(db->Delete(WriteOptions(), key_of(key)).ok());
+      } else {
+        ASSERT_TRUE(db->Put(WriteOptions(), key_of(key),
+                            "value" + to_string(key * 10 + round))
+                        .ok());
+      }
+    }
+  }
+  db->CompactRange(nullptr, nullptr);
+
+  for (uint32_t key = 0; key < 5000; ++key) {
+    string value;
+    auto s = db->Get(ReadOptions(), key_of(key), &value);
+    if (key % 11 == 3) {
+      EXPECT_TRUE(s.IsNotFound());
+    } else {
+      ASSERT_TRUE(s.ok());
+      EXPECT_EQ("value" + to_string(key * 10 + 3), value);
+    }
+  }
+  delete db;
+  ASSERT_TRUE(DestroyDB(dbname, options).ok());
+}
+
+// LevelDB test did not use gtest_main
+int main(int argc, char** argv) {
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -85,7 +85,7 @@ Iterator* CompressBlockCore::NewIterator(const Comparator* comparator) {
   auto data_pointer = decompressed.data.data();
   auto data_length = decompressed.data.size();
   uint32_t last = *((uint32_t*)(data_pointer + data_length - 4));
-  if (last == colsm::MAGIC) {
+  if (colsm::IsVertBlock(last)) {
     inner_ = std::unique_ptr<BlockCore>(new colsm::VertBlockCore(decompressed));
   } else {
     inner_ = std::unique_ptr<BlockCore>(new BasicBlockCore(decompressed));
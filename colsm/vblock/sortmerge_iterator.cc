@@ -5,6 +5,9 @@
 #include "sortmerge_iterator.h"
 
 #include <memory>
+#include <string>
+
+#include "table/merger.h"
 
 using namespace leveldb;
 
@@ -12,96 +15,63 @@ namespace colsm {
 
 using namespace std;
 
-class TwoMergeIterator : public Iterator {
+// Merge the children in a loser tree and skip the keys equal to the last
+// one returned. The tree gives equal keys to the smallest index in both
+// directions, so the first of a run of equal keys is the one to keep.
+class SortMergeIterator : public Iterator {
  protected:
-  Status status_;
   const Comparator* comparator_;
-  unique_ptr<Iterator> left_;
-  unique_ptr<Iterator> right_;
-  bool fill_left_ = false;
-
-  Iterator* pointer_;
-
-  bool both_valid_ = true;
+  unique_ptr<Iterator> merged_;
+  std::string last_key_;
 
  public:
-  TwoMergeIterator(const Comparator* comparator, Iterator* left,
-                   Iterator* right)
-      : comparator_(comparator) {
-    left_ = unique_ptr<Iterator>(left);
-    right_ = unique_ptr<Iterator>(right);
-
-    auto compare = comparator_->Compare(left_->key(),right_->key());
-    if(compare < 0) {
-      pointer_ = left_.get();
-    } else if(compare > 0) {
-      pointer_ = right_.get();
-    } else {
-      pointer_ = left_.get();
-      right_->Next();
-    }
-  }
+  SortMergeIterator(const Comparator* comparator, Iterator** children, int n)
+      : comparator_(comparator),
+        merged_(NewMergingIterator(comparator, children, n)) {}
 
-  void Seek(const Slice& target) override {
-    // Not supported
-    status_ = Status::NotSupported(Slice("Seek Not Supported"));
-  }
+  void Seek(const Slice& target) override { merged_->Seek(target); }
 
-  void SeekToFirst() override {
-    // Not supported
-    status_ = Status::NotSupported(Slice("SeekToFirst Not Supported"));
-  }
+  void SeekToFirst() override { merged_->SeekToFirst(); }
 
-  void SeekToLast() override {
-    // Not supported
-    status_ = Status::NotSupported(Slice("SeekToLast Not Supported"));
-  }
+  void SeekToLast() override { merged_->SeekToLast(); }
 
   void Next() override {
-    pointer_->Next();
-
-    if (both_valid_) {
-      if (pointer_->Valid()) {
-        auto compared = comparator_->Compare(left_->key(), right_->key());
-        if (compared < 0) {
-          pointer_ = left_.get();
-        } else if (compared == 0) {
-          pointer_ = left_.get();
-          // In the case of equal, left preempts
-          right_->Next();
-        } else {
-          pointer_ = right_.get();
-        }
-      } else {
-        both_valid_ = false;
-        pointer_ =
-            (Iterator*)(((uint64_t)left_.get() + (uint64_t)right_.get()) -
-                        (uint64_t)pointer_);
-      }
-    }
+    last_key_.assign(merged_->key().data(), merged_->key().size());
+    do {
+      merged_->Next();
+    } while (merged_->Valid() &&
+             comparator_->Compare(merged_->key(), last_key_) == 0);
   }
 
   void Prev() override {
-    status_ = Status::NotSupported(Slice("Prev Not Supported"));
+    last_key_.assign(merged_->key().data(), merged_->key().size());
+    do {
+      merged_->Prev();
+    } while (merged_->Valid() &&
+             comparator_->Compare(merged_->key(), last_key_) == 0);
   }
 
-  bool Valid() const override { return left_->Valid() || right_->Valid(); }
+  bool Valid() const override { return merged_->Valid(); }
 
-  Slice key() const override { return pointer_->key(); }
+  Slice key() const override { return merged_->key(); }
 
-  Slice value() const override { return pointer_->value(); }
+  Slice value() const override { return merged_->value(); }
 
-  Status status() const override {
-    if (left_->status().ok()) {
-      return right_->status();
-    } else {
-      return left_->status();
-    }
-  }
+  Status status() const override { return merged_->status(); }
 };
 
+Iterator* sortMergeIterator(const Comparator* comparator, Iterator** children,
+                            int n) {
+  return new SortMergeIterator(comparator, children, n);
+}
+
 Iterator* sortMergeIterator(const Comparator* comparator, Iterator* left,
                             Iterator* right) {
-  return new TwoMergeIterator(comparator, left, right);
+  Iterator* children[2] = {left, right};
+  auto result = sortMergeIterator(comparator, children, 2);
+  // Start from where the children are, the same as a SeekToFirst on
+  // children positioned at their first entry
+  result->SeekToFirst();
+  return result;
 }
-}  // namespace colsm
\ No newline at end of file
+}  // namespace colsm
@@ -12,9 +12,15 @@ using namespace leveldb;
 namespace colsm {
 
 // Create a Sort-Merge iterator. Values from left will preempt the ones from
-// right
+// right. The iterator starts at the current position of the children.
 Iterator* sortMergeIterator(const Comparator*, Iterator*, Iterator*);
 
+// Create a Sort-Merge iterator on n children, owned by the result. When
+// several children hold the same key, only the one with the smallest index
+// is returned. Position the iterator with Seek or SeekToFirst/Last before
+// use.
+Iterator* sortMergeIterator(const Comparator*, Iterator** children, int n);
+
 }  // namespace colsm
 
 #endif  // LEVELDB_SORTMERGE_ITERATOR_H
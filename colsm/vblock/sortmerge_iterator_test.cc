@@ -5,12 +5,16 @@
 #include "sortmerge_iterator.h"
 
 #include <gtest/gtest.h>
+#include <algorithm>
 #include <vector>
 
 #include "leveldb/iterator.h"
 #include "leveldb/slice.h"
 
 #include "colsm/comparators.h"
+#include "db/dbformat.h"
+#include "table/merger.h"
+#include "util/coding.h"
 
 using namespace std;
 using namespace leveldb;
@@ -85,7 +89,6 @@ TEST(TwoMergeIterator, Next) {
     Iterator *sm = colsm::sortMergeIterator(intcompare.get(), left, right);
 
     vector<int> buffer;
-    sm->Next();
     while (sm->Valid()) {
         auto key = sm->key();
         buffer.push_back(*((int32_t *) key.data()));
@@ -103,6 +106,163 @@ TEST(TwoMergeIterator, Next) {
     delete sm;
 }
 
+class StringIterator : public Iterator {
+protected:
+    const Comparator *comparator_;
+    vector<string> content_;
+    int pointer_ = -1;
+
+public:
+    StringIterator(const Comparator *comparator, vector<string> content)
+            : comparator_(comparator), content_(move(content)) {}
+
+    bool Valid() const override {
+        return pointer_ >= 0 && pointer_ < (int) content_.size();
+    }
+
+    void SeekToFirst() override { pointer_ = 0; }
+
+    void SeekToLast() override { pointer_ = content_.size() - 1; }
+
+    void Seek(const Slice &target) override {
+        pointer_ = 0;
+        while (Valid() && comparator_->Compare(content_[pointer_], target) < 0) {
+            pointer_++;
+        }
+    }
+
+    void Next() override { pointer_++; }
+
+    void Prev() override { pointer_--; }
+
+    Slice key() const override { return content_[pointer_]; }
+
+    Slice value() const override { return content_[pointer_]; }
+
+    Status status() const override { return Status::OK(); }
+};
+
+string IntKey(uint32_t key) {
+    string result;
+    PutFixed32(&result, key);
+    return result;
+}
+
+string InternalIntKey(uint32_t key, SequenceNumber seq) {
+    string result;
+    AppendInternalKey(&result, ParsedInternalKey(IntKey(key), seq, kTypeValue));
+    return result;
+}
+
+uint32_t KeyOf(const Slice &key) { return DecodeFixed32(key.data()); }
+
+TEST(SortMergeIterator, NWay) {
+    unique_ptr<Comparator> intcompare = colsm::intComparator();
+    vector<Iterator *> children;
+    for (uint32_t i = 0; i < 5; ++i) {
+        vector<string> content;
+        for (uint32_t key = i; key < 100; key += 5) {
+            content.push_back(IntKey(key));
+        }
+        // Every child also holds 1000, only the first one is kept
+        content.push_back(IntKey(1000));
+        children.push_back(new StringIterator(intcompare.get(), content));
+    }
+    unique_ptr<Iterator> sm(
+            colsm::sortMergeIterator(intcompare.get(), children.data(), 5));
+
+    sm->SeekToFirst();
+    for (uint32_t key = 0; key < 100; ++key) {
+        ASSERT_TRUE(sm->Valid());
+        EXPECT_EQ(key, KeyOf(sm->key()));
+        sm->Next();
+    }
+    ASSERT_TRUE(sm->Valid());
+    EXPECT_EQ(1000, KeyOf(sm->key()));
+    sm->Next();
+    EXPECT_FALSE(sm->Valid());
+
+    sm->Seek(IntKey(37));
+    ASSERT_TRUE(sm->Valid());
+    EXPECT_EQ(37, KeyOf(sm->key()));
+    sm->Prev();
+    EXPECT_EQ(36, KeyOf(sm->key()));
+    sm->Prev();
+    EXPECT_EQ(35, KeyOf(sm->key()));
+    sm->Next();
+    EXPECT_EQ(36, KeyOf(sm->key()));
+    sm->Next();
+    EXPECT_EQ(37, KeyOf(sm->key()));
+
+    sm->SeekToLast();
+    ASSERT_TRUE(sm->Valid());
+    EXPECT_EQ(1000, KeyOf(sm->key()));
+    for (int key = 99; key >= 0; --key) {
+        sm->Prev();
+        ASSERT_TRUE(sm->Valid());
+        EXPECT_EQ(key, KeyOf(sm->key()));
+    }
+    sm->Prev();
+    EXPECT_FALSE(sm->Valid());
+}
+
+// The int keys are compared without the comparator, check against it
+TEST(MergingIterator, InternalIntKey) {
+    unique_ptr<Comparator> intcompare = colsm::intComparator();
+    InternalKeyComparator icmp(intcompare.get());
+    vector<Iterator *> children;
+    vector<string> all;
+    SequenceNumber seq = 1;
+    for (uint32_t i = 0; i < 7; ++i) {
+        vector<string> content;
+        for (uint32_t key = i; key < 200; key += 3) {
+            content.push_back(InternalIntKey(key, seq++));
+        }
+        sort(content.begin(), content.end(),
+             [&](const string &a, const string &b) {
+                 return icmp.Compare(a, b) < 0;
+             });
+        all.insert(all.end(), content.begin(), content.end());
+        children.push_back(new StringIterator(&icmp, content));
+    }
+    sort(all.begin(), all.end(), [&](const string &a, const string &b) {
+        return icmp.Compare(a, b) < 0;
+    });
+    unique_ptr<Iterator> merged(
+            NewMergingIterator(&icmp, children.data(), children.size()));
+
+    merged->SeekToFirst();
+    for (auto &expect : all) {
+        ASSERT_TRUE(merged->Valid());
+        EXPECT_EQ(expect, merged->key().ToString());
+        merged->Next();
+    }
+    EXPECT_FALSE(merged->Valid());
+
+    merged->SeekToLast();
+    for (auto it = all.rbegin(); it != all.rend(); ++it) {
+        ASSERT_TRUE(merged->Valid());
+        EXPECT_EQ(*it, merged->key().ToString());
+        merged->Prev();
+    }
+    EXPECT_FALSE(merged->Valid());
+
+    // The newest version of 100 comes first
+    merged->Seek(InternalIntKey(100, kMaxSequenceNumber));
+    ASSERT_TRUE(merged->Valid());
+    auto pos = lower_bound(all.begin(), all.end(),
+                           InternalIntKey(100, kMaxSequenceNumber),
+                           [&](const string &a, const string &b) {
+                               return icmp.Compare(a, b) < 0;
+                           });
+    EXPECT_EQ(*pos, merged->key().ToString());
+    merged->Prev();
+    EXPECT_EQ(*(pos - 1), merged->key().ToString());
+    merged->Next();
+    merged->Next();
+    EXPECT_EQ(*(pos + 1), merged->key().ToString());
+}
+
 // LevelDB test did not use gtest_main
 int main(int argc, char **argv) {
     testing::InitGoogleTest(&argc, argv);
@@ -4,101 +4,32 @@
 
 #include "vert_block.h"
 
+#include <algorithm>
 #include <immintrin.h>
 #include <util/coding.h>
 
+#include "db/dbformat.h"
+#include "util/no_destructor.h"
+
 #include "byteutils.h"
 #include "sboost.h"
 #include "unpacker.h"
+#include "vert_search.h"
 
 namespace colsm {
 
 using namespace encoding;
 
-int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
-              uint32_t target) {
-  uint32_t mask = (1 << bitwidth) - 1;
-  uint32_t begin = 0;
-  uint32_t end = num_entry - 1;
-  while (begin <= end) {
-    auto current = (begin + end + 1) / 2;
-
-    auto bits = current * bitwidth;
-    auto index = bits >> 3;
-    auto offset = bits & 0x7;
-
-    auto extracted = (*(uint32_t*)(data + index) >> offset) & mask;
-
-    if (extracted == target) {
-      return current;
-    }
-    if (extracted > target) {
-      end = current - 1;
-    } else {
-      begin = current + 1;
-    }
-  }
-  return -1;
-}
-
-// Return the first entry larger or equal to the target
-int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
-               uint32_t target) {
-  uint32_t mask = (1 << bitwidth) - 1;
-  if (target > mask) {
-    return num_entry;
-  }
-  uint32_t begin = 0;
-  uint32_t end = num_entry - 1;
-  while (begin <= end) {
-    auto current = (begin + end + 1) / 2;
-
-    auto bits = current * bitwidth;
-    auto index = bits >> 3;
-    auto offset = bits & 0x7;
-
-    auto extracted = (*(uint32_t*)(data + index) >> offset) & mask;
-
-    if (extracted == target) {
-      return current;
-    }
-    if (extracted > target) {
-      end = current - 1;
-    } else {
-      begin = current + 1;
-    }
-  }
-  return begin;
-}
-// Return the last entry with a key smaller or equal to target
-int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
-                   uint32_t target) {
-  uint32_t mask = (1 << bitwidth) - 1;
-  if (target > mask) {
-    return num_entry - 1;
-  }
-  uint32_t begin = 0;
-  uint32_t end = num_entry - 1;
-  while (begin < end) {
-    auto current = (begin + end + 1) / 2;
-
-    auto bits = current * bitwidth;
-    auto index = bits >> 3;
-    auto offset = bits & 0x7;
-
-    auto extracted = (*(uint32_t*)(data + index) >> offset) & mask;
-
-    if (extracted <= target) {
-      begin = current;
-    } else {
-      end = current - 1;
-    }
-  }
-  return begin;
-}
-
 VertBlockMeta::VertBlockMeta()
-    : num_section_(0), start_min_(0), start_bitwidth_(0), starts_(NULL) {}
+    : num_section_(0),
+      offsets_(nullptr),
+      start_min_(0),
+      start_bitwidth_(0),
+      starts_(NULL),
+      num_probe_(0),
+      filter_words_(0),
+      maxes_(nullptr),
+      filters_(nullptr) {}
 
 VertBlockMeta::~VertBlockMeta() {}
 
@@ -108,11 +39,65 @@ void VertBlockMeta::Reset() {
   start_bitwidth_ = 0;
   starts_ = nullptr;
   starts_plain_.clear();
-  offsets_.clear();
+  offsets_ = nullptr;
+  offsets_plain_.clear();
+  // Keep the filter settings
+  maxes_ = nullptr;
+  filters_ = nullptr;
+  maxes_plain_.clear();
+  filters_plain_.clear();
+}
+
+namespace {
+inline uint64_t FilterHash(uint32_t value) {
+  // Finalizer of MurmurHash3
+  uint64_t h = value;
+  h ^= h >> 33;
+  h *= 0xff51afd7ed558ccdULL;
+  h ^= h >> 33;
+  h *= 0xc4ceb9fe1a85ec53ULL;
+  h ^= h >> 33;
+  return h;
+}
+
+// Register-blocked bloom filter, all probes of a value fall in one 64-bit
+// word. The high half of the hash picks the word, the low half gives a
+// 6-bit position for each probe.
+inline uint64_t FilterMask(uint64_t hash, uint8_t num_probe) {
+  uint64_t mask = 0;
+  for (uint8_t i = 0; i < num_probe; ++i) {
+    mask |= 1ULL << ((hash >> (6 * i)) & 63);
+  }
+  return mask;
+}
+
+inline uint32_t FilterWord(uint64_t hash, uint32_t num_word) {
+  return ((hash >> 32) * num_word) >> 32;
 }
+}  // namespace
 
-uint32_t VertBlockMeta::SectionOffset(uint32_t sec_index) {
-  return offsets_[sec_index];
+void VertBlockMeta::EnableFilter(uint32_t bits_per_key,
+                                 uint32_t section_limit) {
+  // Probes of a value use 32 bits of the hash
+  num_probe_ = std::max(1u, std::min(5u, bits_per_key * 69 / 100));
+  filter_words_ = std::max(1u, (bits_per_key * section_limit + 63) / 64);
+}
+
+bool VertBlockMeta::MayContain(uint32_t value) const {
+  if (num_probe_ == 0) {
+    return true;
+  }
+  if (num_section_ == 0 || value < start_min_) {
+    return false;
+  }
+  auto section = Search(value);
+  if (value > maxes_[section]) {
+    return false;
+  }
+  auto hash = FilterHash(value);
+  auto mask = FilterMask(hash, num_probe_);
+  auto word = filters_[section * filter_words_ + FilterWord(hash, filter_words_)];
+  return (word & mask) == mask;
 }
 
 void VertBlockMeta::AddSection(uint64_t offset, uint32_t start_value) {
@@ -121,10 +106,29 @@ void VertBlockMeta::AddSection(uint64_t offset, uint32_t start_value) {
     start_min_ = start_value;
   }
   starts_plain_.push_back(start_value - start_min_);
-  offsets_.push_back(offset);
+  offsets_plain_.push_back(offset);
+  offsets_ = offsets_plain_.data();
+}
+
+void VertBlockMeta::AddSection(uint64_t offset,
+                               const std::vector<uint32_t>& keys) {
+  AddSection(offset, keys.front());
+  if (num_probe_ == 0) {
+    return;
+  }
+  maxes_plain_.push_back(keys.back());
+  maxes_ = maxes_plain_.data();
+  auto filter_start = filters_plain_.size();
+  filters_plain_.resize(filter_start + filter_words_, 0);
+  for (auto key : keys) {
+    auto hash = FilterHash(key);
+    filters_plain_[filter_start + FilterWord(hash, filter_words_)] |=
+        FilterMask(hash, num_probe_);
+  }
+  filters_ = filters_plain_.data();
 }
 
-int32_t VertBlockMeta::Search(uint32_t value) {
+int32_t VertBlockMeta::Search(uint32_t value) const {
   if (value < start_min_) {
     return 0;
   }
@@ -132,19 +136,29 @@ int32_t VertBlockMeta::Search(uint32_t value) {
                         value - start_min_);
 }
 
-uint32_t VertBlockMeta::Read(const uint8_t* in) {
+uint32_t VertBlockMeta::Read(const uint8_t* in, uint32_t size) {
   auto pointer = in;
   num_section_ = *reinterpret_cast<const uint32_t*>(pointer);
   pointer += 4;
-  offsets_.resize(num_section_);
-  memcpy(offsets_.data(), pointer, num_section_ * 8);
+  offsets_ = reinterpret_cast<const uint64_t*>(pointer);
   pointer += num_section_ * 8;
   start_min_ = *reinterpret_cast<const uint32_t*>(pointer);
   pointer += 4;
   start_bitwidth_ = *(pointer++);
 
   starts_ = (uint8_t*)pointer;
-
+  pointer += BitPackSize();
+
+  num_probe_ = 0;
+  if (size > pointer - in) {
+    num_probe_ = *(pointer++);
+    filter_words_ = *reinterpret_cast<const uint32_t*>(pointer);
+    pointer += 4;
+    maxes_ = reinterpret_cast<const uint32_t*>(pointer);
+    pointer += num_section_ * 4;
+    filters_ = reinterpret_cast<const uint64_t*>(pointer);
+    pointer += num_section_ * filter_words_ * 8;
+  }
   return pointer - in;
 }
 
@@ -153,14 +167,14 @@ void VertBlockMeta::Finish() {
 }
 
 uint32_t VertBlockMeta::EstimateSize() const {
-  return 9 + num_section_ * 8 + BitPackSize();
+  return 9 + num_section_ * 8 + BitPackSize() + FilterSize();
 }
 
 void VertBlockMeta::Write(uint8_t* out) {
   auto pointer = out;
   *reinterpret_cast<uint32_t*>(pointer) = num_section_;
   pointer += 4;
-  memcpy(pointer, offsets_.data(), 8 * num_section_);
+  memcpy(pointer, offsets_plain_.data(), 8 * num_section_);
   pointer += 8 * num_section_;
   *reinterpret_cast<uint32_t*>(pointer) = start_min_;
   pointer += 4;
@@ -168,13 +182,29 @@ void VertBlockMeta::Write(uint8_t* out) {
   *reinterpret_cast<uint8_t*>(pointer++) = start_bitwidth_;
   sboost::byteutils::bitpack(starts_plain_.data(), num_section_,
                              start_bitwidth_, (uint8_t*)pointer);
+  pointer += BitPackSize();
+
+  if (num_probe_ != 0) {
+    *(pointer++) = num_probe_;
+    *reinterpret_cast<uint32_t*>(pointer) = filter_words_;
+    pointer += 4;
+    memcpy(pointer, maxes_plain_.data(), num_section_ * 4);
+    pointer += num_section_ * 4;
+    memcpy(pointer, filters_plain_.data(), filters_plain_.size() * 8);
+  }
 
   //  memcpy(pointer, starts_, (start_bitwidth_ * num_section_ + 7) >> 3);
 }
 
-VertSection::VertSection() : num_entry_(0) {}
+VertSection::VertSection()
+    : num_entry_(0),
+      key_enc_(BITPACK),
+      key_decoder_(&key_bitpack_),
+      seq_decoder_(&seq_plain_),
+      type_decoder_(&type_rle_),
+      value_decoder_(&value_length_) {}
 
-void VertSection::Read(const uint8_t* in) {
+void VertSection::Read(const uint8_t* in, VertKeyFormat key_format) {
   auto pointer = in;
   num_entry_ = *reinterpret_cast<const uint32_t*>(pointer);
   pointer += 4;
@@ -193,62 +223,322 @@ void VertSection::Read(const uint8_t* in) {
   auto value_size = *((uint32_t*)pointer);
   pointer += 4;
   EncodingType value_enc = (EncodingType) * (pointer++);
+  if (key_format == kVertStringKey) {
+    // Skip the suffix size, the suffix column is the last one
+    assert(*(pointer + 4) == LENGTH);
+    pointer += 5;
+  }
 
   // Read data about key encoding
-  bit_width_ = *(pointer);
-  key_data_ = pointer + 1;
-  assert(key_enc == BITPACK);
-//  key_decoder_ = u32::EncodingFactory::Get(BITPACK).decoder();
-  key_decoder_.Attach(pointer);
+  key_enc_ = key_enc;
+  switch (key_enc) {
+    case PFOR:
+      key_pfor_.Attach(pointer);
+      key_decoder_ = &key_pfor_;
+      bit_width_ = key_pfor_.BitWidth();
+      key_data_ = key_pfor_.Data();
+      break;
+    case SKIPDELTA:
+      key_skip_delta_.Attach(pointer);
+      key_decoder_ = &key_skip_delta_;
+      bit_width_ = 0;
+      key_data_ = nullptr;
+      break;
+    default:
+      assert(key_enc == BITPACK);
+      bit_width_ = *(pointer);
+      key_data_ = pointer + 1;
+      key_bitpack_.Attach(pointer);
+      key_decoder_ = &key_bitpack_;
+      break;
+  }
   pointer += key_size;
 
-//  seq_decoder_ = u64::EncodingFactory::Get(seq_enc).decoder();
-  assert(seq_enc == PLAIN);
-  seq_decoder_.Attach(pointer);
+  switch (seq_enc) {
+    case BITPACK:
+      seq_decoder_ = &seq_bitpack_;
+      break;
+    case DELTA:
+      seq_decoder_ = &seq_delta_;
+      break;
+    default:
+      assert(seq_enc == PLAIN);
+      seq_decoder_ = &seq_plain_;
+      break;
+  }
+  seq_decoder_->Attach(pointer);
+  seq_enc_ = seq_enc;
+  seq_data_ = pointer;
   pointer += seq_size;
 
-//  type_decoder_ = u8::EncodingFactory::Get(type_enc).decoder();
-  assert(type_enc = RUNLENGTH);
-  type_decoder_.Attach(pointer);
+  // u8 BITPACK is the var-int RLE, see u8::EncodingFactory
+  switch (type_enc) {
+    case PLAIN:
+      type_decoder_ = &type_plain_;
+      break;
+    case BITPACK:
+      type_decoder_ = &type_rle_varint_;
+      break;
+    default:
+      assert(type_enc == RUNLENGTH);
+      type_decoder_ = &type_rle_;
+      break;
+  }
+  type_decoder_->Attach(pointer);
   pointer += type_size;
 
-//  value_decoder_= string::EncodingFactory::Get(value_enc).decoder();
-  assert(value_enc == LENGTH);
-  value_decoder_.Attach(pointer);
+  value_enc_ = value_enc;
+  switch (value_enc) {
+    case PLAIN:
+      value_decoder_ = &value_plain_;
+      break;
+    case DICTIONARY:
+      value_decoder_ = &value_dictionary_;
+      break;
+    case FSST:
+      value_decoder_ = &value_fsst_;
+      break;
+    default:
+      assert(value_enc == LENGTH);
+      value_decoder_ = &value_length_;
+      break;
+  }
+  value_decoder_->Attach(pointer);
+  pointer += value_size;
+
+  if (key_format == kVertStringKey) {
+    suffix_decoder_.Attach(pointer);
+  }
+}
+
+uint32_t VertSection::LowerBound(uint32_t value) {
+  switch (key_enc_) {
+    case PFOR: {
+      // Keys are sorted, the exceptions are the largest ones
+      auto num_packed = num_entry_ - key_pfor_.NumException();
+      if ((uint64_t)value >> bit_width_ == 0) {
+        return num_packed == 0
+                   ? 0
+                   : geq_packed(key_data_, num_packed, bit_width_, value);
+      }
+      auto exceptions = key_pfor_.ExceptionValues();
+      return num_packed +
+             (std::lower_bound(exceptions,
+                               exceptions + key_pfor_.NumException(), value) -
+              exceptions);
+    }
+    case SKIPDELTA:
+      return key_skip_delta_.LowerBound(value);
+    default:
+      return geq_packed(key_data_, num_entry_, bit_width_, value);
+  }
 }
 
 int32_t VertSection::Find(uint32_t target) {
   //  sboost::SortedBitpack sbp(bit_width_, target - start_value_);
   //  return sbp.equal(keys_data_, num_entry_);
   assert(target >= start_value_);
-  return eq_packed(key_data_, num_entry_, bit_width_, target - start_value_);
+  auto value = target - start_value_;
+  switch (key_enc_) {
+    case PFOR: {
+      auto num_packed = num_entry_ - key_pfor_.NumException();
+      if ((uint64_t)value >> bit_width_ == 0) {
+        return num_packed == 0
+                   ? -1
+                   : eq_packed(key_data_, num_packed, bit_width_, value);
+      }
+      auto index = LowerBound(value);
+      if (index < num_entry_ &&
+          key_pfor_.ExceptionValues()[index - num_packed] == value) {
+        return index;
+      }
+      return -1;
+    }
+    case SKIPDELTA: {
+      auto index = key_skip_delta_.LowerBound(value);
+      if (index < num_entry_ && key_skip_delta_.At(index) == value) {
+        return index;
+      }
+      return -1;
+    }
+    default:
+      return eq_packed(key_data_, num_entry_, bit_width_, value);
+  }
+}
+
+uint64_t VertSection::SeqAt(uint32_t index) {
+  switch (seq_enc_) {
+    case BITPACK:
+      return seq_bitpack_.At(index);
+    case DELTA: {
+      // Delta values are accumulated from the beginning
+      encoding::u64::DeltaDecoder decoder;
+      decoder.Attach(seq_data_);
+      decoder.Skip(index);
+      return decoder.DecodeU64();
+    }
+    default:
+      return seq_plain_.At(index);
+  }
+}
+
+uint32_t VertSection::FindVersion(uint32_t target, uint64_t seq) {
+  if (target < start_value_) {
+    return 0;
+  }
+  auto value = target - start_value_;
+  uint32_t begin = LowerBound(value);
+  uint32_t end =
+      value == UINT32_MAX ? num_entry_ : std::max(begin, LowerBound(value + 1));
+  if (begin == end) {
+    return begin;
+  }
+  if (seq_enc_ == DELTA) {
+    // Delta values are accumulated from the beginning, scan the run
+    encoding::u64::DeltaDecoder decoder;
+    decoder.Attach(seq_data_);
+    decoder.Skip(begin);
+    while (begin < end && decoder.DecodeU64() > seq) {
+      begin++;
+    }
+    return begin;
+  }
+  // Binary search in the run for the first sequence at most seq
+  while (begin < end) {
+    auto current = begin + (end - begin) / 2;
+    if (SeqAt(current) > seq) {
+      begin = current + 1;
+    } else {
+      end = current;
+    }
+  }
+  return begin;
 }
 
 int32_t VertSection::FindStart(uint32_t target) {
   if (target <= start_value_) {
     return 0;
   }
-  // TODO Test the performance of sboost and plain
-  //  sboost::SortedBitpack sbp(bit_width_, target - start_value_);
-  //  return sbp.geq(key_data_, num_entry_);
-  auto index =
-      geq_packed(key_data_, num_entry_, bit_width_, target - start_value_);
+  auto index = LowerBound(target - start_value_);
   if (index >= num_entry_) {
     return -1;
   }
   return index;
 }
 
+namespace {
+// Sections are large with a decoder for each encoding, the iterators of all
+// blocks share a pool of them
+steal_pool<VertSection>* SectionPool() {
+  static NoDestructor<steal_pool<VertSection>> pool(
+      16, []() { return new VertSection(); });
+  return pool.get();
+}
+}  // namespace
+
 VertBlockCore::VertBlockCore(const BlockContents& data)
     : raw_data_((uint8_t*)data.data.data()),
       size_(data.data.size()),
       owned_(data.heap_allocated) {
-
+  key_format_ = *((uint32_t*)(raw_data_ + size_ - 4)) == MAGIC_STRING_KEY
+                    ? kVertStringKey
+                    : kVertIntKey;
   auto meta_size = *((uint32_t*)(raw_data_ + size_-8));
-  meta_.Read(raw_data_+size_-8-meta_size);
+  meta_.Read(raw_data_ + size_ - 8 - meta_size, meta_size);
   content_data_ = raw_data_;
 }
 
+bool VertBlockCore::KeyMayMatch(const Slice& internal_key) const {
+  if (!meta_.HasFilter()) {
+    return true;
+  }
+  Slice user_key = ExtractUserKey(internal_key);
+  uint32_t code = key_format_ == kVertStringKey
+                      ? KeyPrefixCode(user_key)
+                      : *reinterpret_cast<const uint32_t*>(user_key.data());
+  return meta_.MayContain(code);
+}
+
+Status VertBlockCore::Get(const Comparator* comparator,
+                          const Slice& internal_key, void* arg,
+                          void (*handle_result)(void*, const Slice&,
+                                                const Slice&)) {
+  if (key_format_ == kVertStringKey) {
+    return BlockCore::Get(comparator, internal_key, arg, handle_result);
+  }
+  uint32_t target = *reinterpret_cast<const uint32_t*>(internal_key.data());
+  uint64_t seq = internal_key.size() >= 12
+                     ? DecodeFixed64(internal_key.data() + 4) >> 8
+                     : kMaxSequenceNumber;
+
+  // Same search as VIter::Seek
+  auto section = SectionPool()->get();
+  uint32_t section_index = meta_.Search(target > 0 ? target - 1 : 0);
+  uint32_t entry_index;
+  while (true) {
+    if (!meta_.HasFilter() || target <= meta_.SectionMax(section_index)) {
+      section->Read(content_data_ + meta_.SectionOffset(section_index),
+                    key_format_);
+      entry_index = section->FindVersion(target, seq);
+      if (entry_index < section->NumEntry()) {
+        break;
+      }
+    }
+    if (section_index >= meta_.NumSection() - 1) {
+      return Status::OK();
+    }
+    section_index++;
+  }
+
+  // The decoders are at the start of the section after Read
+  section->KeyDecoder()->Skip(entry_index);
+  section->SeqDecoder()->Skip(entry_index);
+  section->TypeDecoder()->Skip(entry_index);
+  section->ValueDecoder()->Skip(entry_index);
+  char key_buffer[12];
+  EncodeFixed32(key_buffer,
+                section->StartValue() + section->KeyDecoder()->DecodeU32());
+  uint64_t entry_seq = section->SeqDecoder()->DecodeU64();
+  EncodeFixed64(key_buffer + 4,
+                (entry_seq << 8) + section->TypeDecoder()->DecodeU8());
+  (*handle_result)(arg, Slice(key_buffer, 12),
+                   section->ValueDecoder()->Decode());
+  return Status::OK();
+}
+
+Status VertBlockCore::ReadColumns(uint32_t run, BlockColumns* columns) {
+  if (key_format_ == kVertStringKey) {
+    return Status::NotSupported("Block keys are not int keys");
+  }
+  auto section = SectionPool()->get();
+  section->Read(content_data_ + meta_.SectionOffset(run), key_format_);
+  uint32_t num_entry = section->NumEntry();
+  columns->clear();
+  columns->keys.resize(num_entry);
+  columns->seqs.resize(num_entry);
+  columns->types.resize(num_entry);
+  columns->values.resize(num_entry);
+  section->KeyDecoder()->DecodeBatch(columns->keys.data(), num_entry);
+  for (auto& key : columns->keys) {
+    key += section->StartValue();
+  }
+  section->SeqDecoder()->DecodeBatch(columns->seqs.data(), num_entry);
+  section->TypeDecoder()->DecodeBatch(columns->types.data(), num_entry);
+  section->ValueDecoder()->DecodeBatch(columns->values.data(), num_entry);
+  if (section->ValueEncoding() == FSST && num_entry > 0) {
+    // Decoded into the section, which goes back to the pool. The values
+    // are contiguous, copy them at once.
+    auto begin = columns->values[0].data();
+    auto end = columns->values.back().data() + columns->values.back().size();
+    columns->value_buffer.assign(begin, end - begin);
+    for (auto& value : columns->values) {
+      value = Slice(columns->value_buffer.data() + (value.data() - begin),
+                    value.size());
+    }
+  }
+  return Status::OK();
+}
+
 VertBlockCore::~VertBlockCore() {
   if (owned_) {
     delete[] raw_data_;
@@ -257,92 +547,245 @@ VertBlockCore::~VertBlockCore() {
 
 class VertBlockCore::VIter : public Iterator {
  private:
+  // Number of entries decoded at a time when scanning
+  static const uint32_t kBatchSize = 64;
+  // Number of entries decoded after a seek, one bit-packed group
+  static const uint32_t kSeekBatchSize = 8;
+
   const Comparator* const comparator_;
   VertBlockMeta& meta_;
   const uint8_t* data_pointer_;
+  const VertKeyFormat key_format_;
 
   uint32_t section_index_ = -1;
-  VertSection section_;
+  // Taken from the pool, the decoders are reused across iterators
+  steal_pool<VertSection>::handle section_;
   uint32_t entry_index_ = -1;
 
+  // Decoded entries [batch_start_, batch_start_ + batch_size_) of the
+  // section. The decoders are positioned right after the batch, except the
+  // value decoder.
+  uint32_t batch_start_ = 0;
+  uint32_t batch_size_ = 0;
+  uint32_t keys_[kBatchSize];
+  uint64_t seqs_[kBatchSize];
+  uint8_t types_[kBatchSize];
+  Slice suffixes_[kBatchSize];
+
+  // Values are only decoded when value() is called. Values of entries
+  // [value_begin_, value_end_) in current batch are held in values_, and
+  // the value decoder is positioned at value_cursor_.
+  Decoder* value_decoder_;
+  mutable uint32_t value_cursor_ = 0;
+  mutable uint32_t value_begin_ = 0;
+  mutable uint32_t value_end_ = 0;
+  mutable Slice values_[kBatchSize];
+
   char key_buffer_[12];
+  // Keys restored from prefix code and suffix
+  std::string key_string_;
   Slice key_;
-  Slice value_;
 
   Status status_;
 
   void ReadSection(int sec_index) {
     section_index_ = sec_index;
-    section_.Read(data_pointer_ + meta_.SectionOffset(section_index_));
+    section_->Read(data_pointer_ + meta_.SectionOffset(section_index_),
+                  key_format_);
+    batch_start_ = 0;
+    batch_size_ = 0;
+    value_decoder_ = section_->ValueDecoder();
+    value_cursor_ = 0;
+    value_begin_ = 0;
+    value_end_ = 0;
   }
 
-  void ReadKeyValue() {
-    // Seek to the position, extract the keys and values
-    section_.KeyDecoder()->Skip(entry_index_);
-    section_.SeqDecoder()->Skip(entry_index_);
-    section_.TypeDecoder()->Skip(entry_index_);
-    section_.ValueDecoder()->Skip(entry_index_);
-    ComposeKeyValue();
+  void LoadBatch(uint32_t start, uint32_t size) {
+    // Move the decoders from the end of current batch to start
+    uint32_t cursor = batch_start_ + batch_size_;
+    if (start >= cursor) {
+      auto offset = start - cursor;
+      section_->KeyDecoder()->Skip(offset);
+      section_->SeqDecoder()->Skip(offset);
+      section_->TypeDecoder()->Skip(offset);
+      if (key_format_ == kVertStringKey) {
+        section_->SuffixDecoder()->Skip(offset);
+      }
+    } else {
+      auto offset = cursor - start;
+      section_->KeyDecoder()->SkipBack(offset);
+      section_->SeqDecoder()->SkipBack(offset);
+      section_->TypeDecoder()->SkipBack(offset);
+      if (key_format_ == kVertStringKey) {
+        section_->SuffixDecoder()->SkipBack(offset);
+      }
+    }
+    batch_start_ = start;
+    batch_size_ = std::min(size, section_->NumEntry() - start);
+    section_->KeyDecoder()->DecodeBatch(keys_, batch_size_);
+    section_->SeqDecoder()->DecodeBatch(seqs_, batch_size_);
+    section_->TypeDecoder()->DecodeBatch(types_, batch_size_);
+    value_begin_ = start;
+    value_end_ = start;
+    if (key_format_ == kVertStringKey) {
+      section_->SuffixDecoder()->DecodeBatch(suffixes_, batch_size_);
+    }
+  }
+
+  // Load a batch ending at entry_index_
+  void LoadBatchBackward() {
+    auto end = entry_index_ + 1;
+    LoadBatch(end > kBatchSize ? end - kBatchSize : 0, kBatchSize);
   }
 
   void ComposeKeyValue() {
-    *((uint32_t*)key_buffer_) =
-        section_.StartValue() + section_.KeyDecoder()->DecodeU32();
-    auto seq = section_.SeqDecoder()->DecodeU64();
-    auto type = section_.TypeDecoder()->DecodeU8();
-    EncodeFixed64(key_buffer_ + 4, (seq << 8) + type);
-    value_ = section_.ValueDecoder()->Decode();
+    auto offset = entry_index_ - batch_start_;
+    if (key_format_ == kVertStringKey) {
+      DecodeStringKey(section_->StartValue() + keys_[offset], suffixes_[offset],
+                      &key_string_);
+      PutFixed64(&key_string_, (seqs_[offset] << 8) + types_[offset]);
+      key_ = Slice(key_string_);
+    } else {
+      *((uint32_t*)key_buffer_) = section_->StartValue() + keys_[offset];
+      EncodeFixed64(key_buffer_ + 4, (seqs_[offset] << 8) + types_[offset]);
+    }
+  }
+
+  // Decode the values from current entry to the end of the batch, or from
+  // the start of the batch to current entry when moving backward. Entries
+  // skipped by the caller are passed over with the decoder's Skip.
+  void LoadValues() const {
+    uint32_t begin = entry_index_;
+    uint32_t end = batch_start_ + batch_size_;
+    if (entry_index_ < value_begin_) {
+      begin = batch_start_;
+      end = entry_index_ + 1;
+    }
+    if (begin >= value_cursor_) {
+      value_decoder_->Skip(begin - value_cursor_);
+    } else {
+      value_decoder_->SkipBack(value_cursor_ - begin);
+    }
+    value_decoder_->DecodeBatch(values_ + (begin - batch_start_), end - begin);
+    value_cursor_ = end;
+    value_begin_ = begin;
+    value_end_ = end;
+  }
+
+  void Invalidate() {
+    section_index_ = meta_.NumSection();
+    entry_index_ = section_->NumEntry();
+  }
+
+  // Whether current entry is ordered before the internal key of user_key and
+  // tag, versions of a key are ordered by tag descending
+  bool EntryBefore(const Slice& user_key, uint64_t tag) const {
+    int r = ExtractUserKey(key_).compare(user_key);
+    return r < 0 ||
+           (r == 0 && DecodeFixed64(key_.data() + key_.size() - 8) > tag);
+  }
+
+  // Coarse search on the prefix codes, then compare the suffix of entries
+  // sharing the code with the target
+  void SeekString(const Slice& target) {
+    Slice user_key = ExtractUserKey(target);
+    uint32_t code = KeyPrefixCode(user_key);
+
+    // Entries with the same code may start in the previous section
+    ReadSection(code > 0 ? meta_.Search(code - 1) : 0);
+
+    int32_t start = section_->FindStart(code);
+    if (start == -1) {
+      if (section_index_ < meta_.NumSection() - 1) {
+        ReadSection(section_index_ + 1);
+        start = 0;
+      } else {
+        status_ = Status::NotFound(target);
+        return;
+      }
+    }
+    entry_index_ = start;
+    LoadBatch(entry_index_, kSeekBatchSize);
+    ComposeKeyValue();
+    // Also pass over the versions newer than the target
+    uint64_t tag = DecodeFixed64(target.data() + target.size() - 8);
+    while (EntryBefore(user_key, tag)) {
+      Next();
+      if (!Valid()) {
+        status_ = Status::NotFound(target);
+        return;
+      }
+    }
   }
 
  public:
-  VIter(const Comparator* comparator, VertBlockMeta& meta, const uint8_t* data)
+  VIter(const Comparator* comparator, VertBlockMeta& meta, const uint8_t* data,
+        VertKeyFormat key_format)
       : comparator_(comparator),
         meta_(meta),
         data_pointer_(data),
+        key_format_(key_format),
+        section_(SectionPool()->get()),
         key_(key_buffer_, 12) {
 //    ReadSection(0);
   }
 
   void Seek(const Slice& target) override {
-    // Scan through blocks
-    int32_t target_key = *reinterpret_cast<const int32_t*>(target.data());
-
-    auto new_section_index = meta_.Search(target_key);
-    if (new_section_index != section_index_) {
-      ReadSection(new_section_index);
+    if (key_format_ == kVertStringKey) {
+      SeekString(target);
+      return;
     }
-
-    entry_index_ = section_.FindStart(target_key);
-    if (entry_index_ == -1) {
-      // Not found in current section
-      // If there is next section, move to the beginning of next section
-      // Otherwise not found
-      if (section_index_ < meta_.NumSection() - 1) {
-        ReadSection(section_index_ + 1);
-        entry_index_ = 0;
-      } else {
+    uint32_t target_key = *reinterpret_cast<const uint32_t*>(target.data());
+    // A bare user key seeks to its newest version
+    uint64_t seq = target.size() >= 12
+                       ? DecodeFixed64(target.data() + 4) >> 8
+                       : kMaxSequenceNumber;
+
+    // Versions of the target may start in the section before the one
+    // starting with it, and spill over to the following ones
+    uint32_t section = meta_.Search(target_key > 0 ? target_key - 1 : 0);
+    while (true) {
+      // With a filter, sections whose keys are all smaller are not read
+      if (!meta_.HasFilter() || target_key <= meta_.SectionMax(section)) {
+        // Always reload the section, the decoders may have been moved by
+        // previous operations
+        ReadSection(section);
+        entry_index_ = section_->FindVersion(target_key, seq);
+        if (entry_index_ < section_->NumEntry()) {
+          break;
+        }
+      }
+      if (section >= meta_.NumSection() - 1) {
+        // Not found
+        section_index_ = section;
+        entry_index_ = -1;
         status_ = Status::NotFound(target);
         return;
       }
+      section++;
     }
-    ReadKeyValue();
+    // A seek is usually followed by few reads, only decode a small batch
+    LoadBatch(entry_index_, kSeekBatchSize);
+    ComposeKeyValue();
   }
 
   void SeekToFirst() override {
     ReadSection(0);
     entry_index_ = 0;
-    ReadKeyValue();
+    LoadBatch(entry_index_, kBatchSize);
+    ComposeKeyValue();
   }
 
   void SeekToLast() override {
     ReadSection(meta_.NumSection() - 1);
-    entry_index_ = section_.NumEntry() - 1;
-    ReadKeyValue();
+    entry_index_ = section_->NumEntry() - 1;
+    LoadBatchBackward();
+    ComposeKeyValue();
   }
 
   void Next() override {
     entry_index_++;
-    if (entry_index_ >= section_.NumEntry()) {
+    if (entry_index_ >= section_->NumEntry()) {
       if (section_index_ < meta_.NumSection() - 1) {
         ReadSection(section_index_ + 1);
         entry_index_ = 0;
@@ -352,29 +795,50 @@ class VertBlockCore::VIter : public Iterator {
         return;
       }
     }
+    if (entry_index_ >= batch_start_ + batch_size_) {
+      LoadBatch(entry_index_, kBatchSize);
+    }
     ComposeKeyValue();
   }
 
   void Prev() override {
-    // Not supported
-    status_ = Status::NotSupported(Slice("Prev Not Supported"));
-    assert(false);
+    if (entry_index_ > 0) {
+      entry_index_--;
+    } else if (section_index_ > 0 && section_index_ < meta_.NumSection()) {
+      // Step back to the last entry of previous section
+      ReadSection(section_index_ - 1);
+      entry_index_ = section_->NumEntry() - 1;
+    } else {
+      // No more element
+      Invalidate();
+      return;
+    }
+    if (entry_index_ < batch_start_ ||
+        entry_index_ >= batch_start_ + batch_size_) {
+      LoadBatchBackward();
+    }
+    ComposeKeyValue();
   }
 
   bool Valid() const override {
-    return entry_index_ < section_.NumEntry() ||
+    return entry_index_ < section_->NumEntry() ||
            section_index_ < meta_.NumSection() - 1;
   }
 
   Slice key() const override { return key_; }
 
-  Slice value() const override { return value_; }
+  Slice value() const override {
+    if (entry_index_ < value_begin_ || entry_index_ >= value_end_) {
+      LoadValues();
+    }
+    return values_[entry_index_ - batch_start_];
+  }
 
   Status status() const override { return status_; }
 };
 
 Iterator* VertBlockCore::NewIterator(const Comparator* comparator) {
-  return new VIter(comparator, meta_, content_data_);
+  return new VIter(comparator, meta_, content_data_, key_format_);
 }
 
 }  // namespace colsm
\ No newline at end of file
@@ -5,11 +5,13 @@
 #ifndef LEVELDB_VERT_BLOCK_H
 #define LEVELDB_VERT_BLOCK_H
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <vector>
 
 #include "leveldb/iterator.h"
+#include "leveldb/options.h"
 #include "leveldb/slice.h"
 
 #include "table/block.h"
@@ -22,22 +24,79 @@ namespace colsm {
 using namespace encoding;
 
 const uint32_t MAGIC = 0xCAAEDADE;
+// Vertical blocks with byte-string keys
+const uint32_t MAGIC_STRING_KEY = 0xCAAEDADF;
+
+inline bool IsVertBlock(uint32_t magic) {
+  return magic == MAGIC || magic == MAGIC_STRING_KEY;
+}
+
+// Number of leading key bytes kept in the prefix code of a string key
+const uint32_t kKeyPrefixSize = 3;
+
+/**
+ * Order-preserving code of a byte-string key: the first 3 bytes in
+ * big-endian, zero padded, followed by min(length, 3). Keys with the same
+ * code are ordered by their suffix, the bytes after the first 3.
+ */
+inline uint32_t KeyPrefixCode(const Slice& key) {
+  uint32_t code = 0;
+  uint32_t prefix = std::min<size_t>(key.size(), kKeyPrefixSize);
+  for (uint32_t i = 0; i < kKeyPrefixSize; ++i) {
+    code = (code << 8) | (i < prefix ? (uint8_t)key[i] : 0);
+  }
+  return (code << 8) | prefix;
+}
+
+inline Slice KeySuffix(const Slice& key) {
+  auto prefix = std::min<size_t>(key.size(), kKeyPrefixSize);
+  return Slice(key.data() + prefix, key.size() - prefix);
+}
+
+// Restore the key from its prefix code and suffix
+inline void DecodeStringKey(uint32_t code, const Slice& suffix,
+                            std::string* key) {
+  key->clear();
+  auto prefix = code & 0xFF;
+  for (uint32_t i = 0; i < prefix; ++i) {
+    key->push_back((char)(code >> (24 - 8 * i)));
+  }
+  key->append(suffix.data(), suffix.size());
+}
 
 class VertBlockMeta {
  protected:
   uint32_t num_section_;
-  // Section offsets
-  std::vector<uint64_t> offsets_;
+  // Section offsets, read in place from the block
+  const uint64_t* offsets_;
   uint32_t start_min_;
   uint8_t start_bitwidth_;
   uint8_t* starts_;
 
+  // Used when building the meta
+  std::vector<uint64_t> offsets_plain_;
   std::vector<uint32_t> starts_plain_;
 
+  // Optional sidecar with the max key and a bloom filter of each section,
+  // num_probe_ is 0 when the block has none
+  uint8_t num_probe_;
+  uint32_t filter_words_;
+  const uint32_t* maxes_;
+  const uint64_t* filters_;
+
+  std::vector<uint32_t> maxes_plain_;
+  std::vector<uint64_t> filters_plain_;
+
   uint32_t BitPackSize() const {
     return (start_bitwidth_ * num_section_ + 63) >> 6 << 3;
   }
 
+  uint32_t FilterSize() const {
+    return num_probe_ == 0
+               ? 0
+               : 5 + num_section_ * 4 + num_section_ * filter_words_ * 8;
+  }
+
  public:
   VertBlockMeta();
 
@@ -47,13 +106,36 @@ class VertBlockMeta {
 
   uint32_t NumSection() const { return num_section_; }
 
-  uint32_t SectionOffset(uint32_t);
+  uint64_t SectionOffset(uint32_t sec_index) const {
+    return offsets_[sec_index];
+  }
+
+  /**
+   * Keep a max key and a bloom filter of the given bits per key for each
+   * section added later. All sections but the last have section_limit keys.
+   */
+  void EnableFilter(uint32_t bits_per_key, uint32_t section_limit);
+
+  bool HasFilter() const { return num_probe_ != 0; }
+
+  // Requires HasFilter()
+  uint32_t SectionMax(uint32_t sec_index) const { return maxes_[sec_index]; }
+
+  /**
+   * Check the section max and bloom filter for the value
+   * @return false if no section contains the value, true if there is no
+   * filter
+   */
+  bool MayContain(uint32_t value) const;
 
   /**
-   * Read the metadata from the given buffer location.
+   * Read the metadata from the given buffer location. Nothing is copied,
+   * the buffer should be live while the meta is used.
+   * @param size size of the metadata, the filter sidecar is only read when
+   * given
    * @return the bytes read
    */
-  uint32_t Read(const uint8_t*);
+  uint32_t Read(const uint8_t*, uint32_t size = 0);
 
   /**
    * Write metadata to the buffer
@@ -70,6 +152,12 @@ class VertBlockMeta {
    */
   void AddSection(uint64_t offset, uint32_t start_value);
 
+  /**
+   * Add a section with its keys, which go to the filter if enabled
+   * @param keys sorted values in the key column of the section
+   */
+  void AddSection(uint64_t offset, const std::vector<uint32_t>& keys);
+
   void Finish();
 
   /**
@@ -78,7 +166,7 @@ class VertBlockMeta {
    * @return index of the section,
    * -1 if not in range
    */
-  int32_t Search(uint32_t value);
+  int32_t Search(uint32_t value) const;
 };
 
 class VertSection {
@@ -87,18 +175,45 @@ class VertSection {
   uint32_t num_entry_;
   uint32_t start_value_;
 
-  // For fast lookup on key_data
+  // For fast lookup on key_data, the bit-packed part of BITPACK and PFOR
+  // key columns
+  EncodingType key_enc_;
   const uint8_t* key_data_;
   uint8_t bit_width_;
 
-//  std::shared_ptr<Decoder> key_decoder_;
-//  std::shared_ptr<Decoder> seq_decoder_;
-//  std::shared_ptr<Decoder> type_decoder_;
-//  std::shared_ptr<Decoder> value_decoder_;
-  encoding::u32::BitpackDecoder key_decoder_;
-  encoding::u64::PlainDecoder seq_decoder_;
-  encoding::u8::RleDecoder type_decoder_;
-  encoding::string::LengthDecoder value_decoder_;
+  EncodingType seq_enc_;
+  const uint8_t* seq_data_;
+
+  EncodingType value_enc_;
+
+  // Decoders for each encoding a column may use, the one recorded in the
+  // section header is picked when reading the section
+  encoding::u32::BitpackDecoder key_bitpack_;
+  encoding::u32::PforDecoder key_pfor_;
+  encoding::u32::SkipDeltaDecoder key_skip_delta_;
+  encoding::u64::PlainDecoder seq_plain_;
+  encoding::u64::BitpackDecoder seq_bitpack_;
+  encoding::u64::DeltaDecoder seq_delta_;
+  encoding::u8::RleDecoder type_rle_;
+  encoding::u8::PlainDecoder type_plain_;
+  encoding::u8::RleVarIntDecoder type_rle_varint_;
+  encoding::string::LengthDecoder value_length_;
+  encoding::string::PlainDecoder value_plain_;
+  encoding::string::DictionaryDecoder value_dictionary_;
+  encoding::string::FsstDecoder value_fsst_;
+
+  Decoder* key_decoder_;
+  Decoder* seq_decoder_;
+  Decoder* type_decoder_;
+  Decoder* value_decoder_;
+  // Only used with string keys
+  encoding::string::LengthDecoder suffix_decoder_;
+
+  // Index of the first key larger or equal to value - start_value
+  uint32_t LowerBound(uint32_t value);
+
+  // Sequence of the entry at index, without moving the seq decoder
+  uint64_t SeqAt(uint32_t index);
 
  public:
   VertSection();
@@ -113,17 +228,20 @@ class VertSection {
 
   const uint8_t* KeysData() { return key_data_; }
 
+  EncodingType ValueEncoding() const { return value_enc_; }
+
   /**
    * Expose Decoder for iterator operations
    *
    * @return
    */
-  Decoder* KeyDecoder() { return &key_decoder_; }
-  Decoder* SeqDecoder() { return &seq_decoder_; }
-  Decoder* TypeDecoder() { return &type_decoder_; }
-  Decoder* ValueDecoder() { return &value_decoder_; }
+  Decoder* KeyDecoder() { return key_decoder_; }
+  Decoder* SeqDecoder() { return seq_decoder_; }
+  Decoder* TypeDecoder() { return type_decoder_; }
+  Decoder* ValueDecoder() { return value_decoder_; }
+  Decoder* SuffixDecoder() { return &suffix_decoder_; }
 
-  void Read(const uint8_t*);
+  void Read(const uint8_t*, VertKeyFormat key_format = kVertIntKey);
 
   /**
    * Find target in the section
@@ -138,6 +256,15 @@ class VertSection {
    * @return -1 if not found
    */
   int32_t FindStart(uint32_t target);
+
+  /**
+   * Versions of a key are stored in a run ordered by sequence descending.
+   * Find the first entry of the target's run with a sequence at most seq,
+   * i.e. the newest version visible at seq.
+   * @return index of the entry, or of the first entry after the run.
+   * NumEntry() if there is none in the section.
+   */
+  uint32_t FindVersion(uint32_t target, uint64_t seq);
 };
 
 class VertBlockCore : public BlockCore {
@@ -155,6 +282,21 @@ class VertBlockCore : public BlockCore {
 
   Iterator* NewIterator(const Comparator* comparator);
 
+  // Check the section max and filter with the prefix code of the key
+  bool KeyMayMatch(const Slice& internal_key) const override;
+
+  // With int keys, decode the entry found in a pooled section without
+  // building an iterator
+  Status Get(const Comparator* comparator, const Slice& internal_key,
+             void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&)) override;
+
+  // Each section is a run
+  uint32_t NumRun() const override { return meta_.NumSection(); }
+
+  // Decode all columns of a section at once, only with int keys
+  Status ReadColumns(uint32_t run, BlockColumns* columns) override;
+
  private:
   class VIter;
 
@@ -164,6 +306,7 @@ class VertBlockCore : public BlockCore {
 
   VertBlockMeta meta_;
   const uint8_t* content_data_;
+  VertKeyFormat key_format_;
 };
 }  // namespace colsm
 
@@ -4,48 +4,238 @@
 
 #include "vert_block_builder.h"
 
+#include <algorithm>
+
 #include "db/dbformat.h"
 
 #include "table/format.h"
+#include "util/coding.h"
 
 namespace colsm {
 
-VertSectionBuilder::VertSectionBuilder(EncodingType enc_type)
-    : num_entry_(0), value_enc_type_(enc_type) {
+namespace {
+// Pick from candidates ordered by decoding speed. A slower encoding has to be
+// smaller by more than sizes >> slack (and at least 8 bytes) to be picked.
+int PickEncoding(const uint32_t* sizes, int num_candidate, int slack = 3) {
+  int picked = 0;
+  for (int i = 1; i < num_candidate; ++i) {
+    if ((uint64_t)sizes[i] + std::max<uint32_t>(sizes[i] >> slack, 8) <
+        sizes[picked]) {
+      picked = i;
+    }
+  }
+  return picked;
+}
+}  // namespace
+
+VertSectionBuilder::VertSectionBuilder(EncodingType enc_type,
+                                       VertKeyFormat key_format,
+                                       bool value_compression)
+    : num_entry_(0),
+      value_base_type_(enc_type),
+      key_format_(key_format),
+      value_compression_(value_compression) {
   Encoding& encoding = string::EncodingFactory::Get(enc_type);
-  value_encoder_ = encoding.encoder();
+  value_base_ = encoding.encoder();
 }
 
 void VertSectionBuilder::Open(uint32_t sv) {
   start_value_ = sv;
   num_entry_ = 0;
-  key_encoder_.Open();
-  seq_encoder_.Open();
-  type_encoder_.Open();
-  value_encoder_->Open();
+  key_bitpack_.Open();
+  key_pfor_.Open();
+  key_skip_delta_.Open();
+  seq_plain_.Open();
+  seq_bitpack_.Open();
+  seq_delta_.Open();
+  type_rle_.Open();
+  type_plain_.Open();
+  type_rle_varint_.Open();
+  seq_min_ = UINT64_MAX;
+  seq_max_ = 0;
+  value_base_->Open();
+  if (value_compression_) {
+    value_dictionary_.Open();
+    value_fsst_.Open();
+  }
+  suffix_encoder_.Open();
+}
+
+uint32_t VertSectionBuilder::KeyCode(const Slice& user_key) const {
+  if (key_format_ == kVertStringKey) {
+    return KeyPrefixCode(user_key);
+  }
+  return *reinterpret_cast<const uint32_t*>(user_key.data());
 }
 
 void VertSectionBuilder::Reset() { num_entry_ = 0; }
 
 void VertSectionBuilder::Add(ParsedInternalKey key, const Slice& value) {
+  Add(KeyCode(key.user_key), key.sequence, key.type, value);
+  if (key_format_ == kVertStringKey) {
+    suffix_encoder_.Encode(KeySuffix(key.user_key));
+  }
+}
+
+void VertSectionBuilder::Add(uint32_t key_code, uint64_t seq, uint8_t type,
+                             const Slice& value) {
   num_entry_++;
 
-  key_encoder_.Encode((*(uint32_t*)(key.user_key.data()) - start_value_));
-  seq_encoder_.Encode(key.sequence);
-  type_encoder_.Encode((uint8_t)key.type);
-  value_encoder_->Encode(value);
+  auto key_value = key_code - start_value_;
+  key_bitpack_.Encode(key_value);
+  key_pfor_.Encode(key_value);
+  key_skip_delta_.Encode(key_value);
+  seq_plain_.Encode(seq);
+  seq_bitpack_.Encode(seq);
+  seq_delta_.Encode(seq);
+  seq_min_ = std::min(seq_min_, seq);
+  seq_max_ = std::max(seq_max_, seq);
+  type_rle_.Encode(type);
+  type_plain_.Encode(type);
+  type_rle_varint_.Encode(type);
+  value_base_->Encode(value);
+  if (value_compression_) {
+    value_dictionary_.Encode(value);
+    value_fsst_.Encode(value);
+  }
+}
+
+EncodingType VertSectionBuilder::PickKeyEncoding(uint32_t* size) const {
+  static const EncodingType types[] = {BITPACK, PFOR, SKIPDELTA};
+  uint32_t sizes[] = {key_bitpack_.EstimateSize(), key_pfor_.EstimateSize(),
+                      key_skip_delta_.EstimateSize()};
+  // Keys are searched on every lookup, only leave bit-packing for a large gain
+  auto picked = PickEncoding(sizes, 3, 1);
+  *size = sizes[picked];
+  return types[picked];
+}
+
+EncodingType VertSectionBuilder::PickSeqEncoding(uint32_t* size) const {
+  static const EncodingType types[] = {PLAIN, BITPACK, DELTA};
+  uint32_t sizes[] = {seq_plain_.EstimateSize(), seq_bitpack_.EstimateSize(),
+                      seq_delta_.EstimateSize()};
+  // Bit-packing supports up to 31 bits of range, and needs at least 1 bit
+  auto range = seq_max_ - seq_min_;
+  if (range == 0 || range >= (1u << 31)) {
+    sizes[1] = UINT32_MAX;
+  }
+  auto picked = PickEncoding(sizes, 3);
+  *size = sizes[picked];
+  return types[picked];
+}
+
+EncodingType VertSectionBuilder::PickTypeEncoding(uint32_t* size) const {
+  // u8 BITPACK is the var-int RLE, see u8::EncodingFactory
+  static const EncodingType types[] = {RUNLENGTH, PLAIN, BITPACK};
+  uint32_t sizes[] = {type_rle_.EstimateSize(), type_plain_.EstimateSize(),
+                      type_rle_varint_.EstimateSize()};
+  auto picked = PickEncoding(sizes, 3);
+  *size = sizes[picked];
+  return types[picked];
+}
+
+EncodingType VertSectionBuilder::PickValueEncoding(uint32_t* size) const {
+  EncodingType types[] = {value_base_type_, DICTIONARY, FSST};
+  uint32_t sizes[] = {value_base_->EstimateSize(), 0, 0};
+  int picked = 0;
+  if (value_compression_) {
+    // Before Close, FSST estimates the values without compression
+    sizes[1] = value_dictionary_.EstimateSize();
+    sizes[2] = value_fsst_.EstimateSize();
+    picked = PickEncoding(sizes, 3);
+  }
+  *size = sizes[picked];
+  return types[picked];
+}
+
+Encoder* VertSectionBuilder::KeyEncoder(EncodingType type) {
+  switch (type) {
+    case PFOR:
+      return &key_pfor_;
+    case SKIPDELTA:
+      return &key_skip_delta_;
+    default:
+      return &key_bitpack_;
+  }
+}
+
+Encoder* VertSectionBuilder::SeqEncoder(EncodingType type) {
+  switch (type) {
+    case BITPACK:
+      return &seq_bitpack_;
+    case DELTA:
+      return &seq_delta_;
+    default:
+      return &seq_plain_;
+  }
+}
+
+Encoder* VertSectionBuilder::TypeEncoder(EncodingType type) {
+  switch (type) {
+    case PLAIN:
+      return &type_plain_;
+    case BITPACK:
+      return &type_rle_varint_;
+    default:
+      return &type_rle_;
+  }
+}
+
+Encoder* VertSectionBuilder::ValueEncoder(EncodingType type) {
+  if (type == value_base_type_) {
+    return value_base_.get();
+  }
+  switch (type) {
+    case DICTIONARY:
+      return &value_dictionary_;
+    case FSST:
+      return &value_fsst_;
+    default:
+      return value_base_.get();
+  }
 }
 
 uint32_t VertSectionBuilder::EstimateSize() const {
-  return 28 + key_encoder_.EstimateSize() + seq_encoder_.EstimateSize() +
-         type_encoder_.EstimateSize() + value_encoder_->EstimateSize();
+  uint32_t key_size;
+  uint32_t seq_size;
+  uint32_t type_size;
+  uint32_t value_size;
+  PickKeyEncoding(&key_size);
+  PickSeqEncoding(&seq_size);
+  PickTypeEncoding(&type_size);
+  PickValueEncoding(&value_size);
+  auto size = 28 + key_size + seq_size + type_size + value_size;
+  if (key_format_ == kVertStringKey) {
+    size += 5 + suffix_encoder_.EstimateSize();
+  }
+  return size;
 }
 
 void VertSectionBuilder::Close() {
-  key_encoder_.Close();
-  seq_encoder_.Close();
-  type_encoder_.Close();
-  value_encoder_->Close();
+  key_bitpack_.Close();
+  key_pfor_.Close();
+  key_skip_delta_.Close();
+  seq_plain_.Close();
+  seq_bitpack_.Close();
+  seq_delta_.Close();
+  type_rle_.Close();
+  type_plain_.Close();
+  type_rle_varint_.Close();
+  value_base_->Close();
+  if (value_compression_) {
+    value_dictionary_.Close();
+    value_fsst_.Close();
+  }
+  uint32_t size;
+  key_enc_type_ = PickKeyEncoding(&size);
+  key_encoder_ = KeyEncoder(key_enc_type_);
+  seq_enc_type_ = PickSeqEncoding(&size);
+  seq_encoder_ = SeqEncoder(seq_enc_type_);
+  type_enc_type_ = PickTypeEncoding(&size);
+  type_encoder_ = TypeEncoder(type_enc_type_);
+  value_enc_type_ = PickValueEncoding(&size);
+  value_encoder_ = ValueEncoder(value_enc_type_);
+  suffix_encoder_.Close();
 }
 
 void VertSectionBuilder::Dump(uint8_t* out) {
@@ -55,31 +245,42 @@ void VertSectionBuilder::Dump(uint8_t* out) {
   *reinterpret_cast<uint32_t*>(pointer) = start_value_;
   pointer += 4;
 
-  auto key_size = key_encoder_.EstimateSize();
-  auto seq_size = seq_encoder_.EstimateSize();
-  auto type_size = type_encoder_.EstimateSize();
+  auto key_size = key_encoder_->EstimateSize();
+  auto seq_size = seq_encoder_->EstimateSize();
+  auto type_size = type_encoder_->EstimateSize();
   auto value_size = value_encoder_->EstimateSize();
 
   *((uint32_t*)pointer) = key_size;
   pointer += 4;
-  *(pointer++) = BITPACK;
+  *(pointer++) = key_enc_type_;
   *((uint32_t*)pointer) = seq_size;
   pointer += 4;
-  *(pointer++) = PLAIN;
+  *(pointer++) = seq_enc_type_;
   *((uint32_t*)pointer) = type_size;
   pointer += 4;
-  *(pointer++) = RUNLENGTH;
+  *(pointer++) = type_enc_type_;
   *((uint32_t*)pointer) = value_size;
   pointer += 4;
   *(pointer++) = value_enc_type_;
+  uint32_t suffix_size = 0;
+  if (key_format_ == kVertStringKey) {
+    suffix_size = suffix_encoder_.EstimateSize();
+    *((uint32_t*)pointer) = suffix_size;
+    pointer += 4;
+    *(pointer++) = LENGTH;
+  }
 
-  key_encoder_.Dump(pointer);
+  key_encoder_->Dump(pointer);
   pointer += key_size;
-  seq_encoder_.Dump(pointer);
+  seq_encoder_->Dump(pointer);
   pointer += seq_size;
-  type_encoder_.Dump(pointer);
+  type_encoder_->Dump(pointer);
   pointer += type_size;
   value_encoder_->Dump(pointer);
+  if (key_format_ == kVertStringKey) {
+    pointer += value_size;
+    suffix_encoder_.Dump(pointer);
+  }
 }
 
 VertBlockBuilder::VertBlockBuilder(const Options* options,
@@ -87,22 +288,47 @@ VertBlockBuilder::VertBlockBuilder(const Options* options,
     : BlockBuilder(options),
       value_encoding_(value_encoding),
       section_limit_(options->section_limit),
-      current_section_(value_encoding),
-      offset_(0) {}
+      key_format_(options->vert_key_format),
+      current_section_(value_encoding, options->vert_key_format,
+                       options->vert_value_compression),
+      offset_(0) {
+  if (options->vert_section_filter_bits > 0) {
+    meta_.EnableFilter(options->vert_section_filter_bits, section_limit_);
+  }
+}
 
-// Assert the keys and values are both int32_t
 void VertBlockBuilder::Add(const Slice& key, const Slice& value) {
-  // Need to handle the internal key
+  if (key_format_ == kVertIntKey) {
+    // Int keys are the key code followed by the tag, no need to parse
+    uint64_t tag = DecodeFixed64(key.data() + 4);
+    Add(DecodeFixed32(key.data()), tag >> 8, tag & 0xff, value);
+    return;
+  }
   ParsedInternalKey internal_key;
   ParseInternalKey(key, &internal_key);
 
-  // write other parts of the internal key
+  uint32_t key_code = current_section_.KeyCode(internal_key.user_key);
   if (current_section_.NumEntry() == 0) {
-    uint32_t intkey =
-        *reinterpret_cast<const uint32_t*>(internal_key.user_key.data());
-    current_section_.Open(intkey);
+    current_section_.Open(key_code);
   }
   current_section_.Add(internal_key, value);
+  EndEntry(key_code);
+}
+
+void VertBlockBuilder::Add(uint32_t key, uint64_t seq, uint8_t type,
+                           const Slice& value) {
+  assert(key_format_ == kVertIntKey);
+  if (current_section_.NumEntry() == 0) {
+    current_section_.Open(key);
+  }
+  current_section_.Add(key, seq, type, value);
+  EndEntry(key);
+}
+
+void VertBlockBuilder::EndEntry(uint32_t key_code) {
+  if (meta_.HasFilter()) {
+    section_keys_.push_back(key_code);
+  }
   if (current_section_.NumEntry() >= section_limit_) {
     DumpSection();
   }
@@ -110,7 +336,12 @@ void VertBlockBuilder::Add(const Slice& key, const Slice& value) {
 
 void VertBlockBuilder::DumpSection() {
   current_section_.Close();
-  meta_.AddSection(offset_, current_section_.StartValue());
+  if (meta_.HasFilter()) {
+    meta_.AddSection(offset_, section_keys_);
+    section_keys_.clear();
+  } else {
+    meta_.AddSection(offset_, current_section_.StartValue());
+  }
   auto section_size = current_section_.EstimateSize();
   offset_ += section_size;
 
@@ -126,6 +357,7 @@ void VertBlockBuilder::Reset() {
   offset_ = 0;
   buffer_.clear();
   meta_.Reset();
+  section_keys_.clear();
 }
 
 Slice VertBlockBuilder::Finish() {
@@ -146,7 +378,8 @@ Slice VertBlockBuilder::Finish() {
   *((uint32_t*)pointer) = meta_size;
   pointer += 4;
   // MAGIC
-  *((uint32_t*)pointer) = MAGIC;
+  *((uint32_t*)pointer) =
+      key_format_ == kVertStringKey ? MAGIC_STRING_KEY : MAGIC;
 
   return Slice((const char*)buffer_.data(), buffer_.size());
 }
@@ -17,6 +17,7 @@
 //               start_min      : uint32_t
 //               start_bitwidth : uint8_t
 //               starts         : bit-packed uint32_t
+//               filter sidecar (optional, see below)
 //    section:   num_entry      : uint32_t
 //               start_value    : uint32_t
 //               key_offset     : uint32_t
@@ -27,14 +28,40 @@
 //               type_encoding  : uint8_t
 //               value_offset   : uint32_t
 //               value_encoding : uint8_t
+//               suffix_offset  : uint32_t (string keys only)
+//               suffix_encoding: uint8_t  (string keys only)
 //               keys {num_entry}
 //               seq {num_entry}
 //               type {num_entry}
 //               values {num_entry}
+//               suffixes {num_entry} (string keys only)
 //
 //
 //  The value column can be encoded with any valid encoding that supports
-//  fast skipping. For now we just use plain encoding
+//  fast skipping. The builder uses the given encoding, and with
+//  Options::vert_value_compression also tries DICTIONARY and FSST, which
+//  both decode a single value without the rest of the section.
+//
+//  The key column is bit-packed so that it can be searched without
+//  decoding. Sections with a few outlying keys may use PFOR, which keeps the
+//  outliers as exceptions, and dense sections may use SKIPDELTA, which
+//  packs the deltas in blocks with a skip table of block starts. The key,
+//  seq and type columns are encoded with every candidate encoding, and the
+//  one that fits the section best is recorded in the encoding byte when the
+//  section is closed.
+//
+//  With string keys (Options::vert_key_format = kVertStringKey), the key
+//  column stores the KeyPrefixCode of each key, and the remaining bytes
+//  are kept in the suffix column. Such blocks end with MAGIC_STRING_KEY.
+//
+//  With Options::vert_section_filter_bits, the metadata ends with a sidecar
+//  of the max key code and a bloom filter of the key codes of each section.
+//  Readers tell it apart by the meta size.
+//
+//    filter:    num_probe      : uint8_t
+//               filter_words   : uint32_t
+//               maxes          : uint32_t{num_section}
+//               filters        : uint64_t{num_section * filter_words}
 
 #ifndef LEVELDB_BLOCK_VERT_BUILDER_H
 #define LEVELDB_BLOCK_VERT_BUILDER_H
@@ -54,16 +81,61 @@ class VertSectionBuilder {
  private:
   uint32_t num_entry_;
   uint32_t start_value_;
+  // Value encoding given to the builder
+  EncodingType value_base_type_;
+  VertKeyFormat key_format_;
+  bool value_compression_;
+
+  std::unique_ptr<Encoder> value_base_;
+
+  // Candidates for the key, seq, type and value columns, ordered from the
+  // fastest to decode
+  u32::BitpackEncoder key_bitpack_;
+  u32::PforEncoder key_pfor_;
+  u32::SkipDeltaEncoder key_skip_delta_;
+  u64::PlainEncoder seq_plain_;
+  u64::BitpackEncoder seq_bitpack_;
+  u64::DeltaEncoder seq_delta_;
+  u8::RleEncoder type_rle_;
+  u8::PlainEncoder type_plain_;
+  u8::RleVarIntEncoder type_rle_varint_;
+  string::DictionaryEncoder value_dictionary_;
+  string::FsstEncoder value_fsst_;
+  uint64_t seq_min_;
+  uint64_t seq_max_;
+
+  // Picked on Close
+  EncodingType key_enc_type_;
+  EncodingType seq_enc_type_;
+  EncodingType type_enc_type_;
   EncodingType value_enc_type_;
+  Encoder* key_encoder_;
+  Encoder* seq_encoder_;
+  Encoder* type_encoder_;
+  Encoder* value_encoder_;
+
+  // Pick the encoding for current content, size is the column size with it
+  EncodingType PickKeyEncoding(uint32_t* size) const;
+
+  EncodingType PickSeqEncoding(uint32_t* size) const;
+
+  EncodingType PickTypeEncoding(uint32_t* size) const;
+
+  EncodingType PickValueEncoding(uint32_t* size) const;
 
-  u32::BitpackEncoder key_encoder_;
-  u64::BitpackEncoder seq_encoder_;
-//  u64::PlainEncoder seq_encoder_;
-  u8::RleEncoder type_encoder_;
-  std::unique_ptr<Encoder> value_encoder_;
+  Encoder* KeyEncoder(EncodingType);
+
+  Encoder* SeqEncoder(EncodingType);
+
+  Encoder* TypeEncoder(EncodingType);
+
+  Encoder* ValueEncoder(EncodingType);
+  string::LengthEncoder suffix_encoder_;
 
  public:
-  VertSectionBuilder(EncodingType enc_type);
+  VertSectionBuilder(EncodingType enc_type,
+                     VertKeyFormat key_format = kVertIntKey,
+                     bool value_compression = false);
 
   virtual ~VertSectionBuilder() = default;
 
@@ -71,10 +143,16 @@ class VertSectionBuilder {
 
   uint32_t StartValue() const { return start_value_; }
 
+  // Value stored in the key column for the user key
+  uint32_t KeyCode(const Slice& user_key) const;
+
   void Reset();
 
   void Add(ParsedInternalKey key, const Slice& value);
 
+  // Add an entry of an int key, given column by column
+  void Add(uint32_t key_code, uint64_t seq, uint8_t type, const Slice& value);
+
   uint32_t NumEntry() const { return num_entry_; }
 
   uint32_t EstimateSize() const;
@@ -106,6 +184,10 @@ class VertBlockBuilder : public BlockBuilder {
   // REQUIRES: key is larger than any previously added key
   void Add(const Slice& key, const Slice& value);
 
+  // Add an entry of an int key without composing the internal key
+  // REQUIRES: Options::vert_key_format is kVertIntKey
+  void Add(uint32_t key, uint64_t seq, uint8_t type, const Slice& value);
+
   // Finish building the block and return a slice that refers to the
   // block contents.  The returned slice will remain valid for the
   // lifetime of this builder or until Reset() is called.
@@ -120,15 +202,21 @@ class VertBlockBuilder : public BlockBuilder {
 
  private:
   uint32_t section_limit_;
+  VertKeyFormat key_format_;
 
   VertBlockMeta meta_;
   VertSectionBuilder current_section_;
+  // Key codes of the current section, kept only for the section filter
+  std::vector<uint32_t> section_keys_;
 
   uint64_t offset_;
 
   std::vector<uint8_t> buffer_;
 
   void DumpSection();
+
+  // Keep the key for the filter and close the section when full
+  void EndEntry(uint32_t key_code);
 };
 
 }  // namespace colsm
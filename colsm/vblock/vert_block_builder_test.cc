@@ -24,8 +24,9 @@ TEST(VertSectionBuilder, Write) {
   }
   section.Close();
   auto size = section.EstimateSize();
-  // 137 data, 800 value, 800 seq, 4 type, 28 additional
-  EXPECT_EQ(1777, size);
+  // 75 data (skip delta, 1 block of 2-bit deltas), 808 value, 5 seq (two
+  // delta runs), 4 type, 28 additional
+  EXPECT_EQ(920, size);
   EXPECT_EQ(100, section.NumEntry());
   uint8_t buffer[size];
   memset(buffer, 0, size);
@@ -37,12 +38,12 @@ TEST(VertSectionBuilder, Write) {
   pointer += 4;
   EXPECT_EQ(3, *(int32_t*)pointer);
   pointer += 4;
-  EXPECT_EQ(137, *(uint32_t*)pointer);
+  EXPECT_EQ(75, *(uint32_t*)pointer);
   pointer += 4;
-  EXPECT_EQ(BITPACK, *(uint8_t*)pointer++);
-  EXPECT_EQ(800, *(uint32_t*)pointer);
+  EXPECT_EQ(SKIPDELTA, *(uint8_t*)pointer++);
+  EXPECT_EQ(5, *(uint32_t*)pointer);
   pointer += 4;
-  EXPECT_EQ(PLAIN, *(uint8_t*)pointer++);
+  EXPECT_EQ(DELTA, *(uint8_t*)pointer++);
   EXPECT_EQ(4, *(uint32_t*)pointer);
   pointer += 4;
   EXPECT_EQ(RUNLENGTH, *(uint8_t*)pointer++);
@@ -66,11 +67,87 @@ TEST(VertSectionBuilder, EstimateSize) {
     int bitwidth = 32 - _lzcnt_u32(i);
     int expected_value_size = (i + 1) * (4 + strvalue.size());
     int bitpack_size = 33 + ((i + 1 + 7) >> 3) * bitwidth;
-    int seq_size = 8 * (i + 1);
+    // Consecutive keys have 1-bit deltas, a block of a single key has none
+    int num_block = (i + 128) / 128;
+    int open_size = i + 1 - (num_block - 1) * 128;
+    int skip_delta_size = 8 + 8 * num_block + 17 * (num_block - 1) + 1 +
+                          (open_size > 1 ? (open_size + 7) >> 3 : 0) + 32;
+    int key_size =
+        skip_delta_size + std::max(skip_delta_size >> 1, 8) < bitpack_size
+            ? skip_delta_size
+            : bitpack_size;
+    // Delta has the first run written and 12 bytes estimated for the open
+    // one, and is picked when it is 8 bytes smaller than plain
+    int seq_size = i >= 2 ? 15 : 8 * (i + 1);
     int type_size = 4;
 
-    EXPECT_EQ(28 + bitpack_size + expected_value_size + seq_size + type_size,
-              section.EstimateSize());
+    EXPECT_EQ(28 + key_size + expected_value_size + seq_size + type_size,
+              section.EstimateSize())
+        << i;
+  }
+}
+
+TEST(VertSectionBuilder, PickEncoding) {
+  VertSectionBuilder section(EncodingType::LENGTH);
+  section.Open(0);
+  int ik;
+  Slice key((char*)&ik, 4);
+  char v[4];
+  Slice value(v, 4);
+  srand(0);
+  for (auto i = 0; i < 100; ++i) {
+    ik = i;
+    // Sequence numbers in a narrow range, but no delta runs
+    auto seq = 1000000 + i * 37 + rand() % 30;
+    // Types change on every entry
+    auto type = i % 2 ? ValueType::kTypeValue : ValueType::kTypeDeletion;
+    section.Add(ParsedInternalKey(key, seq, type), value);
+  }
+  section.Close();
+  uint8_t buffer[section.EstimateSize()];
+  section.Dump(buffer);
+
+  auto pointer = buffer + 8 + 5;
+  // 12 bits, 9 + 12 * 13 + 32
+  EXPECT_EQ(197, *(uint32_t*)pointer);
+  EXPECT_EQ(BITPACK, *(pointer + 4));
+  pointer += 5;
+  EXPECT_EQ(100, *(uint32_t*)pointer);
+  EXPECT_EQ(PLAIN, *(pointer + 4));
+}
+
+TEST(VertSectionBuilder, PickValueEncoding) {
+  int ik;
+  Slice key((char*)&ik, 4);
+  std::vector<std::string> values;
+  for (auto i = 0; i < 256; ++i) {
+    values.push_back("status-" + std::to_string(i % 4));
+  }
+  for (auto i = 0; i < 256; ++i) {
+    values.push_back("{\"user\":\"user" + std::to_string(i * 7919) +
+                     "\",\"field\":\"value\"}");
+  }
+  EncodingType expect[] = {DICTIONARY, FSST};
+  for (int run = 0; run < 2; ++run) {
+    VertSectionBuilder section(EncodingType::LENGTH, kVertIntKey, true);
+    section.Open(0);
+    for (auto i = 0; i < 256; ++i) {
+      ik = i;
+      section.Add(ParsedInternalKey(key, 100, ValueType::kTypeValue),
+                  values[run * 256 + i]);
+    }
+    section.Close();
+    std::vector<uint8_t> buffer(section.EstimateSize());
+    section.Dump(buffer.data());
+    // Value encoding follows the key, seq and type columns
+    EXPECT_EQ(expect[run], buffer[8 + 5 * 4 - 1]) << run;
+
+    VertSection reader;
+    reader.Read(buffer.data());
+    auto decoder = reader.ValueDecoder();
+    for (auto i = 0; i < 256; ++i) {
+      ASSERT_EQ(values[run * 256 + i], decoder->Decode().ToString()) << i;
+    }
   }
 }
 
@@ -78,7 +155,7 @@ class VertBlockMetaForTest : public VertBlockMeta {
  public:
   VertBlockMetaForTest() : VertBlockMeta() {}
 
-  std::vector<uint64_t>& Offset() { return offsets_; }
+  const uint64_t* Offset() { return offsets_; }
 
   uint8_t StartBitWidth() { return start_bitwidth_; }
 
@@ -88,6 +165,8 @@ class VertBlockMetaForTest : public VertBlockMeta {
 TEST(VertBlockBuilder, Build) {
   Options option;
   option.section_limit=128;
+  // Keep the value column as given to check the layout
+  option.vert_value_compression = false;
   VertBlockBuilder builder(&option, LENGTH);
 
   char buffer[12];
@@ -100,12 +179,12 @@ TEST(VertBlockBuilder, Build) {
   auto result = builder.Finish();
   // section_size = 128, 8 sections
   // meta = 9 + 8 * 8 + 16 = 89
-  // section = 28 + 145 + 1024 + 4 + 2056 = 3257
+  // section = 28 + 65 + 5 + 4 + 2056 = 2158
   // last_section size 104
-  // section = 28 + 124 + 832 + 4 + 1672 = 2660
+  // section = 28 + 62 + 5 + 4 + 1672 = 1771
   // meta_size: 4
   // MAGIC: 4
-  EXPECT_EQ(25556, result.size());
+  EXPECT_EQ(16974, result.size());
 
   uint8_t* data = (uint8_t*)result.data();
 
@@ -117,10 +196,9 @@ TEST(VertBlockBuilder, Build) {
   VertBlockMetaForTest meta;
   meta.Read(data + result.size() - 8 - meta_size);
   EXPECT_EQ(8, meta.NumSection());
-  auto& offset = meta.Offset();
-  EXPECT_EQ(8, offset.size());
+  auto offset = meta.Offset();
   for (auto i = 0; i < 8; ++i) {
-    EXPECT_EQ(3257 * i, offset[i]);
+    EXPECT_EQ(2158 * i, offset[i]);
   }
 
   EXPECT_EQ(10, meta.StartBitWidth());
@@ -129,6 +207,7 @@ TEST(VertBlockBuilder, Build) {
 TEST(VertBlockBuilder, Reset) {
   Options options;
   options.section_limit = 128;
+  options.vert_value_compression = false;
   auto comparator = intComparator();
   options.comparator = comparator.get();
 
@@ -146,12 +225,12 @@ TEST(VertBlockBuilder, Reset) {
     auto result = builder.Finish();
     // section_size = 128, 8 sections
     // meta = 9 + 8 * 8 + 16 = 89
-    // section = 28 + 145 + 1024 + 4 + 2048 = 3249
+    // section = 28 + 65 + 5 + 4 + 2048 = 2150
     // last_section size 104
-    // section = 28 + 124 + 832 + 4 + 1664 = 2652
+    // section = 28 + 62 + 5 + 4 + 1664 = 1763
     // meta_size: 4
     // MAGIC: 4
-    EXPECT_EQ(25492, result.size()) << repeat;
+    EXPECT_EQ(16910, result.size()) << repeat;
 
     uint8_t* data = (uint8_t*)result.data();
 
@@ -164,10 +243,9 @@ TEST(VertBlockBuilder, Reset) {
     meta.Read(data + result.size() - 8 - meta_size);
 
     EXPECT_EQ(8, meta.NumSection());
-    auto& offset = meta.Offset();
-    EXPECT_EQ(8, offset.size());
+    auto offset = meta.Offset();
     for (auto i = 0; i < 8; ++i) {
-      EXPECT_EQ(3249 * i, offset[i]);
+      EXPECT_EQ(2150 * i, offset[i]);
     }
 
     EXPECT_EQ(10, meta.StartBitWidth());
@@ -147,5 +147,39 @@ void VBlockMergeWithNoOverlap(benchmark::State& state) {
   delete content2.data.data();
 }
 
+void VBlockMergeNWay(benchmark::State& state) {
+  int num_block = state.range(0);
+  auto comparator = colsm::intComparator();
+  vector<BlockContents> contents;
+  for (int b = 0; b < num_block; ++b) {
+    vector<int32_t> keys;
+    for (int i = b; i < batch_size; i += num_block) {
+      keys.push_back(i);
+    }
+    contents.push_back(prepareVBlock(keys, EncodingType::LENGTH));
+  }
+
+  for (auto _ : state) {
+    vector<unique_ptr<VertBlockCore>> blocks;
+    vector<Iterator*> children;
+    for (auto& content : contents) {
+      blocks.emplace_back(new VertBlockCore(content));
+      children.push_back(blocks.back()->NewIterator(comparator.get()));
+    }
+    unique_ptr<Iterator> ite(
+        colsm::sortMergeIterator(comparator.get(), children.data(), num_block));
+    int count = 0;
+    for (ite->SeekToFirst(); ite->Valid(); ite->Next()) {
+      ++count;
+    }
+    benchmark::DoNotOptimize(count);
+  }
+
+  for (auto& content : contents) {
+    delete content.data.data();
+  }
+}
+
 BENCHMARK(BlockMergeWithNoOverlap);
 BENCHMARK(VBlockMergeWithNoOverlap);
+BENCHMARK(VBlockMergeNWay)->Arg(2)->Arg(8)->Arg(32);
@@ -7,14 +7,18 @@
 
 #include "leveldb/comparator.h"
 
+#include "db/dbformat.h"
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "util/coding.h"
 
 #include "colsm/comparators.h"
+#include "byteutils.h"
 #include "micro_helper.h"
 #include "vert_block.h"
 #include "vert_block_builder.h"
+#include "vert_search.h"
 
 using namespace std;
 using namespace leveldb;
@@ -130,6 +134,7 @@ BENCHMARK_F(BlockReadBenchmark, Normal)(benchmark::State& state) {
 BENCHMARK_F(BlockReadBenchmark, Vert)(benchmark::State& state) {
   for (auto _ : state) {
     char at[12];
+    EncodeFixed64(at + 4, kMaxSequenceNumber << 8);
     for (int i = 0; i < 10000; ++i) {
       auto ite = vblock_->NewIterator(NULL);
       *((uint32_t*)at) = target[i];
@@ -139,4 +144,80 @@ BENCHMARK_F(BlockReadBenchmark, Vert)(benchmark::State& state) {
       delete ite;
     }
   }
-}
\ No newline at end of file
+}
+
+void KeepKey(void* arg, const Slice& key, const Slice& value) {
+  *reinterpret_cast<Slice*>(arg) = key;
+}
+
+// Point lookups without an iterator
+BENCHMARK_F(BlockReadBenchmark, VertGet)(benchmark::State& state) {
+  for (auto _ : state) {
+    char at[12];
+    EncodeFixed64(at + 4, kMaxSequenceNumber << 8);
+    Slice found;
+    for (int i = 0; i < 10000; ++i) {
+      *((uint32_t*)at) = target[i];
+      Slice t(at, 12);
+      vblock_->Get(NULL, t, &found, KeepKey);
+      benchmark::DoNotOptimize(found);
+    }
+  }
+}
+// Scan the block, values are only decoded when read
+BENCHMARK_F(BlockReadBenchmark, VertScanKey)(benchmark::State& state) {
+  for (auto _ : state) {
+    auto ite = vblock_->NewIterator(NULL);
+    for (ite->SeekToFirst(); ite->Valid(); ite->Next()) {
+      benchmark::DoNotOptimize(ite->key());
+    }
+    delete ite;
+  }
+}
+
+BENCHMARK_F(BlockReadBenchmark, VertScanValue)(benchmark::State& state) {
+  for (auto _ : state) {
+    auto ite = vblock_->NewIterator(NULL);
+    for (ite->SeekToFirst(); ite->Valid(); ite->Next()) {
+      benchmark::DoNotOptimize(ite->key());
+      benchmark::DoNotOptimize(ite->value());
+    }
+    delete ite;
+  }
+}
+
+// Search a bit-packed section, the bit width is given as argument
+static void PackedSearch(benchmark::State& state,
+                         int (*search)(const uint8_t*, uint32_t, uint8_t,
+                                       uint32_t)) {
+  uint32_t num_entry = 256;
+  uint8_t bitwidth = state.range(0);
+  uint64_t limit = 1ULL << bitwidth;
+
+  srand(time(nullptr));
+  vector<uint32_t> entries;
+  for (uint32_t i = 0; i < num_entry; ++i) {
+    entries.push_back(((uint64_t)rand() * rand()) % limit);
+  }
+  std::sort(entries.begin(), entries.end());
+  vector<uint32_t> targets;
+  for (int i = 0; i < 10000; ++i) {
+    targets.push_back(entries[rand() % num_entry]);
+  }
+  vector<uint8_t> packed(num_entry * 4 + 64);
+  sboost::byteutils::bitpack(entries.data(), num_entry, bitwidth,
+                             packed.data());
+
+  for (auto _ : state) {
+    for (auto t : targets) {
+      benchmark::DoNotOptimize(search(packed.data(), num_entry, bitwidth, t));
+    }
+  }
+}
+
+BENCHMARK_CAPTURE(PackedSearch, Scalar, scalar::geq_packed)->DenseRange(1, 32);
+#if defined(COLSM_SEARCH_X86)
+BENCHMARK_CAPTURE(PackedSearch, Avx2, avx2::geq_packed)->DenseRange(1, 32);
+BENCHMARK_CAPTURE(PackedSearch, Avx512, avx512::geq_packed)
+    ->DenseRange(1, 32);
+#endif
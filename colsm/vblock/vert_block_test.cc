@@ -6,11 +6,13 @@
 
 #include <gtest/gtest.h>
 #include <immintrin.h>
+#include <set>
 
 #include "table/block.h"
 
 #include "byteutils.h"
 #include "vert_block_builder.h"
+#include "vert_search.h"
 
 using namespace leveldb;
 using namespace colsm;
@@ -144,6 +146,56 @@ TEST(VertBlockMeta, Search) {
   }
 }
 
+TEST(VertBlockMeta, Filter) {
+  VertBlockMeta meta;
+  meta.EnableFilter(10, 100);
+  // Sections of even keys with gaps in between
+  std::vector<uint32_t> keys;
+  for (uint32_t i = 0; i < 20; ++i) {
+    keys.clear();
+    for (uint32_t j = 0; j < 100; ++j) {
+      keys.push_back(1000 + i * 1000 + j * 2);
+    }
+    meta.AddSection(i * 64, keys);
+  }
+  meta.Finish();
+  // 1 + 4 + 20 * 4 + 20 * 16 * 8 filter sidecar
+  auto size = meta.EstimateSize();
+  EXPECT_EQ(9 + 20 * 8 + 40 + 2645, size);
+
+  std::vector<uint8_t> buffer(size);
+  meta.Write(buffer.data());
+
+  VertBlockMeta read;
+  EXPECT_EQ(size, read.Read(buffer.data(), size));
+  ASSERT_TRUE(read.HasFilter());
+  EXPECT_EQ(20, read.NumSection());
+  for (uint32_t i = 0; i < 20; ++i) {
+    EXPECT_EQ(i * 64, read.SectionOffset(i));
+    EXPECT_EQ(1000 + i * 1000 + 198, read.SectionMax(i));
+  }
+  uint32_t false_positive = 0;
+  for (uint32_t key = 0; key < 22000; ++key) {
+    bool in_section = key >= 1000 && key % 1000 < 200 && key % 2 == 0 &&
+                      key < 21000;
+    if (in_section) {
+      ASSERT_TRUE(read.MayContain(key)) << key;
+    } else if (read.MayContain(key)) {
+      // Only keys within the section ranges can pass
+      ASSERT_TRUE(key >= 1000 && key % 1000 < 199) << key;
+      false_positive++;
+    }
+  }
+  // 2000 odd keys within the ranges
+  EXPECT_LT(false_positive, 100);
+
+  // Reading without the size ignores the sidecar
+  VertBlockMeta plain;
+  EXPECT_EQ(size - 2645, plain.Read(buffer.data()));
+  EXPECT_FALSE(plain.HasFilter());
+  EXPECT_TRUE(plain.MayContain(1));
+}
+
 TEST(VertSection, Read) {
   uint8_t buffer[150];
   memset(buffer, 0, 150);
@@ -559,6 +611,652 @@ TEST(VertBlockTest, SeekThenNext) {
   }
 }
 
+TEST(VertBlock, Prev) {
+  Options option;
+  VertBlockBuilder builder(&option, LENGTH);
+
+  char buffer[12];
+  Slice key((const char*)buffer, 12);
+  for (uint32_t i = 0; i < 100000; ++i) {
+    *((int32_t*)buffer) = 2 * i;
+    // Mix the types to have multiple runs in the type column
+    auto type = (i / 3) % 2 ? ValueType::kTypeDeletion : ValueType::kTypeValue;
+    EncodeFixed64(buffer + 4, (i << 8) | type);
+    builder.Add(key, key);
+  }
+  auto result = builder.Finish();
+
+  BlockContents content;
+  content.data = result;
+  content.cachable = false;
+  content.heap_allocated = false;
+  VertBlockCore block(content);
+  ParsedInternalKey pkey;
+
+  {
+    auto ite = block.NewIterator(NULL);
+    ite->SeekToLast();
+    int i = 99999;
+    while (ite->Valid()) {
+      auto key = ite->key();
+      auto value = ite->value();
+      ParseInternalKey(key, &pkey);
+      ASSERT_EQ(2 * i, *((int32_t*)pkey.user_key.data())) << i;
+      ASSERT_EQ(i, pkey.sequence) << i;
+      ASSERT_EQ((i / 3) % 2 ? ValueType::kTypeDeletion : ValueType::kTypeValue,
+                pkey.type)
+          << i;
+      ASSERT_EQ(12, value.size());
+      ASSERT_EQ(2 * i, *((int32_t*)value.data())) << i;
+      ite->Prev();
+      i--;
+    }
+    EXPECT_EQ(-1, i);
+    delete ite;
+  }
+  {
+    // Seek then move back and forth, across section boundaries
+    auto ite = block.NewIterator(NULL);
+    int target_key = 1030;
+    Slice target((const char*)&target_key, 4);
+    ite->Seek(target);
+    ASSERT_TRUE(ite->Valid());
+    for (int i = 515; i > 200; --i) {
+      ParseInternalKey(ite->key(), &pkey);
+      ASSERT_EQ(2 * i, *((int32_t*)pkey.user_key.data())) << i;
+      ASSERT_EQ(i, pkey.sequence) << i;
+      ite->Prev();
+    }
+    for (int i = 200; i < 800; ++i) {
+      ParseInternalKey(ite->key(), &pkey);
+      ASSERT_EQ(2 * i, *((int32_t*)pkey.user_key.data())) << i;
+      ASSERT_EQ(2 * i, *((int32_t*)ite->value().data())) << i;
+      ite->Next();
+    }
+    ite->Prev();
+    ParseInternalKey(ite->key(), &pkey);
+    EXPECT_EQ(2 * 799, *((int32_t*)pkey.user_key.data()));
+    ite->Prev();
+    ParseInternalKey(ite->key(), &pkey);
+    EXPECT_EQ(2 * 798, *((int32_t*)pkey.user_key.data()));
+    delete ite;
+  }
+}
+
+TEST(VertBlock, StringKey) {
+  Options option;
+  option.vert_key_format = kVertStringKey;
+  VertBlockBuilder builder(&option, LENGTH);
+
+  // Short alphabet and lengths so that many keys share the prefix code
+  srand(0);
+  std::set<std::string> key_set;
+  while (key_set.size() < 5000) {
+    std::string key;
+    auto length = rand() % 8;
+    for (int i = 0; i < length; ++i) {
+      key.push_back("\0abc"[rand() % 4]);
+    }
+    key_set.insert(key);
+  }
+  std::vector<std::string> keys(key_set.begin(), key_set.end());
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    std::string internal_key = keys[i];
+    PutFixed64(&internal_key, (i << 8) | ValueType::kTypeValue);
+    builder.Add(internal_key, keys[i]);
+  }
+  auto result = builder.Finish();
+
+  BlockContents content;
+  content.data = result;
+  content.cachable = false;
+  content.heap_allocated = false;
+  Block block(content);
+  ParsedInternalKey pkey;
+
+  {
+    auto ite = block.NewIterator(NULL);
+    ite->SeekToFirst();
+    for (uint32_t i = 0; i < keys.size(); ++i) {
+      ASSERT_TRUE(ite->Valid()) << i;
+      ParseInternalKey(ite->key(), &pkey);
+      ASSERT_EQ(keys[i], pkey.user_key.ToString()) << i;
+      ASSERT_EQ(i, pkey.sequence) << i;
+      ASSERT_EQ(keys[i], ite->value().ToString()) << i;
+      ite->Next();
+    }
+    ASSERT_FALSE(ite->Valid());
+    delete ite;
+  }
+  {
+    auto ite = block.NewIterator(NULL);
+    ite->SeekToLast();
+    for (int i = keys.size() - 1; i >= 0; --i) {
+      ASSERT_TRUE(ite->Valid()) << i;
+      ParseInternalKey(ite->key(), &pkey);
+      ASSERT_EQ(keys[i], pkey.user_key.ToString()) << i;
+      ite->Prev();
+    }
+    ASSERT_FALSE(ite->Valid());
+    delete ite;
+  }
+  for (int i = 0; i < 2000; ++i) {
+    std::string target;
+    auto length = rand() % 9;
+    for (int j = 0; j < length; ++j) {
+      target.push_back("\0abcd"[rand() % 5]);
+    }
+    auto expect = std::lower_bound(keys.begin(), keys.end(), target);
+    PutFixed64(&target, kMaxSequenceNumber << 8);
+
+    auto ite = block.NewIterator(NULL);
+    ite->Seek(target);
+    if (expect == keys.end()) {
+      EXPECT_TRUE(ite->status().IsNotFound());
+    } else {
+      ASSERT_TRUE(ite->Valid());
+      ParseInternalKey(ite->key(), &pkey);
+      EXPECT_EQ(*expect, pkey.user_key.ToString());
+      EXPECT_EQ(*expect, ite->value().ToString());
+    }
+    delete ite;
+  }
+}
+
+TEST(VertBlock, ColumnEncodings) {
+  Options option;
+  VertBlockBuilder builder(&option, PLAIN);
+
+  // Alternate data patterns between sections so that each picks different
+  // encodings for seq and type
+  srand(0);
+  std::vector<uint64_t> seqs;
+  std::vector<ValueType> types;
+  char buffer[12];
+  Slice key((const char*)buffer, 12);
+  for (uint32_t i = 0; i < 10000; ++i) {
+    uint64_t seq;
+    ValueType type;
+    switch ((i / 256) % 3) {
+      case 0:
+        seq = 5000000 + i * 37 + rand() % 30;
+        type = rand() % 2 ? kTypeValue : kTypeDeletion;
+        break;
+      case 1:
+        seq = i;
+        type = kTypeValue;
+        break;
+      default:
+        seq = ((uint64_t)rand() << 20) + rand();
+        type = (i / 40) % 2 ? kTypeValue : kTypeDeletion;
+        break;
+    }
+    seqs.push_back(seq);
+    types.push_back(type);
+    *((int32_t*)buffer) = i;
+    EncodeFixed64(buffer + 4, (seq << 8) | type);
+    builder.Add(key, key);
+  }
+  auto result = builder.Finish();
+
+  BlockContents content;
+  content.data = result;
+  content.cachable = false;
+  content.heap_allocated = false;
+  VertBlockCore block(content);
+  ParsedInternalKey pkey;
+
+  auto ite = block.NewIterator(NULL);
+  ite->SeekToFirst();
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_TRUE(ite->Valid());
+    ParseInternalKey(ite->key(), &pkey);
+    ASSERT_EQ(i, *((int32_t*)pkey.user_key.data()));
+    ASSERT_EQ(seqs[i], pkey.sequence) << i;
+    ASSERT_EQ(types[i], pkey.type) << i;
+    ASSERT_EQ(12, ite->value().size());
+    ite->Next();
+  }
+  ite->SeekToLast();
+  for (int i = 9999; i >= 0; --i) {
+    ASSERT_TRUE(ite->Valid());
+    ParseInternalKey(ite->key(), &pkey);
+    ASSERT_EQ(seqs[i], pkey.sequence) << i;
+    ASSERT_EQ(types[i], pkey.type) << i;
+    ite->Prev();
+  }
+  delete ite;
+}
+
+TEST(VertBlock, KeyEncodings) {
+  Options option;
+  VertBlockBuilder builder(&option, PLAIN);
+
+  // Sections alternate between dense keys, keys with a few outliers at the
+  // end and sparse keys, so that each picks a different key encoding
+  srand(0);
+  std::vector<int32_t> keys;
+  int32_t current = 0;
+  for (uint32_t i = 0; i < 256 * 9; ++i) {
+    switch ((i / 256) % 3) {
+      case 0:
+        current += 1 + i % 2;
+        break;
+      case 1:
+        current += i % 256 >= 252 ? 1000000 : 1 + rand() % 30;
+        break;
+      default:
+        current += 1 + rand() % 100000;
+        break;
+    }
+    keys.push_back(current);
+  }
+  char buffer[12];
+  Slice key((const char*)buffer, 12);
+  for (auto k : keys) {
+    *((int32_t*)buffer) = k;
+    EncodeFixed64(buffer + 4, (100 << 8) | kTypeValue);
+    builder.Add(key, key);
+  }
+  auto result = builder.Finish();
+
+  uint32_t meta_size = *((uint32_t*)(result.data() + result.size() - 8));
+  VertBlockMeta meta;
+  meta.Read((const uint8_t*)result.data() + result.size() - 8 - meta_size);
+  ASSERT_EQ(9, meta.NumSection());
+  EncodingType expect[] = {SKIPDELTA, PFOR, BITPACK};
+  for (uint32_t i = 0; i < 9; ++i) {
+    EXPECT_EQ(expect[i % 3], result[meta.SectionOffset(i) + 12]) << i;
+  }
+
+  BlockContents content;
+  content.data = result;
+  content.cachable = false;
+  content.heap_allocated = false;
+  VertBlockCore block(content);
+  ParsedInternalKey pkey;
+
+  auto ite = block.NewIterator(NULL);
+  ite->SeekToFirst();
+  for (auto k : keys) {
+    ASSERT_TRUE(ite->Valid());
+    ParseInternalKey(ite->key(), &pkey);
+    ASSERT_EQ(k, *((int32_t*)pkey.user_key.data()));
+    ite->Next();
+  }
+  ASSERT_FALSE(ite->Valid());
+
+  for (uint32_t i = 0; i < keys.size(); ++i) {
+    // Exact match, and a missing key before it
+    for (auto target_key : {keys[i], keys[i] - 1}) {
+      if (i > 0 && target_key == keys[i - 1]) {
+        continue;
+      }
+      Slice target((const char*)&target_key, 4);
+      ite->Seek(target);
+      ASSERT_TRUE(ite->Valid()) << target_key;
+      ParseInternalKey(ite->key(), &pkey);
+      ASSERT_EQ(keys[i], *((int32_t*)pkey.user_key.data())) << target_key;
+    }
+  }
+  delete ite;
+}
+
+TEST(VertBlock, ValueEncodings) {
+  Options option;
+  VertBlockBuilder builder(&option, LENGTH);
+
+  // Sections alternate between few distinct values, repetitive values and
+  // random bytes
+  srand(0);
+  std::vector<std::string> values;
+  char buffer[12];
+  Slice key((const char*)buffer, 12);
+  for (uint32_t i = 0; i < 256 * 6; ++i) {
+    std::string value;
+    switch ((i / 256) % 3) {
+      case 0:
+        value = "status-" + std::to_string(rand() % 5);
+        break;
+      case 1:
+        value = "{\"user\":\"user" + std::to_string(rand()) +
+                "\",\"field\":\"value\"}";
+        break;
+      default:
+        for (int j = 0; j < 20; ++j) {
+          value.push_back((char)(rand() % 256));
+        }
+        break;
+    }
+    values.push_back(value);
+    *((int32_t*)buffer) = i;
+    EncodeFixed64(buffer + 4, (100 << 8) | kTypeValue);
+    builder.Add(key, value);
+  }
+  auto result = builder.Finish();
+
+  uint32_t meta_size = *((uint32_t*)(result.data() + result.size() - 8));
+  VertBlockMeta meta;
+  meta.Read((const uint8_t*)result.data() + result.size() - 8 - meta_size);
+  ASSERT_EQ(6, meta.NumSection());
+  EncodingType expect[] = {DICTIONARY, FSST, LENGTH};
+  for (uint32_t i = 0; i < 6; ++i) {
+    EXPECT_EQ(expect[i % 3], result[meta.SectionOffset(i) + 27]) << i;
+  }
+
+  BlockContents content;
+  content.data = result;
+  content.cachable = false;
+  content.heap_allocated = false;
+  VertBlockCore block(content);
+
+  auto ite = block.NewIterator(NULL);
+  ite->SeekToFirst();
+  for (auto& value : values) {
+    ASSERT_TRUE(ite->Valid());
+    ASSERT_EQ(value, ite->value().ToString());
+    ite->Next();
+  }
+  ite->SeekToLast();
+  for (int i = values.size() - 1; i >= 0; --i) {
+    ASSERT_TRUE(ite->Valid());
+    ASSERT_EQ(values[i], ite->value().ToString()) << i;
+    ite->Prev();
+  }
+  for (int i = 0; i < 1000; ++i) {
+    int32_t target_key = rand() % values.size();
+    Slice target((const char*)&target_key, 4);
+    ite->Seek(target);
+    ASSERT_TRUE(ite->Valid());
+    ASSERT_EQ(values[target_key], ite->value().ToString()) << target_key;
+  }
+  delete ite;
+}
+
+TEST(VertBlock, LazyValue) {
+  for (auto encoding : {PLAIN, LENGTH}) {
+    Options option;
+    option.vert_value_compression = false;
+    VertBlockBuilder builder(&option, encoding);
+
+    char buffer[12];
+    Slice key((const char*)buffer, 12);
+    for (uint32_t i = 0; i < 2000; ++i) {
+      *((int32_t*)buffer) = i;
+      EncodeFixed64(buffer + 4, (100 << 8) | kTypeValue);
+      builder.Add(key, "value" + std::to_string(i));
+    }
+    auto result = builder.Finish();
+
+    BlockContents content;
+    content.data = result;
+    content.cachable = false;
+    content.heap_allocated = false;
+    VertBlockCore block(content);
+    ParsedInternalKey pkey;
+
+    // Read the values of a few entries while scanning in both directions
+    srand(0);
+    auto ite = block.NewIterator(NULL);
+    ite->SeekToFirst();
+    for (int i = 0; i < 2000; ++i) {
+      ASSERT_TRUE(ite->Valid());
+      if (rand() % 10 == 0) {
+        ASSERT_EQ("value" + std::to_string(i), ite->value().ToString()) << i;
+      }
+      ite->Next();
+    }
+    ite->SeekToLast();
+    for (int i = 1999; i >= 0; --i) {
+      ASSERT_TRUE(ite->Valid());
+      if (rand() % 10 == 0) {
+        ASSERT_EQ("value" + std::to_string(i), ite->value().ToString()) << i;
+      }
+      ite->Prev();
+    }
+    int current = 0;
+    ite->SeekToFirst();
+    for (int i = 0; i < 2000; ++i) {
+      if (rand() % 2 && current > 0) {
+        ite->Prev();
+        current--;
+      } else if (current < 1999) {
+        ite->Next();
+        current++;
+      }
+      ParseInternalKey(ite->key(), &pkey);
+      ASSERT_EQ(current, *((int32_t*)pkey.user_key.data()));
+      if (rand() % 3 == 0) {
+        ASSERT_EQ("value" + std::to_string(current), ite->value().ToString())
+            << current;
+      }
+    }
+    delete ite;
+  }
+}
+
+TEST(VertBlock, SectionFilter) {
+  Options option;
+  option.section_limit = 64;
+  option.vert_section_filter_bits = 10;
+  VertBlockBuilder builder(&option, LENGTH);
+
+  // Runs of 64 keys, multiples of 3, with a gap of 1000 after each run
+  std::vector<int32_t> keys;
+  for (int32_t i = 0; i < 2000; ++i) {
+    keys.push_back((i / 64) * 1200 + (i % 64) * 3);
+  }
+  char buffer[12];
+  Slice key((const char*)buffer, 12);
+  for (auto k : keys) {
+    *((int32_t*)buffer) = k;
+    EncodeFixed64(buffer + 4, (100 << 8) | kTypeValue);
+    builder.Add(key, "value" + std::to_string(k));
+  }
+  auto result = builder.Finish();
+
+  BlockContents content;
+  content.data = result;
+  content.cachable = false;
+  content.heap_allocated = false;
+  VertBlockCore block(content);
+  ParsedInternalKey pkey;
+
+  auto ite = block.NewIterator(NULL);
+  for (int32_t target = 0; target <= keys.back() + 10; ++target) {
+    *((int32_t*)buffer) = target;
+    auto next = std::lower_bound(keys.begin(), keys.end(), target);
+    bool exist = next != keys.end() && *next == target;
+    if (exist) {
+      ASSERT_TRUE(block.KeyMayMatch(key)) << target;
+    }
+    if (target > keys.back()) {
+      ASSERT_FALSE(block.KeyMayMatch(key)) << target;
+    }
+
+    ite->Seek(key);
+    if (next == keys.end()) {
+      ASSERT_FALSE(ite->Valid()) << target;
+      continue;
+    }
+    ASSERT_TRUE(ite->Valid()) << target;
+    ParseInternalKey(ite->key(), &pkey);
+    ASSERT_EQ(*next, *((int32_t*)pkey.user_key.data())) << target;
+    ASSERT_EQ("value" + std::to_string(*next), ite->value().ToString());
+  }
+  delete ite;
+}
+
+// Keep the entry given to Get
+void SaveEntry(void* arg, const Slice& key, const Slice& value) {
+  auto entry = reinterpret_cast<std::pair<std::string, std::string>*>(arg);
+  entry->first = key.ToString();
+  entry->second = value.ToString();
+}
+
+TEST(VertBlock, MultiVersion) {
+  // Keys with a few versions, every 50th key has enough versions to spill
+  // over several sections
+  std::vector<std::pair<uint32_t, uint64_t>> entries;
+  for (uint32_t k = 0; k < 400; ++k) {
+    uint32_t num_version = k % 50 == 0 ? 150 : 1 + k % 5;
+    for (uint32_t v = 0; v < num_version; ++v) {
+      entries.emplace_back(2 * k + 10, 1000 - 3 * v - k % 3);
+    }
+  }
+  // Internal key order, versions by sequence descending
+  auto before = [](const std::pair<uint32_t, uint64_t>& a,
+                   const std::pair<uint32_t, uint64_t>& b) {
+    return a.first < b.first || (a.first == b.first && a.second > b.second);
+  };
+
+  for (uint32_t filter_bits : {0, 10}) {
+    Options option;
+    option.section_limit = 64;
+    option.vert_section_filter_bits = filter_bits;
+    VertBlockBuilder builder(&option, LENGTH);
+    char buffer[12];
+    Slice key((const char*)buffer, 12);
+    for (auto& entry : entries) {
+      *((uint32_t*)buffer) = entry.first;
+      EncodeFixed64(buffer + 4, (entry.second << 8) | kTypeValue);
+      builder.Add(key, std::to_string(entry.second));
+    }
+    auto result = builder.Finish();
+
+    BlockContents content;
+    content.data = result;
+    content.cachable = false;
+    content.heap_allocated = false;
+    VertBlockCore block(content);
+    ParsedInternalKey pkey;
+
+    auto ite = block.NewIterator(NULL);
+    for (uint32_t target = 8; target <= 2 * 400 + 12; ++target) {
+      for (uint64_t seq : {2000, 1000, 999, 850, 700, 500, 0}) {
+        *((uint32_t*)buffer) = target;
+        EncodeFixed64(buffer + 4, (seq << 8) | kTypeValue);
+        auto expect = std::lower_bound(entries.begin(), entries.end(),
+                                       std::make_pair(target, seq), before);
+        ite->Seek(key);
+        std::pair<std::string, std::string> found;
+        ASSERT_TRUE(block.Get(nullptr, key, &found, SaveEntry).ok());
+        if (expect == entries.end()) {
+          ASSERT_FALSE(ite->Valid()) << target << " " << seq;
+          ASSERT_TRUE(found.first.empty());
+          continue;
+        }
+        ASSERT_EQ(ite->key().ToString(), found.first);
+        ASSERT_EQ(ite->value().ToString(), found.second);
+        ASSERT_TRUE(ite->Valid()) << target << " " << seq;
+        ParseInternalKey(ite->key(), &pkey);
+        ASSERT_EQ(expect->first, *((uint32_t*)pkey.user_key.data()))
+            << target << " " << seq;
+        ASSERT_EQ(expect->second, pkey.sequence) << target << " " << seq;
+        ASSERT_EQ(std::to_string(expect->second), ite->value().ToString());
+      }
+    }
+    delete ite;
+  }
+}
+
+TEST(PackedSearch, BitWidth) {
+  srand(0);
+  for (uint8_t bitwidth = 1; bitwidth <= 32; ++bitwidth) {
+    uint64_t limit = 1ULL << bitwidth;
+    for (uint32_t num_entry : {1, 7, 8, 9, 16, 17, 100, 256}) {
+      std::vector<uint32_t> entries;
+      for (uint32_t i = 0; i < num_entry; ++i) {
+        entries.push_back(((uint64_t)rand() * rand()) % limit);
+      }
+      std::sort(entries.begin(), entries.end());
+      std::vector<uint8_t> packed(num_entry * 4 + 64);
+      sboost::byteutils::bitpack(entries.data(), num_entry, bitwidth,
+                                 packed.data());
+
+      for (int i = 0; i < 50; ++i) {
+        uint32_t target = i % 2 ? entries[rand() % num_entry]
+                                : ((uint64_t)rand() * rand()) % limit;
+        auto lower = std::lower_bound(entries.begin(), entries.end(), target) -
+                     entries.begin();
+        auto upper = std::upper_bound(entries.begin(), entries.end(), target) -
+                     entries.begin();
+
+        auto geq = geq_packed(packed.data(), num_entry, bitwidth, target);
+        EXPECT_EQ(lower, geq);
+        auto eq = eq_packed(packed.data(), num_entry, bitwidth, target);
+        if (lower < upper) {
+          EXPECT_EQ(target, entries[eq]);
+        } else {
+          EXPECT_EQ(-1, eq);
+        }
+        auto section =
+            section_packed(packed.data(), num_entry, bitwidth, target);
+        EXPECT_EQ(upper == 0 ? 0 : upper - 1, section);
+
+        // The first entry geq target, even among equal keys
+        uint32_t sgeq = scalar::geq_packed(packed.data(), num_entry, bitwidth,
+                                           target);
+        EXPECT_TRUE(sgeq == num_entry || entries[sgeq] >= target);
+        EXPECT_TRUE(sgeq == 0 || entries[sgeq - 1] < target);
+        EXPECT_EQ(
+            upper == 0 ? 0 : upper - 1,
+            scalar::section_packed(packed.data(), num_entry, bitwidth, target));
+      }
+    }
+  }
+}
+
+TEST(PackedSearch, ExactBuffer) {
+  std::vector<decltype(&scalar::geq_packed)> geqs = {scalar::geq_packed};
+  std::vector<decltype(&scalar::section_packed)> sections = {
+      scalar::section_packed};
+#if defined(COLSM_SEARCH_X86)
+  if (avx2::Supported()) {
+    geqs.push_back(avx2::geq_packed);
+    sections.push_back(avx2::section_packed);
+  }
+  if (avx512::Supported()) {
+    geqs.push_back(avx512::geq_packed);
+    sections.push_back(avx512::section_packed);
+  }
+#endif
+  srand(0);
+  for (uint8_t bitwidth = 1; bitwidth <= 32; ++bitwidth) {
+    uint64_t limit = 1ULL << bitwidth;
+    for (uint32_t num_entry : {1, 7, 9, 15, 17, 31, 33, 100}) {
+      std::vector<uint32_t> entries;
+      for (uint32_t i = 0; i < num_entry; ++i) {
+        entries.push_back(((uint64_t)rand() * rand()) % limit);
+      }
+      std::sort(entries.begin(), entries.end());
+      std::vector<uint8_t> packed(num_entry * 4 + 64);
+      sboost::byteutils::bitpack(entries.data(), num_entry, bitwidth,
+                                 packed.data());
+      // Nothing follows the packed bytes, reading past them is caught by
+      // the address sanitizer
+      auto size = (num_entry * bitwidth + 7) / 8;
+      std::unique_ptr<uint8_t[]> exact(new uint8_t[size]);
+      memcpy(exact.get(), packed.data(), size);
+
+      for (uint32_t target : {0u, entries.back(), (uint32_t)(limit - 1),
+                              entries[num_entry / 2]}) {
+        auto lower = std::lower_bound(entries.begin(), entries.end(), target) -
+                     entries.begin();
+        auto upper = std::upper_bound(entries.begin(), entries.end(), target) -
+                     entries.begin();
+        for (auto geq : geqs) {
+          EXPECT_EQ(lower, geq(exact.get(), num_entry, bitwidth, target));
+        }
+        for (auto section : sections) {
+          EXPECT_EQ(upper == 0 ? 0 : upper - 1,
+                    section(exact.get(), num_entry, bitwidth, target));
+        }
+      }
+    }
+  }
+}
+
 // LevelDB test did not use gtest_main
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
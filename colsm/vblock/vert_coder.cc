@@ -4,6 +4,8 @@
 
 #include "vert_coder.h"
 
+#include <algorithm>
+#include <cassert>
 #include <byteutils.h>
 #include <cstring>
 #include <immintrin.h>
@@ -13,8 +15,6 @@
 
 #include "util/coding.h"
 
-#include "../respool/respool.h"
-
 using namespace leveldb;
 namespace colsm {
 namespace encoding {
@@ -75,7 +75,7 @@ inline uint64_t readVar64(uint8_t*& pointer) {
   uint8_t byte;
   do {
     byte = *(pointer++);
-    result |= (byte & 0x7F) << ((bytec++) * 7);
+    result |= ((uint64_t)(byte & 0x7F)) << ((bytec++) * 7);
   } while (byte & 0x80);
   return result;
 }
@@ -92,7 +92,8 @@ template <class E, class D>
 class EncodingTemplate : public Encoding {
  private:
   simple_pool<Encoder> epool_;
-  simple_pool<Decoder> dpool_;
+  // Decoders are taken by concurrent readers
+  steal_pool<Decoder> dpool_;
 
  public:
   EncodingTemplate()
@@ -104,7 +105,7 @@ class EncodingTemplate : public Encoding {
     return std::make_unique<E>();
   }
 
-  std::shared_ptr<Decoder> decoder() override {
+  DecoderHandle decoder() override {
     return dpool_.get();
     //    return std::make_unique<D>();
   }
@@ -129,26 +130,54 @@ void PlainEncoder::Dump(uint8_t* output) {
 }
 
 void PlainDecoder::Attach(const uint8_t* buffer) {
+  base_ = buffer;
+  position_ = 0;
   length_pointer_ = (uint8_t*)buffer;
   data_pointer_ = buffer + 4;
+  checkpoints_.clear();
 }
 
 void PlainDecoder::Skip(uint32_t offset) {
   for (uint32_t i = 0; i < offset; ++i) {
+    Checkpoint();
     auto length = *((uint32_t*)length_pointer_);
     data_pointer_ += length + 4;
     length_pointer_ += length + 4;
+    position_++;
+  }
+}
+
+void PlainDecoder::SkipBack(uint32_t offset) {
+  // Lengths are interleaved with data, so walk from the checkpoint before
+  // the target, which has been passed on the way forward
+  auto target = position_ - offset;
+  auto index = target / kCheckpointInterval;
+  if (index >= checkpoints_.size()) {
+    // Only when the target is the current position
+    return;
   }
+  length_pointer_ = checkpoints_[index];
+  data_pointer_ = length_pointer_ + 4;
+  position_ = index * kCheckpointInterval;
+  Skip(target - position_);
 }
 
 Slice PlainDecoder::Decode() {
+  Checkpoint();
   auto length = *((uint32_t*)length_pointer_);
   auto result = Slice(reinterpret_cast<const char*>(data_pointer_), length);
   data_pointer_ += length + 4;
   length_pointer_ += length + 4;
+  position_++;
   return result;
 }
 
+void PlainDecoder::DecodeBatch(Slice* out, uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i) {
+    out[i] = PlainDecoder::Decode();
+  }
+}
+
 void LengthEncoder::Open() {
   offset_ = 0;
   length_.clear();
@@ -191,6 +220,11 @@ void LengthDecoder::Skip(uint32_t offset) {
   data_pointer_ = data_base_ + *length_pointer_;
 }
 
+void LengthDecoder::SkipBack(uint32_t offset) {
+  length_pointer_ -= offset;
+  data_pointer_ = data_base_ + *length_pointer_;
+}
+
 Slice LengthDecoder::Decode() {
   auto length = *(length_pointer_ + 1) - (*length_pointer_);
   auto result = Slice(reinterpret_cast<const char*>(data_pointer_), length);
@@ -199,14 +233,310 @@ Slice LengthDecoder::Decode() {
   return result;
 }
 
+void LengthDecoder::DecodeBatch(Slice* out, uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i) {
+    out[i] = Slice(reinterpret_cast<const char*>(data_base_ + length_pointer_[i]),
+                   length_pointer_[i + 1] - length_pointer_[i]);
+  }
+  length_pointer_ += n;
+  data_pointer_ = data_base_ + *length_pointer_;
+}
+
+void DictionaryEncoder::Open() {
+  index_.clear();
+  offsets_.clear();
+  offsets_.push_back(0);
+  dict_.clear();
+  codes_.clear();
+}
+
+void DictionaryEncoder::Encode(const Slice& value) {
+  auto inserted = index_.emplace(value.ToString(), index_.size());
+  if (inserted.second) {
+    dict_.append(value.data(), value.size());
+    offsets_.push_back(dict_.size());
+  }
+  codes_.push_back(inserted.first->second);
+}
+
+uint8_t DictionaryEncoder::BitWidth() const {
+  return index_.size() <= 1 ? 0 : 32 - _lzcnt_u32(index_.size() - 1);
+}
+
+uint32_t DictionaryEncoder::EstimateSize() const {
+  // Codes are read with 64-bit loads, keep 8 bytes after them
+  return 5 + offsets_.size() * 4 + dict_.size() +
+         ((codes_.size() * BitWidth() + 7) >> 3) + 8;
+}
+
+void DictionaryEncoder::Close() {}
+
+void DictionaryEncoder::Dump(uint8_t* output) {
+  auto pointer = output;
+  *((uint32_t*)pointer) = index_.size();
+  pointer += 4;
+  auto bit_width = BitWidth();
+  *(pointer++) = bit_width;
+  memcpy(pointer, offsets_.data(), offsets_.size() * 4);
+  pointer += offsets_.size() * 4;
+  memcpy(pointer, dict_.data(), dict_.size());
+  pointer += dict_.size();
+  sboost::byteutils::bitpack(codes_.data(), codes_.size(), bit_width, pointer);
+}
+
+uint32_t DictionaryDecoder::Code(uint32_t index) const {
+  uint64_t bits = (uint64_t)index * bit_width_;
+  return (uint32_t)(*(uint64_t*)(codes_ + (bits >> 3)) >> (bits & 0x7)) &
+         mask_;
+}
+
+void DictionaryDecoder::Attach(const uint8_t* buffer) {
+  auto num_dict = *((uint32_t*)buffer);
+  bit_width_ = *(buffer + 4);
+  mask_ = (uint32_t)((1ULL << bit_width_) - 1);
+  offsets_ = (const uint32_t*)(buffer + 5);
+  dict_ = (const uint8_t*)(offsets_ + num_dict + 1);
+  codes_ = dict_ + offsets_[num_dict];
+  position_ = 0;
+}
+
+void DictionaryDecoder::Skip(uint32_t offset) { position_ += offset; }
+
+void DictionaryDecoder::SkipBack(uint32_t offset) { position_ -= offset; }
+
+Slice DictionaryDecoder::Decode() {
+  auto code = Code(position_++);
+  return Slice(reinterpret_cast<const char*>(dict_ + offsets_[code]),
+               offsets_[code + 1] - offsets_[code]);
+}
+
+void DictionaryDecoder::DecodeBatch(Slice* out, uint32_t n) {
+  for (uint32_t i = 0; i < n; ++i) {
+    out[i] = DictionaryDecoder::Decode();
+  }
+}
+
+namespace {
+// Number of bytes sampled from the values to build the symbol table
+const uint32_t kFsstSampleSize = 16384;
+const uint32_t kFsstMaxSymbol = 255;
+const uint32_t kFsstMaxSymbolLength = 8;
+
+inline uint64_t LoadSymbol(const uint8_t* data, uint32_t length) {
+  uint64_t symbol = 0;
+  memcpy(&symbol, data, length);
+  return symbol;
+}
+}  // namespace
+
+void FsstEncoder::Open() {
+  offsets_.clear();
+  offsets_.push_back(0);
+  buffer_.clear();
+  symbols_.clear();
+  lengths_.clear();
+  compressed_offsets_.clear();
+  compressed_.clear();
+}
+
+void FsstEncoder::Encode(const Slice& value) {
+  buffer_.append(value.data(), value.size());
+  offsets_.push_back(buffer_.size());
+}
+
+uint32_t FsstEncoder::EstimateSize() const {
+  if (compressed_offsets_.empty()) {
+    // Not closed yet, assume the values are not compressed
+    return 5 + offsets_.size() * 4 + buffer_.size();
+  }
+  return 5 + symbols_.size() * 9 + compressed_offsets_.size() * 4 +
+         compressed_.size();
+}
+
+void FsstEncoder::Compress(const uint8_t* data, uint32_t size,
+                           std::string* out, uint32_t* counts) const {
+  auto end = data + size;
+  while (data < end) {
+    bool matched = false;
+    for (auto code : first_[*data]) {
+      auto length = lengths_[code];
+      if (length <= end - data &&
+          LoadSymbol(data, length) == symbols_[code]) {
+        out->push_back((char)code);
+        if (counts != nullptr) {
+          counts[code]++;
+        }
+        data += length;
+        matched = true;
+        break;
+      }
+    }
+    if (!matched) {
+      out->push_back((char)kEscape);
+      out->push_back((char)*(data++));
+    }
+  }
+}
+
+void FsstEncoder::BuildTable() {
+  // Count substrings of 1 to 8 bytes in a sample of the values
+  std::unordered_map<uint64_t, uint32_t> counts[kFsstMaxSymbolLength + 1];
+  auto data = reinterpret_cast<const uint8_t*>(buffer_.data());
+  uint32_t sample_size = 0;
+  for (uint32_t i = 0; i + 1 < offsets_.size() && sample_size < kFsstSampleSize;
+       ++i) {
+    auto begin = offsets_[i];
+    auto end = offsets_[i + 1];
+    for (auto pos = begin; pos < end; ++pos) {
+      auto max_length = std::min(kFsstMaxSymbolLength, end - pos);
+      for (uint32_t length = 1; length <= max_length; ++length) {
+        counts[length][LoadSymbol(data + pos, length)]++;
+      }
+    }
+    sample_size = end;
+  }
+  // Keep the symbols covering most bytes. Counts of overlapping substrings
+  // overestimate the gain, so the unused ones are dropped after a trial
+  // compression of the sample.
+  struct Candidate {
+    uint64_t symbol;
+    uint8_t length;
+    uint32_t gain;
+  };
+  std::vector<Candidate> candidates;
+  for (uint32_t length = 1; length <= kFsstMaxSymbolLength; ++length) {
+    for (auto& count : counts[length]) {
+      if (count.second > 1) {
+        candidates.push_back({count.first, (uint8_t)length,
+                              count.second * length});
+      }
+    }
+  }
+  auto num_symbol = std::min<size_t>(kFsstMaxSymbol, candidates.size());
+  std::partial_sort(candidates.begin(), candidates.begin() + num_symbol,
+                    candidates.end(),
+                    [](const Candidate& a, const Candidate& b) {
+                      return a.gain > b.gain;
+                    });
+  candidates.resize(num_symbol);
+
+  for (int round = 0; round < 2; ++round) {
+    // Longer symbols are tried first
+    std::sort(candidates.begin(), candidates.end(),
+              [](const Candidate& a, const Candidate& b) {
+                return a.length > b.length;
+              });
+    for (auto& codes : first_) {
+      codes.clear();
+    }
+    symbols_.clear();
+    lengths_.clear();
+    for (auto& candidate : candidates) {
+      first_[candidate.symbol & 0xFF].push_back(symbols_.size());
+      symbols_.push_back(candidate.symbol);
+      lengths_.push_back(candidate.length);
+    }
+    if (round == 1) {
+      break;
+    }
+    uint32_t used[kFsstMaxSymbol] = {0};
+    std::string trial;
+    Compress(data, sample_size, &trial, used);
+    std::vector<Candidate> kept;
+    for (uint32_t i = 0; i < symbols_.size(); ++i) {
+      if (used[i] > 1) {
+        kept.push_back(candidates[i]);
+      }
+    }
+    candidates.swap(kept);
+  }
+}
+
+void FsstEncoder::Close() {
+  BuildTable();
+  compressed_offsets_.clear();
+  compressed_offsets_.push_back(0);
+  compressed_.clear();
+  auto data = reinterpret_cast<const uint8_t*>(buffer_.data());
+  for (uint32_t i = 0; i + 1 < offsets_.size(); ++i) {
+    Compress(data + offsets_[i], offsets_[i + 1] - offsets_[i], &compressed_,
+             nullptr);
+    compressed_offsets_.push_back(compressed_.size());
+  }
+}
+
+void FsstEncoder::Dump(uint8_t* output) {
+  auto pointer = output;
+  *((uint32_t*)pointer) = compressed_offsets_.size() - 1;
+  pointer += 4;
+  *(pointer++) = symbols_.size();
+  memcpy(pointer, lengths_.data(), lengths_.size());
+  pointer += lengths_.size();
+  memcpy(pointer, symbols_.data(), symbols_.size() * 8);
+  pointer += symbols_.size() * 8;
+  memcpy(pointer, compressed_offsets_.data(), compressed_offsets_.size() * 4);
+  pointer += compressed_offsets_.size() * 4;
+  memcpy(pointer, compressed_.data(), compressed_.size());
+}
+
+void FsstDecoder::Attach(const uint8_t* buffer) {
+  num_entry_ = *((uint32_t*)buffer);
+  auto num_symbol = *(buffer + 4);
+  lengths_ = buffer + 5;
+  symbols_ = lengths_ + num_symbol;
+  offsets_ = (const uint32_t*)(symbols_ + num_symbol * 8);
+  data_ = (const uint8_t*)(offsets_ + num_entry_ + 1);
+  position_ = 0;
+}
+
+void FsstDecoder::Skip(uint32_t offset) { position_ += offset; }
+
+void FsstDecoder::SkipBack(uint32_t offset) { position_ -= offset; }
+
+Slice FsstDecoder::Decode() {
+  Slice result;
+  FsstDecoder::DecodeBatch(&result, 1);
+  return result;
+}
+
+void FsstDecoder::DecodeBatch(Slice* out, uint32_t n) {
+  // A code expands to at most 8 bytes, and symbols are copied 8 bytes at a
+  // time
+  buffer_.resize((offsets_[position_ + n] - offsets_[position_]) * 8 + 8);
+  auto output = &buffer_[0];
+  for (uint32_t i = 0; i < n; ++i) {
+    auto pointer = data_ + offsets_[position_];
+    auto end = data_ + offsets_[position_ + 1];
+    auto start = output;
+    while (pointer < end) {
+      auto code = *(pointer++);
+      if (code == FsstEncoder::kEscape) {
+        *(output++) = *(pointer++);
+      } else {
+        memcpy(output, symbols_ + code * 8, 8);
+        output += lengths_[code];
+      }
+    }
+    out[i] = Slice(start, output - start);
+    position_++;
+  }
+}
+
 Encoding& EncodingFactory::Get(EncodingType encoding) {
   static EncodingTemplate<PlainEncoder, PlainDecoder> plainEncoding;
   static EncodingTemplate<LengthEncoder, LengthDecoder> lengthEncoding;
+  static EncodingTemplate<DictionaryEncoder, DictionaryDecoder>
+      dictionaryEncoding;
+  static EncodingTemplate<FsstEncoder, FsstDecoder> fsstEncoding;
   switch (encoding) {
     case PLAIN:
       return plainEncoding;
     case LENGTH:
       return lengthEncoding;
+    case DICTIONARY:
+      return dictionaryEncoding;
+    case FSST:
+      return fsstEncoding;
     default:
       return plainEncoding;
   }
@@ -229,13 +559,21 @@ void PlainEncoder::Dump(uint8_t* output) {
 }
 
 void PlainDecoder::Attach(const uint8_t* buffer) {
-  raw_pointer_ = (uint64_t*)buffer;
+  base_ = (uint64_t*)buffer;
+  raw_pointer_ = base_;
 }
 
 void PlainDecoder::Skip(uint32_t offset) { raw_pointer_ += offset; }
 
+void PlainDecoder::SkipBack(uint32_t offset) { raw_pointer_ -= offset; }
+
 uint64_t PlainDecoder::DecodeU64() { return *(raw_pointer_++); }
 
+void PlainDecoder::DecodeBatch(uint64_t* out, uint32_t n) {
+  memcpy(out, raw_pointer_, n * sizeof(uint64_t));
+  raw_pointer_ += n;
+}
+
 void DeltaEncoder::Open() {
   buffer_.clear();
   delta_prev_ = 0;
@@ -272,23 +610,63 @@ void DeltaEncoder::Dump(uint8_t* output) {
 }
 
 void DeltaDecoder::LoadEntry() {
+  if (run_ % kCheckpointInterval == 0 &&
+      run_ / kCheckpointInterval == checkpoints_.size()) {
+    checkpoints_.push_back({pointer_, position_, run_, base_});
+  }
   rle_value_ = zigzagDecoding(readVar64(pointer_));
   rle_counter_ = readVar32(pointer_);
+  rle_length_ = rle_counter_;
+  run_++;
 }
 
 void DeltaDecoder::Attach(const uint8_t* buffer) {
+  start_ = buffer;
+  position_ = 0;
+  base_ = 0;
+  rle_counter_ = 0;
+  rle_length_ = 0;
+  run_ = 0;
   pointer_ = (uint8_t*)buffer;
+  checkpoints_.clear();
 }
 
 void DeltaDecoder::Skip(uint32_t offset) {
-  uint32_t remain = offset;
-  while (remain >= rle_counter_) {
-    remain -= rle_counter_;
-    base_ += rle_value_ * rle_counter_;
-    LoadEntry();
+  while (offset > 0) {
+    if (rle_counter_ == 0) {
+      LoadEntry();
+    }
+    auto run = std::min(rle_counter_, offset);
+    base_ += rle_value_ * run;
+    rle_counter_ -= run;
+    position_ += run;
+    offset -= run;
   }
-  rle_counter_ -= remain;
-  base_ += rle_value_ * remain;
+}
+
+void DeltaDecoder::SkipBack(uint32_t offset) {
+  if (offset <= rle_length_ - rle_counter_) {
+    // Still in the current run
+    position_ -= offset;
+    base_ -= rle_value_ * offset;
+    rle_counter_ += offset;
+    return;
+  }
+  // Values are accumulated from the beginning, so replay them from the
+  // last checkpoint before the target
+  auto target = position_ - offset;
+  auto checkpoint = std::upper_bound(
+      checkpoints_.begin(), checkpoints_.end(), target,
+      [](uint32_t t, const Checkpoint& c) { return t < c.position; });
+  assert(checkpoint != checkpoints_.begin());
+  --checkpoint;
+  pointer_ = checkpoint->pointer;
+  position_ = checkpoint->position;
+  run_ = checkpoint->run;
+  base_ = checkpoint->base;
+  rle_counter_ = 0;
+  rle_length_ = 0;
+  Skip(target - position_);
 }
 
 uint64_t DeltaDecoder::DecodeU64() {
@@ -297,9 +675,27 @@ uint64_t DeltaDecoder::DecodeU64() {
   }
   rle_counter_--;
   base_ += rle_value_;
+  position_++;
   return base_;
 }
 
+void DeltaDecoder::DecodeBatch(uint64_t* out, uint32_t n) {
+  while (n > 0) {
+    if (rle_counter_ == 0) {
+      LoadEntry();
+    }
+    auto run = std::min(rle_counter_, n);
+    for (uint32_t i = 0; i < run; ++i) {
+      base_ += rle_value_;
+      out[i] = base_;
+    }
+    out += run;
+    n -= run;
+    rle_counter_ -= run;
+    position_ += run;
+  }
+}
+
 void BitpackEncoder::Open() {
   buffer_.clear();
   min_ = INT64_MAX;
@@ -316,7 +712,8 @@ uint32_t BitpackEncoder::EstimateSize() const {
   uint8_t bit_width = 64 - _lzcnt_u64(max_ - min_);
   // The buffer should be large enough for a 256 bit read after valid data
   uint32_t buffer_group_size = (buffer_.size() + 7) >> 3;
-  uint32_t size = 1 + bit_width * buffer_group_size + 32;
+  // min and bit width, followed by packed data
+  uint32_t size = 9 + bit_width * buffer_group_size + 32;
   return size;
 }
 
@@ -355,15 +752,27 @@ void BitpackDecoder::Attach(const uint8_t* buffer) {
 }
 
 void BitpackDecoder::Skip(uint32_t offset) {
-  index_ += offset;
-  auto group_index = index_ >> 3;
-  index_ &= 0x7;
+  uint32_t target = index_ + offset;
+  auto group_index = target >> 3;
   if (group_index > 0) {
     pointer_ += (group_index - 1) * bit_width_;
-    auto index_back = index_;
     LoadNextGroup();
-    index_ = index_back;
   }
+  index_ = target & 0x7;
+}
+
+void BitpackDecoder::SkipBack(uint32_t offset) {
+  if (offset <= index_) {
+    index_ -= offset;
+    return;
+  }
+  // Number of groups to move back. pointer_ is always at the group
+  // following the one that has been unpacked
+  uint32_t group_back = (offset - index_ + 7) >> 3;
+  pointer_ -= (group_back + 1) * bit_width_;
+  uint32_t target = index_ + (group_back << 3) - offset;
+  LoadNextGroup();
+  index_ = target;
 }
 
 uint64_t BitpackDecoder::DecodeU64() {
@@ -375,6 +784,42 @@ uint64_t BitpackDecoder::DecodeU64() {
   return entry + min_;
 }
 
+uint64_t BitpackDecoder::At(uint32_t index) const {
+  // Entries are below 32 bits, a 64-bit load at the first byte covers them.
+  // The encoder leaves 32 bytes after the packed data.
+  uint64_t bits = (uint64_t)index * bit_width_;
+  uint64_t word = *(const uint64_t*)(base_ + 9 + (bits >> 3));
+  return ((word >> (bits & 0x7)) & ((1ULL << bit_width_) - 1)) + min_;
+}
+
+void BitpackDecoder::DecodeBatch(uint64_t* out, uint32_t n) {
+  // Drain the group already unpacked
+  uint32_t head = std::min<uint32_t>(8 - index_, n);
+  for (uint32_t i = 0; i < head; ++i) {
+    out[i] = unpacked_[index_ + i] + min_;
+  }
+  index_ += head;
+  if (index_ < 8) {
+    return;
+  }
+  out += head;
+  n -= head;
+  // Unpack full groups, widen to 64 bits and add min in one go
+  auto min = _mm512_set1_epi64(min_);
+  while (n >= 8) {
+    auto up = unpacker_->unpack(pointer_);
+    _mm512_storeu_si512(out, _mm512_add_epi64(_mm512_cvtepu32_epi64(up), min));
+    pointer_ += bit_width_;
+    out += 8;
+    n -= 8;
+  }
+  LoadNextGroup();
+  for (uint32_t i = 0; i < n; ++i) {
+    out[i] = unpacked_[i] + min_;
+  }
+  index_ = n;
+}
+
 Encoding& EncodingFactory::Get(EncodingType encoding) {
   static EncodingTemplate<PlainEncoder, PlainDecoder> plainEncoding;
   static EncodingTemplate<DeltaEncoder, DeltaDecoder> deltaEncoding;
@@ -412,8 +857,15 @@ void PlainDecoder::Attach(const uint8_t* buffer) {
 
 void PlainDecoder::Skip(uint32_t offset) { raw_pointer_ += offset; }
 
+void PlainDecoder::SkipBack(uint32_t offset) { raw_pointer_ -= offset; }
+
 uint32_t PlainDecoder::DecodeU32() { return *(raw_pointer_++); }
 
+void PlainDecoder::DecodeBatch(uint32_t* out, uint32_t n) {
+  memcpy(out, raw_pointer_, n * sizeof(uint32_t));
+  raw_pointer_ += n;
+}
+
 void BitpackEncoder::Open() { buffer_.clear(); }
 
 void BitpackEncoder::Encode(const uint32_t& value) { buffer_.push_back(value); }
@@ -451,15 +903,27 @@ void BitpackDecoder::Attach(const uint8_t* buffer) {
 }
 
 void BitpackDecoder::Skip(uint32_t offset) {
-  index_ += offset;
-  auto group_index = index_ >> 3;
-  index_ &= 0x7;
+  uint32_t target = index_ + offset;
+  auto group_index = target >> 3;
   if (group_index > 0) {
     pointer_ += (group_index - 1) * bit_width_;
-    auto index_back = index_;
     LoadNextGroup();
-    index_ = index_back;
   }
+  index_ = target & 0x7;
+}
+
+void BitpackDecoder::SkipBack(uint32_t offset) {
+  if (offset <= index_) {
+    index_ -= offset;
+    return;
+  }
+  // Number of groups to move back. pointer_ is always at the group
+  // following the one that has been unpacked
+  uint32_t group_back = (offset - index_ + 7) >> 3;
+  pointer_ -= (group_back + 1) * bit_width_;
+  uint32_t target = index_ + (group_back << 3) - offset;
+  LoadNextGroup();
+  index_ = target;
 }
 
 uint32_t BitpackDecoder::DecodeU32() {
@@ -471,14 +935,297 @@ uint32_t BitpackDecoder::DecodeU32() {
   return entry;
 }
 
+void BitpackDecoder::DecodeBatch(uint32_t* out, uint32_t n) {
+  // Drain the group already unpacked
+  uint32_t head = std::min<uint32_t>(8 - index_, n);
+  memcpy(out, unpacked_ + index_, head * sizeof(uint32_t));
+  index_ += head;
+  if (index_ < 8) {
+    return;
+  }
+  out += head;
+  n -= head;
+  // Unpack full groups directly into the output
+  while (n >= 8) {
+    _mm256_storeu_si256((__m256i*)out, unpacker_->unpack(pointer_));
+    pointer_ += bit_width_;
+    out += 8;
+    n -= 8;
+  }
+  LoadNextGroup();
+  memcpy(out, unpacked_, n * sizeof(uint32_t));
+  index_ = n;
+}
+
+void PforEncoder::Open() {
+  buffer_.clear();
+  memset(width_count_, 0, sizeof(width_count_));
+}
+
+void PforEncoder::Encode(const uint32_t& value) {
+  buffer_.push_back(value);
+  width_count_[32 - _lzcnt_u32(value)]++;
+}
+
+uint8_t PforEncoder::BitWidth(uint32_t* num_exception) const {
+  uint32_t num_group = (buffer_.size() + 7) >> 3;
+  uint32_t best_size = UINT32_MAX;
+  uint8_t best_width = 32;
+  // Values wider than the bit width become exceptions, 8 bytes each
+  uint32_t exceptions = 0;
+  for (int width = 32; width >= 0; --width) {
+    uint32_t size = width * num_group + exceptions * 8;
+    if (size < best_size) {
+      best_size = size;
+      best_width = width;
+      *num_exception = exceptions;
+    }
+    exceptions += width_count_[width];
+  }
+  return best_width;
+}
+
+uint32_t PforEncoder::EstimateSize() const {
+  uint32_t num_exception = 0;
+  auto bit_width = BitWidth(&num_exception);
+  uint32_t num_group = (buffer_.size() + 7) >> 3;
+  // The buffer should be large enough for a 256 bit read after valid data
+  return 5 + num_exception * 8 + bit_width * num_group + 32;
+}
+
+void PforEncoder::Close() {}
+
+void PforEncoder::Dump(uint8_t* output) {
+  uint32_t num_exception = 0;
+  auto bit_width = BitWidth(&num_exception);
+  uint32_t mask = (uint32_t)((1ULL << bit_width) - 1);
+
+  auto pointer = output;
+  *(pointer++) = bit_width;
+  *((uint32_t*)pointer) = num_exception;
+  pointer += 4;
+  auto exception_index = (uint32_t*)pointer;
+  auto exception_value = exception_index + num_exception;
+  std::vector<uint32_t> packed;
+  packed.reserve(buffer_.size());
+  for (uint32_t i = 0; i < buffer_.size(); ++i) {
+    auto value = buffer_[i];
+    if (value > mask) {
+      *(exception_index++) = i;
+      *(exception_value++) = value;
+    }
+    packed.push_back(value & mask);
+  }
+  pointer += num_exception * 8;
+  sboost::byteutils::bitpack(packed.data(), packed.size(), bit_width,
+                             pointer);
+}
+
+void PforDecoder::LoadGroup(uint32_t group) {
+  auto up = unpacker_->unpack(data_ + group * bit_width_);
+  memcpy(unpacked_, (uint8_t*)&up, 32);
+  // Patch the exceptions in this group
+  uint32_t start = group << 3;
+  auto exception = std::lower_bound(exception_index_,
+                                    exception_index_ + num_exception_, start);
+  auto exception_end = exception_index_ + num_exception_;
+  for (; exception < exception_end && *exception < start + 8; ++exception) {
+    unpacked_[*exception - start] =
+        exception_value_[exception - exception_index_];
+  }
+  group_ = group;
+}
+
+void PforDecoder::Attach(const uint8_t* buffer) {
+  bit_width_ = *buffer;
+  num_exception_ = *((uint32_t*)(buffer + 1));
+  exception_index_ = (const uint32_t*)(buffer + 5);
+  exception_value_ = exception_index_ + num_exception_;
+  data_ = (const uint8_t*)(exception_value_ + num_exception_);
+  unpacker_ = sboost::unpackers[bit_width_];
+  position_ = 0;
+  LoadGroup(0);
+}
+
+void PforDecoder::Skip(uint32_t offset) { position_ += offset; }
+
+void PforDecoder::SkipBack(uint32_t offset) { position_ -= offset; }
+
+uint32_t PforDecoder::DecodeU32() {
+  auto group = position_ >> 3;
+  if (group != group_) {
+    LoadGroup(group);
+  }
+  return unpacked_[(position_++) & 0x7];
+}
+
+void PforDecoder::DecodeBatch(uint32_t* out, uint32_t n) {
+  while (n > 0) {
+    auto group = position_ >> 3;
+    if (group != group_) {
+      LoadGroup(group);
+    }
+    auto index = position_ & 0x7;
+    auto run = std::min(8 - index, n);
+    memcpy(out, unpacked_ + index, run * sizeof(uint32_t));
+    out += run;
+    n -= run;
+    position_ += run;
+  }
+}
+
+void SkipDeltaEncoder::Open() {
+  buffer_.clear();
+  blocks_size_ = 0;
+  max_delta_ = 0;
+}
+
+void SkipDeltaEncoder::Encode(const uint32_t& value) {
+  if (buffer_.size() % kBlockSize == 0) {
+    if (!buffer_.empty()) {
+      // Close the full block
+      blocks_size_ += 1 + (32 - _lzcnt_u32(max_delta_)) * (kBlockSize >> 3);
+    }
+    max_delta_ = 0;
+  } else {
+    max_delta_ = std::max(max_delta_, value - buffer_.back());
+  }
+  buffer_.push_back(value);
+}
+
+uint32_t SkipDeltaEncoder::EstimateSize() const {
+  uint32_t num_block = (buffer_.size() + kBlockSize - 1) / kBlockSize;
+  uint32_t open_size = buffer_.size() - (num_block - 1) * kBlockSize;
+  uint32_t open_block =
+      1 + (32 - _lzcnt_u32(max_delta_)) * ((open_size + 7) >> 3);
+  // The buffer should be large enough for a 256 bit read after valid data
+  return 8 + num_block * 8 + blocks_size_ + open_block + 32;
+}
+
+void SkipDeltaEncoder::Close() {}
+
+void SkipDeltaEncoder::Dump(uint8_t* output) {
+  uint32_t num_entry = buffer_.size();
+  uint32_t num_block = (num_entry + kBlockSize - 1) / kBlockSize;
+  auto skips = (uint32_t*)(output + 8);
+  *((uint32_t*)output) = num_entry;
+  *((uint32_t*)(output + 4)) = num_block;
+
+  auto blocks = output + 8 + num_block * 8;
+  auto pointer = blocks;
+  uint32_t deltas[kBlockSize];
+  for (uint32_t block = 0; block < num_block; ++block) {
+    auto start = block * kBlockSize;
+    auto size = std::min(kBlockSize, num_entry - start);
+    uint32_t max_delta = 0;
+    deltas[0] = 0;
+    for (uint32_t i = 1; i < size; ++i) {
+      deltas[i] = buffer_[start + i] - buffer_[start + i - 1];
+      max_delta = std::max(max_delta, deltas[i]);
+    }
+    uint8_t bit_width = 32 - _lzcnt_u32(max_delta);
+    skips[block * 2] = buffer_[start];
+    skips[block * 2 + 1] = pointer - blocks;
+    *(pointer++) = bit_width;
+    sboost::byteutils::bitpack(deltas, size, bit_width, pointer);
+    pointer += bit_width * ((size + 7) >> 3);
+  }
+}
+
+void SkipDeltaDecoder::LoadBlock(uint32_t block) {
+  auto pointer = blocks_ + skips_[block * 2 + 1];
+  auto unpacker = sboost::unpackers[*pointer];
+  auto bit_width = *(pointer++);
+  auto size = std::min(SkipDeltaEncoder::kBlockSize,
+                       num_entry_ - block * SkipDeltaEncoder::kBlockSize);
+  for (uint32_t i = 0; i < size; i += 8) {
+    _mm256_storeu_si256((__m256i*)(values_ + i), unpacker->unpack(pointer));
+    pointer += bit_width;
+  }
+  values_[0] = skips_[block * 2];
+  for (uint32_t i = 1; i < size; ++i) {
+    values_[i] += values_[i - 1];
+  }
+  block_ = block;
+}
+
+void SkipDeltaDecoder::Attach(const uint8_t* buffer) {
+  num_entry_ = *((uint32_t*)buffer);
+  num_block_ = *((uint32_t*)(buffer + 4));
+  skips_ = (const uint32_t*)(buffer + 8);
+  blocks_ = buffer + 8 + num_block_ * 8;
+  position_ = 0;
+  LoadBlock(0);
+}
+
+void SkipDeltaDecoder::Skip(uint32_t offset) { position_ += offset; }
+
+void SkipDeltaDecoder::SkipBack(uint32_t offset) { position_ -= offset; }
+
+uint32_t SkipDeltaDecoder::DecodeU32() { return At(position_++); }
+
+void SkipDeltaDecoder::DecodeBatch(uint32_t* out, uint32_t n) {
+  while (n > 0) {
+    auto block = position_ / SkipDeltaEncoder::kBlockSize;
+    if (block != block_) {
+      LoadBlock(block);
+    }
+    auto index = position_ % SkipDeltaEncoder::kBlockSize;
+    auto run = std::min(SkipDeltaEncoder::kBlockSize - index, n);
+    memcpy(out, values_ + index, run * sizeof(uint32_t));
+    out += run;
+    n -= run;
+    position_ += run;
+  }
+}
+
+uint32_t SkipDeltaDecoder::At(uint32_t index) {
+  auto block = index / SkipDeltaEncoder::kBlockSize;
+  if (block != block_) {
+    LoadBlock(block);
+  }
+  return values_[index % SkipDeltaEncoder::kBlockSize];
+}
+
+uint32_t SkipDeltaDecoder::LowerBound(uint32_t target) {
+  if (num_entry_ == 0 || target <= skips_[0]) {
+    return 0;
+  }
+  // Last block starting before target, equal values may end the block
+  // before the one starting with target
+  uint32_t begin = 0;
+  uint32_t end = num_block_ - 1;
+  while (begin < end) {
+    auto current = (begin + end + 1) / 2;
+    if (skips_[current * 2] < target) {
+      begin = current;
+    } else {
+      end = current - 1;
+    }
+  }
+  if (begin != block_) {
+    LoadBlock(begin);
+  }
+  auto size = std::min(SkipDeltaEncoder::kBlockSize,
+                       num_entry_ - begin * SkipDeltaEncoder::kBlockSize);
+  return begin * SkipDeltaEncoder::kBlockSize +
+         (std::lower_bound(values_, values_ + size, target) - values_);
+}
+
 Encoding& EncodingFactory::Get(EncodingType encoding) {
   static EncodingTemplate<PlainEncoder, PlainDecoder> plainEncoding;
   static EncodingTemplate<BitpackEncoder, BitpackDecoder> bitpackEncoding;
+  static EncodingTemplate<PforEncoder, PforDecoder> pforEncoding;
+  static EncodingTemplate<SkipDeltaEncoder, SkipDeltaDecoder> skipDeltaEncoding;
   switch (encoding) {
     case PLAIN:
       return plainEncoding;
     case BITPACK:
       return bitpackEncoding;
+    case PFOR:
+      return pforEncoding;
+    case SKIPDELTA:
+      return skipDeltaEncoding;
     default:
       return plainEncoding;
   }
@@ -500,8 +1247,15 @@ void PlainDecoder::Attach(const uint8_t* buffer) {
 
 void PlainDecoder::Skip(uint32_t offset) { raw_pointer_ += offset; }
 
+void PlainDecoder::SkipBack(uint32_t offset) { raw_pointer_ -= offset; }
+
 uint8_t PlainDecoder::DecodeU8() { return *(raw_pointer_++); }
 
+void PlainDecoder::DecodeBatch(uint8_t* out, uint32_t n) {
+  memcpy(out, raw_pointer_, n);
+  raw_pointer_ += n;
+}
+
 void RleEncoder::writeEntry() {
   buffer_.push_back((last_counter_ << 8) + last_value_);
 }
@@ -552,6 +1306,21 @@ void RleDecoder::Skip(uint32_t offset) {
   counter_ -= remain;
 }
 
+void RleDecoder::SkipBack(uint32_t offset) {
+  auto remain = offset;
+  // pointer_ is right after the entry of the current run
+  uint32_t consumed = (*(pointer_ - 1) >> 8) - counter_;
+  while (remain > consumed) {
+    remain -= consumed;
+    pointer_--;
+    auto result = *(pointer_ - 1);
+    value_ = result & 0xFF;
+    counter_ = 0;
+    consumed = result >> 8;
+  }
+  counter_ += remain;
+}
+
 uint8_t RleDecoder::DecodeU8() {
   if (counter_ == 0) {
     readEntry();
@@ -561,6 +1330,19 @@ uint8_t RleDecoder::DecodeU8() {
   return result;
 }
 
+void RleDecoder::DecodeBatch(uint8_t* out, uint32_t n) {
+  while (n > 0) {
+    if (counter_ == 0) {
+      readEntry();
+    }
+    auto run = std::min(counter_, n);
+    memset(out, value_, run);
+    out += run;
+    n -= run;
+    counter_ -= run;
+  }
+}
+
 void RleVarIntEncoder::writeEntry() {
   buffer_.push_back(last_value_);
   // Write var int
@@ -601,21 +1383,59 @@ void RleVarIntEncoder::Dump(uint8_t* output) {
 }
 
 void RleVarIntDecoder::readEntry() {
+  if (run_ % kCheckpointInterval == 0 &&
+      run_ / kCheckpointInterval == checkpoints_.size()) {
+    checkpoints_.push_back({pointer_, position_, run_});
+  }
   value_ = *(pointer_++);
   counter_ = readVar32(pointer_);
+  length_ = counter_;
+  run_++;
 }
 
 void RleVarIntDecoder::Attach(const uint8_t* buffer) {
+  base_ = buffer;
+  position_ = 0;
+  counter_ = 0;
+  length_ = 0;
+  run_ = 0;
   pointer_ = (uint8_t*)buffer;
+  checkpoints_.clear();
 }
 
 void RleVarIntDecoder::Skip(uint32_t offset) {
-  auto remain = offset;
-  while (remain >= counter_) {
-    remain -= counter_;
-    readEntry();
+  while (offset > 0) {
+    if (counter_ == 0) {
+      readEntry();
+    }
+    auto run = std::min(counter_, offset);
+    counter_ -= run;
+    position_ += run;
+    offset -= run;
   }
-  counter_ -= remain;
+}
+
+void RleVarIntDecoder::SkipBack(uint32_t offset) {
+  if (offset <= length_ - counter_) {
+    // Still in the current run
+    position_ -= offset;
+    counter_ += offset;
+    return;
+  }
+  // Var-int entries cannot be read backward, replay from the last
+  // checkpoint before the target
+  auto target = position_ - offset;
+  auto checkpoint = std::upper_bound(
+      checkpoints_.begin(), checkpoints_.end(), target,
+      [](uint32_t t, const Checkpoint& c) { return t < c.position; });
+  assert(checkpoint != checkpoints_.begin());
+  --checkpoint;
+  pointer_ = checkpoint->pointer;
+  position_ = checkpoint->position;
+  run_ = checkpoint->run;
+  counter_ = 0;
+  length_ = 0;
+  Skip(target - position_);
 }
 
 uint8_t RleVarIntDecoder::DecodeU8() {
@@ -623,9 +1443,24 @@ uint8_t RleVarIntDecoder::DecodeU8() {
     readEntry();
   }
   counter_--;
+  position_++;
   return value_;
 }
 
+void RleVarIntDecoder::DecodeBatch(uint8_t* out, uint32_t n) {
+  while (n > 0) {
+    if (counter_ == 0) {
+      readEntry();
+    }
+    auto run = std::min(counter_, n);
+    memset(out, value_, run);
+    out += run;
+    n -= run;
+    counter_ -= run;
+    position_ += run;
+  }
+}
+
 Encoding& EncodingFactory::Get(EncodingType encoding) {
   static EncodingTemplate<PlainEncoder, PlainDecoder> plainEncoding;
   static EncodingTemplate<RleEncoder, RleDecoder> rleEncoding;
@@ -7,10 +7,15 @@
 
 #include <cstdint>
 #include <memory>
+#include <string>
+#include <unordered_map>
 #include <unpacker.h>
+#include <vector>
 
 #include "leveldb/slice.h"
 
+#include "../respool/respool.h"
+
 using namespace leveldb;
 namespace colsm {
 
@@ -37,6 +42,11 @@ class Encoder {
   virtual void Dump(uint8_t*) = 0;
 };
 
+// Decoders whose records can only be read forward remember their state
+// every kCheckpointInterval records or runs they pass, so that SkipBack
+// replays at most that many from the closest checkpoint before the target
+const uint32_t kCheckpointInterval = 16;
+
 class Decoder {
  public:
   virtual ~Decoder() = default;
@@ -46,6 +56,9 @@ class Decoder {
   // Move forward by records
   virtual void Skip(uint32_t offset) = 0;
 
+  // Move backward by records
+  virtual void SkipBack(uint32_t offset) = 0;
+
   virtual Slice Decode() { return Slice(); }
 
   virtual uint64_t DecodeU64() { return 0; }
@@ -53,13 +66,34 @@ class Decoder {
   virtual uint32_t DecodeU32() { return 0; }
 
   virtual uint8_t DecodeU8() { return 0; }
+
+  // Decode the next n records into out. Encodings that can unpack several
+  // records at a time override these to avoid a virtual call per record
+  virtual void DecodeBatch(Slice* out, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) out[i] = Decode();
+  }
+
+  virtual void DecodeBatch(uint64_t* out, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) out[i] = DecodeU64();
+  }
+
+  virtual void DecodeBatch(uint32_t* out, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) out[i] = DecodeU32();
+  }
+
+  virtual void DecodeBatch(uint8_t* out, uint32_t n) {
+    for (uint32_t i = 0; i < n; ++i) out[i] = DecodeU8();
+  }
 };
 
+// A pooled decoder, returned to the pool when destroyed
+using DecoderHandle = steal_pool<Decoder>::handle;
+
 class Encoding {
  public:
   virtual std::unique_ptr<Encoder> encoder() = 0;
 
-  virtual std::shared_ptr<Decoder> decoder() = 0;
+  virtual DecoderHandle decoder() = 0;
 };
 
 enum EncodingType {
@@ -71,7 +105,16 @@ enum EncodingType {
   // For numbers
   BITPACK,
   RUNLENGTH,
-  DELTA
+  DELTA,
+  // Patched bit-packing, values that do not fit are kept as exceptions
+  PFOR,
+  // Delta of sorted values with skip pointers
+  SKIPDELTA,
+  // For String
+  // Distinct values with bit-packed codes
+  DICTIONARY,
+  // Values compressed with a static table of up to 8-byte symbols
+  FSST
 };
 
 namespace string {
@@ -90,13 +133,26 @@ class PlainEncoder : public Encoder {
 
 class PlainDecoder : public Decoder {
  private:
+  const uint8_t* base_;
+  uint32_t position_;
   uint8_t* length_pointer_;
   const uint8_t* data_pointer_;
+  // length_pointer_ of record i * kCheckpointInterval
+  std::vector<uint8_t*> checkpoints_;
+
+  void Checkpoint() {
+    if (position_ % kCheckpointInterval == 0 &&
+        position_ / kCheckpointInterval == checkpoints_.size()) {
+      checkpoints_.push_back(length_pointer_);
+    }
+  }
 
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   Slice Decode() override;
+  void DecodeBatch(Slice* out, uint32_t n) override;
 };
 
 class LengthEncoder : public Encoder {
@@ -122,7 +178,105 @@ class LengthDecoder : public Decoder {
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
+  Slice Decode() override;
+  void DecodeBatch(Slice* out, uint32_t n) override;
+};
+
+/**
+ * Keeps each distinct value once, and bit-packs the code of every record.
+ * Decoded values point to the dictionary in the encoded buffer.
+ */
+class DictionaryEncoder : public Encoder {
+ private:
+  std::unordered_map<std::string, uint32_t> index_;
+  std::vector<uint32_t> offsets_;
+  std::string dict_;
+  std::vector<uint32_t> codes_;
+
+  uint8_t BitWidth() const;
+
+ public:
+  void Open() override;
+  void Encode(const Slice& value) override;
+  uint32_t EstimateSize() const override;
+  void Close() override;
+  void Dump(uint8_t* output) override;
+};
+
+class DictionaryDecoder : public Decoder {
+ private:
+  uint8_t bit_width_;
+  uint32_t mask_;
+  const uint32_t* offsets_;
+  const uint8_t* dict_;
+  const uint8_t* codes_;
+  uint32_t position_;
+
+  uint32_t Code(uint32_t index) const;
+
+ public:
+  void Attach(const uint8_t* buffer) override;
+  void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
+  Slice Decode() override;
+  void DecodeBatch(Slice* out, uint32_t n) override;
+};
+
+/**
+ * FSST-style compression. A table of up to 255 symbols of 1 to 8 bytes is
+ * built from the values of the column when it is closed, and each value is
+ * compressed separately into symbol codes, so any record can be decoded
+ * without the others. Bytes not covered by a symbol are escaped.
+ */
+class FsstEncoder : public Encoder {
+ private:
+  std::vector<uint32_t> offsets_;
+  std::string buffer_;
+
+  // Symbol table and compressed values, built on Close
+  std::vector<uint64_t> symbols_;
+  std::vector<uint8_t> lengths_;
+  std::vector<uint32_t> compressed_offsets_;
+  std::string compressed_;
+  // Codes of the symbols by their first byte, longest first
+  std::vector<uint8_t> first_[256];
+
+  void BuildTable();
+
+  // Compress data with current table. Count the use of each symbol if
+  // counts is not null
+  void Compress(const uint8_t* data, uint32_t size, std::string* out,
+                uint32_t* counts) const;
+
+ public:
+  static const uint8_t kEscape = 255;
+
+  void Open() override;
+  void Encode(const Slice& value) override;
+  // Before Close, the size of the values without compression
+  uint32_t EstimateSize() const override;
+  void Close() override;
+  void Dump(uint8_t* output) override;
+};
+
+class FsstDecoder : public Decoder {
+ private:
+  uint32_t num_entry_;
+  const uint8_t* lengths_;
+  const uint8_t* symbols_;
+  const uint32_t* offsets_;
+  const uint8_t* data_;
+  uint32_t position_;
+  // Holds the values decoded by the last Decode or DecodeBatch call
+  std::string buffer_;
+
+ public:
+  void Attach(const uint8_t* buffer) override;
+  void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   Slice Decode() override;
+  void DecodeBatch(Slice* out, uint32_t n) override;
 };
 
 class EncodingFactory {
@@ -147,12 +301,18 @@ class PlainEncoder : public Encoder {
 
 class PlainDecoder : public Decoder {
  private:
+  uint64_t* base_;
   uint64_t* raw_pointer_;
 
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint64_t DecodeU64() override;
+  void DecodeBatch(uint64_t* out, uint32_t n) override;
+
+  // Value at index, without moving the decoder
+  uint64_t At(uint32_t index) const { return base_[index]; }
 };
 
 /**
@@ -176,17 +336,33 @@ class DeltaEncoder : public Encoder {
 
 class DeltaDecoder : public Decoder {
  private:
+  // State before a run is loaded
+  struct Checkpoint {
+    uint8_t* pointer;
+    uint32_t position;
+    uint32_t run;
+    uint64_t base;
+  };
+
+  const uint8_t* start_;
+  uint32_t position_;
   uint64_t base_ = 0;
   uint64_t rle_value_;
   uint32_t rle_counter_ = 0;
+  uint32_t rle_length_ = 0;
+  uint32_t run_ = 0;  // Runs loaded
   uint8_t* pointer_;
+  // State before run i * kCheckpointInterval
+  std::vector<Checkpoint> checkpoints_;
 
   void LoadEntry();
 
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint64_t DecodeU64() override;
+  void DecodeBatch(uint64_t* out, uint32_t n) override;
 };
 
 /**
@@ -221,7 +397,12 @@ class BitpackDecoder : public Decoder {
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint64_t DecodeU64() override;
+  void DecodeBatch(uint64_t* out, uint32_t n) override;
+
+  // Value at index, without moving the decoder
+  uint64_t At(uint32_t index) const;
 };
 
 class EncodingFactory {
@@ -251,7 +432,9 @@ class PlainDecoder : public Decoder {
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint32_t DecodeU32() override;
+  void DecodeBatch(uint32_t* out, uint32_t n) override;
 };
 
 class BitpackEncoder : public Encoder {
@@ -280,7 +463,121 @@ class BitpackDecoder : public Decoder {
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
+  uint32_t DecodeU32() override;
+  void DecodeBatch(uint32_t* out, uint32_t n) override;
+};
+
+/**
+ * Patched bit-packing. The bit width is chosen to minimize the total size,
+ * values wider than that are stored as exceptions and only their low bits
+ * are packed.
+ *
+ *   bit_width       : uint8_t
+ *   num_exception   : uint32_t
+ *   exception_index : uint32_t {num_exception}
+ *   exception_value : uint32_t {num_exception}
+ *   packed          : bit-packed uint32_t
+ *
+ * For sorted input the exceptions are the tail of the values.
+ */
+class PforEncoder : public Encoder {
+ private:
+  std::vector<uint32_t> buffer_;
+  // Number of values by their bit width
+  uint32_t width_count_[33];
+
+  uint8_t BitWidth(uint32_t* num_exception) const;
+
+ public:
+  void Open() override;
+  void Encode(const uint32_t& value) override;
+  uint32_t EstimateSize() const override;
+  void Close() override;
+  void Dump(uint8_t* output) override;
+};
+
+class PforDecoder : public Decoder {
+ private:
+  uint8_t bit_width_;
+  uint32_t num_exception_;
+  const uint32_t* exception_index_;
+  const uint32_t* exception_value_;
+  const uint8_t* data_;
+  sboost::Unpacker* unpacker_;
+  // Next record to decode, and the group held in unpacked_
+  uint32_t position_;
+  uint32_t group_;
+  uint32_t unpacked_[8];
+
+  void LoadGroup(uint32_t group);
+
+ public:
+  void Attach(const uint8_t* buffer) override;
+  void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
+  uint32_t DecodeU32() override;
+  void DecodeBatch(uint32_t* out, uint32_t n) override;
+
+  uint8_t BitWidth() const { return bit_width_; }
+  uint32_t NumException() const { return num_exception_; }
+  const uint32_t* ExceptionValues() const { return exception_value_; }
+  const uint8_t* Data() const { return data_; }
+};
+
+/**
+ * Delta of sorted values, bit-packed in blocks of 128 entries with a width
+ * per block. The skip table keeps the first value and offset of each block,
+ * so a search only decodes one block.
+ *
+ *   num_entry : uint32_t
+ *   num_block : uint32_t
+ *   skips     : {start: uint32_t, offset: uint32_t} {num_block}
+ *   blocks    : {bit_width: uint8_t, deltas: bit-packed} {num_block}
+ */
+class SkipDeltaEncoder : public Encoder {
+ private:
+  std::vector<uint32_t> buffer_;
+  // Size of the closed blocks, and max delta of the open one
+  uint32_t blocks_size_;
+  uint32_t max_delta_;
+
+ public:
+  static constexpr uint32_t kBlockSize = 128;
+
+  void Open() override;
+  void Encode(const uint32_t& value) override;
+  uint32_t EstimateSize() const override;
+  void Close() override;
+  void Dump(uint8_t* output) override;
+};
+
+class SkipDeltaDecoder : public Decoder {
+ private:
+  uint32_t num_entry_;
+  uint32_t num_block_;
+  const uint32_t* skips_;
+  const uint8_t* blocks_;
+  // Next record to decode, and the block held in values_
+  uint32_t position_;
+  uint32_t block_;
+  uint32_t values_[SkipDeltaEncoder::kBlockSize];
+
+  void LoadBlock(uint32_t block);
+
+ public:
+  void Attach(const uint8_t* buffer) override;
+  void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint32_t DecodeU32() override;
+  void DecodeBatch(uint32_t* out, uint32_t n) override;
+
+  // Value at index, without moving the decoder
+  uint32_t At(uint32_t index);
+
+  // Index of the first value larger or equal to target, requires the values
+  // to be sorted
+  uint32_t LowerBound(uint32_t target);
 };
 
 class EncodingFactory {
@@ -309,7 +606,9 @@ class PlainDecoder : public Decoder {
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint8_t DecodeU8() override;
+  void DecodeBatch(uint8_t* out, uint32_t n) override;
 };
 
 class RleEncoder : public Encoder {
@@ -343,7 +642,9 @@ class RleDecoder : public Decoder {
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint8_t DecodeU8() override;
+  void DecodeBatch(uint8_t* out, uint32_t n) override;
 };
 
 class RleVarIntEncoder : public Encoder {
@@ -364,16 +665,31 @@ class RleVarIntEncoder : public Encoder {
 
 class RleVarIntDecoder : public Decoder {
  private:
+  // State before a run is read
+  struct Checkpoint {
+    uint8_t* pointer;
+    uint32_t position;
+    uint32_t run;
+  };
+
+  const uint8_t* base_;
+  uint32_t position_;
   uint8_t value_;
   uint32_t counter_ = 0;
+  uint32_t length_ = 0;
+  uint32_t run_ = 0;  // Runs read
   uint8_t* pointer_;
+  // State before run i * kCheckpointInterval
+  std::vector<Checkpoint> checkpoints_;
 
   void readEntry();
 
  public:
   void Attach(const uint8_t* buffer) override;
   void Skip(uint32_t offset) override;
+  void SkipBack(uint32_t offset) override;
   uint8_t DecodeU8() override;
+  void DecodeBatch(uint8_t* out, uint32_t n) override;
 };
 
 class EncodingFactory {
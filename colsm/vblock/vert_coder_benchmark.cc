@@ -138,6 +138,87 @@ void DELTA_64(benchmark::State& state) {
   delete[] byte_buffer;
 }
 
+// Key columns of a section, dense keys or sparse keys with a few outliers
+void prepareKeyData(std::vector<uint32_t>& buffer, bool outlier) {
+  srand(0);
+  uint32_t value = 0;
+  for (int i = 0; i < 256; ++i) {
+    value += outlier && i >= 250 ? 1000000 : 1 + rand() % (outlier ? 30 : 3);
+    buffer.push_back(value);
+  }
+}
+
+void KEY_32(benchmark::State& state, EncodingType type, bool outlier) {
+  std::vector<uint32_t> buffer;
+  prepareKeyData(buffer, outlier);
+
+  auto encoder = u32::EncodingFactory::Get(type).encoder();
+  for (auto& item : buffer) {
+    encoder->Encode(item);
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+
+  uint8_t* byte_buffer = new uint8_t[size];
+  encoder->Dump(byte_buffer);
+
+  uint32_t batch[256];
+  auto decoder = u32::EncodingFactory::Get(type).decoder();
+  for (auto _ : state) {
+    decoder->Attach(byte_buffer);
+    decoder->DecodeBatch(batch, buffer.size());
+    benchmark::DoNotOptimize(batch);
+  }
+  state.counters["bytes"] = size;
+
+  delete[] byte_buffer;
+}
+
+BENCHMARK_CAPTURE(KEY_32, Bitpack/Dense, BITPACK, false);
+BENCHMARK_CAPTURE(KEY_32, Pfor/Dense, PFOR, false);
+BENCHMARK_CAPTURE(KEY_32, SkipDelta/Dense, SKIPDELTA, false);
+BENCHMARK_CAPTURE(KEY_32, Bitpack/Outlier, BITPACK, true);
+BENCHMARK_CAPTURE(KEY_32, Pfor/Outlier, PFOR, true);
+BENCHMARK_CAPTURE(KEY_32, SkipDelta/Outlier, SKIPDELTA, true);
+// YCSB-style values of a section, decoded one at a time at random
+void prepareValueData(std::vector<std::string>& buffer) {
+  srand(0);
+  for (int i = 0; i < 256; ++i) {
+    buffer.push_back("{\"field0\":\"user" + std::to_string(rand() % 1000) +
+                     "\",\"field1\":\"value" + std::to_string(i % 10) +
+                     "\"}");
+  }
+}
+
+void VALUE(benchmark::State& state, EncodingType type) {
+  std::vector<std::string> buffer;
+  prepareValueData(buffer);
+
+  auto encoder = string::EncodingFactory::Get(type).encoder();
+  encoder->Open();
+  for (auto& item : buffer) {
+    encoder->Encode(Slice(item));
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+
+  uint8_t* byte_buffer = new uint8_t[size];
+  encoder->Dump(byte_buffer);
+
+  auto decoder = string::EncodingFactory::Get(type).decoder();
+  for (auto _ : state) {
+    decoder->Attach(byte_buffer);
+    decoder->Skip(rand() % buffer.size());
+    benchmark::DoNotOptimize(decoder->Decode());
+  }
+  state.counters["bytes"] = size;
+
+  delete[] byte_buffer;
+}
+
+BENCHMARK_CAPTURE(VALUE, Length, LENGTH);
+BENCHMARK_CAPTURE(VALUE, Dictionary, DICTIONARY);
+BENCHMARK_CAPTURE(VALUE, Fsst, FSST);
 BENCHMARK(PLAIN_64);
 BENCHMARK(DELTA_64);
 //BENCHMARK(RLE);
@@ -4,10 +4,12 @@
 
 #include "vert_coder.h"
 
+#include <algorithm>
 #include <cstdlib>
 #include <gtest/gtest.h>
 #include <immintrin.h>
 #include <sstream>
+#include <vector>
 
 using namespace colsm;
 using namespace colsm::encoding;
@@ -65,6 +67,53 @@ TEST(StrPlain, EncDec) {
   delete[] buffer;
 }
 
+TEST(StrPlain, SkipBack) {
+  Encoding& plainEncoding = encoding::string::EncodingFactory::Get(PLAIN);
+  auto encoder = plainEncoding.encoder();
+  auto decoder = plainEncoding.decoder();
+
+  std::vector<std::string> expect;
+  for (int i = 0; i < 10000; ++i) {
+    expect.push_back("num" + std::to_string(i));
+    encoder->Encode(Slice(expect.back()));
+  }
+  encoder->Close();
+  uint8_t* buffer = new uint8_t[encoder->EstimateSize()];
+  encoder->Dump(buffer);
+
+  // Batches from the end, as a backward iterator loads them
+  decoder->Attach(buffer);
+  decoder->Skip(10000);
+  Slice batch[64];
+  for (int end = 10000; end > 0; end -= 64) {
+    int start = std::max(0, end - 64);
+    decoder->SkipBack(end - start);
+    decoder->DecodeBatch(batch, end - start);
+    for (int i = start; i < end; ++i) {
+      ASSERT_EQ(expect[i], batch[i - start].ToString()) << i;
+    }
+    decoder->SkipBack(end - start);
+  }
+
+  srand(time(0));
+  int current = 0;
+  for (int i = 0; i < 1000; ++i) {
+    int back = rand() % 100;
+    if (back <= current) {
+      decoder->SkipBack(back);
+      current -= back;
+    }
+    int skip = rand() % 100;
+    if (current + skip < 10000) {
+      decoder->Skip(skip);
+      current += skip;
+      ASSERT_EQ(expect[current], decoder->Decode().ToString());
+      current++;
+    }
+  }
+  delete[] buffer;
+}
+
 TEST(StrLength, EncDec) {
   Encoding& plainEncoding =
       colsm::encoding::string::EncodingFactory::Get(LENGTH);
@@ -119,6 +168,117 @@ TEST(StrLength, EncDec) {
   delete[] buffer;
 }
 
+TEST(StrDictionary, EncDec) {
+  Encoding& dictionaryEncoding =
+      colsm::encoding::string::EncodingFactory::Get(DICTIONARY);
+  auto encoder = dictionaryEncoding.encoder();
+  auto decoder = dictionaryEncoding.decoder();
+
+  std::vector<std::string> values;
+  for (int i = 0; i < 10000; ++i) {
+    values.push_back("value" + std::to_string((i * 7) % 37));
+  }
+  encoder->Open();
+  for (auto& value : values) {
+    encoder->Encode(Slice(value));
+  }
+  encoder->Close();
+  // 37 distinct values in 6 bits, 27 of them have 2 digits
+  ASSERT_EQ(5 + 38 * 4 + 37 * 6 + 27 + 7500 + 8, encoder->EstimateSize());
+  uint8_t* buffer = new uint8_t[encoder->EstimateSize()];
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_EQ(values[i], decoder->Decode().ToString()) << i;
+  }
+
+  srand(time(0));
+  int current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t skip = rand() % 100;
+    current += skip;
+    if (current < 10000) {
+      decoder->Skip(skip);
+      ASSERT_EQ(values[current], decoder->Decode().ToString());
+      current++;
+    }
+  }
+  decoder->Attach(buffer);
+  Slice batch[100];
+  current = 0;
+  while (current < 10000) {
+    uint32_t n = std::min(rand() % 100, 10000 - current);
+    decoder->DecodeBatch(batch, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      ASSERT_EQ(values[current + i], batch[i].ToString()) << current;
+    }
+    current += n;
+  }
+  delete[] buffer;
+}
+
+TEST(StrFsst, EncDec) {
+  Encoding& fsstEncoding = colsm::encoding::string::EncodingFactory::Get(FSST);
+  auto encoder = fsstEncoding.encoder();
+  auto decoder = fsstEncoding.decoder();
+
+  std::vector<std::string> values;
+  uint32_t raw_size = 0;
+  srand(0);
+  for (int i = 0; i < 10000; ++i) {
+    std::string value = "{\"id\":" + std::to_string(rand() % 10000) +
+                        ",\"name\":\"user_" + std::to_string(i) + "\"}";
+    // Bytes not in the symbol table are escaped
+    value.push_back((char)(rand() % 256));
+    if (i % 100 == 0) {
+      value.clear();
+    }
+    values.push_back(value);
+    raw_size += value.size();
+  }
+  encoder->Open();
+  for (auto& value : values) {
+    encoder->Encode(Slice(value));
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  ASSERT_LT(size, raw_size / 2);
+  uint8_t* buffer = new uint8_t[size];
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  for (int i = 0; i < 10000; ++i) {
+    ASSERT_EQ(values[i], decoder->Decode().ToString()) << i;
+  }
+
+  int current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t skip = rand() % 100;
+    current += skip;
+    if (current < 10000) {
+      decoder->Skip(skip);
+      ASSERT_EQ(values[current], decoder->Decode().ToString());
+      current++;
+    }
+  }
+  decoder->Attach(buffer);
+  // Values of a batch stay valid until the next decode
+  Slice batch[100];
+  current = 0;
+  while (current < 10000) {
+    uint32_t n = std::min(rand() % 100, 10000 - current);
+    decoder->DecodeBatch(batch, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      ASSERT_EQ(values[current + i], batch[i].ToString()) << current;
+    }
+    current += n;
+  }
+  delete[] buffer;
+}
+
 TEST(U64Plain, EncDec) {
   Encoding& plainEncoding = u64::EncodingFactory::Get(PLAIN);
   auto encoder = plainEncoding.encoder();
@@ -250,6 +410,53 @@ TEST(U64Delta, EncDec) {
   delete[] buffer;
 }
 
+TEST(U64Delta, SkipBack) {
+  Encoding& deltaEncoding = u64::EncodingFactory::Get(DELTA);
+  auto encoder = deltaEncoding.encoder();
+  auto decoder = deltaEncoding.decoder();
+
+  std::vector<uint64_t> expect;
+  for (int i = 0; i < 10000; ++i) {
+    // Runs of equal deltas broken by jumps
+    expect.push_back(i % 15 == 0 ? i * 100 : i);
+    encoder->Encode(expect.back());
+  }
+  encoder->Close();
+  uint8_t* buffer = new uint8_t[encoder->EstimateSize()];
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  decoder->Skip(10000);
+  uint64_t batch[64];
+  for (int end = 10000; end > 0; end -= 64) {
+    int start = std::max(0, end - 64);
+    decoder->SkipBack(end - start);
+    decoder->DecodeBatch(batch, end - start);
+    for (int i = start; i < end; ++i) {
+      ASSERT_EQ(expect[i], batch[i - start]) << i;
+    }
+    decoder->SkipBack(end - start);
+  }
+
+  srand(time(0));
+  int current = 0;
+  for (int i = 0; i < 1000; ++i) {
+    int back = rand() % 100;
+    if (back <= current) {
+      decoder->SkipBack(back);
+      current -= back;
+    }
+    int skip = rand() % 100;
+    if (current + skip < 10000) {
+      decoder->Skip(skip);
+      current += skip;
+      ASSERT_EQ(expect[current], decoder->DecodeU64()) << current;
+      current++;
+    }
+  }
+  delete[] buffer;
+}
+
 TEST(U64Bitpack, EncDec) {
   Encoding& plainEncoding = u64::EncodingFactory::Get(BITPACK);
   auto encoder = plainEncoding.encoder();
@@ -262,7 +469,7 @@ TEST(U64Bitpack, EncDec) {
 
     auto bitwidth = 64 - _lzcnt_u64(i);
     uint32_t buffer_group_size = (i + 1 + 7) >> 3;
-    uint32_t expect_size = 1 + bitwidth * buffer_group_size + 32;
+    uint32_t expect_size = 9 + bitwidth * buffer_group_size + 32;
     ASSERT_EQ(expect_size, encoder->EstimateSize());
   }
   encoder->Close();
@@ -298,6 +505,59 @@ TEST(U64Bitpack, EncDec) {
   delete[] buffer;
 }
 
+TEST(U64Bitpack, DecodeBatch) {
+  Encoding& bitpackEncoding = u64::EncodingFactory::Get(BITPACK);
+  auto encoder = bitpackEncoding.encoder();
+  auto decoder = bitpackEncoding.decoder();
+
+  for (int i = 0; i < 10000; ++i) {
+    encoder->Encode((uint64_t)(i + 100000));
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder->Dump(buffer);
+
+  srand(time(0));
+  uint64_t batch[100];
+  int current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t n = std::min(rand() % 100, 10000 - current);
+    decoder->DecodeBatch(batch, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      ASSERT_EQ(current + i + 100000, batch[i]) << current;
+    }
+    current += n;
+  }
+  delete[] buffer;
+}
+
+TEST(U64Bitpack, At) {
+  u64::BitpackEncoder encoder;
+  u64::BitpackDecoder decoder;
+
+  encoder.Open();
+  for (int i = 0; i < 1000; ++i) {
+    encoder.Encode((uint64_t)(5000 - i * 3));
+  }
+  encoder.Close();
+  auto size = encoder.EstimateSize();
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder.Dump(buffer);
+
+  decoder.Attach(buffer);
+  decoder.Skip(17);
+  for (int i = 999; i >= 0; --i) {
+    ASSERT_EQ(5000 - i * 3, decoder.At(i)) << i;
+  }
+  // The decoder is not moved
+  ASSERT_EQ(5000 - 17 * 3, decoder.DecodeU64());
+  delete[] buffer;
+}
+
 TEST(U32Plain, EncDec) {
   Encoding& plainEncoding = u32::EncodingFactory::Get(PLAIN);
   auto encoder = plainEncoding.encoder();
@@ -387,6 +647,239 @@ TEST(U32Bitpack, EncDec) {
   delete[] buffer;
 }
 
+TEST(U32Bitpack, SkipBack) {
+  Encoding& bitpackEncoding = u32::EncodingFactory::Get(BITPACK);
+  auto encoder = bitpackEncoding.encoder();
+  auto decoder = bitpackEncoding.decoder();
+
+  for (int i = 0; i < 10000; ++i) {
+    encoder->Encode((uint32_t)i);
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  decoder->Skip(9999);
+  for (int i = 9999; i >= 0; --i) {
+    ASSERT_EQ(i, decoder->DecodeU32()) << i;
+    if (i > 0) {
+      decoder->SkipBack(2);
+    }
+  }
+
+  srand(time(0));
+  int current = 5000;
+  decoder->Attach(buffer);
+  decoder->Skip(current);
+  ASSERT_EQ(current, decoder->DecodeU32());
+  for (int i = 0; i < 1000; ++i) {
+    int back = rand() % 100;
+    if (back > current) {
+      continue;
+    }
+    // The decoder is positioned after current
+    decoder->SkipBack(back + 1);
+    current -= back;
+    ASSERT_EQ(current, decoder->DecodeU32());
+    int skip = rand() % 100;
+    if (current + skip + 1 >= 10000) {
+      continue;
+    }
+    decoder->Skip(skip);
+    current += skip + 1;
+    ASSERT_EQ(current, decoder->DecodeU32());
+  }
+  delete[] buffer;
+}
+
+TEST(U32Bitpack, DecodeBatch) {
+  Encoding& bitpackEncoding = u32::EncodingFactory::Get(BITPACK);
+  auto encoder = bitpackEncoding.encoder();
+  auto decoder = bitpackEncoding.decoder();
+
+  for (int i = 0; i < 10000; ++i) {
+    encoder->Encode((uint32_t)i);
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder->Dump(buffer);
+
+  srand(time(0));
+  uint32_t batch[100];
+  int current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t n = std::min(rand() % 100, 10000 - current);
+    decoder->DecodeBatch(batch, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      ASSERT_EQ(current + i, batch[i]) << current;
+    }
+    current += n;
+    // Mix with single decoding
+    if (current < 10000) {
+      ASSERT_EQ(current, decoder->DecodeU32());
+      current++;
+    }
+  }
+  delete[] buffer;
+}
+
+TEST(U32Pfor, EncDec) {
+  Encoding& pforEncoding = u32::EncodingFactory::Get(PFOR);
+  auto encoder = pforEncoding.encoder();
+  auto decoder = pforEncoding.decoder();
+
+  // Small values with a few large outliers
+  std::vector<uint32_t> values;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    values.push_back(i % 1000 == 999 ? 0x10000000 + i : i % 100);
+  }
+  for (auto& value : values) {
+    encoder->Encode(value);
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  // 7 bits, 10 exceptions
+  ASSERT_EQ(5 + 80 + 7 * 1250 + 32, size);
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  for (uint32_t i = 0; i < 10000; ++i) {
+    ASSERT_EQ(values[i], decoder->DecodeU32()) << i;
+  }
+
+  srand(time(0));
+  int current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t skip = rand() % 100;
+    current += skip;
+    if (current < 10000) {
+      decoder->Skip(skip);
+      ASSERT_EQ(values[current], decoder->DecodeU32()) << current;
+      current++;
+    }
+  }
+
+  decoder->Attach(buffer);
+  decoder->Skip(9999);
+  for (int i = 9999; i >= 0; --i) {
+    ASSERT_EQ(values[i], decoder->DecodeU32()) << i;
+    if (i > 0) {
+      decoder->SkipBack(2);
+    }
+  }
+
+  uint32_t batch[100];
+  current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t n = std::min(rand() % 100, 10000 - current);
+    decoder->DecodeBatch(batch, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      ASSERT_EQ(values[current + i], batch[i]) << current;
+    }
+    current += n;
+  }
+  delete[] buffer;
+}
+
+TEST(U32SkipDelta, EncDec) {
+  Encoding& skipDeltaEncoding = u32::EncodingFactory::Get(SKIPDELTA);
+  auto encoder = skipDeltaEncoding.encoder();
+  auto decoder = skipDeltaEncoding.decoder();
+
+  // Sorted values with small gaps, and a large one in block 2
+  std::vector<uint32_t> values;
+  uint32_t value = 0;
+  for (uint32_t i = 0; i < 10000; ++i) {
+    value += i == 300 ? 100000 : i % 3;
+    values.push_back(value);
+    encoder->Encode(value);
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  // 79 blocks of 2-bit deltas, but 17 bits for block 2, the last block has
+  // 16 entries
+  ASSERT_EQ(8 + 79 * 8 + 77 * 33 + 1 + 17 * 16 + 1 + 2 * 2 + 32, size);
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  for (uint32_t i = 0; i < 10000; ++i) {
+    ASSERT_EQ(values[i], decoder->DecodeU32()) << i;
+  }
+
+  srand(time(0));
+  int current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t skip = rand() % 300;
+    current += skip;
+    if (current < 10000) {
+      decoder->Skip(skip);
+      ASSERT_EQ(values[current], decoder->DecodeU32()) << current;
+      current++;
+    }
+  }
+
+  decoder->Attach(buffer);
+  decoder->Skip(9999);
+  for (int i = 9999; i >= 0; --i) {
+    ASSERT_EQ(values[i], decoder->DecodeU32()) << i;
+    if (i > 0) {
+      decoder->SkipBack(2);
+    }
+  }
+
+  uint32_t batch[300];
+  current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t n = std::min(rand() % 300, 10000 - current);
+    decoder->DecodeBatch(batch, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      ASSERT_EQ(values[current + i], batch[i]) << current;
+    }
+    current += n;
+  }
+  delete[] buffer;
+}
+
+TEST(U32SkipDelta, LowerBound) {
+  u32::SkipDeltaEncoder encoder;
+  u32::SkipDeltaDecoder decoder;
+
+  // Runs of equal values crossing the block boundaries
+  std::vector<uint32_t> values;
+  encoder.Open();
+  for (uint32_t i = 0; i < 1000; ++i) {
+    values.push_back(i / 5 * 3);
+    encoder.Encode(values.back());
+  }
+  encoder.Close();
+  std::vector<uint8_t> buffer(encoder.EstimateSize());
+  encoder.Dump(buffer.data());
+
+  decoder.Attach(buffer.data());
+  for (uint32_t target = 0; target <= values.back() + 1; ++target) {
+    uint32_t expect =
+        std::lower_bound(values.begin(), values.end(), target) - values.begin();
+    ASSERT_EQ(expect, decoder.LowerBound(target)) << target;
+    if (expect < values.size()) {
+      ASSERT_EQ(values[expect], decoder.At(expect));
+    }
+  }
+}
+
 TEST(U8Plain, EncDec) {
   Encoding& plainEncoding = u8::EncodingFactory::Get(PLAIN);
   auto encoder = plainEncoding.encoder();
@@ -472,6 +965,83 @@ TEST(U8Rle, EncDec) {
   delete[] buffer;
 }
 
+TEST(U8Rle, SkipBack) {
+  Encoding& rleEncoding = u8::EncodingFactory::Get(RUNLENGTH);
+  auto encoder = rleEncoding.encoder();
+  auto decoder = rleEncoding.decoder();
+
+  for (int i = 0; i < 10000; ++i) {
+    encoder->Encode((uint8_t)((i / 17) % 256));
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  decoder->Skip(9999);
+  for (int i = 9999; i >= 0; --i) {
+    ASSERT_EQ((i / 17) % 256, decoder->DecodeU8()) << i;
+    if (i > 0) {
+      decoder->SkipBack(2);
+    }
+  }
+
+  srand(time(0));
+  int current = 5000;
+  decoder->Attach(buffer);
+  decoder->Skip(current);
+  ASSERT_EQ((current / 17) % 256, decoder->DecodeU8());
+  for (int i = 0; i < 1000; ++i) {
+    int back = rand() % 100;
+    if (back > current) {
+      continue;
+    }
+    // The decoder is positioned after current
+    decoder->SkipBack(back + 1);
+    current -= back;
+    ASSERT_EQ((current / 17) % 256, decoder->DecodeU8());
+    int skip = rand() % 100;
+    if (current + skip + 1 >= 10000) {
+      continue;
+    }
+    decoder->Skip(skip);
+    current += skip + 1;
+    ASSERT_EQ((current / 17) % 256, decoder->DecodeU8());
+  }
+  delete[] buffer;
+}
+
+TEST(U8Rle, DecodeBatch) {
+  Encoding& rleEncoding = u8::EncodingFactory::Get(RUNLENGTH);
+  auto encoder = rleEncoding.encoder();
+  auto decoder = rleEncoding.decoder();
+
+  for (int i = 0; i < 10000; ++i) {
+    encoder->Encode((uint8_t)((i / 17) % 256));
+  }
+  encoder->Close();
+  auto size = encoder->EstimateSize();
+  uint8_t* buffer = new uint8_t[size];
+  memset(buffer, 0, size);
+  encoder->Dump(buffer);
+
+  srand(time(0));
+  uint8_t batch[100];
+  int current = 0;
+  decoder->Attach(buffer);
+  while (current < 10000) {
+    uint32_t n = std::min(rand() % 100, 10000 - current);
+    decoder->DecodeBatch(batch, n);
+    for (uint32_t i = 0; i < n; ++i) {
+      ASSERT_EQ(((current + i) / 17) % 256, batch[i]) << current;
+    }
+    current += n;
+  }
+  delete[] buffer;
+}
+
 TEST(U8RleVar, EncDec) {
   Encoding& plainEncoding = u8::EncodingFactory::Get(BITPACK);
   auto encoder = plainEncoding.encoder();
@@ -525,6 +1095,52 @@ TEST(U8RleVar, EncDec) {
   delete[] buffer;
 }
 
+TEST(U8RleVar, SkipBack) {
+  Encoding& rleVarEncoding = u8::EncodingFactory::Get(BITPACK);
+  auto encoder = rleVarEncoding.encoder();
+  auto decoder = rleVarEncoding.decoder();
+
+  std::vector<uint8_t> expect;
+  for (int i = 0; i < 10000; ++i) {
+    expect.push_back((uint8_t)((i / 17) % 256));
+    encoder->Encode(expect.back());
+  }
+  encoder->Close();
+  uint8_t* buffer = new uint8_t[encoder->EstimateSize()];
+  encoder->Dump(buffer);
+
+  decoder->Attach(buffer);
+  decoder->Skip(10000);
+  uint8_t batch[64];
+  for (int end = 10000; end > 0; end -= 64) {
+    int start = std::max(0, end - 64);
+    decoder->SkipBack(end - start);
+    decoder->DecodeBatch(batch, end - start);
+    for (int i = start; i < end; ++i) {
+      ASSERT_EQ(expect[i], batch[i - start]) << i;
+    }
+    decoder->SkipBack(end - start);
+  }
+
+  srand(time(0));
+  int current = 0;
+  for (int i = 0; i < 1000; ++i) {
+    int back = rand() % 100;
+    if (back <= current) {
+      decoder->SkipBack(back);
+      current -= back;
+    }
+    int skip = rand() % 100;
+    if (current + skip < 10000) {
+      decoder->Skip(skip);
+      current += skip;
+      ASSERT_EQ(expect[current], decoder->DecodeU8()) << current;
+      current++;
+    }
+  }
+  delete[] buffer;
+}
+
 // LevelDB test did not use gtest_main
 int main(int argc, char** argv) {
   testing::InitGoogleTest(&argc, argv);
@@ -42,10 +42,11 @@ bool IsVerticalTable(leveldb::Env* env, const std::string& filename) {
 
   bool usev = false;
   Iterator* iter = meta->NewIterator(BytewiseComparator());
-  std::string key = "vformat";
+  std::string key = "block.colsm.vformat";
   iter->Seek(key);
   if (iter->Valid() && iter->key() == Slice(key)) {
-    usev = (iter->value().ToString() == "true");
+    // Tables with vertical and row data blocks are rebuilt the same way
+    usev = (iter->value().ToString() != "false");
   }
   delete iter;
   delete meta;
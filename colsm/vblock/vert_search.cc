@@ -0,0 +1,429 @@
+//
+// Created by harper on 12/9/20.
+//
+
+#include "vert_search.h"
+
+#include <cstring>
+
+#if defined(COLSM_SEARCH_X86)
+#include <immintrin.h>
+
+#define COLSM_TARGET_AVX2 __attribute__((target("avx2")))
+#define COLSM_TARGET_AVX512 __attribute__((target("avx2,avx512f")))
+#endif
+
+namespace colsm {
+
+namespace {
+inline uint32_t width_mask(uint8_t bitwidth) {
+  return (uint32_t)((1ULL << bitwidth) - 1);
+}
+
+// Bytes taken by num_entry packed entries
+inline uint32_t packed_size(uint32_t num_entry, uint8_t bitwidth) {
+  return (uint32_t)(((uint64_t)num_entry * bitwidth + 7) >> 3);
+}
+
+// Load 8 bytes at offset, with the bytes beyond size as 0
+inline uint64_t load_bytes(const uint8_t* data, uint32_t offset,
+                           uint32_t size) {
+  uint64_t value = 0;
+  if (offset + 8 <= size) {
+    memcpy(&value, data + offset, 8);
+  } else {
+    memcpy(&value, data + offset, size - offset);
+  }
+  return value;
+}
+
+// Entries are at most 32 bits and start at any bit offset in a byte, a 64-bit
+// load always covers them
+inline uint32_t extract(const uint8_t* data, uint32_t size, uint32_t index,
+                        uint8_t bitwidth, uint32_t mask) {
+  uint64_t bits = (uint64_t)index * bitwidth;
+  return (uint32_t)(load_bytes(data, bits >> 3, size) >> (bits & 0x7)) & mask;
+}
+
+// The first entry of each group starts at a byte boundary
+template <uint32_t kLanes>
+inline uint32_t group_head(const uint8_t* data, uint32_t size, uint32_t group,
+                           uint8_t bitwidth, uint32_t mask) {
+  return (uint32_t)load_bytes(data, group * bitwidth * (kLanes / 8), size) &
+         mask;
+}
+
+// Find the last group whose head satisfies pred, the caller makes sure
+// group 0 does
+template <uint32_t kLanes, typename P>
+inline uint32_t search_group(const uint8_t* data, uint32_t size,
+                             uint32_t num_entry, uint8_t bitwidth,
+                             uint32_t mask, P pred) {
+  uint32_t begin = 0;
+  uint32_t end = (num_entry - 1) / kLanes;
+  while (begin < end) {
+    auto current = (begin + end + 1) / 2;
+    if (pred(group_head<kLanes>(data, size, current, bitwidth, mask))) {
+      begin = current;
+    } else {
+      end = current - 1;
+    }
+  }
+  return begin;
+}
+
+// The gathers load 8 bytes for each lane, which may pass the end of the
+// last group. Such a group is copied to tail, zero padded, and read there.
+template <uint32_t kLanes>
+inline const uint8_t* group_data(const uint8_t* data, uint32_t size,
+                                 uint32_t group, uint8_t bitwidth,
+                                 uint8_t* tail) {
+  uint32_t offset = group * bitwidth * (kLanes / 8);
+  if (offset + bitwidth * (kLanes / 8) + 8 <= size) {
+    return data + offset;
+  }
+  memset(tail, 0, kLanes * 4 + 8);
+  memcpy(tail, data + offset, size - offset);
+  return tail;
+}
+}  // namespace
+
+namespace scalar {
+
+// Keys may repeat, one for each version. Both searches return the first of
+// the equal entries.
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target) {
+  uint32_t index = geq_packed(data, num_entry, bitwidth, target);
+  if (index < num_entry &&
+      extract(data, packed_size(num_entry, bitwidth), index, bitwidth,
+              width_mask(bitwidth)) == target) {
+    return index;
+  }
+  return -1;
+}
+
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target) {
+  uint32_t mask = width_mask(bitwidth);
+  if (target > mask) {
+    return num_entry;
+  }
+  uint32_t size = packed_size(num_entry, bitwidth);
+  uint32_t begin = 0;
+  uint32_t end = num_entry;
+  while (begin < end) {
+    auto current = begin + (end - begin) / 2;
+    if (extract(data, size, current, bitwidth, mask) < target) {
+      begin = current + 1;
+    } else {
+      end = current;
+    }
+  }
+  return begin;
+}
+
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target) {
+  uint32_t mask = width_mask(bitwidth);
+  if (target > mask) {
+    return num_entry - 1;
+  }
+  uint32_t size = packed_size(num_entry, bitwidth);
+  uint32_t begin = 0;
+  uint32_t end = num_entry - 1;
+  while (begin < end) {
+    auto current = (begin + end + 1) / 2;
+
+    auto extracted = extract(data, size, current, bitwidth, mask);
+
+    if (extracted <= target) {
+      begin = current;
+    } else {
+      end = current - 1;
+    }
+  }
+  return begin;
+}
+}  // namespace scalar
+
+#if defined(COLSM_SEARCH_X86)
+namespace avx2 {
+
+namespace {
+COLSM_TARGET_AVX2
+inline __m256i valid_lanes(uint32_t num_valid) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  return _mm256_cmpgt_epi32(_mm256_set1_epi32(num_valid), lanes);
+}
+
+// Unpack the valid entries of a group with two 4-lane gathers
+COLSM_TARGET_AVX2
+inline __m256i unpack_group(const uint8_t* group, uint8_t bitwidth,
+                            uint32_t mask, __m256i valid) {
+  const __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  const __m256i low_dwords = _mm256_setr_epi32(0, 2, 4, 6, 1, 3, 5, 7);
+  __m256i bits = _mm256_mullo_epi32(lanes, _mm256_set1_epi32(bitwidth));
+  __m256i bytes = _mm256_srli_epi32(bits, 3);
+  __m256i shifts = _mm256_and_si256(bits, _mm256_set1_epi32(0x7));
+
+  __m256i low = _mm256_mask_i32gather_epi64(
+      _mm256_setzero_si256(), (const long long*)group,
+      _mm256_castsi256_si128(bytes),
+      _mm256_cvtepi32_epi64(_mm256_castsi256_si128(valid)), 1);
+  __m256i high = _mm256_mask_i32gather_epi64(
+      _mm256_setzero_si256(), (const long long*)group,
+      _mm256_extracti128_si256(bytes, 1),
+      _mm256_cvtepi32_epi64(_mm256_extracti128_si256(valid, 1)), 1);
+  low = _mm256_srlv_epi64(
+      low, _mm256_cvtepu32_epi64(_mm256_castsi256_si128(shifts)));
+  high = _mm256_srlv_epi64(
+      high, _mm256_cvtepu32_epi64(_mm256_extracti128_si256(shifts, 1)));
+
+  low = _mm256_permutevar8x32_epi32(low, low_dwords);
+  high = _mm256_permutevar8x32_epi32(high, low_dwords);
+  __m256i result = _mm256_permute2x128_si256(low, high, 0x20);
+  return _mm256_and_si256(result, _mm256_set1_epi32(mask));
+}
+
+// AVX2 has no unsigned compare, use min/max instead
+COLSM_TARGET_AVX2
+inline uint32_t count_lt(__m256i entries, uint32_t target, __m256i valid) {
+  __m256i ge = _mm256_cmpeq_epi32(
+      _mm256_max_epu32(entries, _mm256_set1_epi32(target)), entries);
+  return __builtin_popcount(
+      _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_andnot_si256(ge, valid))));
+}
+
+COLSM_TARGET_AVX2
+inline uint32_t count_le(__m256i entries, uint32_t target, __m256i valid) {
+  __m256i le = _mm256_cmpeq_epi32(
+      _mm256_min_epu32(entries, _mm256_set1_epi32(target)), entries);
+  return __builtin_popcount(
+      _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_and_si256(le, valid))));
+}
+}  // namespace
+
+bool Supported() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+}
+
+COLSM_TARGET_AVX2
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target) {
+  uint32_t index = geq_packed(data, num_entry, bitwidth, target);
+  if (index < num_entry &&
+      extract(data, packed_size(num_entry, bitwidth), index, bitwidth,
+              width_mask(bitwidth)) == target) {
+    return index;
+  }
+  return -1;
+}
+
+COLSM_TARGET_AVX2
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target) {
+  uint32_t mask = width_mask(bitwidth);
+  if (target > mask) {
+    return num_entry;
+  }
+  uint32_t size = packed_size(num_entry, bitwidth);
+  if (num_entry == 0 ||
+      group_head<kLanes>(data, size, 0, bitwidth, mask) >= target) {
+    return 0;
+  }
+  auto group =
+      search_group<kLanes>(data, size, num_entry, bitwidth, mask,
+                           [=](uint32_t head) { return head < target; });
+  auto base = group * kLanes;
+  auto valid = valid_lanes(num_entry - base);
+  uint8_t tail[kLanes * 4 + 8];
+  auto entries = unpack_group(
+      group_data<kLanes>(data, size, group, bitwidth, tail), bitwidth, mask,
+      valid);
+  return base + count_lt(entries, target, valid);
+}
+
+COLSM_TARGET_AVX2
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target) {
+  uint32_t mask = width_mask(bitwidth);
+  if (target > mask) {
+    return num_entry - 1;
+  }
+  uint32_t size = packed_size(num_entry, bitwidth);
+  if (num_entry == 0 ||
+      group_head<kLanes>(data, size, 0, bitwidth, mask) > target) {
+    return 0;
+  }
+  auto group =
+      search_group<kLanes>(data, size, num_entry, bitwidth, mask,
+                           [=](uint32_t head) { return head <= target; });
+  auto base = group * kLanes;
+  auto valid = valid_lanes(num_entry - base);
+  uint8_t tail[kLanes * 4 + 8];
+  auto entries = unpack_group(
+      group_data<kLanes>(data, size, group, bitwidth, tail), bitwidth, mask,
+      valid);
+  return base + count_le(entries, target, valid) - 1;
+}
+}  // namespace avx2
+
+namespace avx512 {
+
+namespace {
+inline __mmask16 valid_lanes(uint32_t num_valid) {
+  return num_valid >= 16 ? 0xFFFF : (__mmask16)((1u << num_valid) - 1);
+}
+
+// Unpack the valid entries of a group with two 8-lane gathers. Invalid lanes
+// are not loaded.
+COLSM_TARGET_AVX512
+inline __m512i unpack_group(const uint8_t* group, uint8_t bitwidth,
+                            uint32_t mask, __mmask16 valid) {
+  const __m512i lanes =
+      _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15);
+  __m512i bits = _mm512_mullo_epi32(lanes, _mm512_set1_epi32(bitwidth));
+  __m512i bytes = _mm512_srli_epi32(bits, 3);
+  __m512i shifts = _mm512_and_si512(bits, _mm512_set1_epi32(0x7));
+
+  __m512i low = _mm512_mask_i32gather_epi64(
+      _mm512_setzero_si512(), (__mmask8)valid, _mm512_castsi512_si256(bytes),
+      group, 1);
+  __m512i high = _mm512_mask_i32gather_epi64(
+      _mm512_setzero_si512(), (__mmask8)(valid >> 8),
+      _mm512_extracti64x4_epi64(bytes, 1), group, 1);
+  low = _mm512_srlv_epi64(
+      low, _mm512_cvtepu32_epi64(_mm512_castsi512_si256(shifts)));
+  high = _mm512_srlv_epi64(
+      high, _mm512_cvtepu32_epi64(_mm512_extracti64x4_epi64(shifts, 1)));
+
+  __m512i result =
+      _mm512_inserti64x4(_mm512_castsi256_si512(_mm512_cvtepi64_epi32(low)),
+                         _mm512_cvtepi64_epi32(high), 1);
+  return _mm512_and_si512(result, _mm512_set1_epi32(mask));
+}
+
+// Number of valid entries in the group smaller than target
+COLSM_TARGET_AVX512
+inline uint32_t count_lt(__m512i entries, uint32_t target, __mmask16 valid) {
+  return __builtin_popcount(
+      _mm512_mask_cmplt_epu32_mask(valid, entries, _mm512_set1_epi32(target)));
+}
+
+COLSM_TARGET_AVX512
+inline uint32_t count_le(__m512i entries, uint32_t target, __mmask16 valid) {
+  return __builtin_popcount(
+      _mm512_mask_cmple_epu32_mask(valid, entries, _mm512_set1_epi32(target)));
+}
+}  // namespace
+
+bool Supported() {
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx512f");
+}
+
+COLSM_TARGET_AVX512
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target) {
+  uint32_t index = geq_packed(data, num_entry, bitwidth, target);
+  if (index < num_entry &&
+      extract(data, packed_size(num_entry, bitwidth), index, bitwidth,
+              width_mask(bitwidth)) == target) {
+    return index;
+  }
+  return -1;
+}
+
+COLSM_TARGET_AVX512
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target) {
+  uint32_t mask = width_mask(bitwidth);
+  if (target > mask) {
+    return num_entry;
+  }
+  uint32_t size = packed_size(num_entry, bitwidth);
+  if (num_entry == 0 ||
+      group_head<kLanes>(data, size, 0, bitwidth, mask) >= target) {
+    return 0;
+  }
+  auto group =
+      search_group<kLanes>(data, size, num_entry, bitwidth, mask,
+                           [=](uint32_t head) { return head < target; });
+  auto base = group * kLanes;
+  auto valid = valid_lanes(num_entry - base);
+  uint8_t tail[kLanes * 4 + 8];
+  auto entries = unpack_group(
+      group_data<kLanes>(data, size, group, bitwidth, tail), bitwidth, mask,
+      valid);
+  return base + count_lt(entries, target, valid);
+}
+
+COLSM_TARGET_AVX512
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target) {
+  uint32_t mask = width_mask(bitwidth);
+  if (target > mask) {
+    return num_entry - 1;
+  }
+  uint32_t size = packed_size(num_entry, bitwidth);
+  if (num_entry == 0 ||
+      group_head<kLanes>(data, size, 0, bitwidth, mask) > target) {
+    return 0;
+  }
+  auto group =
+      search_group<kLanes>(data, size, num_entry, bitwidth, mask,
+                           [=](uint32_t head) { return head <= target; });
+  auto base = group * kLanes;
+  auto valid = valid_lanes(num_entry - base);
+  uint8_t tail[kLanes * 4 + 8];
+  auto entries = unpack_group(
+      group_data<kLanes>(data, size, group, bitwidth, tail), bitwidth, mask,
+      valid);
+  return base + count_le(entries, target, valid) - 1;
+}
+}  // namespace avx512
+#endif
+
+namespace {
+struct PackedSearch {
+  decltype(&scalar::eq_packed) eq;
+  decltype(&scalar::geq_packed) geq;
+  decltype(&scalar::section_packed) section;
+};
+
+PackedSearch PickSearch() {
+#if defined(COLSM_SEARCH_X86)
+  if (avx512::Supported()) {
+    return {avx512::eq_packed, avx512::geq_packed, avx512::section_packed};
+  }
+  if (avx2::Supported()) {
+    return {avx2::eq_packed, avx2::geq_packed, avx2::section_packed};
+  }
+#endif
+  return {scalar::eq_packed, scalar::geq_packed, scalar::section_packed};
+}
+
+const PackedSearch& Search() {
+  static const PackedSearch search = PickSearch();
+  return search;
+}
+}  // namespace
+
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target) {
+  return Search().eq(data, num_entry, bitwidth, target);
+}
+
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target) {
+  return Search().geq(data, num_entry, bitwidth, target);
+}
+
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target) {
+  return Search().section(data, num_entry, bitwidth, target);
+}
+
+}  // namespace colsm
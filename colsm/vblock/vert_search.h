@@ -0,0 +1,86 @@
+//
+// Search functions on bit-packed sorted keys, used by vertical blocks to
+// locate entries in sections and sections in block meta.
+//
+// The entries are packed little-endian in a continuous bit stream, as done
+// by sboost::byteutils::bitpack. Each group of 8 entries takes exactly
+// bitwidth bytes, so the head of each group is byte-aligned. The searches
+// read no byte beyond the ceil(num_entry * bitwidth / 8) bytes of the
+// stream.
+//
+
+#ifndef LEVELDB_VERT_SEARCH_H
+#define LEVELDB_VERT_SEARCH_H
+
+#include <cstdint>
+
+#if defined(__x86_64__) || defined(__i386__)
+#define COLSM_SEARCH_X86 1
+#endif
+
+namespace colsm {
+
+namespace scalar {
+// Return the index of the first entry equal to target, -1 if not found
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target);
+
+// Return the first entry larger or equal to the target
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target);
+
+// Return the last entry with a key smaller or equal to target
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target);
+}  // namespace scalar
+
+#if defined(COLSM_SEARCH_X86)
+// Binary search on the heads of lane groups, then compare the entries of the
+// last group in one instruction. These are built for their instruction set
+// whatever the compiler flags are, and must only be called when
+// Supported() is true.
+namespace avx2 {
+const uint32_t kLanes = 8;
+
+bool Supported();
+
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target);
+
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target);
+
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target);
+}  // namespace avx2
+
+namespace avx512 {
+const uint32_t kLanes = 16;
+
+bool Supported();
+
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target);
+
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target);
+
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target);
+}  // namespace avx512
+#endif
+
+// The searches of the widest instruction set the CPU supports, picked when
+// first called
+int eq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+              uint32_t target);
+
+int geq_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+               uint32_t target);
+
+int section_packed(const uint8_t* data, uint32_t num_entry, uint8_t bitwidth,
+                   uint32_t target);
+
+}  // namespace colsm
+
+#endif  // LEVELDB_VERT_SEARCH_H
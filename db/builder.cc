@@ -13,12 +13,11 @@
 #include "leveldb/env.h"
 #include "leveldb/iterator.h"
 
-#include "colsm/cost/cost_model.h"
-
 namespace leveldb {
 
 Status BuildTable(const std::string& dbname, Env* env, const Options& options,
-                  TableCache* table_cache, Iterator* iter, FileMetaData* meta) {
+                  TableCache* table_cache, Iterator* iter, FileMetaData* meta,
+                  bool vertical) {
   Status s;
   meta->file_size = 0;
   iter->SeekToFirst();
@@ -31,12 +30,7 @@ Status BuildTable(const std::string& dbname, Env* env, const Options& options,
       return s;
     }
 
-    // Only writing level 0 will call this function
-    // The function `BuildTable` is called by WriteLevel0Table and ConvertLogToTable, which
-    // are both level 0 tables
-    // July 5th, 2021
-    TableBuilder* builder = new TableBuilder(
-            options, colsm::CostModel::INSTANCE->ShouldVertical(0), file);
+    TableBuilder* builder = new TableBuilder(options, vertical, file);
     meta->smallest.DecodeFrom(iter->key());
     Slice key;
     for (; iter->Valid(); iter->Next()) {
@@ -18,6 +18,7 @@
 #include <atomic>
 #include <cstdint>
 #include <cstdio>
+#include <memory>
 #include <set>
 #include <string>
 #include <vector>
@@ -36,6 +37,8 @@
 #include "util/logging.h"
 #include "util/mutexlock.h"
 
+#include "colsm/cost/calibrate.h"
+
 namespace leveldb {
 
 const int kNumNonTableCacheFiles = 10;
@@ -43,12 +46,21 @@ const int kNumNonTableCacheFiles = 10;
 // Information kept for every waiting writer
 struct DBImpl::Writer {
   explicit Writer(port::Mutex* mu)
-      : batch(nullptr), sync(false), done(false), cv(mu) {}
+      : batch(nullptr),
+        sync(false),
+        done(false),
+        last_sequence(0),
+        leader(nullptr),
+        pending_inserts(0),
+        cv(mu) {}
 
   Status status;
   WriteBatch* batch;
   bool sync;
   bool done;
+  SequenceNumber last_sequence;  // Of the group led by this writer
+  Writer* leader;       // Set once batch is logged and may be inserted
+  int pending_inserts;  // Followers of this leader still inserting
   port::CondVar cv;
 };
 
@@ -65,6 +77,8 @@ struct DBImpl::CompactionState {
   explicit CompactionState(Compaction* c)
       : compaction(c),
         smallest_snapshot(0),
+        has_start(false),
+        has_end(false),
         outfile(nullptr),
         builder(nullptr),
         total_bytes(0) {}
@@ -77,6 +91,14 @@ struct DBImpl::CompactionState {
   // we can drop all entries for the same key with sequence numbers < S.
   SequenceNumber smallest_snapshot;
 
+  // Key range merged by this state, the user keys in (start, end]. Only
+  // bounded for the subcompactions of a split compaction.
+  bool has_start;
+  bool has_end;
+  std::string start;
+  std::string end;
+  Compaction::KeyCursor cursor;
+
   std::vector<Output> outputs;
 
   // State kept for output being generated
@@ -84,6 +106,9 @@ struct DBImpl::CompactionState {
   TableBuilder* builder;
 
   uint64_t total_bytes;
+
+  // Of the key range, bytes_read counts the entries read
+  CompactionStats stats;
 };
 
 // Fix user-supplied options to be reasonable
@@ -102,6 +127,8 @@ Options SanitizeOptions(const std::string& dbname,
   ClipToRange(&result.max_open_files, 64 + kNumNonTableCacheFiles, 50000);
   ClipToRange(&result.write_buffer_size, 64 << 10, 1 << 30);
   ClipToRange(&result.max_file_size, 1 << 20, 1 << 30);
+  ClipToRange(&result.max_subcompactions, 1, 64);
+  ClipToRange(&result.max_background_compactions, 1, 64);
   ClipToRange(&result.block_size, 1 << 10, 4 << 20);
   if (result.info_log == nullptr) {
     // Open a log file in the same directory as the db
@@ -139,13 +166,15 @@ DBImpl::DBImpl(const Options& raw_options, const std::string& dbname)
       background_work_finished_signal_(&mutex_),
       mem_(nullptr),
       imm_(nullptr),
-      has_imm_(false),
       logfile_(nullptr),
       logfile_number_(0),
       log_(nullptr),
       seed_(0),
-      tmp_batch_(new WriteBatch),
-      background_compaction_scheduled_(false),
+      background_flush_scheduled_(false),
+      background_compactions_scheduled_(0),
+      background_compactions_running_(0),
+      manifest_writing_(false),
+      memtable_pushdown_pending_(false),
       manual_compaction_(nullptr),
       versions_(new VersionSet(dbname_, &options_, table_cache_,
                                &internal_comparator_)) {}
@@ -154,7 +183,7 @@ DBImpl::~DBImpl() {
   // Wait for background work to finish.
   mutex_.Lock();
   shutting_down_.store(true, std::memory_order_release);
-  while (background_compaction_scheduled_) {
+  while (background_flush_scheduled_ || background_compactions_scheduled_ > 0) {
     background_work_finished_signal_.Wait();
   }
   mutex_.Unlock();
@@ -166,7 +195,6 @@ DBImpl::~DBImpl() {
   delete versions_;
   if (mem_ != nullptr) mem_->Unref();
   if (imm_ != nullptr) imm_->Unref();
-  delete tmp_batch_;
   delete log_;
   delete logfile_;
   delete table_cache_;
@@ -211,6 +239,82 @@ Status DBImpl::NewDB() {
   return s;
 }
 
+bool ReadLayoutParameter(Env* env, const std::string& dbname,
+                         colsm::CostModel* model) {
+  const std::string fname = ColsmParameterFileName(dbname);
+  colsm::Parameter param = model->GetParameter();
+  std::string contents;
+  if (env->FileExists(fname) &&
+      ReadFileToString(env, fname, &contents).ok() &&
+      colsm::DecodeHardwareParameter(contents, &param)) {
+    model->SetHardwareParameter(param);
+    return true;
+  }
+  return false;
+}
+
+void InitLayout(const Options& options, colsm::CostModel* model) {
+  const char* kModelFile = "colsm_model";
+  colsm::Workload workload{options.layout_lookup_ratio,
+                           options.layout_scan_ratio,
+                           options.layout_update_ratio};
+  bool has_workload = workload.alpha + workload.beta + workload.gamma > 0;
+  if (options.env->FileExists(kModelFile)) {
+    std::string contents;
+    std::vector<bool> layout;
+    if (has_workload) {
+      Log(options.info_log,
+          "Ignoring %s, the layout is solved for the workload in options",
+          kModelFile);
+    } else if (ReadFileToString(options.env, kModelFile, &contents).ok() &&
+               colsm::DecodeLayout(contents, &layout)) {
+      Log(options.info_log,
+          "Layout taken from %s, set the layout_*_ratio options instead",
+          kModelFile);
+      model->SetLayout(layout);
+      return;
+    } else {
+      Log(options.info_log, "Ignoring malformed %s", kModelFile);
+    }
+  }
+  if (model->SolveLayout(workload)) {
+    Log(options.info_log, "Layout solved\n%s", model->DebugString().c_str());
+  }
+}
+
+void DBImpl::LoadLayoutParameter() {
+  if (ReadLayoutParameter(env_, dbname_, &cost_model_) ||
+      !options_.calibrate_layout_model) {
+    return;
+  }
+  const std::string fname = ColsmParameterFileName(dbname_);
+  colsm::Parameter param = cost_model_.GetParameter();
+  const uint64_t start_micros = env_->NowMicros();
+  colsm::Calibrator().Run(&param);
+  cost_model_.SetHardwareParameter(param);
+  Status s =
+      WriteStringToFile(env_, colsm::EncodeHardwareParameter(param), fname);
+  Log(options_.info_log, "Calibrated cost model in %llu micros: %s",
+      static_cast<unsigned long long>(env_->NowMicros() - start_micros),
+      s.ToString().c_str());
+}
+
+void DBImpl::SolveLayout() {
+  mutex_.AssertHeld();
+  cost_model_.SetSpaceBudget(options_.layout_space_budget);
+  UpdateLayoutLevelBytes();
+  InitLayout(options_, &cost_model_);
+}
+
+void DBImpl::UpdateLayoutLevelBytes() {
+  mutex_.AssertHeld();
+  std::vector<int64_t> bytes;
+  for (int level = 0; level < config::kNumLevels; ++level) {
+    bytes.push_back(versions_->NumLevelBytes(level));
+  }
+  cost_model_.SetLevelBytes(bytes);
+}
+
 void DBImpl::MaybeIgnoreError(Status* s) const {
   if (s->ok() || options_.paranoid_checks) {
     // No change needed
@@ -262,11 +366,16 @@ void DBImpl::RemoveObsoleteFiles() {
         case kCurrentFile:
         case kDBLockFile:
         case kInfoLogFile:
+        case kColsmParameterFile:
           keep = true;
           break;
       }
 
       if (!keep) {
+        if (!files_being_deleted_.insert(filename).second) {
+          // Another thread has listed it and is deleting it
+          continue;
+        }
         files_to_delete.push_back(std::move(filename));
         if (type == kTableFile) {
           table_cache_->Evict(number);
@@ -285,6 +394,9 @@ void DBImpl::RemoveObsoleteFiles() {
     env_->RemoveFile(dbname_ + "/" + filename);
   }
   mutex_.Lock();
+  for (const std::string& filename : files_to_delete) {
+    files_being_deleted_.erase(filename);
+  }
 }
 
 Status DBImpl::Recover(VersionEdit* edit, bool* save_manifest) {
@@ -434,7 +546,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     WriteBatchInternal::SetContents(&batch, record);
 
     if (mem == nullptr) {
-      mem = new MemTable(internal_comparator_);
+      mem = new MemTable(internal_comparator_,
+                         options_.allow_concurrent_memtable_write);
       mem->Ref();
     }
     status = WriteBatchInternal::InsertInto(&batch, mem);
@@ -451,7 +564,10 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     if (mem->ApproximateMemoryUsage() > options_.write_buffer_size) {
       compactions++;
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t number;
+      status = WriteLevel0Table(mem, edit, nullptr, &number);
+      // Nothing deletes obsolete files during recovery
+      pending_outputs_.erase(number);
       mem->Unref();
       mem = nullptr;
       if (!status.ok()) {
@@ -480,7 +596,8 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
         mem = nullptr;
       } else {
         // mem can be nullptr if lognum exists but was empty.
-        mem_ = new MemTable(internal_comparator_);
+        mem_ = new MemTable(internal_comparator_,
+                            options_.allow_concurrent_memtable_write);
         mem_->Ref();
       }
     }
@@ -490,7 +607,9 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
     // mem did not get reused; compact it.
     if (status.ok()) {
       *save_manifest = true;
-      status = WriteLevel0Table(mem, edit, nullptr);
+      uint64_t number;
+      status = WriteLevel0Table(mem, edit, nullptr, &number);
+      pending_outputs_.erase(number);
     }
     mem->Unref();
   }
@@ -499,12 +618,13 @@ Status DBImpl::RecoverLogFile(uint64_t log_number, bool last_log,
 }
 
 Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
-                                Version* base) {
+                                Version* base, uint64_t* number) {
   mutex_.AssertHeld();
   const uint64_t start_micros = env_->NowMicros();
   FileMetaData meta;
   meta.number = versions_->NewFileNumber();
   pending_outputs_.insert(meta.number);
+  *number = meta.number;
   Iterator* iter = mem->NewIterator();
   Log(options_.info_log, "Level-0 table #%llu: started",
       (unsigned long long)meta.number);
@@ -512,7 +632,8 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   Status s;
   {
     mutex_.Unlock();
-    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    s = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta,
+                   cost_model_.ShouldVertical(0));
     mutex_.Lock();
   }
 
@@ -520,7 +641,6 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
       (unsigned long long)meta.number, (unsigned long long)meta.file_size,
       s.ToString().c_str());
   delete iter;
-  pending_outputs_.erase(meta.number);
 
   // Note that if file_size is zero, the file has been deleted and
   // should not be added to the manifest.
@@ -528,8 +648,10 @@ Status DBImpl::WriteLevel0Table(MemTable* mem, VersionEdit* edit,
   if (s.ok() && meta.file_size > 0) {
     const Slice min_user_key = meta.smallest.user_key();
     const Slice max_user_key = meta.largest.user_key();
-    if (base != nullptr) {
+    // Running compactions may write to the levels below level-0
+    if (base != nullptr && background_compactions_running_ == 0) {
       level = base->PickLevelForMemTableOutput(min_user_key, max_user_key);
+      memtable_pushdown_pending_ = (level > 0);
     }
     edit->AddFile(level, meta.number, meta.file_size, meta.smallest,
                   meta.largest);
@@ -550,7 +672,8 @@ void DBImpl::CompactMemTable() {
   VersionEdit edit;
   Version* base = versions_->current();
   base->Ref();
-  Status s = WriteLevel0Table(imm_, &edit, base);
+  uint64_t number;
+  Status s = WriteLevel0Table(imm_, &edit, base, &number);
   base->Unref();
 
   if (s.ok() && shutting_down_.load(std::memory_order_acquire)) {
@@ -561,14 +684,15 @@ void DBImpl::CompactMemTable() {
   if (s.ok()) {
     edit.SetPrevLogNumber(0);
     edit.SetLogNumber(logfile_number_);  // Earlier logs no longer needed
-    s = versions_->LogAndApply(&edit, &mutex_);
+    s = LogAndApply(&edit);
   }
+  pending_outputs_.erase(number);
+  memtable_pushdown_pending_ = false;
 
   if (s.ok()) {
     // Commit to the new state
     imm_->Unref();
     imm_ = nullptr;
-    has_imm_.store(false, std::memory_order_release);
     RemoveObsoleteFiles();
   } else {
     RecordBackgroundError(s);
@@ -602,6 +726,7 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
   ManualCompaction manual;
   manual.level = level;
   manual.done = false;
+  manual.in_progress = false;
   if (begin == nullptr) {
     manual.begin = nullptr;
   } else {
@@ -629,6 +754,10 @@ void DBImpl::TEST_CompactRange(int level, const Slice* begin,
     // Cancel my manual compaction since we aborted early for some reason.
     manual_compaction_ = nullptr;
   }
+  while (manual.in_progress) {
+    // A background thread is still compacting a part of it
+    background_work_finished_signal_.Wait();
+  }
 }
 
 Status DBImpl::TEST_CompactMemTable() {
@@ -655,59 +784,119 @@ void DBImpl::RecordBackgroundError(const Status& s) {
   }
 }
 
+Status DBImpl::LogAndApply(VersionEdit* edit) {
+  mutex_.AssertHeld();
+  // Memtable and level compactions finish on different threads
+  while (manifest_writing_) {
+    background_work_finished_signal_.Wait();
+  }
+  manifest_writing_ = true;
+  Status s = versions_->LogAndApply(edit, &mutex_);
+  manifest_writing_ = false;
+  background_work_finished_signal_.SignalAll();
+  return s;
+}
+
 void DBImpl::MaybeScheduleCompaction() {
   mutex_.AssertHeld();
-  if (background_compaction_scheduled_) {
-    // Already scheduled
-  } else if (shutting_down_.load(std::memory_order_acquire)) {
+  if (shutting_down_.load(std::memory_order_acquire)) {
     // DB is being deleted; no more background compactions
+    return;
   } else if (!bg_error_.ok()) {
     // Already got an error; no more changes
-  } else if (imm_ == nullptr && manual_compaction_ == nullptr &&
-             !versions_->NeedsCompaction()) {
+    return;
+  }
+
+  if (imm_ != nullptr && !background_flush_scheduled_) {
+    background_flush_scheduled_ = true;
+    env_->ScheduleWithPriority(&DBImpl::BGFlush, this, Env::kHighPriority);
+  }
+  if (background_compactions_scheduled_ >=
+      options_.max_background_compactions) {
+    // All compaction threads are busy
+  } else if (manual_compaction_ == nullptr && !versions_->NeedsCompaction()) {
     // No work to be done
   } else {
-    background_compaction_scheduled_ = true;
-    env_->Schedule(&DBImpl::BGWork, this);
+    background_compactions_scheduled_++;
+    env_->ScheduleWithPriority(&DBImpl::BGWork, this, Env::kLowPriority);
   }
 }
 
+void DBImpl::BGFlush(void* db) {
+  reinterpret_cast<DBImpl*>(db)->BackgroundFlushCall();
+}
+
+void DBImpl::BackgroundFlushCall() {
+  MutexLock l(&mutex_);
+  assert(background_flush_scheduled_);
+  if (shutting_down_.load(std::memory_order_acquire)) {
+    // No more background work when shutting down.
+  } else if (!bg_error_.ok()) {
+    // No more background work after a background error.
+  } else if (imm_ != nullptr) {
+    CompactMemTable();
+  }
+
+  background_flush_scheduled_ = false;
+
+  // The new level-0 file may call for a compaction.
+  MaybeScheduleCompaction();
+  background_work_finished_signal_.SignalAll();
+}
+
 void DBImpl::BGWork(void* db) {
   reinterpret_cast<DBImpl*>(db)->BackgroundCall();
 }
 
 void DBImpl::BackgroundCall() {
   MutexLock l(&mutex_);
-  assert(background_compaction_scheduled_);
+  assert(background_compactions_scheduled_ > 0);
+  bool compacted = false;
   if (shutting_down_.load(std::memory_order_acquire)) {
     // No more background work when shutting down.
   } else if (!bg_error_.ok()) {
     // No more background work after a background error.
   } else {
-    BackgroundCompaction();
+    compacted = BackgroundCompaction();
   }
 
-  background_compaction_scheduled_ = false;
+  background_compactions_scheduled_--;
 
   // Previous compaction may have produced too many files in a level,
-  // so reschedule another compaction if needed.
-  MaybeScheduleCompaction();
+  // so reschedule another compaction if needed.  When nothing could be
+  // picked, the running compactions reschedule as they finish.
+  if (compacted) {
+    MaybeScheduleCompaction();
+  }
   background_work_finished_signal_.SignalAll();
 }
 
-void DBImpl::BackgroundCompaction() {
+bool DBImpl::BackgroundCompaction() {
   mutex_.AssertHeld();
 
-  if (imm_ != nullptr) {
-    CompactMemTable();
-    return;
+  if (options_.layout_adapt_interval > 0) {
+    UpdateLayoutLevelBytes();
+  }
+  if (cost_model_.MaybeReevaluate(options_.layout_adapt_interval)) {
+    Log(options_.info_log, "Layout changed\n%s",
+        cost_model_.DebugString().c_str());
+  }
+
+  while (memtable_pushdown_pending_) {
+    background_work_finished_signal_.Wait();
   }
 
   Compaction* c;
-  bool is_manual = (manual_compaction_ != nullptr);
+  ManualCompaction* m = manual_compaction_;
+  bool is_manual = (m != nullptr && !m->in_progress);
   InternalKey manual_end;
   if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
+    if (background_compactions_running_ > 0) {
+      // Start nothing else, the manual compaction runs once the running
+      // compactions finish
+      return false;
+    }
+    m->in_progress = true;
     c = versions_->CompactRange(m->level, m->begin, m->end);
     m->done = (c == nullptr);
     if (c != nullptr) {
@@ -722,6 +911,13 @@ void DBImpl::BackgroundCompaction() {
     c = versions_->PickCompaction();
   }
 
+  const bool picked = (c != nullptr);
+  if (picked) {
+    background_compactions_running_++;
+    // Another thread may find a compaction of other files
+    MaybeScheduleCompaction();
+  }
+
   Status status;
   if (c == nullptr) {
     // Nothing to do
@@ -732,7 +928,7 @@ void DBImpl::BackgroundCompaction() {
     c->edit()->RemoveFile(c->level(), f->number);
     c->edit()->AddFile(c->level() + 1, f->number, f->file_size, f->smallest,
                        f->largest);
-    status = versions_->LogAndApply(c->edit(), &mutex_);
+    status = LogAndApply(c->edit());
     if (!status.ok()) {
       RecordBackgroundError(status);
     }
@@ -752,6 +948,9 @@ void DBImpl::BackgroundCompaction() {
     RemoveObsoleteFiles();
   }
   delete c;
+  if (picked) {
+    background_compactions_running_--;
+  }
 
   if (status.ok()) {
     // Done
@@ -762,7 +961,6 @@ void DBImpl::BackgroundCompaction() {
   }
 
   if (is_manual) {
-    ManualCompaction* m = manual_compaction_;
     if (!status.ok()) {
       m->done = true;
     }
@@ -772,8 +970,12 @@ void DBImpl::BackgroundCompaction() {
       m->tmp_storage = manual_end;
       m->begin = &m->tmp_storage;
     }
-    manual_compaction_ = nullptr;
+    m->in_progress = false;
+    if (manual_compaction_ == m) {
+      manual_compaction_ = nullptr;
+    }
   }
+  return picked;
 }
 
 void DBImpl::CleanupCompaction(CompactionState* compact) {
@@ -813,9 +1015,10 @@ Status DBImpl::OpenCompactionOutputFile(CompactionState* compact) {
   std::string fname = TableFileName(dbname_, file_number);
   Status s = env_->NewWritableFile(fname, &compact->outfile);
   if (s.ok()) {
-    auto level = compact->compaction->level();
+    // Outputs go to the level below the compaction level
+    const int level = compact->compaction->level() + 1;
     compact->builder = new TableBuilder(
-            options_, colsm::CostModel::INSTANCE->ShouldVertical(level), compact->outfile);
+        options_, cost_model_.ShouldVertical(level), compact->outfile);
   }
   return s;
 }
@@ -884,12 +1087,11 @@ Status DBImpl::InstallCompactionResults(CompactionState* compact) {
     compact->compaction->edit()->AddFile(level + 1, out.number, out.file_size,
                                          out.smallest, out.largest);
   }
-  return versions_->LogAndApply(compact->compaction->edit(), &mutex_);
+  return LogAndApply(compact->compaction->edit());
 }
 
 Status DBImpl::DoCompactionWork(CompactionState* compact) {
   const uint64_t start_micros = env_->NowMicros();
-  int64_t imm_micros = 0;  // Micros spent doing imm_ compactions
 
   Log(options_.info_log, "Compacting %d@%d + %d@%d files",
       compact->compaction->num_input_files(0), compact->compaction->level(),
@@ -905,33 +1107,153 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
     compact->smallest_snapshot = snapshots_.oldest()->sequence_number();
   }
 
-  Iterator* input = versions_->MakeInputIterator(compact->compaction);
+  // Split the compaction into key ranges, the column inputs cannot seek
+  std::vector<std::string> boundaries;
+  if (options_.max_subcompactions > 1 && !options_.vert_column_compaction) {
+    compact->compaction->SplitKeyRange(options_.max_subcompactions,
+                                       &boundaries);
+  }
+  std::vector<CompactionState*> ranges;
+  std::vector<Iterator*> inputs;
+  if (boundaries.empty()) {
+    ranges.push_back(compact);
+  } else {
+    for (size_t i = 0; i <= boundaries.size(); i++) {
+      CompactionState* range = new CompactionState(compact->compaction);
+      range->smallest_snapshot = compact->smallest_snapshot;
+      if (i > 0) {
+        range->has_start = true;
+        range->start = boundaries[i - 1];
+      }
+      if (i < boundaries.size()) {
+        range->has_end = true;
+        range->end = boundaries[i];
+      }
+      ranges.push_back(range);
+    }
+  }
+  for (size_t i = 0; i < ranges.size(); i++) {
+    inputs.push_back(versions_->MakeInputIterator(compact->compaction));
+  }
 
   // Release mutex while we're actually doing the compaction work
   mutex_.Unlock();
 
-  input->SeekToFirst();
+  // The other ranges run on their own threads, and this thread takes the
+  // first one
+  struct RangeWork {
+    DBImpl* db;
+    CompactionState* range;
+    Iterator* input;
+    port::Mutex* mu;
+    port::CondVar* cv;
+    int* remaining;
+    Status status;
+
+    static void Run(void* arg) {
+      RangeWork* work = reinterpret_cast<RangeWork*>(arg);
+      work->status = work->db->CompactKeyRange(work->range, work->input);
+      MutexLock l(work->mu);
+      (*work->remaining)--;
+      work->cv->Signal();
+    }
+  };
+  port::Mutex range_mu;
+  port::CondVar range_cv(&range_mu);
+  int remaining = ranges.size() - 1;
+  std::vector<RangeWork> works(ranges.size());
+  for (size_t i = 1; i < ranges.size(); i++) {
+    works[i] = RangeWork{this,      ranges[i], inputs[i],  &range_mu,
+                         &range_cv, &remaining, Status()};
+    env_->StartThread(&RangeWork::Run, &works[i]);
+  }
+  works[0].status = CompactKeyRange(ranges[0], inputs[0]);
+  range_mu.Lock();
+  while (remaining > 0) {
+    range_cv.Wait();
+  }
+  range_mu.Unlock();
+
+  Status status;
+  for (size_t i = 0; i < ranges.size(); i++) {
+    if (status.ok()) {
+      status = works[i].status;
+    }
+    delete inputs[i];
+  }
+
+  CompactionStats stats;
+  stats.micros = env_->NowMicros() - start_micros;
+  for (int which = 0; which < 2; which++) {
+    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
+      stats.bytes_read += compact->compaction->input(which, i)->file_size;
+    }
+  }
+
+  mutex_.Lock();
+  if (ranges.size() > 1) {
+    // Outputs of the ranges are in key order
+    for (size_t i = 0; i < ranges.size(); i++) {
+      CompactionState* range = ranges[i];
+      Log(options_.info_log,
+          "Subcompaction %d/%d: %d files, %lld bytes read, %lld bytes "
+          "written, %lld micros",
+          static_cast<int>(i + 1), static_cast<int>(ranges.size()),
+          static_cast<int>(range->outputs.size()),
+          static_cast<long long>(range->stats.bytes_read),
+          static_cast<long long>(range->stats.bytes_written),
+          static_cast<long long>(range->stats.micros));
+      compact->outputs.insert(compact->outputs.end(), range->outputs.begin(),
+                              range->outputs.end());
+      compact->total_bytes += range->total_bytes;
+      range->outputs.clear();
+      CleanupCompaction(range);
+    }
+  }
+  for (size_t i = 0; i < compact->outputs.size(); i++) {
+    stats.bytes_written += compact->outputs[i].file_size;
+  }
+  stats_[compact->compaction->level() + 1].Add(stats);
+
+  if (status.ok()) {
+    status = InstallCompactionResults(compact);
+  }
+  if (!status.ok()) {
+    RecordBackgroundError(status);
+  }
+  VersionSet::LevelSummaryStorage tmp;
+  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  return status;
+}
+
+Status DBImpl::CompactKeyRange(CompactionState* compact, Iterator* input) {
+  const uint64_t start_micros = env_->NowMicros();
+  const Comparator* ucmp = user_comparator();
+  if (compact->has_start) {
+    // Skip to the last entry of the start key, then past it
+    InternalKey start(compact->start, 0, static_cast<ValueType>(0));
+    input->Seek(start.Encode());
+    while (input->Valid() && input->key().size() >= 8 &&
+           ucmp->Compare(ExtractUserKey(input->key()), compact->start) == 0) {
+      input->Next();
+    }
+  } else {
+    input->SeekToFirst();
+  }
   Status status;
   ParsedInternalKey ikey;
   std::string current_user_key;
   bool has_current_user_key = false;
   SequenceNumber last_sequence_for_key = kMaxSequenceNumber;
   while (input->Valid() && !shutting_down_.load(std::memory_order_acquire)) {
-    // Prioritize immutable compaction work
-    if (has_imm_.load(std::memory_order_relaxed)) {
-      const uint64_t imm_start = env_->NowMicros();
-      mutex_.Lock();
-      if (imm_ != nullptr) {
-        CompactMemTable();
-        // Wake up MakeRoomForWrite() if necessary.
-        background_work_finished_signal_.SignalAll();
-      }
-      mutex_.Unlock();
-      imm_micros += (env_->NowMicros() - imm_start);
-    }
-
     Slice key = input->key();
-    if (compact->compaction->ShouldStopBefore(key) &&
+    if (compact->has_end && key.size() >= 8 &&
+        ucmp->Compare(ExtractUserKey(key), compact->end) > 0) {
+      // The rest belongs to the next range
+      break;
+    }
+    compact->stats.bytes_read += key.size() + input->value().size();
+    if (compact->compaction->ShouldStopBefore(key, &compact->cursor) &&
         compact->builder != nullptr) {
       status = FinishCompactionOutputFile(compact, input);
       if (!status.ok()) {
@@ -948,8 +1270,7 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
       last_sequence_for_key = kMaxSequenceNumber;
     } else {
       if (!has_current_user_key ||
-          user_comparator()->Compare(ikey.user_key, Slice(current_user_key)) !=
-              0) {
+          ucmp->Compare(ikey.user_key, Slice(current_user_key)) != 0) {
         // First occurrence of this user key
         current_user_key.assign(ikey.user_key.data(), ikey.user_key.size());
         has_current_user_key = true;
@@ -961,7 +1282,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         drop = true;  // (A)
       } else if (ikey.type == kTypeDeletion &&
                  ikey.sequence <= compact->smallest_snapshot &&
-                 compact->compaction->IsBaseLevelForKey(ikey.user_key)) {
+                 compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                                        &compact->cursor)) {
         // For this user key:
         // (1) there is no data in higher levels
         // (2) data in lower levels will have larger sequence numbers
@@ -980,7 +1302,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
         "%d smallest_snapshot: %d",
         ikey.user_key.ToString().c_str(),
         (int)ikey.sequence, ikey.type, kTypeValue, drop,
-        compact->compaction->IsBaseLevelForKey(ikey.user_key),
+        compact->compaction->IsBaseLevelForKey(ikey.user_key,
+                                               &compact->cursor),
         (int)last_sequence_for_key, (int)compact->smallest_snapshot);
 #endif
 
@@ -1020,31 +1343,8 @@ Status DBImpl::DoCompactionWork(CompactionState* compact) {
   if (status.ok()) {
     status = input->status();
   }
-  delete input;
-  input = nullptr;
-
-  CompactionStats stats;
-  stats.micros = env_->NowMicros() - start_micros - imm_micros;
-  for (int which = 0; which < 2; which++) {
-    for (int i = 0; i < compact->compaction->num_input_files(which); i++) {
-      stats.bytes_read += compact->compaction->input(which, i)->file_size;
-    }
-  }
-  for (size_t i = 0; i < compact->outputs.size(); i++) {
-    stats.bytes_written += compact->outputs[i].file_size;
-  }
-
-  mutex_.Lock();
-  stats_[compact->compaction->level() + 1].Add(stats);
-
-  if (status.ok()) {
-    status = InstallCompactionResults(compact);
-  }
-  if (!status.ok()) {
-    RecordBackgroundError(status);
-  }
-  VersionSet::LevelSummaryStorage tmp;
-  Log(options_.info_log, "compacted to: %s", versions_->LevelSummary(&tmp));
+  compact->stats.micros = env_->NowMicros() - start_micros;
+  compact->stats.bytes_written = compact->total_bytes;
   return status;
 }
 
@@ -1151,16 +1451,106 @@ Status DBImpl::Get(const ReadOptions& options, const Slice& key,
   if (have_stat_update && current->UpdateStats(stats)) {
     MaybeScheduleCompaction();
   }
+  cost_model_.RecordLookup(have_stat_update ? stats.levels_read : 0);
   mem->Unref();
   if (imm != nullptr) imm->Unref();
   current->Unref();
   return s;
 }
 
+std::vector<Status> DBImpl::MultiGet(const ReadOptions& options,
+                                     const std::vector<Slice>& keys,
+                                     std::vector<std::string>* values) {
+  const size_t num_keys = keys.size();
+  std::vector<Status> statuses(num_keys);
+  values->resize(num_keys);
+
+  MutexLock l(&mutex_);
+  SequenceNumber snapshot;
+  if (options.snapshot != nullptr) {
+    snapshot =
+        static_cast<const SnapshotImpl*>(options.snapshot)->sequence_number();
+  } else {
+    snapshot = versions_->LastSequence();
+  }
+
+  MemTable* mem = mem_;
+  MemTable* imm = imm_;
+  Version* current = versions_->current();
+  mem->Ref();
+  if (imm != nullptr) imm->Ref();
+  current->Ref();
+
+  // Keys missed by the memtables, looked up in the files in one batch
+  std::vector<uint32_t> file_keys;
+  std::vector<Version::GetStats> stats;
+
+  // Unlock while reading from files and memtables
+  {
+    mutex_.Unlock();
+    // Probe in key order so that the keys of the same file are adjacent
+    const Comparator* ucmp = user_comparator();
+    std::vector<uint32_t> order(num_keys);
+    for (uint32_t i = 0; i < num_keys; i++) {
+      order[i] = i;
+    }
+    std::stable_sort(order.begin(), order.end(), [&](uint32_t a, uint32_t b) {
+      return ucmp->Compare(keys[a], keys[b]) < 0;
+    });
+
+    std::vector<std::unique_ptr<LookupKey>> lkeys;
+    std::vector<const LookupKey*> lookups;
+    std::vector<std::string*> lookup_values;
+    lkeys.reserve(num_keys);
+    for (auto i : order) {
+      lkeys.emplace_back(new LookupKey(keys[i], snapshot));
+      const LookupKey* lkey = lkeys.back().get();
+      std::string* value = &(*values)[i];
+      Status* s = &statuses[i];
+      if (mem->Get(*lkey, value, s)) {
+        // Done
+      } else if (imm != nullptr && imm->Get(*lkey, value, s)) {
+        // Done
+      } else {
+        file_keys.push_back(i);
+        lookups.push_back(lkey);
+        lookup_values.push_back(value);
+      }
+    }
+
+    if (!file_keys.empty()) {
+      std::vector<Status> file_statuses;
+      current->MultiGet(options, lookups, lookup_values, &file_statuses,
+                        &stats);
+      for (size_t j = 0; j < file_keys.size(); j++) {
+        statuses[file_keys[j]] = file_statuses[j];
+      }
+    }
+    mutex_.Lock();
+  }
+
+  bool need_compaction = false;
+  for (auto& key_stats : stats) {
+    need_compaction |= current->UpdateStats(key_stats);
+    cost_model_.RecordLookup(key_stats.levels_read);
+  }
+  for (size_t i = stats.size(); i < num_keys; i++) {
+    cost_model_.RecordLookup(0);
+  }
+  if (need_compaction) {
+    MaybeScheduleCompaction();
+  }
+  mem->Unref();
+  if (imm != nullptr) imm->Unref();
+  current->Unref();
+  return statuses;
+}
+
 Iterator* DBImpl::NewIterator(const ReadOptions& options) {
   SequenceNumber latest_snapshot;
   uint32_t seed;
   Iterator* iter = NewInternalIterator(options, &latest_snapshot, &seed);
+  cost_model_.RecordScan();
   return NewDBIterator(this, user_comparator(), iter,
                        (options.snapshot != nullptr
                             ? static_cast<const SnapshotImpl*>(options.snapshot)
@@ -1200,68 +1590,145 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
   w.batch = updates;
   w.sync = options.sync;
   w.done = false;
+  if (updates != nullptr) {
+    cost_model_.RecordUpdate(WriteBatchInternal::Count(updates));
+  }
 
   MutexLock l(&mutex_);
   writers_.push_back(&w);
-  while (!w.done && &w != writers_.front()) {
+  while (!w.done && w.leader == nullptr && &w != writers_.front()) {
     w.cv.Wait();
   }
+  if (w.leader != nullptr) {
+    // Our leader has logged the group, insert our own batch alongside it
+    Writer* leader = w.leader;
+    mutex_.Unlock();
+    Status s = WriteBatchInternal::InsertInto(w.batch, mem_);
+    mutex_.Lock();
+    if (!s.ok() && leader->status.ok()) {
+      leader->status = s;
+    }
+    if (--leader->pending_inserts == 0) {
+      leader->cv.Signal();
+    }
+    while (!w.done) {
+      w.cv.Wait();
+    }
+  }
   if (w.done) {
     return w.status;
   }
 
   // May temporarily unlock and wait.
   Status status = MakeRoomForWrite(updates == nullptr);
-  uint64_t last_sequence = versions_->LastSequence();
+  if (!status.ok() || updates == nullptr) {  // nullptr batch is for compactions
+    writers_.pop_front();
+    if (!writers_.empty()) {
+      writers_.front()->cv.Signal();
+    }
+    return status;
+  }
+
+  // The groups in memtable_writers_ already took the sequence numbers
+  // up to the last one of them
+  SequenceNumber last_sequence = memtable_writers_.empty()
+                                     ? versions_->LastSequence()
+                                     : memtable_writers_.back()->last_sequence;
   Writer* last_writer = &w;
-  if (status.ok() && updates != nullptr) {  // nullptr batch is for compactions
-    WriteBatch* write_batch = BuildBatchGroup(&last_writer);
-    WriteBatchInternal::SetSequence(write_batch, last_sequence + 1);
-    last_sequence += WriteBatchInternal::Count(write_batch);
-
-    // Add to log and apply to memtable.  We can release the lock
-    // during this phase since &w is currently responsible for logging
-    // and protects against concurrent loggers and concurrent writes
-    // into mem_.
-    {
-      mutex_.Unlock();
-      status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
-      bool sync_error = false;
-      if (status.ok() && options.sync) {
-        status = logfile_->Sync();
-        if (!status.ok()) {
-          sync_error = true;
-        }
-      }
-      if (status.ok()) {
-        status = WriteBatchInternal::InsertInto(write_batch, mem_);
-      }
-      mutex_.Lock();
-      if (sync_error) {
-        // The state of the log file is indeterminate: the log record we
-        // just added may or may not show up when the DB is re-opened.
-        // So we force the DB into a mode where all future writes fail.
-        RecordBackgroundError(status);
+  WriteBatch group_batch;
+  WriteBatch* write_batch = BuildBatchGroup(&last_writer, &group_batch);
+  const SequenceNumber first_sequence = last_sequence + 1;
+  WriteBatchInternal::SetSequence(write_batch, first_sequence);
+  last_sequence += WriteBatchInternal::Count(write_batch);
+  w.last_sequence = last_sequence;
+
+  // Add to log.  We can release the lock during this phase since &w is
+  // currently responsible for logging and protects against concurrent
+  // loggers.
+  {
+    mutex_.Unlock();
+    status = log_->AddRecord(WriteBatchInternal::Contents(write_batch));
+    bool sync_error = false;
+    if (status.ok() && options.sync) {
+      status = logfile_->Sync();
+      if (!status.ok()) {
+        sync_error = true;
       }
     }
-    if (write_batch == tmp_batch_) tmp_batch_->Clear();
-
-    versions_->SetLastSequence(last_sequence);
+    mutex_.Lock();
+    if (sync_error) {
+      // The state of the log file is indeterminate: the log record we
+      // just added may or may not show up when the DB is re-opened.
+      // So we force the DB into a mode where all future writes fail.
+      RecordBackgroundError(status);
+    }
   }
 
+  // Let the next group add to the log while this one is applied to the
+  // memtable
+  std::vector<Writer*> group;
   while (true) {
     Writer* ready = writers_.front();
     writers_.pop_front();
+    group.push_back(ready);
+    if (ready == last_writer) break;
+  }
+  memtable_writers_.push_back(&w);
+  if (!writers_.empty()) {
+    writers_.front()->cv.Signal();
+  }
+
+  // With concurrent memtable writes, every writer of the group inserts its
+  // own batch into mem_, at the sequence numbers it took in the group,
+  // concurrently with the others and with the other groups.  mem_ is not
+  // switched while memtable_writers_ is not empty.
+  const bool concurrent = options_.allow_concurrent_memtable_write;
+  if (status.ok() && concurrent) {
+    SequenceNumber sequence = first_sequence;
+    for (Writer* member : group) {
+      if (member->batch == nullptr) continue;
+      WriteBatchInternal::SetSequence(member->batch, sequence);
+      sequence += WriteBatchInternal::Count(member->batch);
+      if (member != &w) {
+        member->leader = &w;
+        w.pending_inserts++;
+        member->cv.Signal();
+      }
+    }
+    mutex_.Unlock();
+    status = WriteBatchInternal::InsertInto(w.batch, mem_);
+    mutex_.Lock();
+  }
+
+  // Groups are made visible in the order of their sequence numbers
+  while (w.pending_inserts > 0 || &w != memtable_writers_.front()) {
+    w.cv.Wait();
+  }
+  if (status.ok() && !concurrent) {
+    // Otherwise the front of memtable_writers_ is the only writer into mem_
+    mutex_.Unlock();
+    status = WriteBatchInternal::InsertInto(write_batch, mem_);
+    mutex_.Lock();
+  }
+  if (status.ok()) {
+    status = w.status;  // Errors of the followers' inserts
+  }
+  versions_->SetLastSequence(last_sequence);
+  memtable_writers_.pop_front();
+
+  for (Writer* ready : group) {
     if (ready != &w) {
       ready->status = status;
       ready->done = true;
       ready->cv.Signal();
     }
-    if (ready == last_writer) break;
   }
 
-  // Notify new head of write queue
-  if (!writers_.empty()) {
+  // Notify the next group, or the head of write queue which may wait in
+  // MakeRoomForWrite() for the memtable writers to finish
+  if (!memtable_writers_.empty()) {
+    memtable_writers_.front()->cv.Signal();
+  } else if (!writers_.empty()) {
     writers_.front()->cv.Signal();
   }
 
@@ -1270,7 +1737,9 @@ Status DBImpl::Write(const WriteOptions& options, WriteBatch* updates) {
 
 // REQUIRES: Writer list must be non-empty
 // REQUIRES: First writer must have a non-null batch
-WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
+// REQUIRES: tmp_batch is empty
+WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer,
+                                    WriteBatch* tmp_batch) {
   mutex_.AssertHeld();
   assert(!writers_.empty());
   Writer* first = writers_.front();
@@ -1307,7 +1776,7 @@ WriteBatch* DBImpl::BuildBatchGroup(Writer** last_writer) {
       // Append to *result
       if (result == first->batch) {
         // Switch to temporary batch instead of disturbing caller's batch
-        result = tmp_batch_;
+        result = tmp_batch;
         assert(WriteBatchInternal::Count(result) == 0);
         WriteBatchInternal::Append(result, first->batch);
       }
@@ -1355,6 +1824,9 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       // There are too many level-0 files.
       Log(options_.info_log, "Too many L0 files; waiting...\n");
       background_work_finished_signal_.Wait();
+    } else if (!memtable_writers_.empty()) {
+      // Earlier groups are still being applied to the current memtable.
+      writers_.front()->cv.Wait();
     } else {
       // Attempt to switch to a new memtable and trigger compaction of old
       assert(versions_->PrevLogNumber() == 0);
@@ -1372,8 +1844,8 @@ Status DBImpl::MakeRoomForWrite(bool force) {
       logfile_number_ = new_log_number;
       log_ = new log::Writer(lfile);
       imm_ = mem_;
-      has_imm_.store(true, std::memory_order_release);
-      mem_ = new MemTable(internal_comparator_);
+      mem_ = new MemTable(internal_comparator_,
+                          options_.allow_concurrent_memtable_write);
       mem_->Ref();
       force = false;  // Do not force another compaction if have room
       MaybeScheduleCompaction();
@@ -1423,6 +1895,9 @@ bool DBImpl::GetProperty(const Slice& property, std::string* value) {
       }
     }
     return true;
+  } else if (in == "colsm-layout") {
+    *value = cost_model_.DebugString();
+    return true;
   } else if (in == "sstables") {
     *value = versions_->current()->DebugString();
     return true;
@@ -1476,6 +1951,17 @@ Status DB::Delete(const WriteOptions& opt, const Slice& key) {
   return Write(opt, &batch);
 }
 
+std::vector<Status> DB::MultiGet(const ReadOptions& options,
+                                 const std::vector<Slice>& keys,
+                                 std::vector<std::string>* values) {
+  std::vector<Status> statuses;
+  values->resize(keys.size());
+  for (size_t i = 0; i < keys.size(); i++) {
+    statuses.push_back(Get(options, keys[i], &(*values)[i]));
+  }
+  return statuses;
+}
+
 DB::~DB() = default;
 
 Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
@@ -1498,17 +1984,26 @@ Status DB::Open(const Options& options, const std::string& dbname, DB** dbptr) {
       impl->logfile_ = lfile;
       impl->logfile_number_ = new_log_number;
       impl->log_ = new log::Writer(lfile);
-      impl->mem_ = new MemTable(impl->internal_comparator_);
+      impl->mem_ = new MemTable(impl->internal_comparator_,
+                                options.allow_concurrent_memtable_write);
       impl->mem_->Ref();
     }
   }
   if (s.ok() && save_manifest) {
     edit.SetPrevLogNumber(0);  // No older logs needed after recovery.
     edit.SetLogNumber(impl->logfile_number_);
-    s = impl->versions_->LogAndApply(&edit, &impl->mutex_);
+    s = impl->LogAndApply(&edit);
   }
   if (s.ok()) {
+    // The calibration probes run before any background work is scheduled
+    // and without mutex_, which they do not need
+    impl->mutex_.Unlock();
+    impl->LoadLayoutParameter();
+    impl->mutex_.Lock();
+    impl->SolveLayout();
     impl->RemoveObsoleteFiles();
+    options.env->SetBackgroundThreads(impl->options_.max_background_compactions,
+                                      Env::kLowPriority);
     impl->MaybeScheduleCompaction();
   }
   impl->mutex_.Unlock();
@@ -43,6 +43,9 @@ class DBImpl : public DB {
   Status Write(const WriteOptions& options, WriteBatch* updates) override;
   Status Get(const ReadOptions& options, const Slice& key,
              std::string* value) override;
+  std::vector<Status> MultiGet(const ReadOptions& options,
+                               const std::vector<Slice>& keys,
+                               std::vector<std::string>* values) override;
   Iterator* NewIterator(const ReadOptions&) override;
   const Snapshot* GetSnapshot() override;
   void ReleaseSnapshot(const Snapshot* snapshot) override;
@@ -81,6 +84,7 @@ class DBImpl : public DB {
   struct ManualCompaction {
     int level;
     bool done;
+    bool in_progress;  // A background thread is compacting a part of it
     const InternalKey* begin;  // null means beginning of key range
     const InternalKey* end;    // null means end of key range
     InternalKey tmp_storage;   // Used to keep track of compaction progress
@@ -116,6 +120,17 @@ class DBImpl : public DB {
 
   void MaybeIgnoreError(Status* s) const;
 
+  // Load the cost model constants calibrated for this DB, or calibrate them
+  // now if options_.calibrate_layout_model is set
+  void LoadLayoutParameter() LOCKS_EXCLUDED(mutex_);
+
+  // Solve the layout of each level for the workload and space budget given
+  // in options_
+  void SolveLayout() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
+  // Give the cost model the bytes now stored at each level
+  void UpdateLayoutLevelBytes() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   // Delete any unneeded files and stale in-memory entries.
   void RemoveObsoleteFiles() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
@@ -128,24 +143,35 @@ class DBImpl : public DB {
                         VersionEdit* edit, SequenceNumber* max_sequence)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
-  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base)
-      EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Build a table of mem and add it to *edit.  The table stays in
+  // pending_outputs_ as *number until the caller has installed *edit.
+  Status WriteLevel0Table(MemTable* mem, VersionEdit* edit, Version* base,
+                          uint64_t* number) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   Status MakeRoomForWrite(bool force /* compact even if there is room? */)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
-  WriteBatch* BuildBatchGroup(Writer** last_writer)
+  WriteBatch* BuildBatchGroup(Writer** last_writer, WriteBatch* tmp_batch)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
 
   void RecordBackgroundError(const Status& s);
 
+  // Apply *edit to the current version and save it to the manifest, one
+  // edit at a time.
+  Status LogAndApply(VersionEdit* edit) EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+
   void MaybeScheduleCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  static void BGFlush(void* db);
+  void BackgroundFlushCall();
   static void BGWork(void* db);
   void BackgroundCall();
-  void BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Returns false if no compaction could be picked.
+  bool BackgroundCompaction() EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   void CleanupCompaction(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
   Status DoCompactionWork(CompactionState* compact)
       EXCLUSIVE_LOCKS_REQUIRED(mutex_);
+  // Merge the key range of compact from input.
+  Status CompactKeyRange(CompactionState* compact, Iterator* input);
 
   Status OpenCompactionOutputFile(CompactionState* compact);
   Status FinishCompactionOutputFile(CompactionState* compact, Iterator* input);
@@ -177,7 +203,6 @@ class DBImpl : public DB {
   port::CondVar background_work_finished_signal_ GUARDED_BY(mutex_);
   MemTable* mem_;
   MemTable* imm_ GUARDED_BY(mutex_);  // Memtable being compacted
-  std::atomic<bool> has_imm_;         // So bg thread can detect non-null imm_
   WritableFile* logfile_;
   uint64_t logfile_number_ GUARDED_BY(mutex_);
   log::Writer* log_;
@@ -185,7 +210,10 @@ class DBImpl : public DB {
 
   // Queue of writers.
   std::deque<Writer*> writers_ GUARDED_BY(mutex_);
-  WriteBatch* tmp_batch_ GUARDED_BY(mutex_);
+
+  // Leaders of the groups that have been logged, waiting to be applied to
+  // the memtable in order.
+  std::deque<Writer*> memtable_writers_ GUARDED_BY(mutex_);
 
   SnapshotList snapshots_ GUARDED_BY(mutex_);
 
@@ -193,8 +221,26 @@ class DBImpl : public DB {
   // part of ongoing compactions.
   std::set<uint64_t> pending_outputs_ GUARDED_BY(mutex_);
 
-  // Has a background compaction been scheduled or is running?
-  bool background_compaction_scheduled_ GUARDED_BY(mutex_);
+  // Obsolete files that RemoveObsoleteFiles() is deleting with mutex_
+  // released.  A flush and a compaction may both list a file; only the
+  // first one deletes it.
+  std::set<std::string> files_being_deleted_ GUARDED_BY(mutex_);
+
+  // Has a memtable compaction been scheduled or is running?
+  bool background_flush_scheduled_ GUARDED_BY(mutex_);
+
+  // Background compactions scheduled or running, and the ones among them
+  // that have picked their inputs.
+  int background_compactions_scheduled_ GUARDED_BY(mutex_);
+  int background_compactions_running_ GUARDED_BY(mutex_);
+
+  // Is LogAndApply() writing the manifest?
+  bool manifest_writing_ GUARDED_BY(mutex_);
+
+  // Has a memtable compaction placed its table below level-0 without
+  // installing it yet?  No compaction is picked meanwhile, as it could
+  // not see that table.
+  bool memtable_pushdown_pending_ GUARDED_BY(mutex_);
 
   ManualCompaction* manual_compaction_ GUARDED_BY(mutex_);
 
@@ -204,6 +250,10 @@ class DBImpl : public DB {
   Status bg_error_ GUARDED_BY(mutex_);
 
   CompactionStats stats_[config::kNumLevels] GUARDED_BY(mutex_);
+
+  // Layout of new tables at each level, re-decided from the operations
+  // counted while the DB runs
+  colsm::CostModel cost_model_;
 };
 
 // Sanitize db options.  The caller should delete result.info_log if
@@ -213,6 +263,16 @@ Options SanitizeOptions(const std::string& db,
                         const InternalFilterPolicy* ipolicy,
                         const Options& src);
 
+// Give model the cost model constants kept in the COLSM_PARAMETER file of
+// the DB. False if there are none.
+bool ReadLayoutParameter(Env* env, const std::string& dbname,
+                         colsm::CostModel* model);
+
+// Decide the layout of new tables for the workload given in options. Without
+// one, a colsm_model file in the working directory, which earlier versions
+// read the layout from, is taken instead.
+void InitLayout(const Options& options, colsm::CostModel* model);
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_DB_DB_IMPL_H_
@@ -18,6 +18,8 @@
 #include "leveldb/table.h"
 #include "port/port.h"
 #include "port/thread_annotations.h"
+#include "table/block.h"
+#include "table/format.h"
 #include "util/hash.h"
 #include "util/logging.h"
 #include "util/mutexlock.h"
@@ -120,6 +122,16 @@ class SpecialEnv : public EnvWrapper {
   bool count_random_reads_;
   AtomicCounter random_read_counter_;
 
+  // Threads started through StartThread(), e.g. for subcompactions
+  AtomicCounter started_threads_;
+
+  // sstable Sync() calls take a few milliseconds while this is true.
+  std::atomic<bool> slow_table_sync_;
+
+  // sstable Sync() calls in progress, and the most seen at the same time.
+  std::atomic<int> table_syncs_;
+  std::atomic<int> max_table_syncs_;
+
   explicit SpecialEnv(Env* base)
       : EnvWrapper(base),
         delay_data_sync_(false),
@@ -128,16 +140,21 @@ class SpecialEnv : public EnvWrapper {
         non_writable_(false),
         manifest_sync_error_(false),
         manifest_write_error_(false),
-        count_random_reads_(false) {}
+        count_random_reads_(false),
+        slow_table_sync_(false),
+        table_syncs_(0),
+        max_table_syncs_(0) {}
 
   Status NewWritableFile(const std::string& f, WritableFile** r) {
     class DataFile : public WritableFile {
      private:
       SpecialEnv* const env_;
       WritableFile* const base_;
+      const bool table_;
 
      public:
-      DataFile(SpecialEnv* env, WritableFile* base) : env_(env), base_(base) {}
+      DataFile(SpecialEnv* env, WritableFile* base, bool table)
+          : env_(env), base_(base), table_(table) {}
       ~DataFile() { delete base_; }
       Status Append(const Slice& data) {
         if (env_->no_space_.load(std::memory_order_acquire)) {
@@ -156,7 +173,21 @@ class SpecialEnv : public EnvWrapper {
         while (env_->delay_data_sync_.load(std::memory_order_acquire)) {
           DelayMilliseconds(100);
         }
-        return base_->Sync();
+        if (!table_) {
+          return base_->Sync();
+        }
+        int syncs = env_->table_syncs_.fetch_add(1) + 1;
+        int max_syncs = env_->max_table_syncs_.load();
+        while (syncs > max_syncs &&
+               !env_->max_table_syncs_.compare_exchange_weak(max_syncs,
+                                                             syncs)) {
+        }
+        if (env_->slow_table_sync_.load(std::memory_order_acquire)) {
+          DelayMilliseconds(5);
+        }
+        Status s = base_->Sync();
+        env_->table_syncs_.fetch_sub(1);
+        return s;
       }
     };
     class ManifestFile : public WritableFile {
@@ -193,7 +224,7 @@ class SpecialEnv : public EnvWrapper {
     if (s.ok()) {
       if (strstr(f.c_str(), ".ldb") != nullptr ||
           strstr(f.c_str(), ".log") != nullptr) {
-        *r = new DataFile(this, *r);
+        *r = new DataFile(this, *r, strstr(f.c_str(), ".ldb") != nullptr);
       } else if (strstr(f.c_str(), "MANIFEST") != nullptr) {
         *r = new ManifestFile(this, *r);
       }
@@ -224,6 +255,11 @@ class SpecialEnv : public EnvWrapper {
     }
     return s;
   }
+
+  void StartThread(void (*f)(void*), void* a) override {
+    started_threads_.Increment();
+    target()->StartThread(f, a);
+  }
 };
 
 class DBTest : public testing::Test {
@@ -333,6 +369,34 @@ class DBTest : public testing::Test {
     return result;
   }
 
+  // Get of each key through MultiGet, formatted as Get does and joined
+  // by ","
+  std::string MultiGet(const std::vector<std::string>& keys,
+                       const Snapshot* snapshot = nullptr) {
+    ReadOptions options;
+    options.snapshot = snapshot;
+    std::vector<Slice> key_slices(keys.begin(), keys.end());
+    std::vector<std::string> values;
+    std::vector<Status> statuses =
+        db_->MultiGet(options, key_slices, &values);
+    EXPECT_EQ(keys.size(), statuses.size());
+    EXPECT_EQ(keys.size(), values.size());
+    std::string result;
+    for (size_t i = 0; i < statuses.size(); i++) {
+      if (i > 0) {
+        result.push_back(',');
+      }
+      if (statuses[i].IsNotFound()) {
+        result += "NOT_FOUND";
+      } else if (!statuses[i].ok()) {
+        result += statuses[i].ToString();
+      } else {
+        result += values[i];
+      }
+    }
+    return result;
+  }
+
   // Return a string that contains all key,value pairs in order,
   // formatted like "(k1->v1)(k2->v2)".
   std::string Contents() {
@@ -625,6 +689,134 @@ TEST_F(DBTest, GetMemUsage) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, GetLayout) {
+  ASSERT_LEVELDB_OK(Put("foo", "v1"));
+  ASSERT_EQ("v1", Get("foo"));
+  std::string val;
+  ASSERT_TRUE(db_->GetProperty("leveldb.colsm-layout", &val));
+  // One line per level after the header
+  ASSERT_NE(std::string::npos, val.find("    6 horizontal"));
+  ASSERT_NE(std::string::npos, val.find("Evaluations: 0"));
+}
+
+// Layout a table was written in, as recorded in its metaindex block
+static std::string TableLayout(Env* env, const std::string& fname) {
+  uint64_t size;
+  RandomAccessFile* file;
+  if (!env->GetFileSize(fname, &size).ok() ||
+      !env->NewRandomAccessFile(fname, &file).ok()) {
+    return "error";
+  }
+  std::string result = "error";
+  char scratch[Footer::kEncodedLength];
+  Slice input;
+  Footer footer;
+  BlockContents contents;
+  if (file->Read(size - Footer::kEncodedLength, Footer::kEncodedLength,
+                 &input, scratch)
+          .ok() &&
+      footer.DecodeFrom(&input).ok() &&
+      ReadBlock(file, ReadOptions(), footer.metaindex_handle(), &contents)
+          .ok()) {
+    Block meta(contents);
+    Iterator* iter = meta.NewIterator(BytewiseComparator());
+    iter->Seek("block.colsm.vformat");
+    if (iter->Valid() && iter->key() == "block.colsm.vformat") {
+      result = iter->value().ToString();
+    }
+    delete iter;
+  }
+  delete file;
+  return result;
+}
+
+TEST_F(DBTest, CompactionOutputLayout) {
+  Options options = CurrentOptions();
+  options.layout_adapt_interval = 1000;
+  options.vert_key_format = kVertStringKey;
+  Reopen(&options);
+
+  // A table at level 2 holding "m", and one at level 1 before it
+  ASSERT_LEVELDB_OK(Put("a", "va"));
+  ASSERT_LEVELDB_OK(Put("m", "vm"));
+  ASSERT_LEVELDB_OK(Put("z", "vz"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_LEVELDB_OK(Put("a", "va2"));
+  ASSERT_LEVELDB_OK(Put("b", "vb"));
+  dbfull()->TEST_CompactMemTable();
+  ASSERT_EQ("0,1,1", FilesPerLevel());
+
+  // Lookups that only read level 2 make it vertical, while the scans keep
+  // the other levels horizontal
+  for (int i = 0; i < 1000; i++) {
+    ASSERT_EQ("vm", Get("m"));
+  }
+  for (int i = 0; i < 100; i++) {
+    delete db_->NewIterator(ReadOptions());
+  }
+
+  // Compacting level 1 re-decides the layout, then writes to level 2
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_EQ("0,0,1", FilesPerLevel());
+  std::string layout;
+  ASSERT_TRUE(db_->GetProperty("leveldb.colsm-layout", &layout));
+  ASSERT_NE(std::string::npos, layout.find("    1 horizontal")) << layout;
+  ASSERT_NE(std::string::npos, layout.find("    2 vertical")) << layout;
+
+  std::vector<std::string> filenames;
+  ASSERT_LEVELDB_OK(env_->GetChildren(dbname_, &filenames));
+  int tables = 0;
+  uint64_t number;
+  FileType type;
+  for (const std::string& filename : filenames) {
+    if (ParseFileName(filename, &number, &type) && type == kTableFile) {
+      ASSERT_EQ("true", TableLayout(env_, dbname_ + "/" + filename));
+      tables++;
+    }
+  }
+  ASSERT_EQ(1, tables);
+  ASSERT_EQ("va2", Get("a"));
+  ASSERT_EQ("vm", Get("m"));
+}
+
+TEST_F(DBTest, LayoutSolvedAtOpen) {
+  std::string layout;
+  ASSERT_TRUE(db_->GetProperty("leveldb.colsm-layout", &layout));
+  ASSERT_EQ(std::string::npos, layout.find("vertical ")) << layout;
+
+  // A lookup only workload makes the lower levels vertical
+  Options options = CurrentOptions();
+  options.layout_lookup_ratio = 1;
+  Reopen(&options);
+  ASSERT_TRUE(db_->GetProperty("leveldb.colsm-layout", &layout));
+  ASSERT_NE(std::string::npos, layout.find("    2 vertical")) << layout;
+
+  // A scan only workload keeps them horizontal
+  options.layout_lookup_ratio = 0;
+  options.layout_scan_ratio = 1;
+  Reopen(&options);
+  ASSERT_TRUE(db_->GetProperty("leveldb.colsm-layout", &layout));
+  ASSERT_NE(std::string::npos, layout.find("    2 horizontal")) << layout;
+}
+
+TEST_F(DBTest, LayoutFromModelFile) {
+  // The layout file earlier versions read from the working directory
+  ASSERT_LEVELDB_OK(WriteStringToFile(env_, "3\n0\n0\n1\n", "colsm_model"));
+  Options options = CurrentOptions();
+  Reopen(&options);
+  std::string layout;
+  ASSERT_TRUE(db_->GetProperty("leveldb.colsm-layout", &layout));
+  ASSERT_NE(std::string::npos, layout.find("    1 horizontal")) << layout;
+  ASSERT_NE(std::string::npos, layout.find("    2 vertical")) << layout;
+
+  // A workload in options takes precedence
+  options.layout_scan_ratio = 1;
+  Reopen(&options);
+  ASSERT_TRUE(db_->GetProperty("leveldb.colsm-layout", &layout));
+  ASSERT_NE(std::string::npos, layout.find("    2 horizontal")) << layout;
+  ASSERT_LEVELDB_OK(env_->RemoveFile("colsm_model"));
+}
+
 TEST_F(DBTest, GetSnapshot) {
   do {
     // Try with both a short key and a long key
@@ -734,6 +926,68 @@ TEST_F(DBTest, GetPicksCorrectFile) {
   } while (ChangeOptions());
 }
 
+TEST_F(DBTest, MultiGet) {
+  do {
+    ASSERT_EQ("", MultiGet({}));
+    // Files in level 2 and level 0, and the memtable
+    ASSERT_LEVELDB_OK(Put("a", "va1"));
+    ASSERT_LEVELDB_OK(Put("c", "vc1"));
+    Compact("a", "c");
+    ASSERT_LEVELDB_OK(Put("x", "vx1"));
+    ASSERT_LEVELDB_OK(Put("z", "vz1"));
+    Compact("x", "z");
+    ASSERT_LEVELDB_OK(Put("c", "vc2"));
+    ASSERT_LEVELDB_OK(Delete("x"));
+    dbfull()->TEST_CompactMemTable();
+    const Snapshot* snapshot = db_->GetSnapshot();
+    ASSERT_LEVELDB_OK(Put("a", "va2"));
+    ASSERT_LEVELDB_OK(Delete("z"));
+    ASSERT_LEVELDB_OK(Put("m", "vm"));
+
+    // Unsorted, with duplicates and missing keys
+    ASSERT_EQ("NOT_FOUND,NOT_FOUND,vc2,va2,NOT_FOUND,vm,vc2,NOT_FOUND,NOT_FOUND",
+              MultiGet({"x", "z", "c", "a", "b", "m", "c", "zz", "x"}));
+    ASSERT_EQ("NOT_FOUND,vz1,vc2,va1,NOT_FOUND,NOT_FOUND",
+              MultiGet({"x", "z", "c", "a", "b", "m"}, snapshot));
+    db_->ReleaseSnapshot(snapshot);
+  } while (ChangeOptions());
+}
+
+TEST_F(DBTest, MultiGetSameAsGet) {
+  do {
+    // Overlapping files in levels 0 and 1, and the memtable
+    Random rnd(301);
+    for (int file = 0; file < 5; file++) {
+      for (int i = 0; i < 500; i++) {
+        std::string key = "key" + std::to_string(rnd.Uniform(1000));
+        if (rnd.OneIn(5)) {
+          ASSERT_LEVELDB_OK(Delete(key));
+        } else {
+          ASSERT_LEVELDB_OK(Put(key, RandomString(&rnd, 20)));
+        }
+      }
+      if (file == 1) {
+        dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+      } else if (file < 4) {
+        dbfull()->TEST_CompactMemTable();
+      }
+    }
+    ASSERT_GT(TotalTableFiles(), 1);
+    for (int round = 0; round < 10; round++) {
+      std::vector<std::string> keys;
+      std::string expected;
+      for (int i = 0; i < 100; i++) {
+        keys.push_back("key" + std::to_string(rnd.Uniform(1100)));
+        if (i > 0) {
+          expected.push_back(',');
+        }
+        expected += Get(keys.back());
+      }
+      ASSERT_EQ(expected, MultiGet(keys));
+    }
+  } while (ChangeOptions());
+}
+
 TEST_F(DBTest, GetEncountersEmptyLevel) {
   do {
     // Arrange for the following to happen:
@@ -1103,6 +1357,106 @@ TEST_F(DBTest, CompactionsGenerateMultipleFiles) {
   }
 }
 
+TEST_F(DBTest, Subcompactions) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.max_subcompactions = 4;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Overwrites, deletions and a snapshot across many overlapping files
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  const Snapshot* snapshot = nullptr;
+  std::map<std::string, std::string> snapshot_model;
+  for (int i = 0; i < 6000; i++) {
+    std::string key = Key(rnd.Uniform(2000));
+    if (rnd.OneIn(8)) {
+      ASSERT_LEVELDB_OK(Delete(key));
+      model.erase(key);
+    } else {
+      std::string value = RandomString(&rnd, 200);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+    }
+    if (i == 3000) {
+      snapshot = db_->GetSnapshot();
+      snapshot_model = model;
+    }
+  }
+  env_->started_threads_.Reset();
+  dbfull()->TEST_CompactMemTable();
+  dbfull()->TEST_CompactRange(0, nullptr, nullptr);
+  dbfull()->TEST_CompactRange(1, nullptr, nullptr);
+  ASSERT_GT(env_->started_threads_.Read(), 0);
+  ASSERT_EQ(0, NumTableFilesAtLevel(0));
+  ASSERT_EQ(0, NumTableFilesAtLevel(1));
+  ASSERT_GT(NumTableFilesAtLevel(2), 1);
+
+  for (int i = 0; i < 2000; i++) {
+    std::string key = Key(i);
+    auto it = model.find(key);
+    ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(key));
+    it = snapshot_model.find(key);
+    ASSERT_EQ(it == snapshot_model.end() ? "NOT_FOUND" : it->second,
+              Get(key, snapshot));
+  }
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  auto it = model.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+    ASSERT_TRUE(it != model.end());
+    ASSERT_EQ(it->first, iter->key().ToString());
+    ASSERT_EQ(it->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(it == model.end());
+  delete iter;
+  db_->ReleaseSnapshot(snapshot);
+}
+
+TEST_F(DBTest, ConcurrentCompactions) {
+  Options options = CurrentOptions();
+  options.env = env_;
+  options.max_background_compactions = 3;
+  options.write_buffer_size = 100000;  // Small write buffer
+  Reopen(&options);
+
+  // Memtable compactions keep going while compactions run
+  env_->slow_table_sync_.store(true, std::memory_order_release);
+  Random rnd(301);
+  std::map<std::string, std::string> model;
+  for (int i = 0; i < 20000; i++) {
+    std::string key = Key(rnd.Uniform(5000));
+    if (rnd.OneIn(10)) {
+      ASSERT_LEVELDB_OK(Delete(key));
+      model.erase(key);
+    } else {
+      std::string value = RandomString(&rnd, 100);
+      ASSERT_LEVELDB_OK(Put(key, value));
+      model[key] = value;
+    }
+  }
+  dbfull()->TEST_CompactMemTable();
+  env_->slow_table_sync_.store(false, std::memory_order_release);
+  ASSERT_GT(env_->max_table_syncs_.load(), 1);
+  ASSERT_GT(TotalTableFiles(), 1);
+
+  for (int i = 0; i < 5000; i++) {
+    std::string key = Key(i);
+    auto it = model.find(key);
+    ASSERT_EQ(it == model.end() ? "NOT_FOUND" : it->second, Get(key));
+  }
+  Reopen(&options);
+  Iterator* iter = db_->NewIterator(ReadOptions());
+  auto it = model.begin();
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++it) {
+    ASSERT_TRUE(it != model.end());
+    ASSERT_EQ(it->first, iter->key().ToString());
+    ASSERT_EQ(it->second, iter->value().ToString());
+  }
+  ASSERT_TRUE(it == model.end());
+  delete iter;
+}
+
 TEST_F(DBTest, RepeatedWritesToSameKey) {
   Options options = CurrentOptions();
   options.env = env_;
@@ -2017,6 +2371,69 @@ TEST_F(DBTest, MultiThreaded) {
   } while (ChangeOptions());
 }
 
+namespace {
+
+struct PipelineThread {
+  DB* db;
+  int id;
+  std::atomic<bool> done;
+};
+
+static void PipelineThreadBody(void* arg) {
+  PipelineThread* t = reinterpret_cast<PipelineThread*>(arg);
+  char keybuf[20];
+  std::snprintf(keybuf, sizeof(keybuf), "thread%d", t->id);
+  std::string value;
+  WriteOptions sync_options;
+  sync_options.sync = true;
+  for (int i = 0; i < 2000; i++) {
+    // Pad the values to switch memtables while groups are applied
+    char valbuf[1100];
+    std::snprintf(valbuf, sizeof(valbuf), "%d.%-1000d", i, t->id);
+    ASSERT_LEVELDB_OK(t->db->Put(i % 100 == 0 ? sync_options : WriteOptions(),
+                                 Slice(keybuf), Slice(valbuf)));
+    // The write is visible once Put() returns
+    ASSERT_LEVELDB_OK(t->db->Get(ReadOptions(), Slice(keybuf), &value));
+    ASSERT_EQ(std::string(valbuf), value);
+  }
+  t->done.store(true, std::memory_order_release);
+}
+
+}  // namespace
+
+TEST_F(DBTest, PipelinedWrites) {
+  // With the leaders inserting their groups, then with every writer
+  // inserting its own batch
+  for (bool concurrent : {false, true}) {
+    Options options = CurrentOptions();
+    options.write_buffer_size = 100000;  // Small write buffer
+    options.allow_concurrent_memtable_write = concurrent;
+    options.create_if_missing = true;
+    DestroyAndReopen(&options);
+
+    PipelineThread thread[kNumThreads];
+    for (int id = 0; id < kNumThreads; id++) {
+      thread[id].db = db_;
+      thread[id].id = id;
+      thread[id].done.store(false, std::memory_order_release);
+      env_->StartThread(PipelineThreadBody, &thread[id]);
+    }
+    for (int id = 0; id < kNumThreads; id++) {
+      while (!thread[id].done.load(std::memory_order_acquire)) {
+        DelayMilliseconds(10);
+      }
+    }
+
+    // The logs hold every write in the order of the sequence numbers
+    Reopen(&options);
+    for (int id = 0; id < kNumThreads; id++) {
+      char valbuf[1100];
+      std::snprintf(valbuf, sizeof(valbuf), "%d.%-1000d", 1999, id);
+      ASSERT_EQ(std::string(valbuf), Get("thread" + std::to_string(id)));
+    }
+  }
+}
+
 namespace {
 typedef std::map<std::string, std::string> KVMap;
 }
@@ -105,20 +105,53 @@ inline Slice ExtractUserKey(const Slice& internal_key) {
 class InternalKeyComparator : public Comparator {
  private:
   const Comparator* user_comparator_;
+  const KeyType key_type_;
 
  public:
-  explicit InternalKeyComparator(const Comparator* c) : user_comparator_(c) {}
+  explicit InternalKeyComparator(const Comparator* c)
+      : user_comparator_(c),
+        key_type_(c != nullptr && c->key_type() == kIntKey ? kIntInternalKey
+                                                           : kAnyKey) {}
   const char* Name() const override;
   int Compare(const Slice& a, const Slice& b) const override;
   void FindShortestSeparator(std::string* start,
                              const Slice& limit) const override;
   void FindShortSuccessor(std::string* key) const override;
+  KeyType key_type() const override { return key_type_; }
 
   const Comparator* user_comparator() const { return user_comparator_; }
 
   int Compare(const InternalKey& a, const InternalKey& b) const;
 };
 
+// Order of internal keys with 4-byte int user keys, the same as
+// InternalKeyComparator::Compare without calling the user comparator
+inline int CompareIntInternalKey(const Slice& a, const Slice& b) {
+  const uint32_t akey = DecodeFixed32(a.data());
+  const uint32_t bkey = DecodeFixed32(b.data());
+  if (akey != bkey) {
+    return akey < bkey ? -1 : +1;
+  }
+  // Decreasing sequence number
+  const uint64_t anum = DecodeFixed64(a.data() + a.size() - 8);
+  const uint64_t bnum = DecodeFixed64(b.data() + b.size() - 8);
+  return (anum < bnum) - (anum > bnum);
+}
+
+// Key orders for the loops specialized on the comparator at compile time
+struct ComparatorOrder {
+  const Comparator* comparator;
+  int operator()(const Slice& a, const Slice& b) const {
+    return comparator->Compare(a, b);
+  }
+};
+
+struct IntInternalKeyOrder {
+  int operator()(const Slice& a, const Slice& b) const {
+    return CompareIntInternalKey(a, b);
+  }
+};
+
 // Filter policy wrapper that converts from internal keys to user keys
 class InternalFilterPolicy : public FilterPolicy {
  private:
@@ -68,11 +68,16 @@ std::string OldInfoLogFileName(const std::string& dbname) {
   return dbname + "/LOG.old";
 }
 
+std::string ColsmParameterFileName(const std::string& dbname) {
+  return dbname + "/COLSM_PARAMETER";
+}
+
 // Owned filenames have the form:
 //    dbname/CURRENT
 //    dbname/LOCK
 //    dbname/LOG
 //    dbname/LOG.old
+//    dbname/COLSM_PARAMETER
 //    dbname/MANIFEST-[0-9]+
 //    dbname/[0-9]+.(log|sst|ldb)
 bool ParseFileName(const std::string& filename, uint64_t* number,
@@ -87,6 +92,9 @@ bool ParseFileName(const std::string& filename, uint64_t* number,
   } else if (rest == "LOG" || rest == "LOG.old") {
     *number = 0;
     *type = kInfoLogFile;
+  } else if (rest == "COLSM_PARAMETER") {
+    *number = 0;
+    *type = kColsmParameterFile;
   } else if (rest.starts_with("MANIFEST-")) {
     rest.remove_prefix(strlen("MANIFEST-"));
     uint64_t num;
@@ -18,8 +18,11 @@ static Slice GetLengthPrefixedSlice(const char* data) {
   return Slice(p, len);
 }
 
-MemTable::MemTable(const InternalKeyComparator& comparator)
-    : comparator_(comparator), refs_(0), table_(comparator_, &arena_) {}
+MemTable::MemTable(const InternalKeyComparator& comparator, bool concurrent)
+    : comparator_(comparator),
+      refs_(0),
+      arena_(concurrent),
+      table_(comparator_, &arena_) {}
 
 MemTable::~MemTable() { assert(refs_ == 0); }
 
@@ -30,6 +33,9 @@ int MemTable::KeyComparator::operator()(const char* aptr,
   // Internal keys are encoded as length-prefixed strings.
   Slice a = GetLengthPrefixedSlice(aptr);
   Slice b = GetLengthPrefixedSlice(bptr);
+  if (int_key) {
+    return CompareIntInternalKey(a, b);
+  }
   return comparator.Compare(a, b);
 }
 
@@ -95,7 +101,11 @@ void MemTable::Add(SequenceNumber s, ValueType type, const Slice& key,
   p = EncodeVarint32(p, val_size);
   std::memcpy(p, value.data(), val_size);
   assert(p + val_size == buf + encoded_len);
-  table_.Insert(buf);
+  if (arena_.concurrent()) {
+    table_.InsertConcurrently(buf);
+  } else {
+    table_.Insert(buf);
+  }
 }
 
 bool MemTable::Get(const LookupKey& key, std::string* value, Status* s) {
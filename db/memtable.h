@@ -5,6 +5,7 @@
 #ifndef STORAGE_LEVELDB_DB_MEMTABLE_H_
 #define STORAGE_LEVELDB_DB_MEMTABLE_H_
 
+#include <memory>
 #include <string>
 
 #include "db/dbformat.h"
@@ -21,7 +22,10 @@ class MemTable {
  public:
   // MemTables are reference counted.  The initial reference count
   // is zero and the caller must call Ref() at least once.
-  explicit MemTable(const InternalKeyComparator& comparator);
+  //
+  // If concurrent is true, Add() may be called from many threads at once.
+  explicit MemTable(const InternalKeyComparator& comparator,
+                    bool concurrent = false);
 
   MemTable(const MemTable&) = delete;
   MemTable& operator=(const MemTable&) = delete;
@@ -53,6 +57,7 @@ class MemTable {
   // Add an entry into memtable that maps key to value at the
   // specified sequence number and with the specified type.
   // Typically value will be empty if type==kTypeDeletion.
+  // Safe to call from many threads at once if the memtable is concurrent.
   void Add(SequenceNumber seq, ValueType type, const Slice& key,
            const Slice& value);
 
@@ -68,17 +73,47 @@ class MemTable {
 
   struct KeyComparator {
     const InternalKeyComparator comparator;
-    explicit KeyComparator(const InternalKeyComparator& c) : comparator(c) {}
+    // Int keys are compared inline in the skiplist
+    const bool int_key;
+    explicit KeyComparator(const InternalKeyComparator& c)
+        : comparator(c), int_key(c.key_type() == Comparator::kIntInternalKey) {}
     int operator()(const char* a, const char* b) const;
   };
 
-  typedef SkipList<const char*, KeyComparator> Table;
+  // Memory of the entries and the skiplist nodes, from a ConcurrentArena
+  // if the memtable is concurrent
+  class EntryAllocator {
+   public:
+    explicit EntryAllocator(bool concurrent)
+        : concurrent_arena_(concurrent ? new ConcurrentArena : nullptr) {}
+
+    char* Allocate(size_t bytes) {
+      return concurrent_arena_ != nullptr ? concurrent_arena_->Allocate(bytes)
+                                          : arena_.Allocate(bytes);
+    }
+    char* AllocateAligned(size_t bytes) {
+      return concurrent_arena_ != nullptr
+                 ? concurrent_arena_->AllocateAligned(bytes)
+                 : arena_.AllocateAligned(bytes);
+    }
+    size_t MemoryUsage() const {
+      return concurrent_arena_ != nullptr ? concurrent_arena_->MemoryUsage()
+                                          : arena_.MemoryUsage();
+    }
+    bool concurrent() const { return concurrent_arena_ != nullptr; }
+
+   private:
+    Arena arena_;
+    std::unique_ptr<ConcurrentArena> concurrent_arena_;
+  };
+
+  typedef SkipList<const char*, KeyComparator, EntryAllocator> Table;
 
   ~MemTable();  // Private since only Unref() should be used to delete it
 
   KeyComparator comparator_;
   int refs_;
-  Arena arena_;
+  EntryAllocator arena_;
   Table table_;
 };
 
@@ -59,6 +59,10 @@ class Repairer {
         next_file_number_(1) {
     // TableCache can be small since we expect each table to be opened once.
     table_cache_ = new TableCache(dbname_, options_, 10);
+    // Tables from logs take the layout the DB would give them at open
+    ReadLayoutParameter(env_, dbname_, &cost_model_);
+    cost_model_.SetSpaceBudget(options_.layout_space_budget);
+    InitLayout(options_, &cost_model_);
   }
 
   ~Repairer() {
@@ -207,7 +211,9 @@ class Repairer {
     FileMetaData meta;
     meta.number = next_file_number_++;
     Iterator* iter = mem->NewIterator();
-    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta);
+    // Tables converted from logs are level 0 tables
+    status = BuildTable(dbname_, env_, options_, table_cache_, iter, &meta,
+                        cost_model_.ShouldVertical(0));
     delete iter;
     mem->Unref();
     mem = nullptr;
@@ -446,6 +452,7 @@ class Repairer {
   std::vector<uint64_t> logs_;
   std::vector<TableInfo> tables_;
   uint64_t next_file_number_;
+  colsm::CostModel cost_model_;
 };
 }  // namespace
 
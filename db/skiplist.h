@@ -8,10 +8,12 @@
 // Thread safety
 // -------------
 //
-// Writes require external synchronization, most likely a mutex.
-// Reads require a guarantee that the SkipList will not be destroyed
-// while the read is in progress.  Apart from that, reads progress
-// without any internal locking or synchronization.
+// Insert() requires external synchronization, most likely a mutex.
+// InsertConcurrently() may run in many threads at once, as long as the
+// Allocator is thread-safe (e.g. ConcurrentArena) and no Insert() runs
+// at the same time.  Reads require a guarantee that the SkipList will
+// not be destroyed while the read is in progress.  Apart from that,
+// reads progress without any internal locking or synchronization.
 //
 // Invariants:
 //
@@ -21,14 +23,16 @@
 //
 // (2) The contents of a Node except for the next/prev pointers are
 // immutable after the Node has been linked into the SkipList.
-// Only Insert() modifies the list, and it is careful to initialize
-// a node and use release-stores to publish the nodes in one or
-// more lists.
+// Only Insert() and InsertConcurrently() modify the list, and they
+// are careful to initialize a node and use release-stores (or
+// compare-and-swaps with release semantics) to publish the nodes in
+// one or more lists.
 //
 // ... prev vs. next pointer ordering ...
 
 #include <atomic>
 #include <cassert>
+#include <cstdint>
 #include <cstdlib>
 
 #include "util/arena.h"
@@ -38,7 +42,7 @@ namespace leveldb {
 
 class Arena;
 
-template <typename Key, class Comparator>
+template <typename Key, class Comparator, class Allocator = Arena>
 class SkipList {
  private:
   struct Node;
@@ -47,7 +51,7 @@ class SkipList {
   // Create a new SkipList object that will use "cmp" for comparing keys,
   // and will allocate memory using "*arena".  Objects allocated in the arena
   // must remain allocated for the lifetime of the skiplist object.
-  explicit SkipList(Comparator cmp, Arena* arena);
+  explicit SkipList(Comparator cmp, Allocator* arena);
 
   SkipList(const SkipList&) = delete;
   SkipList& operator=(const SkipList&) = delete;
@@ -56,6 +60,14 @@ class SkipList {
   // REQUIRES: nothing that compares equal to key is currently in the list.
   void Insert(const Key& key);
 
+  // Like Insert(), but safe to call from many threads at once.  Each
+  // level of the new node is linked with a compare-and-swap, and the
+  // search is redone from the predecessor if another insert got there
+  // first.
+  // REQUIRES: nothing that compares equal to key is in the list or is
+  // being inserted concurrently.
+  void InsertConcurrently(const Key& key);
+
   // Returns true iff an entry that compares equal to key is in the list.
   bool Contains(const Key& key) const;
 
@@ -106,7 +118,7 @@ class SkipList {
   }
 
   Node* NewNode(const Key& key, int height);
-  int RandomHeight();
+  int RandomHeight(Random* rnd);
   bool Equal(const Key& a, const Key& b) const { return (compare_(a, b) == 0); }
 
   // Return true if key is greater than the data stored in "n"
@@ -127,14 +139,19 @@ class SkipList {
   // Return head_ if list is empty.
   Node* FindLast() const;
 
+  // Find the nodes around key at "level", starting the search from
+  // "before", which must come before key at that level.
+  void FindSpliceForLevel(const Key& key, Node* before, int level,
+                          Node** out_prev, Node** out_next) const;
+
   // Immutable after construction
   Comparator const compare_;
-  Arena* const arena_;  // Arena used for allocations of nodes
+  Allocator* const arena_;  // Arena used for allocations of nodes
 
   Node* const head_;
 
-  // Modified only by Insert().  Read racily by readers, but stale
-  // values are ok.
+  // Modified only by Insert() and InsertConcurrently().  Read racily by
+  // readers, but stale values are ok.
   std::atomic<int> max_height_;  // Height of the entire list
 
   // Read/written only by Insert().
@@ -142,8 +159,8 @@ class SkipList {
 };
 
 // Implementation details follow
-template <typename Key, class Comparator>
-struct SkipList<Key, Comparator>::Node {
+template <typename Key, class Comparator, class Allocator>
+struct SkipList<Key, Comparator, Allocator>::Node {
   explicit Node(const Key& k) : key(k) {}
 
   Key const key;
@@ -173,44 +190,53 @@ struct SkipList<Key, Comparator>::Node {
     next_[n].store(x, std::memory_order_relaxed);
   }
 
+  // Link x after this node at level n if the link is still "expected".
+  // Has the release semantics of SetNext() on success.
+  bool CASNext(int n, Node* expected, Node* x) {
+    assert(n >= 0);
+    return next_[n].compare_exchange_strong(expected, x,
+                                            std::memory_order_release);
+  }
+
  private:
   // Array of length equal to the node height.  next_[0] is lowest level link.
   std::atomic<Node*> next_[1];
 };
 
-template <typename Key, class Comparator>
-typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::NewNode(
-    const Key& key, int height) {
+template <typename Key, class Comparator, class Allocator>
+typename SkipList<Key, Comparator, Allocator>::Node*
+SkipList<Key, Comparator, Allocator>::NewNode(const Key& key, int height) {
   char* const node_memory = arena_->AllocateAligned(
       sizeof(Node) + sizeof(std::atomic<Node*>) * (height - 1));
   return new (node_memory) Node(key);
 }
 
-template <typename Key, class Comparator>
-inline SkipList<Key, Comparator>::Iterator::Iterator(const SkipList* list) {
+template <typename Key, class Comparator, class Allocator>
+inline SkipList<Key, Comparator, Allocator>::Iterator::Iterator(
+    const SkipList* list) {
   list_ = list;
   node_ = nullptr;
 }
 
-template <typename Key, class Comparator>
-inline bool SkipList<Key, Comparator>::Iterator::Valid() const {
+template <typename Key, class Comparator, class Allocator>
+inline bool SkipList<Key, Comparator, Allocator>::Iterator::Valid() const {
   return node_ != nullptr;
 }
 
-template <typename Key, class Comparator>
-inline const Key& SkipList<Key, Comparator>::Iterator::key() const {
+template <typename Key, class Comparator, class Allocator>
+inline const Key& SkipList<Key, Comparator, Allocator>::Iterator::key() const {
   assert(Valid());
   return node_->key;
 }
 
-template <typename Key, class Comparator>
-inline void SkipList<Key, Comparator>::Iterator::Next() {
+template <typename Key, class Comparator, class Allocator>
+inline void SkipList<Key, Comparator, Allocator>::Iterator::Next() {
   assert(Valid());
   node_ = node_->Next(0);
 }
 
-template <typename Key, class Comparator>
-inline void SkipList<Key, Comparator>::Iterator::Prev() {
+template <typename Key, class Comparator, class Allocator>
+inline void SkipList<Key, Comparator, Allocator>::Iterator::Prev() {
   // Instead of using explicit "prev" links, we just search for the
   // last node that falls before key.
   assert(Valid());
@@ -220,30 +246,31 @@ inline void SkipList<Key, Comparator>::Iterator::Prev() {
   }
 }
 
-template <typename Key, class Comparator>
-inline void SkipList<Key, Comparator>::Iterator::Seek(const Key& target) {
+template <typename Key, class Comparator, class Allocator>
+inline void SkipList<Key, Comparator, Allocator>::Iterator::Seek(
+    const Key& target) {
   node_ = list_->FindGreaterOrEqual(target, nullptr);
 }
 
-template <typename Key, class Comparator>
-inline void SkipList<Key, Comparator>::Iterator::SeekToFirst() {
+template <typename Key, class Comparator, class Allocator>
+inline void SkipList<Key, Comparator, Allocator>::Iterator::SeekToFirst() {
   node_ = list_->head_->Next(0);
 }
 
-template <typename Key, class Comparator>
-inline void SkipList<Key, Comparator>::Iterator::SeekToLast() {
+template <typename Key, class Comparator, class Allocator>
+inline void SkipList<Key, Comparator, Allocator>::Iterator::SeekToLast() {
   node_ = list_->FindLast();
   if (node_ == list_->head_) {
     node_ = nullptr;
   }
 }
 
-template <typename Key, class Comparator>
-int SkipList<Key, Comparator>::RandomHeight() {
+template <typename Key, class Comparator, class Allocator>
+int SkipList<Key, Comparator, Allocator>::RandomHeight(Random* rnd) {
   // Increase height with probability 1 in kBranching
   static const unsigned int kBranching = 4;
   int height = 1;
-  while (height < kMaxHeight && ((rnd_.Next() % kBranching) == 0)) {
+  while (height < kMaxHeight && ((rnd->Next() % kBranching) == 0)) {
     height++;
   }
   assert(height > 0);
@@ -251,15 +278,16 @@ int SkipList<Key, Comparator>::RandomHeight() {
   return height;
 }
 
-template <typename Key, class Comparator>
-bool SkipList<Key, Comparator>::KeyIsAfterNode(const Key& key, Node* n) const {
+template <typename Key, class Comparator, class Allocator>
+bool SkipList<Key, Comparator, Allocator>::KeyIsAfterNode(const Key& key,
+                                                          Node* n) const {
   // null n is considered infinite
   return (n != nullptr) && (compare_(n->key, key) < 0);
 }
 
-template <typename Key, class Comparator>
-typename SkipList<Key, Comparator>::Node*
-SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key,
+template <typename Key, class Comparator, class Allocator>
+typename SkipList<Key, Comparator, Allocator>::Node*
+SkipList<Key, Comparator, Allocator>::FindGreaterOrEqual(const Key& key,
                                               Node** prev) const {
   Node* x = head_;
   int level = GetMaxHeight() - 1;
@@ -280,9 +308,9 @@ SkipList<Key, Comparator>::FindGreaterOrEqual(const Key& key,
   }
 }
 
-template <typename Key, class Comparator>
-typename SkipList<Key, Comparator>::Node*
-SkipList<Key, Comparator>::FindLessThan(const Key& key) const {
+template <typename Key, class Comparator, class Allocator>
+typename SkipList<Key, Comparator, Allocator>::Node*
+SkipList<Key, Comparator, Allocator>::FindLessThan(const Key& key) const {
   Node* x = head_;
   int level = GetMaxHeight() - 1;
   while (true) {
@@ -301,9 +329,9 @@ SkipList<Key, Comparator>::FindLessThan(const Key& key) const {
   }
 }
 
-template <typename Key, class Comparator>
-typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
-    const {
+template <typename Key, class Comparator, class Allocator>
+typename SkipList<Key, Comparator, Allocator>::Node*
+SkipList<Key, Comparator, Allocator>::FindLast() const {
   Node* x = head_;
   int level = GetMaxHeight() - 1;
   while (true) {
@@ -321,8 +349,25 @@ typename SkipList<Key, Comparator>::Node* SkipList<Key, Comparator>::FindLast()
   }
 }
 
-template <typename Key, class Comparator>
-SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
+template <typename Key, class Comparator, class Allocator>
+void SkipList<Key, Comparator, Allocator>::FindSpliceForLevel(
+    const Key& key, Node* before, int level, Node** out_prev,
+    Node** out_next) const {
+  while (true) {
+    Node* next = before->Next(level);
+    if (KeyIsAfterNode(key, next)) {
+      before = next;
+    } else {
+      *out_prev = before;
+      *out_next = next;
+      return;
+    }
+  }
+}
+
+template <typename Key, class Comparator, class Allocator>
+SkipList<Key, Comparator, Allocator>::SkipList(Comparator cmp,
+                                               Allocator* arena)
     : compare_(cmp),
       arena_(arena),
       head_(NewNode(0 /* any key will do */, kMaxHeight)),
@@ -333,8 +378,8 @@ SkipList<Key, Comparator>::SkipList(Comparator cmp, Arena* arena)
   }
 }
 
-template <typename Key, class Comparator>
-void SkipList<Key, Comparator>::Insert(const Key& key) {
+template <typename Key, class Comparator, class Allocator>
+void SkipList<Key, Comparator, Allocator>::Insert(const Key& key) {
   // TODO(opt): We can use a barrier-free variant of FindGreaterOrEqual()
   // here since Insert() is externally synchronized.
   Node* prev[kMaxHeight];
@@ -343,7 +388,7 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   // Our data structure does not allow duplicate insertion
   assert(x == nullptr || !Equal(key, x->key));
 
-  int height = RandomHeight();
+  int height = RandomHeight(&rnd_);
   if (height > GetMaxHeight()) {
     for (int i = GetMaxHeight(); i < height; i++) {
       prev[i] = head_;
@@ -367,8 +412,58 @@ void SkipList<Key, Comparator>::Insert(const Key& key) {
   }
 }
 
-template <typename Key, class Comparator>
-bool SkipList<Key, Comparator>::Contains(const Key& key) const {
+template <typename Key, class Comparator, class Allocator>
+void SkipList<Key, Comparator, Allocator>::InsertConcurrently(const Key& key) {
+  // rnd_ belongs to Insert(), so concurrent inserters draw heights from a
+  // generator of their own.
+  static thread_local Random rnd(0xdeadbeef ^ static_cast<uint32_t>(
+      reinterpret_cast<uintptr_t>(&rnd)));
+  const int height = RandomHeight(&rnd);
+
+  // Raising max_height_ is safe for the same reasons as in Insert(); the
+  // new levels of head_ are still nullptr until they are CASed below.
+  int max_height = GetMaxHeight();
+  while (height > max_height) {
+    if (max_height_.compare_exchange_weak(max_height, height,
+                                          std::memory_order_relaxed)) {
+      max_height = height;
+      break;
+    }
+  }
+
+  // Find the splice at every level from the top down, each level starting
+  // from the predecessor found one level above.
+  Node* prev[kMaxHeight];
+  Node* next[kMaxHeight];
+  Node* before = head_;
+  for (int i = max_height - 1; i >= 0; i--) {
+    FindSpliceForLevel(key, before, i, &prev[i], &next[i]);
+    before = prev[i];
+  }
+
+  // Our data structure does not allow duplicate insertion
+  assert(next[0] == nullptr || !Equal(key, next[0]->key));
+
+  Node* x = NewNode(key, height);
+  // Link bottom up, so that x is in the level-0 list, which decides
+  // membership, before it becomes reachable from any higher level.
+  for (int i = 0; i < height; i++) {
+    while (true) {
+      // NoBarrier_SetNext() suffices since the CAS publishing x has
+      // release semantics.
+      x->NoBarrier_SetNext(i, next[i]);
+      if (prev[i]->CASNext(i, next[i], x)) {
+        break;
+      }
+      // Another insert changed prev[i] at this level.  The splice can
+      // only have moved forward, so search again from prev[i].
+      FindSpliceForLevel(key, prev[i], i, &prev[i], &next[i]);
+    }
+  }
+}
+
+template <typename Key, class Comparator, class Allocator>
+bool SkipList<Key, Comparator, Allocator>::Contains(const Key& key) const {
   Node* x = FindGreaterOrEqual(key, nullptr);
   if (x != nullptr && Equal(key, x->key)) {
     return true;
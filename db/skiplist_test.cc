@@ -13,6 +13,7 @@
 #include "port/thread_annotations.h"
 #include "util/arena.h"
 #include "util/hash.h"
+#include "util/mutexlock.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -365,6 +366,108 @@ TEST(SkipTest, Concurrent3) { RunConcurrent(3); }
 TEST(SkipTest, Concurrent4) { RunConcurrent(4); }
 TEST(SkipTest, Concurrent5) { RunConcurrent(5); }
 
+// Several threads insert disjoint sets of keys with InsertConcurrently()
+// while a reader keeps checking that the list stays sorted.
+class ConcurrentInsertState {
+ public:
+  typedef SkipList<Key, Comparator, ConcurrentArena> List;
+
+  static const int kWriters = 4;
+  static const int kKeysPerWriter = 20000;
+
+  ConcurrentInsertState()
+      : list_(Comparator(), &arena_), next_writer_(0), running_(0),
+        done_cv_(&mu_) {}
+
+  static void Writer(void* arg) {
+    ConcurrentInsertState* state = static_cast<ConcurrentInsertState*>(arg);
+    const int id = state->next_writer_.fetch_add(1);
+    Random rnd(test::RandomSeed() + id);
+    // Keys of writer "id" are id, id + kWriters, ..., inserted in a
+    // random order
+    std::vector<Key> keys;
+    for (int i = 0; i < kKeysPerWriter; i++) {
+      keys.push_back(static_cast<Key>(i) * kWriters + id);
+    }
+    for (int i = kKeysPerWriter - 1; i > 0; i--) {
+      std::swap(keys[i], keys[rnd.Uniform(i + 1)]);
+    }
+    for (Key k : keys) {
+      state->list_.InsertConcurrently(k);
+    }
+    state->Finish();
+  }
+
+  static void Reader(void* arg) {
+    ConcurrentInsertState* state = static_cast<ConcurrentInsertState*>(arg);
+    while (state->next_writer_.load() < kWriters || state->Running() > 1) {
+      List::Iterator iter(&state->list_);
+      Key last = 0;
+      bool first = true;
+      for (iter.SeekToFirst(); iter.Valid(); iter.Next()) {
+        if (!first) {
+          EXPECT_LT(last, iter.key());
+        }
+        last = iter.key();
+        first = false;
+      }
+    }
+    state->Finish();
+  }
+
+  void Run() {
+    running_ = kWriters + 1;
+    Env::Default()->StartThread(Reader, this);
+    for (int i = 0; i < kWriters; i++) {
+      Env::Default()->StartThread(Writer, this);
+    }
+    MutexLock l(&mu_);
+    while (running_ > 0) {
+      done_cv_.Wait();
+    }
+  }
+
+  ConcurrentArena arena_;
+  List list_;
+
+ private:
+  void Finish() LOCKS_EXCLUDED(mu_) {
+    MutexLock l(&mu_);
+    running_--;
+    done_cv_.SignalAll();
+  }
+
+  int Running() LOCKS_EXCLUDED(mu_) {
+    MutexLock l(&mu_);
+    return running_;
+  }
+
+  std::atomic<int> next_writer_;
+  port::Mutex mu_;
+  int running_ GUARDED_BY(mu_);
+  port::CondVar done_cv_ GUARDED_BY(mu_);
+};
+
+TEST(SkipTest, ConcurrentInsert) {
+  ConcurrentInsertState state;
+  state.Run();
+
+  const Key kNumKeys = ConcurrentInsertState::kWriters *
+                       ConcurrentInsertState::kKeysPerWriter;
+  ConcurrentInsertState::List::Iterator iter(&state.list_);
+  iter.SeekToFirst();
+  for (Key k = 0; k < kNumKeys; k++) {
+    ASSERT_TRUE(iter.Valid());
+    ASSERT_EQ(k, iter.key());
+    iter.Next();
+  }
+  ASSERT_TRUE(!iter.Valid());
+
+  // Inserts from a single thread still work on the same list
+  state.list_.Insert(kNumKeys);
+  ASSERT_TRUE(state.list_.Contains(kNumKeys));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -19,6 +19,8 @@
 #include "util/coding.h"
 #include "util/logging.h"
 
+#include "colsm/vblock/column_merger.h"
+
 namespace leveldb {
 
 static size_t TargetFileSize(const Options* options) {
@@ -325,6 +327,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
                     std::string* value, GetStats* stats) {
   stats->seek_file = nullptr;
   stats->seek_file_level = -1;
+  stats->levels_read = 0;
 
   struct State {
     Saver saver;
@@ -350,6 +353,7 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
 
       state->last_file_read = f;
       state->last_file_read_level = level;
+      state->stats->levels_read |= 1u << level;
 
       state->s = state->vset->table_cache_->Get(*state->options, f->number,
                                                 f->file_size, state->ikey,
@@ -399,6 +403,145 @@ Status Version::Get(const ReadOptions& options, const LookupKey& k,
   return state.found ? state.s : Status::NotFound(Slice());
 }
 
+void Version::MultiGet(const ReadOptions& options,
+                       const std::vector<const LookupKey*>& keys,
+                       const std::vector<std::string*>& values,
+                       std::vector<Status>* statuses,
+                       std::vector<GetStats>* stats) {
+  const Comparator* ucmp = vset_->icmp_.user_comparator();
+  const size_t num_keys = keys.size();
+
+  std::vector<Saver> savers(num_keys);
+  std::vector<FileMetaData*> last_file_read(num_keys, nullptr);
+  std::vector<int> last_file_read_level(num_keys, -1);
+  statuses->assign(num_keys, Status::NotFound(Slice()));
+  stats->resize(num_keys);
+  for (size_t i = 0; i < num_keys; i++) {
+    savers[i].ucmp = ucmp;
+    savers[i].user_key = keys[i]->user_key();
+    savers[i].value = values[i];
+    (*stats)[i].seek_file = nullptr;
+    (*stats)[i].seek_file_level = -1;
+    (*stats)[i].levels_read = 0;
+  }
+
+  // Keys not found yet, in the order of their user keys
+  std::vector<bool> done(num_keys, false);
+  std::vector<uint32_t> pending(num_keys);
+  for (uint32_t i = 0; i < num_keys; i++) {
+    pending[i] = i;
+  }
+
+  std::vector<uint32_t> batch;
+  std::vector<Slice> ikeys;
+  std::vector<void*> args;
+  // Look up the batch in f and drop the keys resolved from pending
+  auto probe = [&](int level, FileMetaData* f) {
+    ikeys.clear();
+    args.clear();
+    for (auto i : batch) {
+      GetStats& key_stats = (*stats)[i];
+      if (key_stats.seek_file == nullptr && last_file_read[i] != nullptr) {
+        // We have had more than one seek for this read.  Charge the 1st file.
+        key_stats.seek_file = last_file_read[i];
+        key_stats.seek_file_level = last_file_read_level[i];
+      }
+      last_file_read[i] = f;
+      last_file_read_level[i] = level;
+      key_stats.levels_read |= 1u << level;
+
+      savers[i].state = kNotFound;
+      ikeys.push_back(keys[i]->internal_key());
+      args.push_back(&savers[i]);
+    }
+    Status s = vset_->table_cache_->MultiGet(options, f->number, f->file_size,
+                                             batch.size(), ikeys.data(),
+                                             args.data(), SaveValue);
+    for (auto i : batch) {
+      if (!s.ok()) {
+        (*statuses)[i] = s;
+        done[i] = true;
+        continue;
+      }
+      switch (savers[i].state) {
+        case kNotFound:
+          continue;  // Keep searching in other files
+        case kFound:
+          (*statuses)[i] = Status::OK();
+          break;
+        case kDeleted:
+          break;
+        case kCorrupt:
+          (*statuses)[i] =
+              Status::Corruption("corrupted key for ", savers[i].user_key);
+          break;
+      }
+      done[i] = true;
+    }
+    // Keys still kNotFound go on to the next file
+    pending.erase(std::remove_if(pending.begin(), pending.end(),
+                                 [&](uint32_t i) { return done[i]; }),
+                  pending.end());
+    batch.clear();
+  };
+
+  // Search level-0 in order from newest to oldest, each file with the
+  // pending keys in its range
+  std::vector<FileMetaData*> tmp(files_[0]);
+  std::sort(tmp.begin(), tmp.end(), NewestFirst);
+  for (FileMetaData* f : tmp) {
+    for (auto i : pending) {
+      if (ucmp->Compare(savers[i].user_key, f->smallest.user_key()) >= 0 &&
+          ucmp->Compare(savers[i].user_key, f->largest.user_key()) <= 0) {
+        batch.push_back(i);
+      }
+    }
+    if (!batch.empty()) {
+      probe(0, f);
+    }
+    if (pending.empty()) {
+      return;
+    }
+  }
+
+  // Search other levels. The files are sorted and disjoint, so each one
+  // gets a consecutive run of the pending keys.
+  for (int level = 1; level < config::kNumLevels && !pending.empty();
+       level++) {
+    const std::vector<FileMetaData*>& files = files_[level];
+    size_t num_files = files.size();
+    if (num_files == 0) continue;
+
+    uint32_t index = 0;
+    FileMetaData* batch_file = nullptr;
+    // probe modifies pending, so walk a copy
+    std::vector<uint32_t> level_keys(pending);
+    for (auto i : level_keys) {
+      Slice ikey = keys[i]->internal_key();
+      if (vset_->icmp_.Compare(files[index]->largest.Encode(), ikey) < 0) {
+        // Binary search to find earliest index whose largest key >= ikey.
+        index = FindFile(vset_->icmp_, files, ikey);
+        if (index >= num_files) {
+          break;
+        }
+      }
+      FileMetaData* f = files[index];
+      if (ucmp->Compare(savers[i].user_key, f->smallest.user_key()) < 0) {
+        // All of "f" is past any data for user_key
+        continue;
+      }
+      if (f != batch_file && !batch.empty()) {
+        probe(level, batch_file);
+      }
+      batch_file = f;
+      batch.push_back(i);
+    }
+    if (!batch.empty()) {
+      probe(level, batch_file);
+    }
+  }
+}
+
 bool Version::UpdateStats(const GetStats& stats) {
   FileMetaData* f = stats.seek_file;
   if (f != nullptr) {
@@ -1024,8 +1167,7 @@ void VersionSet::MarkFileNumberUsed(uint64_t number) {
 }
 
 void VersionSet::Finalize(Version* v) {
-  // Precomputed best level for next compaction
-  int best_level = -1;
+  // Precomputed scores for next compaction
   double best_score = -1;
 
   for (int level = 0; level < config::kNumLevels - 1; level++) {
@@ -1051,13 +1193,12 @@ void VersionSet::Finalize(Version* v) {
           static_cast<double>(level_bytes) / MaxBytesForLevel(options_, level);
     }
 
+    v->level_scores_[level] = score;
     if (score > best_score) {
-      best_level = level;
       best_score = score;
     }
   }
 
-  v->compaction_level_ = best_level;
   v->compaction_score_ = best_score;
 }
 
@@ -1211,11 +1352,63 @@ void VersionSet::GetRange2(const std::vector<FileMetaData*>& inputs1,
   GetRange(all, smallest, largest);
 }
 
+static void DeleteTableIterator(void* arg, void* ignored) {
+  delete reinterpret_cast<Iterator*>(arg);
+}
+
+Iterator* VersionSet::MakeColumnInputIterator(Compaction* c,
+                                              const ReadOptions& options) {
+  // Same sources as below, each level-0 file and each other level
+  std::vector<std::vector<Table*>> sources;
+  std::vector<Iterator*> pins;
+  Status s;
+  for (int which = 0; which < 2 && s.ok(); which++) {
+    const std::vector<FileMetaData*>& files = c->inputs_[which];
+    for (size_t i = 0; i < files.size() && s.ok(); i++) {
+      if (i == 0 || c->level() + which == 0) {
+        sources.emplace_back();
+      }
+      Table* table;
+      // The table stays in the cache until its iterator is deleted
+      Iterator* pin = table_cache_->NewIterator(options, files[i]->number,
+                                                files[i]->file_size, &table);
+      pins.push_back(pin);
+      s = pin->status();
+      sources.back().push_back(table);
+    }
+  }
+  if (!s.ok()) {
+    for (auto pin : pins) {
+      delete pin;
+    }
+    return nullptr;
+  }
+  std::vector<colsm::ColumnReader*> readers;
+  for (auto& tables : sources) {
+    readers.push_back(new colsm::ColumnReader(options, tables));
+  }
+  Iterator* result = colsm::NewColumnMergingIterator(readers);
+  for (auto pin : pins) {
+    result->RegisterCleanup(&DeleteTableIterator, pin, nullptr);
+  }
+  return result;
+}
+
 Iterator* VersionSet::MakeInputIterator(Compaction* c) {
   ReadOptions options;
   options.verify_checksums = options_->paranoid_checks;
   options.fill_cache = false;
 
+  if (options_->vert_column_compaction &&
+      options_->vert_key_format == kVertIntKey &&
+      icmp_.key_type() == Comparator::kIntInternalKey) {
+    Iterator* result = MakeColumnInputIterator(c, options);
+    // Fall back to the table iterators, which report the error
+    if (result != nullptr) {
+      return result;
+    }
+  }
+
   // Level-0 files have to be merged together.  For other levels,
   // we will make a concatenating iterator per level.
   // TODO(opt): use concatenating iterator for level-0 if there is no overlap
@@ -1245,42 +1438,56 @@ Iterator* VersionSet::MakeInputIterator(Compaction* c) {
 }
 
 Compaction* VersionSet::PickCompaction() {
-  Compaction* c;
-  int level;
-
   // We prefer compactions triggered by too much data in a level over
-  // the compactions triggered by seeks.
-  const bool size_compaction = (current_->compaction_score_ >= 1);
-  const bool seek_compaction = (current_->file_to_compact_ != nullptr);
-  if (size_compaction) {
-    level = current_->compaction_level_;
-    assert(level >= 0);
-    assert(level + 1 < config::kNumLevels);
-    c = new Compaction(options_, level);
-
-    // Pick the first file that comes after compact_pointer_[level]
-    for (size_t i = 0; i < current_->files_[level].size(); i++) {
-      FileMetaData* f = current_->files_[level][i];
-      if (compact_pointer_[level].empty() ||
-          icmp_.Compare(f->largest.Encode(), compact_pointer_[level]) > 0) {
-        c->inputs_[0].push_back(f);
-        break;
-      }
+  // the compactions triggered by seeks.  The levels are tried from the
+  // highest score down, since the files of running compactions may keep
+  // a level from being compacted now.
+  int levels[config::kNumLevels - 1];
+  for (int level = 0; level < config::kNumLevels - 1; level++) {
+    levels[level] = level;
+  }
+  std::stable_sort(levels, levels + config::kNumLevels - 1,
+                   [this](int a, int b) {
+                     return current_->level_scores_[a] >
+                            current_->level_scores_[b];
+                   });
+  for (int level : levels) {
+    if (current_->level_scores_[level] < 1) {
+      break;
     }
-    if (c->inputs_[0].empty()) {
-      // Wrap-around to the beginning of the key space
-      c->inputs_[0].push_back(current_->files_[level][0]);
+    // Pick the first file that comes after compact_pointer_[level],
+    // wrapping around to the beginning of the key space
+    const std::vector<FileMetaData*>& files = current_->files_[level];
+    size_t start = 0;
+    while (start < files.size() && !compact_pointer_[level].empty() &&
+           icmp_.Compare(files[start]->largest.Encode(),
+                         compact_pointer_[level]) <= 0) {
+      start++;
+    }
+    for (size_t i = 0; i < files.size(); i++) {
+      FileMetaData* f = files[(start + i) % files.size()];
+      if (f->being_compacted) {
+        continue;
+      }
+      Compaction* c = SetupCompaction(level, f);
+      if (c != nullptr) {
+        return c;
+      }
     }
-  } else if (seek_compaction) {
-    level = current_->file_to_compact_level_;
-    c = new Compaction(options_, level);
-    c->inputs_[0].push_back(current_->file_to_compact_);
-  } else {
-    return nullptr;
   }
 
-  c->input_version_ = current_;
-  c->input_version_->Ref();
+  FileMetaData* f = current_->file_to_compact_;
+  if (f != nullptr && !f->being_compacted) {
+    return SetupCompaction(current_->file_to_compact_level_, f);
+  }
+  return nullptr;
+}
+
+Compaction* VersionSet::SetupCompaction(int level, FileMetaData* f) {
+  assert(level >= 0);
+  assert(level + 1 < config::kNumLevels);
+  Compaction* c = new Compaction(options_, level);
+  c->inputs_[0].push_back(f);
 
   // Files in level 0 may overlap each other, so pick up all overlapping ones
   if (level == 0) {
@@ -1293,11 +1500,23 @@ Compaction* VersionSet::PickCompaction() {
     assert(!c->inputs_[0].empty());
   }
 
-  SetupOtherInputs(c);
-
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
+// Returns true iff some of the files are inputs of a running compaction
+static bool AnyBeingCompacted(const std::vector<FileMetaData*>& files) {
+  for (FileMetaData* f : files) {
+    if (f->being_compacted) {
+      return true;
+    }
+  }
+  return false;
+}
+
 // Finds the largest key in a vector of files. Returns true if files it not
 // empty.
 bool FindLargestKey(const InternalKeyComparator& icmp,
@@ -1377,7 +1596,7 @@ void AddBoundaryInputs(const InternalKeyComparator& icmp,
   }
 }
 
-void VersionSet::SetupOtherInputs(Compaction* c) {
+bool VersionSet::SetupOtherInputs(Compaction* c) {
   const int level = c->level();
   InternalKey smallest, largest;
 
@@ -1386,6 +1605,9 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
 
   current_->GetOverlappingInputs(level + 1, &smallest, &largest,
                                  &c->inputs_[1]);
+  if (AnyBeingCompacted(c->inputs_[0]) || AnyBeingCompacted(c->inputs_[1])) {
+    return false;
+  }
 
   // Get entire range covered by compaction
   InternalKey all_start, all_limit;
@@ -1402,7 +1624,8 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
     const int64_t expanded0_size = TotalFileSize(expanded0);
     if (expanded0.size() > c->inputs_[0].size() &&
         inputs1_size + expanded0_size <
-            ExpandedCompactionByteSizeLimit(options_)) {
+            ExpandedCompactionByteSizeLimit(options_) &&
+        !AnyBeingCompacted(expanded0)) {
       InternalKey new_start, new_limit;
       GetRange(expanded0, &new_start, &new_limit);
       std::vector<FileMetaData*> expanded1;
@@ -1436,6 +1659,16 @@ void VersionSet::SetupOtherInputs(Compaction* c) {
   // key range next time.
   compact_pointer_[level] = largest.Encode().ToString();
   c->edit_.SetCompactPointer(level, largest);
+
+  // The inputs belong to c until ReleaseInputs()
+  c->input_version_ = current_;
+  c->input_version_->Ref();
+  for (int which = 0; which < 2; which++) {
+    for (FileMetaData* f : c->inputs_[which]) {
+      f->being_compacted = true;
+    }
+  }
+  return true;
 }
 
 Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
@@ -1464,30 +1697,27 @@ Compaction* VersionSet::CompactRange(int level, const InternalKey* begin,
   }
 
   Compaction* c = new Compaction(options_, level);
-  c->input_version_ = current_;
-  c->input_version_->Ref();
   c->inputs_[0] = inputs;
-  SetupOtherInputs(c);
+  if (!SetupOtherInputs(c)) {
+    delete c;
+    return nullptr;
+  }
   return c;
 }
 
 Compaction::Compaction(const Options* options, int level)
     : level_(level),
       max_output_file_size_(MaxFileSizeForLevel(options, level)),
-      input_version_(nullptr),
-      grandparent_index_(0),
-      seen_key_(false),
-      overlapped_bytes_(0) {
+      input_version_(nullptr) {}
+
+Compaction::KeyCursor::KeyCursor()
+    : grandparent_index(0), seen_key(false), overlapped_bytes(0) {
   for (int i = 0; i < config::kNumLevels; i++) {
-    level_ptrs_[i] = 0;
+    level_ptrs[i] = 0;
   }
 }
 
-Compaction::~Compaction() {
-  if (input_version_ != nullptr) {
-    input_version_->Unref();
-  }
-}
+Compaction::~Compaction() { ReleaseInputs(); }
 
 bool Compaction::IsTrivialMove() const {
   const VersionSet* vset = input_version_->vset_;
@@ -1507,13 +1737,14 @@ void Compaction::AddInputDeletions(VersionEdit* edit) {
   }
 }
 
-bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
+bool Compaction::IsBaseLevelForKey(const Slice& user_key,
+                                   KeyCursor* cursor) const {
   // Maybe use binary search to find right entry instead of linear search?
   const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
   for (int lvl = level_ + 2; lvl < config::kNumLevels; lvl++) {
     const std::vector<FileMetaData*>& files = input_version_->files_[lvl];
-    while (level_ptrs_[lvl] < files.size()) {
-      FileMetaData* f = files[level_ptrs_[lvl]];
+    while (cursor->level_ptrs[lvl] < files.size()) {
+      FileMetaData* f = files[cursor->level_ptrs[lvl]];
       if (user_cmp->Compare(user_key, f->largest.user_key()) <= 0) {
         // We've advanced far enough
         if (user_cmp->Compare(user_key, f->smallest.user_key()) >= 0) {
@@ -1522,38 +1753,83 @@ bool Compaction::IsBaseLevelForKey(const Slice& user_key) {
         }
         break;
       }
-      level_ptrs_[lvl]++;
+      cursor->level_ptrs[lvl]++;
     }
   }
   return true;
 }
 
-bool Compaction::ShouldStopBefore(const Slice& internal_key) {
+bool Compaction::ShouldStopBefore(const Slice& internal_key,
+                                  KeyCursor* cursor) const {
   const VersionSet* vset = input_version_->vset_;
   // Scan to find earliest grandparent file that contains key.
   const InternalKeyComparator* icmp = &vset->icmp_;
-  while (grandparent_index_ < grandparents_.size() &&
+  while (cursor->grandparent_index < grandparents_.size() &&
          icmp->Compare(internal_key,
-                       grandparents_[grandparent_index_]->largest.Encode()) >
-             0) {
-    if (seen_key_) {
-      overlapped_bytes_ += grandparents_[grandparent_index_]->file_size;
+                       grandparents_[cursor->grandparent_index]
+                           ->largest.Encode()) > 0) {
+    if (cursor->seen_key) {
+      cursor->overlapped_bytes +=
+          grandparents_[cursor->grandparent_index]->file_size;
     }
-    grandparent_index_++;
+    cursor->grandparent_index++;
   }
-  seen_key_ = true;
+  cursor->seen_key = true;
 
-  if (overlapped_bytes_ > MaxGrandParentOverlapBytes(vset->options_)) {
+  if (cursor->overlapped_bytes > MaxGrandParentOverlapBytes(vset->options_)) {
     // Too much overlap for current output; start new output
-    overlapped_bytes_ = 0;
+    cursor->overlapped_bytes = 0;
     return true;
   } else {
     return false;
   }
 }
 
+void Compaction::SplitKeyRange(int n,
+                               std::vector<std::string>* boundaries) const {
+  boundaries->clear();
+  const Comparator* user_cmp = input_version_->vset_->icmp_.user_comparator();
+  std::vector<FileMetaData*> files(inputs_[0]);
+  files.insert(files.end(), inputs_[1].begin(), inputs_[1].end());
+  if (n <= 1 || files.size() <= 1) {
+    return;
+  }
+  std::sort(files.begin(), files.end(),
+            [user_cmp](FileMetaData* a, FileMetaData* b) {
+              return user_cmp->Compare(a->largest.user_key(),
+                                       b->largest.user_key()) < 0;
+            });
+  const uint64_t total = TotalFileSize(files);
+  const Slice last = files.back()->largest.user_key();
+  uint64_t size = 0;
+  for (FileMetaData* f : files) {
+    size += f->file_size;
+    // Cut when the inputs up to f reach the next 1/n of the total
+    if (size * n < total * (boundaries->size() + 1)) {
+      continue;
+    }
+    Slice boundary = f->largest.user_key();
+    if (user_cmp->Compare(boundary, last) >= 0) {
+      break;
+    }
+    if (boundaries->empty() ||
+        user_cmp->Compare(boundary, boundaries->back()) > 0) {
+      boundaries->push_back(boundary.ToString());
+    }
+    if (boundaries->size() + 1 >= static_cast<size_t>(n)) {
+      break;
+    }
+  }
+}
+
 void Compaction::ReleaseInputs() {
   if (input_version_ != nullptr) {
+    // input_version_ keeps the input files alive until here
+    for (int which = 0; which < 2; which++) {
+      for (FileMetaData* f : inputs_[which]) {
+        f->being_compacted = false;
+      }
+    }
     input_version_->Unref();
     input_version_ = nullptr;
   }
@@ -65,6 +65,7 @@ class Version {
   struct GetStats {
     FileMetaData* seek_file;
     int seek_file_level;
+    uint32_t levels_read;  // Bit i is set if a file at level i was read
   };
 
   // Append to *iters a sequence of iterators that will
@@ -75,6 +76,15 @@ class Version {
   Status Get(const ReadOptions&, const LookupKey& key, std::string* val,
              GetStats* stats);
 
+  // Get for a batch of keys of the same sequence, sorted by user key.
+  // Each level is probed once for all keys not found yet, and the keys
+  // falling in the same file are looked up together. Stores the result
+  // of keys[i] in (*statuses)[i] and (*stats)[i].
+  // REQUIRES: lock is not held
+  void MultiGet(const ReadOptions&, const std::vector<const LookupKey*>& keys,
+                const std::vector<std::string*>& values,
+                std::vector<Status>* statuses, std::vector<GetStats>* stats);
+
   // Adds "stats" into the current state.  Returns true if a new
   // compaction may need to be triggered, false otherwise.
   // REQUIRES: lock is held
@@ -127,8 +137,11 @@ class Version {
         refs_(0),
         file_to_compact_(nullptr),
         file_to_compact_level_(-1),
-        compaction_score_(-1),
-        compaction_level_(-1) {}
+        compaction_score_(-1) {
+    for (int level = 0; level < config::kNumLevels - 1; level++) {
+      level_scores_[level] = -1;
+    }
+  }
 
   Version(const Version&) = delete;
   Version& operator=(const Version&) = delete;
@@ -157,11 +170,11 @@ class Version {
   FileMetaData* file_to_compact_;
   int file_to_compact_level_;
 
-  // Level that should be compacted next and its compaction score.
+  // Compaction score of each level and the highest of them.
   // Score < 1 means compaction is not strictly needed.  These fields
   // are initialized by Finalize().
+  double level_scores_[config::kNumLevels - 1];
   double compaction_score_;
-  int compaction_level_;
 };
 
 class VersionSet {
@@ -227,7 +240,8 @@ class VersionSet {
   // being compacted, or zero if there is no such log file.
   uint64_t PrevLogNumber() const { return prev_log_number_; }
 
-  // Pick level and inputs for a new compaction.
+  // Pick level and inputs for a new compaction, skipping the files
+  // of running compactions.
   // Returns nullptr if there is no compaction to be done.
   // Otherwise returns a pointer to a heap-allocated object that
   // describes the compaction.  Caller should delete the result.
@@ -237,6 +251,7 @@ class VersionSet {
   // the specified level.  Returns nullptr if there is nothing in that
   // level that overlaps the specified range.  Caller should delete
   // the result.
+  // REQUIRES: no other compaction is running.
   Compaction* CompactRange(int level, const InternalKey* begin,
                            const InternalKey* end);
 
@@ -272,6 +287,10 @@ class VersionSet {
  private:
   class Builder;
 
+  // With Options::vert_column_compaction, read the inputs of "*c" column
+  // by column. Returns nullptr if an input table cannot be opened.
+  Iterator* MakeColumnInputIterator(Compaction* c, const ReadOptions& options);
+
   friend class Compaction;
   friend class Version;
 
@@ -286,7 +305,14 @@ class VersionSet {
                  const std::vector<FileMetaData*>& inputs2,
                  InternalKey* smallest, InternalKey* largest);
 
-  void SetupOtherInputs(Compaction* c);
+  // Compaction of the file f in level, or nullptr if an input would be
+  // a file of a running compaction.
+  Compaction* SetupCompaction(int level, FileMetaData* f);
+
+  // Returns false, leaving compact_pointer_ unchanged, if an input of c
+  // is a file of a running compaction. Otherwise c takes its inputs
+  // until c->ReleaseInputs().
+  bool SetupOtherInputs(Compaction* c);
 
   // Save current contents to *log
   Status WriteSnapshot(log::Writer* log);
@@ -344,17 +370,44 @@ class Compaction {
   // Add all inputs to this compaction as delete operations to *edit.
   void AddInputDeletions(VersionEdit* edit);
 
+  // Progress of IsBaseLevelForKey and ShouldStopBefore, which are called
+  // with increasing keys. Subcompactions each keep their own.
+  struct KeyCursor {
+    KeyCursor();
+
+    // State used to check for number of overlapping grandparent files
+    // (parent == level_ + 1, grandparent == level_ + 2)
+    size_t grandparent_index;  // Index in grandparents_
+    bool seen_key;             // Some output key has been seen
+    int64_t overlapped_bytes;  // Bytes of overlap between current output
+                               // and grandparent files
+
+    // State for implementing IsBaseLevelForKey
+
+    // level_ptrs holds indices into input_version_->levels_: our state
+    // is that we are positioned at one of the file ranges for each
+    // higher level than the ones involved in this compaction (i.e. for
+    // all L >= level_ + 2).
+    size_t level_ptrs[config::kNumLevels];
+  };
+
   // Returns true if the information we have available guarantees that
   // the compaction is producing data in "level+1" for which no data exists
   // in levels greater than "level+1".
-  bool IsBaseLevelForKey(const Slice& user_key);
+  bool IsBaseLevelForKey(const Slice& user_key, KeyCursor* cursor) const;
 
   // Returns true iff we should stop building the current output
   // before processing "internal_key".
-  bool ShouldStopBefore(const Slice& internal_key);
+  bool ShouldStopBefore(const Slice& internal_key, KeyCursor* cursor) const;
+
+  // Split the inputs into at most n key ranges of about the same input
+  // size, at the largest user keys of the input files. Stores the
+  // boundaries in *boundaries, range i holds the user keys in
+  // (boundaries[i-1], boundaries[i]].
+  void SplitKeyRange(int n, std::vector<std::string>* boundaries) const;
 
-  // Release the input version for the compaction, once the compaction
-  // is successful.
+  // Release the input files and version for the compaction, once the
+  // compaction is successful.
   void ReleaseInputs();
 
  private:
@@ -371,21 +424,9 @@ class Compaction {
   // Each compaction reads inputs from "level_" and "level_+1"
   std::vector<FileMetaData*> inputs_[2];  // The two sets of inputs
 
-  // State used to check for number of overlapping grandparent files
+  // Grandparent files overlapping the compaction
   // (parent == level_ + 1, grandparent == level_ + 2)
   std::vector<FileMetaData*> grandparents_;
-  size_t grandparent_index_;  // Index in grandparent_starts_
-  bool seen_key_;             // Some output key has been seen
-  int64_t overlapped_bytes_;  // Bytes of overlap between current output
-                              // and grandparent files
-
-  // State for implementing IsBaseLevelForKey
-
-  // level_ptrs_ holds indices into input_version_->levels_: our state
-  // is that we are positioned at one of the file ranges for each
-  // higher level than the ones involved in this compaction (i.e. for
-  // all L >= level_ + 2).
-  size_t level_ptrs_[config::kNumLevels];
 };
 
 }  // namespace leveldb
@@ -52,6 +52,19 @@ class LEVELDB_EXPORT Comparator {
   // Simple comparator implementations may return with *key unchanged,
   // i.e., an implementation of this method that does nothing is correct.
   virtual void FindShortSuccessor(std::string* key) const = 0;
+
+  // CoLSM: fixed-width keys that the engine compares inline instead of
+  // calling Compare. See CompareIntInternalKey in db/dbformat.h.
+  enum KeyType {
+    kAnyKey,
+    // 4-byte unsigned ints in little-endian, see colsm::intComparator()
+    kIntKey,
+    // Internal keys with kIntKey user keys
+    kIntInternalKey,
+  };
+
+  // The comparator must order its keys as the type says
+  virtual KeyType key_type() const { return kAnyKey; }
 };
 
 // Return a builtin comparator that uses lexicographic byte-wise
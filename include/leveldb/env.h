@@ -197,6 +197,23 @@ class LEVELDB_EXPORT Env {
   // serialized.
   virtual void Schedule(void (*function)(void* arg), void* arg) = 0;
 
+  // Pools of background threads used by ScheduleWithPriority().
+  enum Priority { kLowPriority, kHighPriority };
+
+  // Like Schedule(), but runs "(*function)(arg)" in the pool for "priority".
+  // Work in one pool never waits behind work in the other.
+  //
+  // The default implementation calls Schedule().
+  virtual void ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                                    Priority priority);
+
+  // Allow the pool for "priority" to run up to "threads" background work
+  // items at once.  Pools never shrink.  Schedule() uses the low priority
+  // pool, which starts with one thread.
+  //
+  // The default implementation does nothing.
+  virtual void SetBackgroundThreads(int threads, Priority priority);
+
   // Start a new thread, invoking "function(arg)" within the new thread.
   // When "function(arg)" returns, the thread will be destroyed.
   virtual void StartThread(void (*function)(void* arg), void* arg) = 0;
@@ -269,6 +286,11 @@ class LEVELDB_EXPORT RandomAccessFile {
   // Safe for concurrent use by multiple threads.
   virtual Status Read(uint64_t offset, size_t n, Slice* result,
                       char* scratch) const = 0;
+
+  // Returns true if Read() always points "*result" at data that stays
+  // live while the file is open and never uses "scratch". Callers may
+  // then pass a null scratch.
+  virtual bool IsMemoryMapped() const { return false; }
 };
 
 // A file abstraction for sequential writing.  The implementation
@@ -384,6 +406,13 @@ class LEVELDB_EXPORT EnvWrapper : public Env {
   void Schedule(void (*f)(void*), void* a) override {
     return target_->Schedule(f, a);
   }
+  void ScheduleWithPriority(void (*f)(void*), void* a,
+                            Priority priority) override {
+    return target_->ScheduleWithPriority(f, a, priority);
+  }
+  void SetBackgroundThreads(int threads, Priority priority) override {
+    return target_->SetBackgroundThreads(threads, priority);
+  }
   void StartThread(void (*f)(void*), void* a) override {
     return target_->StartThread(f, a);
   }
@@ -6,6 +6,7 @@
 #define STORAGE_LEVELDB_INCLUDE_OPTIONS_H_
 
 #include <cstddef>
+#include <cstdint>
 
 #include "leveldb/export.h"
 
@@ -31,6 +32,16 @@ enum CompressionType {
   kZlibCompression = 0x2
 };
 
+// CoLSM: how user keys are stored in the key column of vertical blocks.
+enum VertKeyFormat {
+  // The first 4 bytes of the user key as a uint32_t, to be used with
+  // colsm::intComparator()
+  kVertIntKey = 0x0,
+  // Arbitrary byte strings in bytewise order. The key column keeps a
+  // fixed-width prefix code and the rest of the key goes to a suffix column.
+  kVertStringKey = 0x1
+};
+
 // Options to control the behavior of a database (passed to DB::Open)
 struct LEVELDB_EXPORT Options {
   // Create an Options object with default values for all fields.
@@ -116,6 +127,26 @@ struct LEVELDB_EXPORT Options {
   // initially populating a large database.
   size_t max_file_size = 2 * 1024 * 1024;
 
+  // Split a compaction into up to this many key ranges at the boundaries
+  // of its input files, and merge each range on its own thread. The
+  // output files of all ranges are installed in one version edit.
+  // Compactions reading their inputs column by column (see
+  // vert_column_compaction) are not split.
+  int max_subcompactions = 1;
+
+  // Run up to this many compactions at the same time on the low priority
+  // background threads of env.  Compactions running together never share
+  // an input file.  Memtable compactions always run on their own high
+  // priority thread and do not wait for these.
+  int max_background_compactions = 1;
+
+  // Let the writers of a write group insert their batches into the
+  // memtable at the same time, and overlap the inserts of consecutive
+  // groups.  The memtable then links its entries with compare-and-swap and
+  // allocates from per-core blocks, which costs single-threaded writes some
+  // throughput.  If false, the leader of each group inserts the whole group.
+  bool allow_concurrent_memtable_write = false;
+
   // Compress blocks using the specified compression algorithm.  This
   // parameter can be changed dynamically.
   //
@@ -144,6 +175,52 @@ struct LEVELDB_EXPORT Options {
   const FilterPolicy* filter_policy = nullptr;
 
   int section_limit = 256;
+
+  // CoLSM: key format of vertical blocks, see VertKeyFormat
+  VertKeyFormat vert_key_format = kVertIntKey;
+
+  // CoLSM: also try dictionary and FSST encodings on the value column of
+  // each vertical section. Vertical data blocks are then written without
+  // block compression so that a value can be decoded without inflating the
+  // block.
+  bool vert_value_compression = true;
+
+  // CoLSM: in vertical tables, choose the layout of each data block from
+  // its entries. Blocks of sparse int keys or wide values stay in row
+  // format, readers tell the two kinds apart by the block magic.
+  bool vert_block_choice = false;
+
+  // CoLSM: bits per key of the bloom filter kept for each vertical section,
+  // stored with the section max key in the block meta so that point lookups
+  // can skip sections and blocks. 0 writes no filter.
+  int vert_section_filter_bits = 0;
+
+  // CoLSM: re-decide the layout of new tables at each level once this many
+  // lookups, scans and updates have been counted since the last decision.
+  // The decisions are shown by the "leveldb.colsm-layout" property. 0 keeps
+  // the layout solved at open.
+  uint64_t layout_adapt_interval = 0;
+
+  // CoLSM: the expected fractions of lookups, scans and updates, from which
+  // the layout of each level is solved when the DB is opened. All 0 keeps
+  // every level horizontal until the layout adapts.
+  double layout_lookup_ratio = 0;
+  double layout_scan_ratio = 0;
+  double layout_update_ratio = 0;
+
+  // CoLSM: the bytes all levels may take in their chosen layout. The
+  // cheapest layout that fits in it is picked. 0 is no limit.
+  uint64_t layout_space_budget = 0;
+
+  // CoLSM: measure the constants of the layout cost model with short block
+  // probes when the DB is opened without calibrated ones, and keep them in
+  // the COLSM_PARAMETER file of the DB.
+  bool calibrate_layout_model = false;
+
+  // CoLSM: with colsm::intComparator() and int vertical keys, read the
+  // inputs of a compaction column by column and merge them on the decoded
+  // keys instead of through a table iterator per file.
+  bool vert_column_compaction = false;
 };
 
 // Options that control read operations
@@ -58,6 +58,17 @@ class LEVELDB_EXPORT Table {
   // be close to the file length.
   uint64_t ApproximateOffsetOf(const Slice& key) const;
 
+  // A data block held in memory, defined in table/block.h
+  struct BlockRef;
+
+  // Returns a new iterator over the index block. Its values are the
+  // handles of the data blocks in key order, read with ReadDataBlock.
+  Iterator* NewIndexIterator() const;
+
+  // Read the data block of the index value, from the block cache if any
+  Status ReadDataBlock(const ReadOptions&, const Slice& index_value,
+                       BlockRef* ref) const;
+
  private:
   friend class TableCache;
   struct Rep;
@@ -73,6 +84,14 @@ class LEVELDB_EXPORT Table {
                      void (*handle_result)(void* arg, const Slice& k,
                                            const Slice& v));
 
+  // InternalGet for n keys in increasing order, with args[i] passed along
+  // for keys[i]. Keys in the same data block share the index seek and the
+  // block read.
+  Status InternalMultiGet(const ReadOptions&, int n, const Slice* keys,
+                          void* const* args,
+                          void (*handle_result)(void* arg, const Slice& k,
+                                                const Slice& v));
+
   void ReadMeta(const Footer& footer);
   void ReadFilter(const Slice& filter_handle_value);
 
@@ -13,6 +13,7 @@
 
 #include "leveldb/comparator.h"
 
+#include "db/dbformat.h"
 #include "table/format.h"
 #include "util/coding.h"
 #include "util/logging.h"
@@ -26,13 +27,49 @@ Block::Block(const BlockContents& contents) {
   auto data_pointer = contents.data.data();
   auto data_length = contents.data.size();
   uint32_t last = *((uint32_t*)(data_pointer + data_length - 4));
-  if (last == colsm::MAGIC) {
+  if (colsm::IsVertBlock(last)) {
     core_ = std::unique_ptr<BlockCore>(new colsm::VertBlockCore(contents));
   } else {
     core_ = std::unique_ptr<BlockCore>(new BasicBlockCore(contents));
   }
 }
 
+Status BlockCore::Get(const Comparator* comparator, const Slice& internal_key,
+                      void* arg,
+                      void (*handle_result)(void*, const Slice&,
+                                            const Slice&)) {
+  Iterator* iter = NewIterator(comparator);
+  iter->Seek(internal_key);
+  if (iter->Valid()) {
+    (*handle_result)(arg, iter->key(), iter->value());
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
+Status BlockCore::ReadColumns(uint32_t run, BlockColumns* columns) {
+  assert(run == 0);
+  columns->clear();
+  // Only Seek needs the comparator
+  Iterator* iter = NewIterator(BytewiseComparator());
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next()) {
+    Slice key = iter->key();
+    if (key.size() != 12) {
+      delete iter;
+      return Status::NotSupported("Block keys are not int keys");
+    }
+    uint64_t tag = DecodeFixed64(key.data() + 4);
+    columns->keys.push_back(DecodeFixed32(key.data()));
+    columns->seqs.push_back(tag >> 8);
+    columns->types.push_back(tag & 0xff);
+    columns->values.push_back(iter->value());
+  }
+  Status s = iter->status();
+  delete iter;
+  return s;
+}
+
 inline uint32_t BasicBlockCore::NumRestarts() const {
   assert(size_ >= sizeof(uint32_t));
   return DecodeFixed32(data_ + size_ - sizeof(uint32_t));
@@ -104,9 +141,9 @@ class BasicBlockCore::Iter : public Iterator {
   Slice value_;
   Status status_;
 
-  inline int Compare(const Slice& a, const Slice& b) const {
-    return comparator_->Compare(a, b);
-  }
+  // Seek with the key order specialized at compile time, see Seek
+  template <typename Order>
+  void SeekWith(const Slice& target, Order compare);
 
   // Return the offset in data_ just past the end of the current entry.
   inline uint32_t NextEntryOffset() const {
@@ -181,46 +218,11 @@ class BasicBlockCore::Iter : public Iterator {
   }
 
   void Seek(const Slice& target) override {
-    //    std::cout << num_restarts_ << std::endl;
-    // Binary search in restart array to find the last restart point
-    // with a key < target
-    uint32_t left = 0;
-    uint32_t right = num_restarts_ - 1;
-    auto loop = 0;
-    while (left < right) {
-      loop++;
-      uint32_t mid = (left + right + 1) / 2;
-      uint32_t region_offset = GetRestartPoint(mid);
-      uint32_t shared, non_shared, value_length;
-      const char* key_ptr =
-          DecodeEntry(data_ + region_offset, data_ + restarts_, &shared,
-                      &non_shared, &value_length);
-      if (key_ptr == nullptr || (shared != 0)) {
-        CorruptionError();
-        return;
-      }
-      Slice mid_key(key_ptr, non_shared);
-      if (Compare(mid_key, target) < 0) {
-        // Key at "mid" is smaller than "target".  Therefore all
-        // blocks before "mid" are uninteresting.
-        left = mid;
-      } else {
-        // Key at "mid" is >= "target".  Therefore all blocks at or
-        // after "mid" are uninteresting.
-        right = mid - 1;
-      }
-    }
-
-    //    std::cout << loop << std::endl;
-    // Linear search (within restart block) for first key >= target
-    SeekToRestartPoint(left);
-    while (true) {
-      if (!ParseNextKey()) {
-        return;
-      }
-      if (Compare(key_, target) >= 0) {
-        return;
-      }
+    // Int keys are compared inline, the others through the comparator
+    if (comparator_->key_type() == Comparator::kIntInternalKey) {
+      SeekWith(target, IntInternalKeyOrder());
+    } else {
+      SeekWith(target, ComparatorOrder{comparator_});
     }
   }
 
@@ -275,6 +277,51 @@ class BasicBlockCore::Iter : public Iterator {
   }
 };
 
+template <typename Order>
+void BasicBlockCore::Iter::SeekWith(const Slice& target, Order compare) {
+  //    std::cout << num_restarts_ << std::endl;
+  // Binary search in restart array to find the last restart point
+  // with a key < target
+  uint32_t left = 0;
+  uint32_t right = num_restarts_ - 1;
+  auto loop = 0;
+  while (left < right) {
+    loop++;
+    uint32_t mid = (left + right + 1) / 2;
+    uint32_t region_offset = GetRestartPoint(mid);
+    uint32_t shared, non_shared, value_length;
+    const char* key_ptr =
+        DecodeEntry(data_ + region_offset, data_ + restarts_, &shared,
+                    &non_shared, &value_length);
+    if (key_ptr == nullptr || (shared != 0)) {
+      CorruptionError();
+      return;
+    }
+    Slice mid_key(key_ptr, non_shared);
+    if (compare(mid_key, target) < 0) {
+      // Key at "mid" is smaller than "target".  Therefore all
+      // blocks before "mid" are uninteresting.
+      left = mid;
+    } else {
+      // Key at "mid" is >= "target".  Therefore all blocks at or
+      // after "mid" are uninteresting.
+      right = mid - 1;
+    }
+  }
+
+  //    std::cout << loop << std::endl;
+  // Linear search (within restart block) for first key >= target
+  SeekToRestartPoint(left);
+  while (true) {
+    if (!ParseNextKey()) {
+      return;
+    }
+    if (compare(key_, target) >= 0) {
+      return;
+    }
+  }
+}
+
 Iterator* BasicBlockCore::NewIterator(const Comparator* comparator) {
   if (size_ < sizeof(uint32_t)) {
     return NewErrorIterator(Status::Corruption("bad block contents"));
@@ -8,9 +8,13 @@
 #include <cstddef>
 #include <cstdint>
 #include <memory>
+#include <string>
 #include <vector>
 
+#include "leveldb/cache.h"
 #include "leveldb/iterator.h"
+#include "leveldb/status.h"
+#include "leveldb/table.h"
 
 namespace leveldb {
 
@@ -18,6 +22,27 @@ struct BlockContents;
 
 class Comparator;
 
+// Entries of a block with 4-byte int user keys, one vector per part of the
+// internal key. Values point into the block, or into value_buffer when the
+// block has to decode them.
+struct BlockColumns {
+  std::vector<uint32_t> keys;
+  std::vector<uint64_t> seqs;
+  std::vector<uint8_t> types;
+  std::vector<Slice> values;
+  std::string value_buffer;
+
+  size_t size() const { return keys.size(); }
+
+  void clear() {
+    keys.clear();
+    seqs.clear();
+    types.clear();
+    values.clear();
+    value_buffer.clear();
+  }
+};
+
 class BlockCore {
  public:
   virtual ~BlockCore() = default;
@@ -25,6 +50,26 @@ class BlockCore {
   virtual size_t size() const = 0;
 
   virtual Iterator* NewIterator(const Comparator* comparator) = 0;
+
+  // Return false if the block surely has no entry with the user key of
+  // the given internal key
+  virtual bool KeyMayMatch(const Slice& internal_key) const { return true; }
+
+  // Call (*handle_result)(arg, ...) with the first entry at or after the
+  // internal key, if any. Seeks an iterator unless the block has a faster
+  // way.
+  virtual Status Get(const Comparator* comparator, const Slice& internal_key,
+                     void* arg,
+                     void (*handle_result)(void*, const Slice&,
+                                           const Slice&));
+
+  // Blocks with int keys are read column by column in runs, the sections
+  // of a vertical block or the whole of a row block
+  virtual uint32_t NumRun() const { return 1; }
+
+  // Replace the columns with the entries of a run. The values are valid
+  // until the next call on the same columns or the block is deleted.
+  virtual Status ReadColumns(uint32_t run, BlockColumns* columns);
 };
 
 class Block {
@@ -46,6 +91,49 @@ class Block {
   Iterator* NewIterator(const Comparator* comparator) {
     return core_->NewIterator(comparator);
   }
+
+  bool KeyMayMatch(const Slice& internal_key) const {
+    return core_->KeyMayMatch(internal_key);
+  }
+
+  Status Get(const Comparator* comparator, const Slice& internal_key,
+             void* arg,
+             void (*handle_result)(void*, const Slice&, const Slice&)) {
+    return core_->Get(comparator, internal_key, arg, handle_result);
+  }
+
+  uint32_t NumRun() const { return core_->NumRun(); }
+
+  Status ReadColumns(uint32_t run, BlockColumns* columns) {
+    return core_->ReadColumns(run, columns);
+  }
+};
+
+// A data block and the block cache handle holding it, if any
+struct Table::BlockRef {
+  Block* block = nullptr;
+  Cache* cache = nullptr;
+  Cache::Handle* cache_handle = nullptr;
+
+  BlockRef() = default;
+
+  BlockRef(const BlockRef&) = delete;
+  BlockRef& operator=(const BlockRef&) = delete;
+
+  ~BlockRef() { Release(); }
+
+  void Release() {
+    if (cache_handle != nullptr) {
+      cache->Release(cache_handle);
+    } else {
+      delete block;
+    }
+    block = nullptr;
+    cache_handle = nullptr;
+  }
+
+  // Keep the block until the iterator is deleted
+  void MoveTo(Iterator* iter);
 };
 
 class BasicBlockCore : public BlockCore {
@@ -70,7 +70,10 @@ Status ReadBlock(RandomAccessFile* file, const ReadOptions& options,
   // Read the block contents as well as the type/crc footer.
   // See table_builder.cc for the code that built this structure.
   size_t n = static_cast<size_t>(handle.size());
-  char* buf = new char[n + kBlockTrailerSize];
+  // Memory-mapped files serve the block from the mapping, no scratch is
+  // needed. Blocks stored without compression are then used in place.
+  char* buf =
+      file->IsMemoryMapped() ? nullptr : new char[n + kBlockTrailerSize];
   Slice contents;
   Status s = file->Read(handle.offset(), n + kBlockTrailerSize, &contents, buf);
   if (!s.ok()) {
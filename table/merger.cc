@@ -4,19 +4,32 @@
 
 #include "table/merger.h"
 
+#include <vector>
+
 #include "leveldb/comparator.h"
 #include "leveldb/iterator.h"
 #include "table/iterator_wrapper.h"
+#include "util/coding.h"
 
 namespace leveldb {
 
 namespace {
+
+// Children are kept in a loser tree. Node 0 holds the index of the current
+// child, nodes [1, n) hold the child that lost the match at that node, and
+// the leaf of child i is node n + i. Moving the current child only replays
+// the matches on its path to the root, log(n) comparisons instead of the n
+// of a linear scan.
 class MergingIterator : public Iterator {
  public:
   MergingIterator(const Comparator* comparator, Iterator** children, int n)
       : comparator_(comparator),
         children_(new IteratorWrapper[n]),
         n_(n),
+        tree_(n),
+        int_keys_(n),
+        tags_(n),
+        key_kind_(KindOf(comparator)),
         current_(nullptr),
         direction_(kForward) {
     for (int i = 0; i < n; i++) {
@@ -32,24 +45,24 @@ class MergingIterator : public Iterator {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToFirst();
     }
-    FindSmallest();
     direction_ = kForward;
+    Rebuild();
   }
 
   void SeekToLast() override {
     for (int i = 0; i < n_; i++) {
       children_[i].SeekToLast();
     }
-    FindLargest();
     direction_ = kReverse;
+    Rebuild();
   }
 
   void Seek(const Slice& target) override {
     for (int i = 0; i < n_; i++) {
       children_[i].Seek(target);
     }
-    FindSmallest();
     direction_ = kForward;
+    Rebuild();
   }
 
   void Next() override {
@@ -71,11 +84,14 @@ class MergingIterator : public Iterator {
           }
         }
       }
+      current_->Next();
       direction_ = kForward;
+      Rebuild();
+      return;
     }
 
     current_->Next();
-    FindSmallest();
+    Replay();
   }
 
   void Prev() override {
@@ -100,11 +116,14 @@ class MergingIterator : public Iterator {
           }
         }
       }
+      current_->Prev();
       direction_ = kReverse;
+      Rebuild();
+      return;
     }
 
     current_->Prev();
-    FindLargest();
+    Replay();
   }
 
   Slice key() const override {
@@ -132,48 +151,102 @@ class MergingIterator : public Iterator {
   // Which direction is the iterator moving?
   enum Direction { kForward, kReverse };
 
-  void FindSmallest();
-  void FindLargest();
+  // Keys of the int comparator are compared without the virtual call
+  enum KeyKind { kGeneric, kInt, kInternalInt };
 
-  // We might want to use a heap in case there are lots of children.
-  // For now we use a simple array since we expect a very small number
-  // of children in leveldb.
-  const Comparator* comparator_;
-  IteratorWrapper* children_;
-  int n_;
-  IteratorWrapper* current_;
-  Direction direction_;
-};
+  static KeyKind KindOf(const Comparator* comparator) {
+    switch (comparator->key_type()) {
+      case Comparator::kIntKey:
+        return kInt;
+      case Comparator::kIntInternalKey:
+        return kInternalInt;
+      default:
+        return kGeneric;
+    }
+  }
 
-void MergingIterator::FindSmallest() {
-  IteratorWrapper* smallest = nullptr;
-  for (int i = 0; i < n_; i++) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (smallest == nullptr) {
-        smallest = child;
-      } else if (comparator_->Compare(child->key(), smallest->key()) < 0) {
-        smallest = child;
-      }
+  // Decode the int key of child i after it moves
+  void Load(int i) {
+    if (key_kind_ == kGeneric || !children_[i].Valid()) {
+      return;
     }
+    Slice key = children_[i].key();
+    int_keys_[i] = DecodeFixed32(key.data());
+    // Larger tags sort first, flip them to compare in the same order
+    tags_[i] = key_kind_ == kInternalInt
+                   ? ~DecodeFixed64(key.data() + key.size() - 8)
+                   : 0;
   }
-  current_ = smallest;
-}
 
-void MergingIterator::FindLargest() {
-  IteratorWrapper* largest = nullptr;
-  for (int i = n_ - 1; i >= 0; i--) {
-    IteratorWrapper* child = &children_[i];
-    if (child->Valid()) {
-      if (largest == nullptr) {
-        largest = child;
-      } else if (comparator_->Compare(child->key(), largest->key()) > 0) {
-        largest = child;
+  // Whether child a wins the match against child b. Exhausted children
+  // lose, equal keys go to the smaller index in both directions.
+  bool Beats(int a, int b) const {
+    if (!children_[a].Valid()) {
+      return false;
+    }
+    if (!children_[b].Valid()) {
+      return true;
+    }
+    int r;
+    if (key_kind_ == kGeneric) {
+      r = comparator_->Compare(children_[a].key(), children_[b].key());
+    } else if (int_keys_[a] != int_keys_[b]) {
+      r = int_keys_[a] < int_keys_[b] ? -1 : 1;
+    } else {
+      r = tags_[a] < tags_[b] ? -1 : (tags_[a] > tags_[b] ? 1 : 0);
+    }
+    if (r == 0) {
+      return a < b;
+    }
+    return direction_ == kForward ? r < 0 : r > 0;
+  }
+
+  // Play all matches after the children are repositioned
+  void Rebuild() {
+    std::vector<int> winners(2 * n_);
+    for (int i = 0; i < n_; i++) {
+      Load(i);
+      winners[n_ + i] = i;
+    }
+    for (int node = n_ - 1; node > 0; node--) {
+      int left = winners[2 * node];
+      int right = winners[2 * node + 1];
+      bool left_wins = Beats(left, right);
+      winners[node] = left_wins ? left : right;
+      tree_[node] = left_wins ? right : left;
+    }
+    tree_[0] = winners[1];
+    SetCurrent();
+  }
+
+  // Replay the matches on the path of the current child after it moves
+  void Replay() {
+    int winner = tree_[0];
+    Load(winner);
+    for (int node = (winner + n_) / 2; node > 0; node /= 2) {
+      if (Beats(tree_[node], winner)) {
+        std::swap(tree_[node], winner);
       }
     }
+    tree_[0] = winner;
+    SetCurrent();
   }
-  current_ = largest;
-}
+
+  void SetCurrent() {
+    IteratorWrapper* winner = &children_[tree_[0]];
+    current_ = winner->Valid() ? winner : nullptr;
+  }
+
+  const Comparator* comparator_;
+  IteratorWrapper* children_;
+  int n_;
+  std::vector<int> tree_;
+  std::vector<uint32_t> int_keys_;
+  std::vector<uint64_t> tags_;
+  KeyKind key_kind_;
+  IteratorWrapper* current_;
+  Direction direction_;
+};
 }  // namespace
 
 Iterator* NewMergingIterator(const Comparator* comparator, Iterator** children,
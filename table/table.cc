@@ -148,14 +148,19 @@ static void ReleaseBlock(void* arg, void* h) {
   cache->Release(handle);
 }
 
-// Convert an index iterator value (i.e., an encoded BlockHandle)
-// into an iterator over the contents of the corresponding block.
-Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
-                             const Slice& index_value) {
-  Table* table = reinterpret_cast<Table*>(arg);
-  Cache* block_cache = table->rep_->options.block_cache;
-  Block* block = nullptr;
-  Cache::Handle* cache_handle = nullptr;
+void Table::BlockRef::MoveTo(Iterator* iter) {
+  if (cache_handle != nullptr) {
+    iter->RegisterCleanup(&ReleaseBlock, cache, cache_handle);
+  } else {
+    iter->RegisterCleanup(&DeleteBlock, block, nullptr);
+  }
+  block = nullptr;
+  cache_handle = nullptr;
+}
+
+Status Table::ReadDataBlock(const ReadOptions& options,
+                            const Slice& index_value, BlockRef* ref) const {
+  Cache* block_cache = rep_->options.block_cache;
 
   BlockHandle handle;
   Slice input = index_value;
@@ -167,41 +172,46 @@ Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
     BlockContents contents;
     if (block_cache != nullptr) {
       char cache_key_buffer[16];
-      EncodeFixed64(cache_key_buffer, table->rep_->cache_id);
+      EncodeFixed64(cache_key_buffer, rep_->cache_id);
       EncodeFixed64(cache_key_buffer + 8, handle.offset());
       Slice key(cache_key_buffer, sizeof(cache_key_buffer));
-      cache_handle = block_cache->Lookup(key);
-      if (cache_handle != nullptr) {
-        block = reinterpret_cast<Block*>(block_cache->Value(cache_handle));
+      ref->cache = block_cache;
+      ref->cache_handle = block_cache->Lookup(key);
+      if (ref->cache_handle != nullptr) {
+        ref->block =
+            reinterpret_cast<Block*>(block_cache->Value(ref->cache_handle));
       } else {
-        s = ReadBlock(table->rep_->file, options, handle, &contents);
+        s = ReadBlock(rep_->file, options, handle, &contents);
         if (s.ok()) {
-          block = new Block(contents);
+          ref->block = new Block(contents);
           if (contents.cachable && options.fill_cache) {
-            cache_handle = block_cache->Insert(key, block, block->size(),
-                                               &DeleteCachedBlock);
+            ref->cache_handle = block_cache->Insert(
+                key, ref->block, ref->block->size(), &DeleteCachedBlock);
           }
         }
       }
     } else {
-      s = ReadBlock(table->rep_->file, options, handle, &contents);
+      s = ReadBlock(rep_->file, options, handle, &contents);
       if (s.ok()) {
-        block = new Block(contents);
+        ref->block = new Block(contents);
       }
     }
   }
+  return s;
+}
 
-  Iterator* iter;
-  if (block != nullptr) {
-    iter = block->NewIterator(table->rep_->options.comparator);
-    if (cache_handle == nullptr) {
-      iter->RegisterCleanup(&DeleteBlock, block, nullptr);
-    } else {
-      iter->RegisterCleanup(&ReleaseBlock, block_cache, cache_handle);
-    }
-  } else {
-    iter = NewErrorIterator(s);
+// Convert an index iterator value (i.e., an encoded BlockHandle)
+// into an iterator over the contents of the corresponding block.
+Iterator* Table::BlockReader(void* arg, const ReadOptions& options,
+                             const Slice& index_value) {
+  Table* table = reinterpret_cast<Table*>(arg);
+  BlockRef ref;
+  Status s = table->ReadDataBlock(options, index_value, &ref);
+  if (!s.ok()) {
+    return NewErrorIterator(s);
   }
+  Iterator* iter = ref.block->NewIterator(table->rep_->options.comparator);
+  ref.MoveTo(iter);
   return iter;
 }
 
@@ -211,6 +221,10 @@ Iterator* Table::NewIterator(const ReadOptions& options) const {
       &Table::BlockReader, const_cast<Table*>(this), options);
 }
 
+Iterator* Table::NewIndexIterator() const {
+  return rep_->index_block->NewIterator(rep_->options.comparator);
+}
+
 Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
                           void (*handle_result)(void*, const Slice&,
                                                 const Slice&)) {
@@ -225,13 +239,57 @@ Status Table::InternalGet(const ReadOptions& options, const Slice& k, void* arg,
         !filter->KeyMayMatch(handle.offset(), k)) {
       // Not found
     } else {
-      Iterator* block_iter = BlockReader(this, options, iiter->value());
-      block_iter->Seek(k);
-      if (block_iter->Valid()) {
-        (*handle_result)(arg, block_iter->key(), block_iter->value());
+      BlockRef ref;
+      s = ReadDataBlock(options, iiter->value(), &ref);
+      if (s.ok() && ref.block->KeyMayMatch(k)) {
+        s = ref.block->Get(rep_->options.comparator, k, arg, handle_result);
+      }
+    }
+  }
+  if (s.ok()) {
+    s = iiter->status();
+  }
+  delete iiter;
+  return s;
+}
+
+Status Table::InternalMultiGet(const ReadOptions& options, int n,
+                               const Slice* keys, void* const* args,
+                               void (*handle_result)(void*, const Slice&,
+                                                     const Slice&)) {
+  Status s;
+  const Comparator* comparator = rep_->options.comparator;
+  FilterBlockReader* filter = rep_->filter;
+  Iterator* iiter = rep_->index_block->NewIterator(comparator);
+  // Data block of the current index entry, read on the first key that
+  // passes the filter
+  BlockRef ref;
+  for (int i = 0; i < n && s.ok(); i++) {
+    const Slice& k = keys[i];
+    // The keys are sorted, so the index only moves forward. The current
+    // block still covers k unless its index key is smaller.
+    if (i == 0 || comparator->Compare(iiter->key(), k) < 0) {
+      iiter->Seek(k);
+      ref.Release();
+      if (!iiter->Valid()) {
+        // This and the remaining keys are past the end of the table
+        break;
+      }
+    }
+    Slice handle_value = iiter->value();
+    BlockHandle handle;
+    if (filter != nullptr && handle.DecodeFrom(&handle_value).ok() &&
+        !filter->KeyMayMatch(handle.offset(), k)) {
+      continue;
+    }
+    if (ref.block == nullptr) {
+      s = ReadDataBlock(options, iiter->value(), &ref);
+      if (!s.ok()) {
+        break;
       }
-      s = block_iter->status();
-      delete block_iter;
+    }
+    if (ref.block->KeyMayMatch(k)) {
+      s = ref.block->Get(comparator, k, args[i], handle_result);
     }
   }
   if (s.ok()) {
@@ -6,6 +6,7 @@
 
 #include <cassert>
 #include <memory>
+#include <vector>
 
 #include "leveldb/comparator.h"
 #include "leveldb/env.h"
@@ -20,12 +21,21 @@
 
 #include "zlib.h"
 
+#include "colsm/vblock/vert_block.h"
 #include "colsm/vblock/vert_block_builder.h"
 
 using namespace colsm;
 
 namespace leveldb {
 
+namespace {
+// With Options::vert_block_choice, data blocks whose int keys are on
+// average this far apart, or whose values are on average this wide, are
+// kept in row format
+const uint32_t kSparseKeyGap = 1u << 16;
+const size_t kWideValueSize = 512;
+}  // namespace
+
 struct TableBuilder::Rep {
   Rep(const Options& opt, bool vf, WritableFile* f)
       : options(opt),
@@ -39,7 +49,11 @@ struct TableBuilder::Rep {
         filter_block(opt.filter_policy == nullptr
                          ? nullptr
                          : new FilterBlockBuilder(opt.filter_policy)),
-        pending_index_entry(false) {
+        pending_index_entry(false),
+        block_choice(vf && opt.vert_block_choice),
+        pending_size(0),
+        num_vert_block(0),
+        num_row_block(0) {
     index_block_options.block_restart_interval = 1;
     if (vformat) {
       data_block =
@@ -47,8 +61,14 @@ struct TableBuilder::Rep {
     } else {
       data_block = std::unique_ptr<BlockBuilder>(new BlockBuilder(&options));
     }
+    if (block_choice) {
+      row_block = std::unique_ptr<BlockBuilder>(new BlockBuilder(&options));
+    }
   }
 
+  // Whether the buffered entries go to a vertical block
+  bool ChooseVertical() const;
+
   Options options;
   Options index_block_options;
   WritableFile* file;
@@ -75,8 +95,36 @@ struct TableBuilder::Rep {
   BlockHandle pending_handle;  // Handle to add to index block
 
   std::string compressed_output;
+
+  // With per-block layouts, the entries of the current data block are
+  // buffered until it is full, then added to data_block or row_block
+  bool block_choice;
+  std::unique_ptr<BlockBuilder> row_block;
+  std::vector<std::string> pending_keys;
+  std::vector<std::string> pending_values;
+  size_t pending_size;
+  uint64_t num_vert_block;
+  uint64_t num_row_block;
 };
 
+bool TableBuilder::Rep::ChooseVertical() const {
+  size_t value_size = 0;
+  for (auto& value : pending_values) {
+    value_size += value.size();
+  }
+  if (value_size >= kWideValueSize * pending_values.size()) {
+    return false;
+  }
+  if (options.vert_key_format == kVertIntKey && pending_keys.size() > 1) {
+    uint32_t first = DecodeFixed32(pending_keys.front().data());
+    uint32_t last = DecodeFixed32(pending_keys.back().data());
+    if ((last - first) / (pending_keys.size() - 1) >= kSparseKeyGap) {
+      return false;
+    }
+  }
+  return true;
+}
+
 TableBuilder::TableBuilder(const Options& options, WritableFile* file)
     : TableBuilder(options, false, file) {}
 
@@ -133,9 +181,17 @@ void TableBuilder::Add(const Slice& key, const Slice& value) {
 
   r->last_key.assign(key.data(), key.size());
   r->num_entries++;
-  r->data_block->Add(key, value);
+  size_t estimated_block_size;
+  if (r->block_choice) {
+    r->pending_keys.emplace_back(key.data(), key.size());
+    r->pending_values.emplace_back(value.data(), value.size());
+    r->pending_size += key.size() + value.size();
+    estimated_block_size = r->pending_size;
+  } else {
+    r->data_block->Add(key, value);
+    estimated_block_size = r->data_block->CurrentSizeEstimate();
+  }
 
-  const size_t estimated_block_size = r->data_block->CurrentSizeEstimate();
   if (estimated_block_size >= r->options.block_size) {
     Flush();
   }
@@ -145,9 +201,25 @@ void TableBuilder::Flush() {
   Rep* r = rep_;
   assert(!r->closed);
   if (!ok()) return;
-  if (r->data_block->empty()) return;
+  BlockBuilder* block = r->data_block.get();
+  if (r->block_choice) {
+    if (r->pending_keys.empty()) return;
+    if (r->ChooseVertical()) {
+      r->num_vert_block++;
+    } else {
+      block = r->row_block.get();
+      r->num_row_block++;
+    }
+    for (size_t i = 0; i < r->pending_keys.size(); ++i) {
+      block->Add(r->pending_keys[i], r->pending_values[i]);
+    }
+    r->pending_keys.clear();
+    r->pending_values.clear();
+    r->pending_size = 0;
+  }
+  if (block->empty()) return;
   assert(!r->pending_index_entry);
-  WriteBlock(r->data_block.get(), &r->pending_handle);
+  WriteBlock(block, &r->pending_handle);
   if (ok()) {
     r->pending_index_entry = true;
     r->status = r->file->Flush();
@@ -168,6 +240,12 @@ void TableBuilder::WriteBlock(BlockBuilder* block, BlockHandle* handle) {
 
   Slice block_contents;
   CompressionType type = r->options.compression;
+  // Vertical sections compress their values, keep the block as is so that
+  // entries can be decoded without inflating the block
+  if (r->vformat && block == r->data_block.get() &&
+      r->options.vert_value_compression) {
+    type = kNoCompression;
+  }
   // TODO(postrelease): Support more compression options: zlib?
   switch (type) {
     case kNoCompression:
@@ -244,7 +322,12 @@ Status TableBuilder::Finish() {
   if (ok()) {
     BlockBuilder meta_index_block(&r->options);
     // Hao : store table format for coLSM in meta
-    meta_index_block.Add("block.colsm.vformat", rep_->vformat ? "true" : "false");
+    // "mixed" if both vertical and row data blocks were written
+    meta_index_block.Add("block.colsm.vformat",
+                         !rep_->vformat                ? "false"
+                         : rep_->num_row_block == 0    ? "true"
+                         : rep_->num_vert_block == 0   ? "false"
+                                                       : "mixed");
     if (r->filter_block != nullptr) {
       // Add mapping from "filter.Name" to location of filter data
       std::string key = "filter.";
@@ -6,8 +6,12 @@
 
 #include <map>
 #include <string>
+#include <vector>
 
 #include "gtest/gtest.h"
+#include "colsm/comparators.h"
+#include "colsm/vblock/vert_block.h"
+#include "colsm/vblock/vert_helper.h"
 #include "db/dbformat.h"
 #include "db/memtable.h"
 #include "db/write_batch_internal.h"
@@ -18,6 +22,7 @@
 #include "table/block.h"
 #include "table/block_builder.h"
 #include "table/format.h"
+#include "util/coding.h"
 #include "util/random.h"
 #include "util/testutil.h"
 
@@ -826,6 +831,174 @@ TEST(TableTest, ApproximateOffsetOfCompressed) {
   ASSERT_TRUE(Between(c.ApproximateOffsetOf("xyz"), 2 * min_z, 2 * max_z));
 }
 
+// Vertical blocks are written without compression, and read in place from
+// the mapping of the table file
+TEST(TableTest, VertBlockFromMmap) {
+  Env* env = Env::Default();
+  std::string fname;
+  ASSERT_LEVELDB_OK(env->GetTestDirectory(&fname));
+  fname += "/vert_mmap_table";
+  auto comparator = colsm::intComparator();
+  Options options;
+  options.comparator = comparator.get();
+  {
+    WritableFile* file;
+    ASSERT_LEVELDB_OK(env->NewWritableFile(fname, &file));
+    TableBuilder builder(options, true, file);
+    char key[12];
+    for (uint32_t i = 0; i < 1000; ++i) {
+      *((uint32_t*)key) = i;
+      EncodeFixed64(key + 4, (100 << 8) | kTypeValue);
+      builder.Add(Slice(key, 12), "value" + std::to_string(i));
+    }
+    ASSERT_LEVELDB_OK(builder.Finish());
+    ASSERT_LEVELDB_OK(file->Close());
+    delete file;
+  }
+
+  uint64_t size;
+  ASSERT_LEVELDB_OK(env->GetFileSize(fname, &size));
+  RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env->NewRandomAccessFile(fname, &file));
+  ASSERT_TRUE(file->IsMemoryMapped());
+
+  // Find the first data block from the footer and the index
+  char footer_space[Footer::kEncodedLength];
+  Slice footer_input;
+  ASSERT_LEVELDB_OK(file->Read(size - Footer::kEncodedLength,
+                               Footer::kEncodedLength, &footer_input,
+                               footer_space));
+  Footer footer;
+  ASSERT_LEVELDB_OK(footer.DecodeFrom(&footer_input));
+  ReadOptions read_options;
+  BlockContents index_contents;
+  ASSERT_LEVELDB_OK(
+      ReadBlock(file, read_options, footer.index_handle(), &index_contents));
+  Block index(index_contents);
+  Iterator* index_iter = index.NewIterator(comparator.get());
+  index_iter->SeekToFirst();
+  ASSERT_TRUE(index_iter->Valid());
+  BlockHandle handle;
+  Slice handle_input = index_iter->value();
+  ASSERT_LEVELDB_OK(handle.DecodeFrom(&handle_input));
+  delete index_iter;
+
+  BlockContents contents;
+  ASSERT_LEVELDB_OK(ReadBlock(file, read_options, handle, &contents));
+  ASSERT_FALSE(contents.heap_allocated);
+  Slice mapped;
+  ASSERT_LEVELDB_OK(file->Read(handle.offset(), 1, &mapped, nullptr));
+  ASSERT_EQ(mapped.data(), contents.data.data());
+  ASSERT_TRUE(colsm::IsVertBlock(
+      DecodeFixed32(contents.data.data() + contents.data.size() - 4)));
+
+  Block block(contents);
+  Iterator* iter = block.NewIterator(comparator.get());
+  uint32_t i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++i) {
+    ASSERT_EQ(i, DecodeFixed32(iter->key().data()));
+    ASSERT_EQ("value" + std::to_string(i), iter->value().ToString());
+  }
+  ASSERT_LT(0, i);
+  delete iter;
+  delete file;
+  ASSERT_LEVELDB_OK(env->RemoveFile(fname));
+}
+
+TEST(TableTest, MixedBlockFormat) {
+  Env* env = Env::Default();
+  std::string fname;
+  ASSERT_LEVELDB_OK(env->GetTestDirectory(&fname));
+  fname += "/mixed_format_table";
+  auto comparator = colsm::intComparator();
+  Options options;
+  options.comparator = comparator.get();
+  options.vert_block_choice = true;
+
+  // Dense keys with small values, sparse keys, then wide values
+  std::vector<std::pair<uint32_t, std::string>> entries;
+  for (uint32_t i = 0; i < 2000; ++i) {
+    entries.emplace_back(i, "value" + std::to_string(i));
+  }
+  for (uint32_t i = 0; i < 2000; ++i) {
+    entries.emplace_back((1u << 24) + (i << 20), "sparse" + std::to_string(i));
+  }
+  for (uint32_t i = 0; i < 100; ++i) {
+    entries.emplace_back(0xF0000000u + i, std::string(1000, 'a' + i % 26));
+  }
+  {
+    WritableFile* file;
+    ASSERT_LEVELDB_OK(env->NewWritableFile(fname, &file));
+    TableBuilder builder(options, true, file);
+    char key[12];
+    for (auto& entry : entries) {
+      EncodeFixed32(key, entry.first);
+      EncodeFixed64(key + 4, (100 << 8) | kTypeValue);
+      builder.Add(Slice(key, 12), entry.second);
+    }
+    ASSERT_LEVELDB_OK(builder.Finish());
+    ASSERT_LEVELDB_OK(file->Close());
+    delete file;
+  }
+  ASSERT_TRUE(colsm::IsVerticalTable(env, fname));
+
+  uint64_t size;
+  ASSERT_LEVELDB_OK(env->GetFileSize(fname, &size));
+  RandomAccessFile* file;
+  ASSERT_LEVELDB_OK(env->NewRandomAccessFile(fname, &file));
+
+  // Both kinds of data blocks are in the table
+  char footer_space[Footer::kEncodedLength];
+  Slice footer_input;
+  ASSERT_LEVELDB_OK(file->Read(size - Footer::kEncodedLength,
+                               Footer::kEncodedLength, &footer_input,
+                               footer_space));
+  Footer footer;
+  ASSERT_LEVELDB_OK(footer.DecodeFrom(&footer_input));
+  ReadOptions read_options;
+  BlockContents index_contents;
+  ASSERT_LEVELDB_OK(
+      ReadBlock(file, read_options, footer.index_handle(), &index_contents));
+  Block index(index_contents);
+  Iterator* index_iter = index.NewIterator(comparator.get());
+  int num_vert = 0;
+  int num_row = 0;
+  for (index_iter->SeekToFirst(); index_iter->Valid(); index_iter->Next()) {
+    BlockHandle handle;
+    Slice handle_input = index_iter->value();
+    ASSERT_LEVELDB_OK(handle.DecodeFrom(&handle_input));
+    BlockContents contents;
+    ASSERT_LEVELDB_OK(ReadBlock(file, read_options, handle, &contents));
+    if (colsm::IsVertBlock(
+            DecodeFixed32(contents.data.data() + contents.data.size() - 4))) {
+      num_vert++;
+    } else {
+      num_row++;
+    }
+    if (contents.heap_allocated) {
+      delete[] contents.data.data();
+    }
+  }
+  delete index_iter;
+  ASSERT_LT(0, num_vert);
+  ASSERT_LT(0, num_row);
+
+  Table* table;
+  ASSERT_LEVELDB_OK(Table::Open(options, file, size, &table));
+  Iterator* iter = table->NewIterator(read_options);
+  size_t i = 0;
+  for (iter->SeekToFirst(); iter->Valid(); iter->Next(), ++i) {
+    ASSERT_LT(i, entries.size());
+    ASSERT_EQ(entries[i].first, DecodeFixed32(iter->key().data()));
+    ASSERT_EQ(entries[i].second, iter->value().ToString());
+  }
+  ASSERT_EQ(entries.size(), i);
+  delete iter;
+  delete table;
+  delete file;
+  ASSERT_LEVELDB_OK(env->RemoveFile(fname));
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
@@ -4,6 +4,10 @@
 
 #include "util/arena.h"
 
+#include <thread>
+
+#include "util/mutexlock.h"
+
 namespace leveldb {
 
 static const int kBlockSize = 4096;
@@ -63,4 +67,59 @@ char* Arena::AllocateNewBlock(size_t block_bytes) {
   return result;
 }
 
+static size_t ShardCount() {
+  size_t cores = std::thread::hardware_concurrency();
+  size_t shards = 1;
+  while (shards < cores && shards < 64) {
+    shards <<= 1;
+  }
+  return shards;
+}
+
+ConcurrentArena::ConcurrentArena()
+    : num_shards_(ShardCount()), shards_(new Shard[num_shards_]) {}
+
+ConcurrentArena::Shard* ConcurrentArena::CurrentShard() {
+  // Threads are spread over the shards in the order they first allocate,
+  // which gives one shard per core as long as there are no more threads
+  // than cores.
+  static std::atomic<size_t> next_slot(0);
+  static thread_local size_t slot =
+      next_slot.fetch_add(1, std::memory_order_relaxed);
+  return &shards_[slot & (num_shards_ - 1)];
+}
+
+char* ConcurrentArena::AllocateImpl(size_t bytes, bool aligned) {
+  assert(bytes > 0);
+  if (bytes > kBlockSize / 4) {
+    // Too big for a shard block, see Arena::AllocateFallback().
+    MutexLock l(&mu_);
+    return aligned ? arena_.AllocateAligned(bytes) : arena_.Allocate(bytes);
+  }
+
+  Shard* shard = CurrentShard();
+  MutexLock l(&shard->mu);
+  size_t slop = 0;
+  if (aligned) {
+    const int align = (sizeof(void*) > 8) ? sizeof(void*) : 8;
+    size_t current_mod =
+        reinterpret_cast<uintptr_t>(shard->alloc_ptr) & (align - 1);
+    slop = (current_mod == 0 ? 0 : align - current_mod);
+  }
+  if (bytes + slop > shard->alloc_bytes_remaining) {
+    // We waste the remaining space in the shard's block.  The new block
+    // comes from a new[] and so is aligned.
+    {
+      MutexLock arena_lock(&mu_);
+      shard->alloc_ptr = arena_.AllocateAligned(kBlockSize);
+    }
+    shard->alloc_bytes_remaining = kBlockSize;
+    slop = 0;
+  }
+  char* result = shard->alloc_ptr + slop;
+  shard->alloc_ptr += bytes + slop;
+  shard->alloc_bytes_remaining -= bytes + slop;
+  return result;
+}
+
 }  // namespace leveldb
@@ -9,8 +9,12 @@
 #include <cassert>
 #include <cstddef>
 #include <cstdint>
+#include <memory>
 #include <vector>
 
+#include "port/port.h"
+#include "port/thread_annotations.h"
+
 namespace leveldb {
 
 class Arena {
@@ -66,6 +70,45 @@ inline char* Arena::Allocate(size_t bytes) {
   return AllocateFallback(bytes);
 }
 
+// An Arena that many threads may allocate from at once.  Small allocations
+// are carved out of a block owned by one of several shards, and each thread
+// sticks to one shard, so threads running on different cores rarely contend
+// for the same lock.  Blocks and large allocations come from a shared Arena.
+class ConcurrentArena {
+ public:
+  ConcurrentArena();
+
+  ConcurrentArena(const ConcurrentArena&) = delete;
+  ConcurrentArena& operator=(const ConcurrentArena&) = delete;
+
+  char* Allocate(size_t bytes) { return AllocateImpl(bytes, false); }
+  char* AllocateAligned(size_t bytes) { return AllocateImpl(bytes, true); }
+
+  size_t MemoryUsage() const { return arena_.MemoryUsage(); }
+
+ private:
+  // Padded to a cache line so that shards used by different cores do not
+  // share one.
+  struct alignas(64) Shard {
+    Shard() : alloc_ptr(nullptr), alloc_bytes_remaining(0) {}
+
+    port::Mutex mu;
+    char* alloc_ptr GUARDED_BY(mu);
+    size_t alloc_bytes_remaining GUARDED_BY(mu);
+  };
+
+  char* AllocateImpl(size_t bytes, bool aligned);
+  Shard* CurrentShard();
+
+  // Refills and large allocations.
+  port::Mutex mu_;
+  Arena arena_ GUARDED_BY(mu_);
+
+  // A power of two, so that a thread's shard is picked with a mask.
+  const size_t num_shards_;
+  std::unique_ptr<Shard[]> shards_;
+};
+
 }  // namespace leveldb
 
 #endif  // STORAGE_LEVELDB_UTIL_ARENA_H_
@@ -4,7 +4,11 @@
 
 #include "util/arena.h"
 
+#include <atomic>
+#include <cstring>
+
 #include "gtest/gtest.h"
+#include "leveldb/env.h"
 #include "util/random.h"
 
 namespace leveldb {
@@ -58,6 +62,59 @@ TEST(ArenaTest, Simple) {
   }
 }
 
+namespace {
+
+struct ConcurrentArenaState {
+  static const int kThreads = 4;
+  static const int kAllocations = 10000;
+
+  ConcurrentArenaState() : next_thread(0), done(0) {}
+
+  ConcurrentArena arena;
+  std::atomic<int> next_thread;
+  std::atomic<int> done;
+  std::vector<std::pair<size_t, char*>> allocated[kThreads];
+};
+
+void ConcurrentArenaThread(void* arg) {
+  ConcurrentArenaState* state = static_cast<ConcurrentArenaState*>(arg);
+  const int id = state->next_thread.fetch_add(1);
+  Random rnd(301 + id);
+  for (int i = 0; i < ConcurrentArenaState::kAllocations; i++) {
+    size_t s = rnd.OneIn(1000) ? rnd.Uniform(6000) : rnd.Uniform(100);
+    if (s == 0) s = 1;
+    char* r = rnd.OneIn(2) ? state->arena.AllocateAligned(s)
+                           : state->arena.Allocate(s);
+    std::memset(r, id, s);
+    state->allocated[id].push_back(std::make_pair(s, r));
+  }
+  state->done.fetch_add(1);
+}
+
+}  // namespace
+
+TEST(ArenaTest, Concurrent) {
+  ConcurrentArenaState state;
+  for (int i = 0; i < ConcurrentArenaState::kThreads; i++) {
+    Env::Default()->StartThread(ConcurrentArenaThread, &state);
+  }
+  while (state.done.load() < ConcurrentArenaState::kThreads) {
+    Env::Default()->SleepForMicroseconds(1000);
+  }
+
+  size_t bytes = 0;
+  for (int id = 0; id < ConcurrentArenaState::kThreads; id++) {
+    for (const auto& allocation : state.allocated[id]) {
+      bytes += allocation.first;
+      // No other thread wrote over this allocation
+      for (size_t b = 0; b < allocation.first; b++) {
+        ASSERT_EQ(id, allocation.second[b]);
+      }
+    }
+  }
+  ASSERT_GE(state.arena.MemoryUsage(), bytes);
+}
+
 }  // namespace leveldb
 
 int main(int argc, char** argv) {
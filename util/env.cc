@@ -28,6 +28,13 @@ Status Env::DeleteDir(const std::string& dirname) { return RemoveDir(dirname); }
 Status Env::RemoveFile(const std::string& fname) { return DeleteFile(fname); }
 Status Env::DeleteFile(const std::string& fname) { return RemoveFile(fname); }
 
+void Env::ScheduleWithPriority(void (*function)(void* arg), void* arg,
+                               Priority priority) {
+  Schedule(function, arg);
+}
+
+void Env::SetBackgroundThreads(int threads, Priority priority) {}
+
 SequentialFile::~SequentialFile() = default;
 
 RandomAccessFile::~RandomAccessFile() = default;
@@ -12,6 +12,7 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <atomic>
 #include <cerrno>
 #include <cstddef>
@@ -239,6 +240,8 @@ class PosixMmapReadableFile final : public RandomAccessFile {
     return Status::OK();
   }
 
+  bool IsMemoryMapped() const override { return true; }
+
  private:
   char* const mmap_base_;
   const size_t length_;
@@ -663,6 +666,12 @@ class PosixEnv : public Env {
   void Schedule(void (*background_work_function)(void* background_work_arg),
                 void* background_work_arg) override;
 
+  void ScheduleWithPriority(
+      void (*background_work_function)(void* background_work_arg),
+      void* background_work_arg, Priority priority) override;
+
+  void SetBackgroundThreads(int threads, Priority priority) override;
+
   void StartThread(void (*thread_main)(void* thread_main_arg),
                    void* thread_main_arg) override {
     std::thread new_thread(thread_main, thread_main_arg);
@@ -717,12 +726,6 @@ class PosixEnv : public Env {
   }
 
  private:
-  void BackgroundThreadMain();
-
-  static void BackgroundThreadEntryPoint(PosixEnv* env) {
-    env->BackgroundThreadMain();
-  }
-
   // Stores the work item data in a Schedule() call.
   //
   // Instances are constructed on the thread calling Schedule() and used on the
@@ -737,12 +740,31 @@ class PosixEnv : public Env {
     void* const arg;
   };
 
-  port::Mutex background_work_mutex_;
-  port::CondVar background_work_cv_ GUARDED_BY(background_work_mutex_);
-  bool started_background_thread_ GUARDED_BY(background_work_mutex_);
+  // Threads and queued work of one priority.
+  struct BackgroundPool {
+    explicit BackgroundPool(port::Mutex* mu)
+        : cv(mu), threads(1), started_threads(0) {}
+
+    port::CondVar cv;
+    int threads;          // Threads allowed, see SetBackgroundThreads()
+    int started_threads;  // Threads started, at most threads
+    std::queue<BackgroundWorkItem> queue;
+  };
 
-  std::queue<BackgroundWorkItem> background_work_queue_
-      GUARDED_BY(background_work_mutex_);
+  void BackgroundThreadMain(BackgroundPool* pool);
+
+  static void BackgroundThreadEntryPoint(PosixEnv* env, BackgroundPool* pool) {
+    env->BackgroundThreadMain(pool);
+  }
+
+  BackgroundPool* Pool(Priority priority) {
+    return priority == kHighPriority ? &high_priority_pool_
+                                     : &low_priority_pool_;
+  }
+
+  port::Mutex background_work_mutex_;
+  BackgroundPool low_priority_pool_ GUARDED_BY(background_work_mutex_);
+  BackgroundPool high_priority_pool_ GUARDED_BY(background_work_mutex_);
 
   PosixLockTable locks_;  // Thread-safe.
   Limiter mmap_limiter_;  // Thread-safe.
@@ -773,45 +795,60 @@ int MaxOpenFiles() {
 }  // namespace
 
 PosixEnv::PosixEnv()
-    : background_work_cv_(&background_work_mutex_),
-      started_background_thread_(false),
+    : low_priority_pool_(&background_work_mutex_),
+      high_priority_pool_(&background_work_mutex_),
       mmap_limiter_(MaxMmaps()),
       fd_limiter_(MaxOpenFiles()) {}
 
 void PosixEnv::Schedule(
     void (*background_work_function)(void* background_work_arg),
     void* background_work_arg) {
+  ScheduleWithPriority(background_work_function, background_work_arg,
+                       kLowPriority);
+}
+
+void PosixEnv::ScheduleWithPriority(
+    void (*background_work_function)(void* background_work_arg),
+    void* background_work_arg, Priority priority) {
   background_work_mutex_.Lock();
+  BackgroundPool* pool = Pool(priority);
 
-  // Start the background thread, if we haven't done so already.
-  if (!started_background_thread_) {
-    started_background_thread_ = true;
-    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this);
+  // Start the background threads, if we haven't done so already.
+  while (pool->started_threads < pool->threads) {
+    pool->started_threads++;
+    std::thread background_thread(PosixEnv::BackgroundThreadEntryPoint, this,
+                                  pool);
     background_thread.detach();
   }
 
-  // If the queue is empty, the background thread may be waiting for work.
-  if (background_work_queue_.empty()) {
-    background_work_cv_.Signal();
-  }
+  // Some background thread of the pool may be waiting for work.
+  pool->cv.Signal();
 
-  background_work_queue_.emplace(background_work_function, background_work_arg);
+  pool->queue.emplace(background_work_function, background_work_arg);
+  background_work_mutex_.Unlock();
+}
+
+void PosixEnv::SetBackgroundThreads(int threads, Priority priority) {
+  background_work_mutex_.Lock();
+  BackgroundPool* pool = Pool(priority);
+  // The threads are started by the next ScheduleWithPriority()
+  pool->threads = std::max(pool->threads, threads);
   background_work_mutex_.Unlock();
 }
 
-void PosixEnv::BackgroundThreadMain() {
+void PosixEnv::BackgroundThreadMain(BackgroundPool* pool) {
   while (true) {
     background_work_mutex_.Lock();
 
     // Wait until there is work to be done.
-    while (background_work_queue_.empty()) {
-      background_work_cv_.Wait();
+    while (pool->queue.empty()) {
+      pool->cv.Wait();
     }
 
-    assert(!background_work_queue_.empty());
-    auto background_work_function = background_work_queue_.front().function;
-    void* background_work_arg = background_work_queue_.front().arg;
-    background_work_queue_.pop();
+    assert(!pool->queue.empty());
+    auto background_work_function = pool->queue.front().function;
+    void* background_work_arg = pool->queue.front().arg;
+    pool->queue.pop();
 
     background_work_mutex_.Unlock();
     background_work_function(background_work_arg);
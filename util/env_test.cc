@@ -153,6 +153,53 @@ static void ThreadBody(void* arg) {
   s->mu.Unlock();
 }
 
+TEST_F(EnvTest, ScheduleWithPriority) {
+  struct RunState {
+    port::Mutex mu;
+    port::CondVar cvar{&mu};
+    int expected = 0;  // Work items that must run at the same time
+    int arrived = 0;
+    int finished = 0;
+
+    static void Run(void* arg) {
+      RunState* state = reinterpret_cast<RunState*>(arg);
+      MutexLock l(&state->mu);
+      state->arrived++;
+      state->cvar.SignalAll();
+      while (state->arrived < state->expected) {
+        state->cvar.Wait();
+      }
+      state->finished++;
+      state->cvar.SignalAll();
+    }
+  };
+
+  // High priority work does not wait behind a busy low priority thread
+  RunState state;
+  state.expected = 2;
+  env_->ScheduleWithPriority(&RunState::Run, &state, Env::kLowPriority);
+  env_->ScheduleWithPriority(&RunState::Run, &state, Env::kHighPriority);
+  {
+    MutexLock l(&state.mu);
+    while (state.finished < 2) {
+      state.cvar.Wait();
+    }
+  }
+
+  // More low priority threads run their work at the same time
+  RunState pool_state;
+  pool_state.expected = 3;
+  env_->SetBackgroundThreads(3, Env::kLowPriority);
+  for (int i = 0; i < 3; i++) {
+    env_->ScheduleWithPriority(&RunState::Run, &pool_state,
+                               Env::kLowPriority);
+  }
+  MutexLock l(&pool_state.mu);
+  while (pool_state.finished < 3) {
+    pool_state.cvar.Wait();
+  }
+}
+
 TEST_F(EnvTest, StartThread) {
   State state(0, 3);
   for (int i = 0; i < 3; i++) {